@@ -0,0 +1,328 @@
+/***** AnalogConversion.cpp *****/
+#include <AnalogConversion.h>
+#include <math.h>
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const float kAnalogInMax = 65535.f/65536.f; // Salt inputs are inverted
+static const float kExpanderOutScale = 0.93f/2.f; // avoid headroom problems with a sagging 5V USB supply
+static const float kNoSlewLimit = 1e30f;
+
+AnalogOutSmoothing::AnalogOutSmoothing() :
+	activeMask(0),
+	targetMask(0),
+	transformGain(1),
+	transformOffset(0)
+{
+	for(unsigned int n = 0; n < kMaxAnalogOutSmoothingChannels; ++n)
+	{
+		coeff[n] = 1;
+		step[n] = kNoSlewLimit;
+		target[n] = 0;
+		value[n] = 0;
+	}
+}
+
+void AnalogOutSmoothing::setSmoothing(unsigned int channel, float maxStep, float timeConstant)
+{
+	if(channel >= kMaxAnalogOutSmoothingChannels)
+		return;
+	uint32_t bit = 1 << channel;
+	step[channel] = maxStep > 0 ? maxStep * fabsf(transformGain) : kNoSlewLimit;
+	coeff[channel] = timeConstant > 0 ? 1.f - expf(-1.f / timeConstant) : 1.f;
+	targetMask &= ~bit;
+	if(maxStep > 0 || timeConstant > 0)
+		activeMask |= bit;
+	else
+		activeMask &= ~bit;
+}
+
+void AnalogOutSmoothing::setTarget(unsigned int channel, float newTarget, unsigned int rampFrames)
+{
+	if(channel >= kMaxAnalogOutSmoothingChannels)
+		return;
+	uint32_t bit = 1 << channel;
+	newTarget = newTarget * transformGain + transformOffset;
+	target[channel] = newTarget;
+	coeff[channel] = 1;
+	step[channel] = rampFrames ? fabsf(newTarget - value[channel]) / rampFrames : kNoSlewLimit;
+	targetMask |= bit;
+	activeMask |= bit;
+}
+
+void AnalogOutSmoothing::setTransform(float gain, float offset)
+{
+	transformGain = gain;
+	transformOffset = offset;
+}
+
+void AnalogOutSmoothing::process(float* values, unsigned int frames, unsigned int channels, bool interleaved)
+{
+	for(unsigned int c = 0; c < channels && c < kMaxAnalogOutSmoothingChannels; ++c)
+	{
+		for(unsigned int f = 0; f < frames; ++f)
+		{
+			float& x = values[interleaved ? f * channels + c : c * frames + f];
+			x = processSample(c, x);
+		}
+	}
+}
+
+#if defined(__ARM_NEON__) || defined(__SSE2__)
+// Build a mask with all the bits set in the lanes whose channel is in channelMask
+static inline void laneMask(uint32_t channelMask, unsigned int firstChannel, uint32_t* lanes)
+{
+	for(unsigned int n = 0; n < 4; ++n)
+		lanes[n] = (channelMask >> (firstChannel + n)) & 1 ? 0xffffffff : 0;
+}
+#endif
+
+void analogInputsToFloat(const uint16_t* raw, float* out, unsigned int frames, unsigned int channels,
+		bool interleaved, bool invert, uint32_t dcBlockMask, float coeff, float* inputHistory, float* outputHistory)
+{
+	unsigned int c = 0;
+#if defined(__ARM_NEON__) || defined(__SSE2__)
+	if((channels & 3) == 0)
+	{
+		for(; c < channels; c += 4)
+		{
+			uint32_t lanes[4];
+			laneMask(dcBlockMask, c, lanes);
+			bool dcBlock = lanes[0] | lanes[1] | lanes[2] | lanes[3];
+			float tmp[4];
+#if defined(__ARM_NEON__)
+			const uint32x4_t mask = vld1q_u32(lanes);
+			const float32x4_t scale = vdupq_n_f32(1.f/65536.f);
+			const float32x4_t max = vdupq_n_f32(kAnalogInMax);
+			const float32x4_t vcoeff = vdupq_n_f32(coeff);
+			float32x4_t inH = vdupq_n_f32(0);
+			float32x4_t outH = vdupq_n_f32(0);
+			if(dcBlock)
+			{
+				inH = vld1q_f32(inputHistory + c);
+				outH = vld1q_f32(outputHistory + c);
+			}
+			for(unsigned int f = 0; f < frames; ++f)
+			{
+				float32x4_t v = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vld1_u16(raw + f * channels + c))), scale);
+				if(invert)
+					v = vsubq_f32(max, v);
+				if(dcBlock)
+				{
+					float32x4_t y = vmulq_f32(vcoeff, vsubq_f32(vaddq_f32(outH, v), inH));
+					inH = vbslq_f32(mask, v, inH);
+					outH = vbslq_f32(mask, y, outH);
+					v = vbslq_f32(mask, vaddq_f32(y, y), v);
+				}
+				if(interleaved)
+					vst1q_f32(out + f * channels + c, v);
+				else {
+					vst1q_f32(tmp, v);
+					for(unsigned int n = 0; n < 4; ++n)
+						out[(c + n) * frames + f] = tmp[n];
+				}
+			}
+			if(dcBlock)
+			{
+				vst1q_f32(inputHistory + c, inH);
+				vst1q_f32(outputHistory + c, outH);
+			}
+#else
+			const __m128 mask = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)lanes));
+			const __m128 scale = _mm_set1_ps(1.f/65536.f);
+			const __m128 max = _mm_set1_ps(kAnalogInMax);
+			const __m128 vcoeff = _mm_set1_ps(coeff);
+			const __m128i zero = _mm_setzero_si128();
+			__m128 inH = _mm_setzero_ps();
+			__m128 outH = _mm_setzero_ps();
+			if(dcBlock)
+			{
+				inH = _mm_loadu_ps(inputHistory + c);
+				outH = _mm_loadu_ps(outputHistory + c);
+			}
+			for(unsigned int f = 0; f < frames; ++f)
+			{
+				__m128i r = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(raw + f * channels + c)), zero);
+				__m128 v = _mm_mul_ps(_mm_cvtepi32_ps(r), scale);
+				if(invert)
+					v = _mm_sub_ps(max, v);
+				if(dcBlock)
+				{
+					__m128 y = _mm_mul_ps(vcoeff, _mm_sub_ps(_mm_add_ps(outH, v), inH));
+					inH = _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, inH));
+					outH = _mm_or_ps(_mm_and_ps(mask, y), _mm_andnot_ps(mask, outH));
+					v = _mm_or_ps(_mm_and_ps(mask, _mm_add_ps(y, y)), _mm_andnot_ps(mask, v));
+				}
+				if(interleaved)
+					_mm_storeu_ps(out + f * channels + c, v);
+				else {
+					_mm_storeu_ps(tmp, v);
+					for(unsigned int n = 0; n < 4; ++n)
+						out[(c + n) * frames + f] = tmp[n];
+				}
+			}
+			if(dcBlock)
+			{
+				_mm_storeu_ps(inputHistory + c, inH);
+				_mm_storeu_ps(outputHistory + c, outH);
+			}
+#endif
+		}
+	}
+#endif
+	for(; c < channels; ++c)
+	{
+		bool dcBlock = dcBlockMask & (1 << c);
+		for(unsigned int f = 0; f < frames; ++f)
+		{
+			float value = (float)raw[f * channels + c] / 65536.0f;
+			if(invert)
+				value = kAnalogInMax - value;
+			if(dcBlock)
+			{
+				// apply highpass filter and scale by 2 to get -1 to 1 range
+				// rather than 0-1
+				float filteredOut = coeff * (outputHistory[c] + value - inputHistory[c]);
+				inputHistory[c] = value;
+				outputHistory[c] = filteredOut;
+				value = 2.0f * filteredOut;
+			}
+			out[interleaved ? f * channels + c : c * frames + f] = value;
+		}
+	}
+}
+
+void analogOutputsToInt(const float* in, uint16_t* raw, unsigned int frames, unsigned int channels,
+		bool interleaved, uint32_t expanderMask, AnalogOutSmoothing* smoothing)
+{
+	unsigned int c = 0;
+	uint32_t activeMask = smoothing ? smoothing->activeMask : 0;
+	uint32_t targetMask = smoothing ? smoothing->targetMask : 0;
+#if defined(__ARM_NEON__) || defined(__SSE2__)
+	if((channels & 3) == 0 && channels <= kMaxAnalogOutSmoothingChannels)
+	{
+		for(; c < channels; c += 4)
+		{
+			uint32_t lanes[4];
+			laneMask(expanderMask, c, lanes);
+			uint32_t activeLanes[4];
+			laneMask(activeMask, c, activeLanes);
+			uint32_t targetLanes[4];
+			laneMask(targetMask, c, targetLanes);
+			bool smooth = smoothing != NULL;
+			float tmp[4];
+#if defined(__ARM_NEON__)
+			const uint32x4_t mask = vld1q_u32(lanes);
+			const uint32x4_t active = vld1q_u32(activeLanes);
+			const uint32x4_t targets = vld1q_u32(targetLanes);
+			float32x4_t value, coeff, step, target;
+			if(smooth)
+			{
+				value = vld1q_f32(smoothing->value + c);
+				coeff = vld1q_f32(smoothing->coeff + c);
+				step = vld1q_f32(smoothing->step + c);
+				target = vld1q_f32(smoothing->target + c);
+			}
+			const float32x4_t one = vdupq_n_f32(1.f);
+			const float32x4_t expanderScale = vdupq_n_f32(kExpanderOutScale);
+			const float32x4_t scale = vdupq_n_f32(65536.f);
+			const int32x4_t top = vdupq_n_s32(65535);
+			const int32x4_t bottom = vdupq_n_s32(0);
+			for(unsigned int f = 0; f < frames; ++f)
+			{
+				float32x4_t x;
+				if(interleaved)
+					x = vld1q_f32(in + f * channels + c);
+				else {
+					for(unsigned int n = 0; n < 4; ++n)
+						tmp[n] = in[(c + n) * frames + f];
+					x = vld1q_f32(tmp);
+				}
+				if(smooth)
+				{
+					x = vbslq_f32(targets, target, x);
+					float32x4_t d = vmulq_f32(coeff, vsubq_f32(x, value));
+					d = vmaxq_f32(vminq_f32(d, step), vnegq_f32(step));
+					value = vbslq_f32(active, vaddq_f32(value, d), x);
+					x = value;
+				}
+				x = vbslq_f32(mask, vmulq_f32(vaddq_f32(x, one), expanderScale), x);
+				int32x4_t i = vcvtq_s32_f32(vmulq_f32(x, scale));
+				i = vmaxq_s32(vminq_s32(i, top), bottom);
+				vst1_u16(raw + f * channels + c, vmovn_u32(vreinterpretq_u32_s32(i)));
+			}
+			if(smooth)
+				vst1q_f32(smoothing->value + c, value);
+#else
+			const __m128 mask = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)lanes));
+			const __m128 active = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)activeLanes));
+			const __m128 targets = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)targetLanes));
+			__m128 value = _mm_setzero_ps(), coeff = value, step = value, target = value;
+			if(smooth)
+			{
+				value = _mm_loadu_ps(smoothing->value + c);
+				coeff = _mm_loadu_ps(smoothing->coeff + c);
+				step = _mm_loadu_ps(smoothing->step + c);
+				target = _mm_loadu_ps(smoothing->target + c);
+			}
+			const __m128 minusStep = _mm_sub_ps(_mm_setzero_ps(), step);
+			const __m128 one = _mm_set1_ps(1.f);
+			const __m128 expanderScale = _mm_set1_ps(kExpanderOutScale);
+			const __m128 scale = _mm_set1_ps(65536.f);
+			const __m128i top = _mm_set1_epi32(65535);
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i offset = _mm_set1_epi32(32768);
+			const __m128i sign = _mm_set1_epi16((short)0x8000);
+			for(unsigned int f = 0; f < frames; ++f)
+			{
+				__m128 x;
+				if(interleaved)
+					x = _mm_loadu_ps(in + f * channels + c);
+				else {
+					for(unsigned int n = 0; n < 4; ++n)
+						tmp[n] = in[(c + n) * frames + f];
+					x = _mm_loadu_ps(tmp);
+				}
+				if(smooth)
+				{
+					x = _mm_or_ps(_mm_and_ps(targets, target), _mm_andnot_ps(targets, x));
+					__m128 d = _mm_mul_ps(coeff, _mm_sub_ps(x, value));
+					d = _mm_max_ps(_mm_min_ps(d, step), minusStep);
+					value = _mm_or_ps(_mm_and_ps(active, _mm_add_ps(value, d)), _mm_andnot_ps(active, x));
+					x = value;
+				}
+				x = _mm_or_ps(_mm_and_ps(mask, _mm_mul_ps(_mm_add_ps(x, one), expanderScale)), _mm_andnot_ps(mask, x));
+				__m128i i = _mm_cvttps_epi32(_mm_mul_ps(x, scale));
+				__m128i over = _mm_cmpgt_epi32(i, top);
+				i = _mm_or_si128(_mm_andnot_si128(over, i), _mm_and_si128(over, top));
+				i = _mm_andnot_si128(_mm_cmplt_epi32(i, zero), i);
+				// there is no unsigned saturating pack in SSE2: shift to the signed range and back
+				i = _mm_sub_epi32(i, offset);
+				_mm_storel_epi64((__m128i*)(raw + f * channels + c), _mm_xor_si128(_mm_packs_epi32(i, i), sign));
+			}
+			if(smooth)
+				_mm_storeu_ps(smoothing->value + c, value);
+#endif
+		}
+	}
+#endif
+	for(; c < channels; ++c)
+	{
+		bool expander = expanderMask & (1 << c);
+		for(unsigned int f = 0; f < frames; ++f)
+		{
+			float value = in[interleaved ? f * channels + c : c * frames + f];
+			if(smoothing && c < kMaxAnalogOutSmoothingChannels)
+				value = smoothing->processSample(c, value);
+			if(expander)
+				value = (value + 1.f) * kExpanderOutScale;
+			int out = value * 65536.0f;
+			if(out < 0) out = 0;
+			else if(out > 65535) out = 65535;
+			raw[f * channels + c] = (uint16_t)out;
+		}
+	}
+}
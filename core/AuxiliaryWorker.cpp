@@ -0,0 +1,100 @@
+/***** AuxiliaryWorker.cpp *****/
+#include <AuxiliaryWorker.h>
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <unistd.h>
+
+// Allocated once per task and never freed, so that a task can always read
+// it, whenever it runs
+struct AuxiliaryWorker::Control {
+	AuxiliaryTask task;
+	int priority;
+	void (*callback)(void*);
+	std::atomic<void*> arg; // NULL when stopped
+	std::atomic<bool> busy; // whether the task is past the check of `arg`
+	Control* next; // in the pool
+};
+
+AuxiliaryWorker::Control* AuxiliaryWorker::pool = NULL;
+static std::mutex gPoolMutex;
+static unsigned int gNumTasks = 0;
+
+AuxiliaryWorker::AuxiliaryWorker() :
+	control(NULL)
+{}
+
+AuxiliaryWorker::~AuxiliaryWorker()
+{
+	stop();
+}
+
+int AuxiliaryWorker::start(void (*callback)(void*), void* arg, int priority, const char* name)
+{
+	stop();
+	Control* c = NULL;
+	{
+		std::lock_guard<std::mutex> lock(gPoolMutex);
+		for(Control** p = &pool; *p; p = &(*p)->next)
+		{
+			if((*p)->priority == priority)
+			{
+				c = *p;
+				*p = c->next;
+				break;
+			}
+		}
+		if(!c)
+		{
+			c = new Control;
+			c->priority = priority;
+			c->arg = NULL;
+			c->busy = false;
+			// task names have to be unique
+			char taskName[64];
+			snprintf(taskName, sizeof(taskName), "%s-%u", name, gNumTasks++);
+			c->task = Bela_createAuxiliaryTask(run, priority, taskName, c);
+			if(!c->task)
+			{
+				fprintf(stderr, "AuxiliaryWorker: unable to create the task %s\n", taskName);
+				delete c;
+				return -1;
+			}
+		}
+	}
+	c->callback = callback;
+	// publishes `callback` to the task
+	c->arg.store(arg);
+	control = c;
+	return 0;
+}
+
+void AuxiliaryWorker::schedule()
+{
+	if(control)
+		Bela_scheduleAuxiliaryTask(control->task);
+}
+
+void AuxiliaryWorker::stop()
+{
+	if(!control)
+		return;
+	// either run() sees `arg` cleared, or this sees it busy and waits
+	control->arg.store(NULL);
+	while(control->busy.load())
+		usleep(1000);
+	std::lock_guard<std::mutex> lock(gPoolMutex);
+	control->next = pool;
+	pool = control;
+	control = NULL;
+}
+
+void AuxiliaryWorker::run(void* ptr)
+{
+	Control* c = (Control*)ptr;
+	c->busy.store(true);
+	void* arg = c->arg.load();
+	if(arg)
+		c->callback(arg);
+	c->busy.store(false);
+}
@@ -0,0 +1,450 @@
+/***** Convolver.cpp *****/
+#include <Convolver.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Number of blocks of the tail that can be waiting to be added to the output
+#define kConvolverTailSlots 4
+
+static unsigned int nextPowerOfTwo(unsigned int n)
+{
+	unsigned int p = 1;
+	while(p < n)
+		p <<= 1;
+	return p;
+}
+
+// acc += a * b, for complex values
+static void complexMultiplyAccumulate(const ne10_fft_cpx_float32_t* a, const ne10_fft_cpx_float32_t* b,
+		ne10_fft_cpx_float32_t* acc, unsigned int bins)
+{
+	unsigned int n = 0;
+#if defined(__ARM_NEON__)
+	for(; n + 4 <= bins; n += 4)
+	{
+		float32x4x2_t x = vld2q_f32((const float*)(a + n));
+		float32x4x2_t y = vld2q_f32((const float*)(b + n));
+		float32x4x2_t z = vld2q_f32((float*)(acc + n));
+		z.val[0] = vmlaq_f32(z.val[0], x.val[0], y.val[0]);
+		z.val[0] = vmlsq_f32(z.val[0], x.val[1], y.val[1]);
+		z.val[1] = vmlaq_f32(z.val[1], x.val[0], y.val[1]);
+		z.val[1] = vmlaq_f32(z.val[1], x.val[1], y.val[0]);
+		vst2q_f32((float*)(acc + n), z);
+	}
+#elif defined(__SSE2__)
+	for(; n + 2 <= bins; n += 2)
+	{
+		// two bins per vector: r0 i0 r1 i1
+		__m128 x = _mm_loadu_ps((const float*)(a + n));
+		__m128 y = _mm_loadu_ps((const float*)(b + n));
+		__m128 ySwapped = _mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 p = _mm_mul_ps(x, y); // xr*yr xi*yi
+		__m128 q = _mm_mul_ps(x, ySwapped); // xr*yi xi*yr
+		__m128 re = _mm_sub_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1)));
+		__m128 im = _mm_add_ps(q, _mm_shuffle_ps(q, q, _MM_SHUFFLE(2, 3, 0, 1)));
+		__m128 product = _mm_shuffle_ps(re, im, _MM_SHUFFLE(2, 0, 2, 0)); // re0 re1 im0 im1
+		product = _mm_shuffle_ps(product, product, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storeu_ps((float*)(acc + n), _mm_add_ps(_mm_loadu_ps((const float*)(acc + n)), product));
+	}
+#endif
+	for(; n < bins; ++n)
+	{
+		acc[n].r += a[n].r * b[n].r - a[n].i * b[n].i;
+		acc[n].i += a[n].r * b[n].i + a[n].i * b[n].r;
+	}
+}
+
+// Compute the spectra of `partitions` partitions of `size` taps, starting
+// from tap `start`, each zero-padded to 2 * size.
+static int computeSpectra(const float* ir, unsigned int length, unsigned int start, unsigned int size,
+		unsigned int partitions, ne10_fft_cpx_float32_t* spectra)
+{
+	unsigned int fftSize = 2 * size;
+	unsigned int bins = size + 1;
+	ne10_fft_r2c_cfg_float32_t cfg = ne10_fft_alloc_r2c_float32(fftSize);
+	float* time = (float*) NE10_MALLOC(fftSize * sizeof(float));
+	if(!cfg || !time)
+	{
+		NE10_FREE(cfg);
+		NE10_FREE(time);
+		return -1;
+	}
+	// depending on the version of NE10, the inverse FFT may or may not be
+	// scaled by 1 / fftSize: find out with an impulse, and fold it into the spectra
+	memset(time, 0, fftSize * sizeof(float));
+	time[0] = 1;
+	ne10_fft_r2c_1d_float32_neon(spectra, time, cfg);
+	ne10_fft_c2r_1d_float32_neon(time, spectra, cfg);
+	float scale = time[0] ? 1.f / time[0] : 1.f / fftSize;
+	for(unsigned int k = 0; k < partitions; ++k)
+	{
+		memset(time, 0, fftSize * sizeof(float));
+		unsigned int first = start + k * size;
+		for(unsigned int n = 0; n < size && first + n < length; ++n)
+			time[n] = ir[first + n] * scale;
+		ne10_fft_r2c_1d_float32_neon(spectra + k * bins, time, cfg);
+	}
+	NE10_FREE(cfg);
+	NE10_FREE(time);
+	return 0;
+}
+
+ConvolverIr::ConvolverIr() :
+	length(0),
+	partitionSize(0),
+	tailPartitionSize(0),
+	head(NULL),
+	bodySpectra(NULL),
+	bodyPartitions(0),
+	tailSpectra(NULL),
+	tailPartitions(0)
+{}
+
+ConvolverIr::~ConvolverIr()
+{
+	cleanup();
+}
+
+int ConvolverIr::setup(const float* ir, unsigned int newLength, unsigned int newPartitionSize, unsigned int newTailPartitionSize)
+{
+	if(!newLength || newPartitionSize < 4 || (newPartitionSize & (newPartitionSize - 1))
+			|| newTailPartitionSize < newPartitionSize || (newTailPartitionSize & (newTailPartitionSize - 1)))
+	{
+		fprintf(stderr, "ConvolverIr: invalid arguments\n");
+		return -1;
+	}
+	cleanup();
+	length = newLength;
+	partitionSize = newPartitionSize;
+	tailPartitionSize = newTailPartitionSize;
+
+	head = new float[partitionSize];
+	for(unsigned int n = 0; n < partitionSize; ++n)
+		head[n] = n < length ? ir[n] : 0;
+
+	unsigned int bodyEnd = length < 2 * tailPartitionSize ? length : 2 * tailPartitionSize;
+	bodyPartitions = bodyEnd > partitionSize ? (bodyEnd - partitionSize + partitionSize - 1) / partitionSize : 0;
+	tailPartitions = length > 2 * tailPartitionSize ? (length - 2 * tailPartitionSize + tailPartitionSize - 1) / tailPartitionSize : 0;
+	if(bodyPartitions)
+	{
+		bodySpectra = (ne10_fft_cpx_float32_t*) NE10_MALLOC(bodyPartitions * (partitionSize + 1) * sizeof(ne10_fft_cpx_float32_t));
+		if(!bodySpectra || computeSpectra(ir, length, partitionSize, partitionSize, bodyPartitions, bodySpectra))
+		{
+			fprintf(stderr, "ConvolverIr: unable to compute the spectra\n");
+			return -1;
+		}
+	}
+	if(tailPartitions)
+	{
+		tailSpectra = (ne10_fft_cpx_float32_t*) NE10_MALLOC(tailPartitions * (tailPartitionSize + 1) * sizeof(ne10_fft_cpx_float32_t));
+		if(!tailSpectra || computeSpectra(ir, length, 2 * tailPartitionSize, tailPartitionSize, tailPartitions, tailSpectra))
+		{
+			fprintf(stderr, "ConvolverIr: unable to compute the spectra\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void ConvolverIr::cleanup()
+{
+	delete[] head;
+	NE10_FREE(bodySpectra);
+	NE10_FREE(tailSpectra);
+	head = NULL;
+	bodySpectra = NULL;
+	tailSpectra = NULL;
+	bodyPartitions = 0;
+	tailPartitions = 0;
+	length = 0;
+}
+
+Convolver::Convolver() :
+	ir(NULL),
+	headHistory(NULL),
+	headPosition(0),
+	input(NULL),
+	inputMask(0),
+	output(NULL),
+	outputMask(0),
+	count(0),
+	tailOutput(NULL),
+	tailOutputBlock(NULL),
+	tailInputBlocks(0),
+	tailDoneBlocks(0),
+	tailNextBlock(0),
+	priority(0),
+	useWorker(false),
+	lateBlocks(0),
+	resyncs(0),
+	stopping(false)
+{
+	memset(&body, 0, sizeof(body));
+	memset(&tail, 0, sizeof(tail));
+}
+
+Convolver::~Convolver()
+{
+	cleanup();
+}
+
+int Convolver::setupSegment(Segment& s, unsigned int size, unsigned int partitions, const ne10_fft_cpx_float32_t* spectra)
+{
+	s.size = size;
+	s.partitions = partitions;
+	s.spectra = spectra;
+	if(!partitions)
+		return 0;
+	s.cfg = ne10_fft_alloc_r2c_float32(2 * size);
+	s.delayLine = (ne10_fft_cpx_float32_t*) NE10_MALLOC(partitions * (size + 1) * sizeof(ne10_fft_cpx_float32_t));
+	s.accumulator = (ne10_fft_cpx_float32_t*) NE10_MALLOC((size + 1) * sizeof(ne10_fft_cpx_float32_t));
+	s.time = (float*) NE10_MALLOC(2 * size * sizeof(float));
+	if(!s.cfg || !s.delayLine || !s.accumulator || !s.time)
+		return -1;
+	resetSegment(s);
+	return 0;
+}
+
+void Convolver::cleanupSegment(Segment& s)
+{
+	NE10_FREE(s.cfg);
+	NE10_FREE(s.delayLine);
+	NE10_FREE(s.accumulator);
+	NE10_FREE(s.time);
+	memset(&s, 0, sizeof(s));
+}
+
+void Convolver::resetSegment(Segment& s)
+{
+	if(s.delayLine)
+		memset(s.delayLine, 0, s.partitions * (s.size + 1) * sizeof(ne10_fft_cpx_float32_t));
+	s.delayLinePosition = 0;
+}
+
+int Convolver::setup(const ConvolverIr* newIr, bool newUseWorker, int newPriority)
+{
+	cleanup();
+	if(!newIr || !newIr->head)
+	{
+		fprintf(stderr, "Convolver: the impulse response has not been set up\n");
+		return -1;
+	}
+	ir = newIr;
+	useWorker = newUseWorker;
+	priority = newPriority;
+	unsigned int partitionSize = ir->partitionSize;
+	unsigned int tailPartitionSize = ir->tailPartitionSize;
+	headHistory = new float[2 * partitionSize];
+	// the tail reads two blocks back, while up to two more are written
+	inputMask = nextPowerOfTwo(4 * tailPartitionSize) - 1;
+	input = new float[inputMask + 1];
+	// the output is written up to one tail block ahead
+	outputMask = nextPowerOfTwo(2 * tailPartitionSize) - 1;
+	output = new float[outputMask + 1];
+	tailOutput = new float[kConvolverTailSlots * tailPartitionSize];
+	tailOutputBlock = new uint64_t[kConvolverTailSlots];
+	if(setupSegment(body, partitionSize, ir->bodyPartitions, ir->bodySpectra)
+			|| setupSegment(tail, tailPartitionSize, ir->tailPartitions, ir->tailSpectra))
+	{
+		fprintf(stderr, "Convolver: unable to allocate the FFT\n");
+		return -1;
+	}
+	stopping = false;
+	reset();
+	if(useWorker && tail.partitions)
+	{
+		if(worker.start(workerLoop, this, priority, "bela-convolver"))
+		{
+			fprintf(stderr, "Convolver: unable to create the worker thread\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void Convolver::reset()
+{
+	if(!ir)
+		return;
+	// the worker must not run while its state is cleared
+	bool restart = worker.isRunning();
+	worker.stop();
+	unsigned int partitionSize = ir->partitionSize;
+	memset(headHistory, 0, 2 * partitionSize * sizeof(float));
+	memset(input, 0, (inputMask + 1) * sizeof(float));
+	memset(output, 0, (outputMask + 1) * sizeof(float));
+	for(unsigned int n = 0; n < kConvolverTailSlots; ++n)
+		tailOutputBlock[n] = -1;
+	resetSegment(body);
+	resetSegment(tail);
+	headPosition = 0;
+	count = 0;
+	tailInputBlocks = 0;
+	tailDoneBlocks = 0;
+	tailNextBlock = 0;
+	lateBlocks = 0;
+	resyncs = 0;
+	if(restart && worker.start(workerLoop, this, priority, "bela-convolver"))
+		fprintf(stderr, "Convolver: unable to restart the worker thread\n");
+}
+
+void Convolver::cleanup()
+{
+	// processTail() returns after the current block once `stopping` is set
+	stopping = true;
+	worker.stop();
+	cleanupSegment(body);
+	cleanupSegment(tail);
+	delete[] headHistory;
+	delete[] input;
+	delete[] output;
+	delete[] tailOutput;
+	delete[] tailOutputBlock;
+	headHistory = NULL;
+	input = NULL;
+	output = NULL;
+	tailOutput = NULL;
+	tailOutputBlock = NULL;
+	ir = NULL;
+}
+
+// Convolve the 2 * size input samples up to `end` (overlap-save), and
+// return the output for the last `size` of them.
+const float* Convolver::processSegment(Segment& s, uint64_t end)
+{
+	unsigned int fftSize = 2 * s.size;
+	unsigned int bins = s.size + 1;
+	unsigned int start = (end - fftSize) & inputMask;
+	unsigned int first = inputMask + 1 - start;
+	if(first > fftSize)
+		first = fftSize;
+	memcpy(s.time, input + start, first * sizeof(float));
+	memcpy(s.time + first, input, (fftSize - first) * sizeof(float));
+	if(++s.delayLinePosition >= s.partitions)
+		s.delayLinePosition = 0;
+	ne10_fft_r2c_1d_float32_neon(s.delayLine + s.delayLinePosition * bins, s.time, s.cfg);
+	memset(s.accumulator, 0, bins * sizeof(ne10_fft_cpx_float32_t));
+	// partition k is applied to the input from k blocks ago
+	unsigned int slot = s.delayLinePosition;
+	for(unsigned int k = 0; k < s.partitions; ++k)
+	{
+		complexMultiplyAccumulate(s.delayLine + slot * bins, s.spectra + k * bins, s.accumulator, bins);
+		slot = slot ? slot - 1 : s.partitions - 1;
+	}
+	ne10_fft_c2r_1d_float32_neon(s.time, s.accumulator, s.cfg);
+	return s.time + s.size;
+}
+
+void Convolver::workerLoop(void* arg)
+{
+	((Convolver*)arg)->processTail();
+}
+
+void Convolver::processTail()
+{
+	unsigned int size = tail.size;
+	while(!gShouldStop && !stopping)
+	{
+		uint64_t available = tailInputBlocks.load(std::memory_order_acquire);
+		uint64_t block = tailNextBlock;
+		if(block >= available)
+			break;
+		if(available - block > 2)
+		{
+			// the input we need has been overwritten: start again from the latest block
+			resetSegment(tail);
+			resyncs++;
+			block = available - 1;
+		}
+		const float* result = processSegment(tail, (block + 1) * size);
+		if(tailInputBlocks.load(std::memory_order_acquire) - block > 2)
+		{
+			// the input was overwritten while we were reading it
+			tailNextBlock = block;
+			continue;
+		}
+		memcpy(tailOutput + (block % kConvolverTailSlots) * size, result, size * sizeof(float));
+		tailOutputBlock[block % kConvolverTailSlots] = block;
+		tailDoneBlocks.store(block + 1, std::memory_order_release);
+		tailNextBlock = block + 1;
+	}
+}
+
+// Called every partitionSize samples
+void Convolver::boundary()
+{
+	unsigned int partitionSize = body.size;
+	unsigned int outputStart = count & outputMask;
+	if(body.partitions)
+	{
+		// the output for the input block that has just ended, with the
+		// taps starting at partitionSize, starts now
+		const float* result = processSegment(body, count);
+		for(unsigned int n = 0; n < partitionSize; ++n)
+			output[(outputStart + n) & outputMask] += result[n];
+	}
+	if(!tail.partitions || count % tail.size)
+		return;
+	// the output for input block c, with the taps starting at
+	// 2 * tailPartitionSize, starts at the end of block c + 1
+	uint64_t blocks = count / tail.size;
+	if(blocks >= 2)
+	{
+		uint64_t c = blocks - 2;
+		unsigned int slot = c % kConvolverTailSlots;
+		if(tailDoneBlocks.load(std::memory_order_acquire) > c && tailOutputBlock[slot] == c)
+		{
+			const float* result = tailOutput + slot * tail.size;
+			for(unsigned int n = 0; n < tail.size; ++n)
+				output[(outputStart + n) & outputMask] += result[n];
+		} else {
+			++lateBlocks;
+		}
+	}
+	tailInputBlocks.store(blocks, std::memory_order_release);
+	if(useWorker)
+		worker.schedule();
+	else
+		processTail();
+}
+
+void Convolver::process(const float* in, float* out, unsigned int frames)
+{
+	if(!ir)
+		return;
+	unsigned int partitionSize = ir->partitionSize;
+	const float* head = ir->head;
+	unsigned int n = 0;
+	while(n < frames)
+	{
+		// run up to the next partition boundary
+		unsigned int run = partitionSize - (count & (partitionSize - 1));
+		if(run > frames - n)
+			run = frames - n;
+		for(unsigned int s = 0; s < run; ++s)
+		{
+			float x = in[n + s];
+			// the history is written twice, so that the last partitionSize
+			// samples are always contiguous, newest first
+			headPosition = (headPosition ? headPosition : partitionSize) - 1;
+			float* history = headHistory + headPosition;
+			history[0] = history[partitionSize] = x;
+			float y = 0;
+			for(unsigned int k = 0; k < partitionSize; ++k)
+				y += head[k] * history[k];
+			input[(count + s) & inputMask] = x;
+			unsigned int o = (count + s) & outputMask;
+			out[n + s] = y + output[o];
+			output[o] = 0;
+		}
+		n += run;
+		count += run;
+		if((count & (partitionSize - 1)) == 0)
+			boundary();
+	}
+}
@@ -0,0 +1,151 @@
+/***** DigitalCapture.cpp *****/
+#include <DigitalCapture.h>
+#include <string.h>
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Change of position for each transition, indexed by (previousAB << 2) | currentAB.
+// 2 marks an invalid transition (both channels changed).
+static const int8_t kQuadratureTable[16] = {
+	0, 1, -1, 2,
+	-1, 0, 2, 1,
+	1, 2, 0, -1,
+	2, -1, 1, 0,
+};
+
+DigitalCapture::DigitalCapture() :
+	numEncoders(0),
+	captureMask(0),
+	encoderMask(0),
+	lastValues(0),
+	firstBlock(true)
+{
+	memset(channels, 0, sizeof(channels));
+	memset(encoders, 0, sizeof(encoders));
+}
+
+void DigitalCapture::setup(BelaContext* context, uint16_t newChannels)
+{
+	captureMask = newChannels;
+	for(unsigned int n = 0; n < 16; ++n)
+	{
+		if(captureMask & (1 << n))
+			pinMode(context, 0, n, INPUT);
+	}
+	firstBlock = true;
+}
+
+int DigitalCapture::addEncoder(unsigned int channelA, unsigned int channelB)
+{
+	if(numEncoders >= kMaxDigitalCaptureEncoders || channelA > 15 || channelB > 15)
+		return -1;
+	if(!(captureMask & (1 << channelA)) || !(captureMask & (1 << channelB)))
+		return -1;
+	DigitalCaptureEncoder& e = encoders[numEncoders];
+	memset(&e, 0, sizeof(e));
+	e.channelA = channelA;
+	e.channelB = channelB;
+	encoderMask |= (1 << channelA) | (1 << channelB);
+	return numEncoders++;
+}
+
+void DigitalCapture::processFrame(uint16_t changed, uint16_t values, uint64_t time)
+{
+	uint16_t previous = values ^ changed;
+	uint16_t bits = changed;
+	while(bits)
+	{
+		unsigned int n = __builtin_ctz(bits);
+		bits &= bits - 1;
+		DigitalCaptureChannel& c = channels[n];
+		c.value = (values >> n) & 1;
+		if(c.value)
+		{
+			if(c.risingEdges)
+				c.period = time - c.lastRisingEdge;
+			if(c.fallingEdges)
+				c.lowWidth = time - c.lastFallingEdge;
+			c.lastRisingEdge = time;
+			++c.risingEdges;
+		} else {
+			if(c.risingEdges)
+				c.highWidth = time - c.lastRisingEdge;
+			c.lastFallingEdge = time;
+			++c.fallingEdges;
+		}
+	}
+	if(changed & encoderMask)
+	{
+		for(unsigned int n = 0; n < numEncoders; ++n)
+		{
+			DigitalCaptureEncoder& e = encoders[n];
+			unsigned int before = (((previous >> e.channelA) & 1) << 1) | ((previous >> e.channelB) & 1);
+			unsigned int after = (((values >> e.channelA) & 1) << 1) | ((values >> e.channelB) & 1);
+			int step = kQuadratureTable[(before << 2) | after];
+			if(step == 2)
+				++e.errors;
+			else
+				e.delta += step;
+		}
+	}
+}
+
+// DIGITAL_FORMAT_ASSUMPTION: the values of the 16 channels are
+// stored in the upper half-word of each frame.
+void DigitalCapture::process(BelaContext* context)
+{
+	const uint32_t* array = context->digital;
+	unsigned int length = context->digitalFrames;
+	if(length == 0 || captureMask == 0)
+		return;
+	uint64_t start = context->audioFramesElapsed * context->digitalFrames / context->audioFrames;
+	for(unsigned int n = 0; n < numEncoders; ++n)
+		encoders[n].delta = 0;
+	const uint16_t mask = captureMask;
+	if(firstBlock)
+	{
+		// initialise the values without reporting edges
+		lastValues = array[0] >> 16;
+		for(unsigned int n = 0; n < 16; ++n)
+			channels[n].value = (lastValues >> n) & 1;
+		firstBlock = false;
+	}
+	uint16_t first = array[0] >> 16;
+	processFrame((first ^ lastValues) & mask, first, start);
+	unsigned int frame = 1;
+	// compare each frame with the previous one, 4 frames at a time,
+	// and only look for the individual bits in groups where something changed
+#if defined(__ARM_NEON__)
+	const uint32x4_t vmask = vdupq_n_u32((uint32_t)mask << 16);
+	for(; frame + 4 <= length; frame += 4)
+	{
+		uint32x4_t changed = vandq_u32(veorq_u32(vld1q_u32(array + frame), vld1q_u32(array + frame - 1)), vmask);
+		uint32x2_t any = vorr_u32(vget_low_u32(changed), vget_high_u32(changed));
+		if((vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) == 0)
+			continue;
+		for(unsigned int n = frame; n < frame + 4; ++n)
+			processFrame(((array[n] ^ array[n - 1]) >> 16) & mask, array[n] >> 16, start + n);
+	}
+#elif defined(__SSE2__)
+	const __m128i vmask = _mm_set1_epi32((uint32_t)mask << 16);
+	const __m128i zero = _mm_setzero_si128();
+	for(; frame + 4 <= length; frame += 4)
+	{
+		__m128i current = _mm_loadu_si128((const __m128i*)(array + frame));
+		__m128i previous = _mm_loadu_si128((const __m128i*)(array + frame - 1));
+		__m128i changed = _mm_and_si128(_mm_xor_si128(current, previous), vmask);
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(changed, zero)) == 0xffff)
+			continue;
+		for(unsigned int n = frame; n < frame + 4; ++n)
+			processFrame(((array[n] ^ array[n - 1]) >> 16) & mask, array[n] >> 16, start + n);
+	}
+#endif
+	for(; frame < length; ++frame)
+		processFrame(((array[frame] ^ array[frame - 1]) >> 16) & mask, array[frame] >> 16, start + frame);
+	lastValues = array[length - 1] >> 16;
+	for(unsigned int n = 0; n < numEncoders; ++n)
+		encoders[n].position += encoders[n].delta;
+}
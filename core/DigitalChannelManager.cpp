@@ -6,12 +6,28 @@
  */
 
 #include <DigitalChannelManager.h>
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 DigitalChannelManager::DigitalChannelManager() :
+	numEvents(0),
+	numDroppedEvents(0),
+	lastDigitalInputValues(0),
+	numSignalRateInputChannels(0),
+	numSignalRateOutputChannels(0),
+	callbackEnabled(false),
+	stateChangedCallback(NULL),
+	clearDataOut(0),
+	setDataOut(0),
+	modeOutput(0),
+	modeInput(0),
+	messageRate(0),
+	signalRate(0),
 	verbose(true)
 {
-	// TODO Auto-generated constructor stub
-
 }
 
 DigitalChannelManager::~DigitalChannelManager() {
@@ -22,3 +38,211 @@ void DigitalChannelManager::setVerbose(bool isVerbose)
 {
 	verbose = isVerbose;
 }
+
+// DIGITAL_FORMAT_ASSUMPTION
+// Note: even though INPUT == 0 and OUTPUT == 1, this is actually reversed in the binary word,
+// so it actually is 1 for input and 0 for output. ANDing the direction with the
+// values masks out the output values.
+static inline uint16_t getInputValues(uint32_t word)
+{
+	return (word >> 16) & word;
+}
+
+void DigitalChannelManager::addEvents(uint16_t changed, uint16_t values, unsigned int frame)
+{
+	// one event per bit set in changed, in ascending channel order
+	while(changed)
+	{
+		if(numEvents == kMaxDigitalChannelEvents)
+		{
+			numDroppedEvents += __builtin_popcount(changed);
+			return;
+		}
+		unsigned int channel = __builtin_ctz(changed);
+		DigitalChannelEvent& e = events[numEvents++];
+		e.frame = frame;
+		e.channel = channel;
+		e.value = (values >> channel) & 1;
+		changed &= changed - 1;
+	}
+}
+
+void DigitalChannelManager::processInput(uint32_t* array, unsigned int length)
+{
+	numEvents = 0;
+	if(length == 0)
+		return;
+	const uint16_t mask = messageRate;
+	uint16_t last = lastDigitalInputValues;
+	lastDigitalInputValues = getInputValues(array[length - 1]);
+	if(mask == 0)
+		return;
+	// first frame is compared against the last frame of the previous block
+	addEvents((getInputValues(array[0]) ^ last) & mask, getInputValues(array[0]), 0);
+	unsigned int frame = 1;
+	// compare each frame with the previous one, 4 frames at a time,
+	// and only look for the individual bits in groups where something changed
+#if defined(__ARM_NEON__)
+	const uint32x4_t vmask = vdupq_n_u32(mask);
+	for(; frame + 4 <= length; frame += 4)
+	{
+		uint32x4_t current = vld1q_u32(array + frame);
+		uint32x4_t previous = vld1q_u32(array + frame - 1);
+		current = vandq_u32(vshrq_n_u32(current, 16), current);
+		previous = vandq_u32(vshrq_n_u32(previous, 16), previous);
+		uint32x4_t changed = vandq_u32(veorq_u32(current, previous), vmask);
+		uint32x2_t any = vorr_u32(vget_low_u32(changed), vget_high_u32(changed));
+		if((vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) == 0)
+			continue;
+		for(unsigned int n = frame; n < frame + 4; ++n)
+			addEvents((getInputValues(array[n]) ^ getInputValues(array[n - 1])) & mask, getInputValues(array[n]), n);
+	}
+#elif defined(__SSE2__)
+	const __m128i vmask = _mm_set1_epi32(mask);
+	const __m128i zero = _mm_setzero_si128();
+	for(; frame + 4 <= length; frame += 4)
+	{
+		__m128i current = _mm_loadu_si128((const __m128i*)(array + frame));
+		__m128i previous = _mm_loadu_si128((const __m128i*)(array + frame - 1));
+		current = _mm_and_si128(_mm_srli_epi32(current, 16), current);
+		previous = _mm_and_si128(_mm_srli_epi32(previous, 16), previous);
+		__m128i changed = _mm_and_si128(_mm_xor_si128(current, previous), vmask);
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(changed, zero)) == 0xffff)
+			continue;
+		for(unsigned int n = frame; n < frame + 4; ++n)
+			addEvents((getInputValues(array[n]) ^ getInputValues(array[n - 1])) & mask, getInputValues(array[n]), n);
+	}
+#endif
+	for(; frame < length; ++frame)
+		addEvents((getInputValues(array[frame]) ^ getInputValues(array[frame - 1])) & mask, getInputValues(array[frame]), frame);
+
+	if(callbackEnabled)
+	{
+		for(unsigned int n = 0; n < numEvents; ++n)
+		{
+			const DigitalChannelEvent& e = events[n];
+			stateChangedCallback(e.value, e.frame, callbackArguments[e.channel]);
+		}
+	}
+}
+
+void DigitalChannelManager::updateSignalRateChannels()
+{
+	numSignalRateInputChannels = 0;
+	numSignalRateOutputChannels = 0;
+	for(unsigned int k = 0; k < 16; ++k)
+	{
+		if(isSignalRate(k) && isInput(k))
+			signalRateInputChannels[numSignalRateInputChannels++] = k;
+		if(isSignalRate(k) && isOutput(k))
+			signalRateOutputChannels[numSignalRateOutputChannels++] = k;
+	}
+}
+
+// DIGITAL_FORMAT_ASSUMPTION: the values of the 16 channels are
+// stored in the upper half-word of each frame.
+void DigitalChannelManager::processSignalRateInput(const uint32_t* array, unsigned int length, float* out, unsigned int stride, unsigned int maxChannels)
+{
+	const uint8_t* channels = signalRateInputChannels;
+	// the channels are in ascending order
+	unsigned int numChannels = numSignalRateInputChannels;
+	while(numChannels && channels[numChannels - 1] >= maxChannels)
+		--numChannels;
+	if(numChannels == 0)
+		return;
+	unsigned int frame = 0;
+	// one pass over the frames, 4 frames at a time: each vector of
+	// words is shifted, masked and converted once per channel
+#if defined(__ARM_NEON__)
+	const uint32x4_t one = vdupq_n_u32(1);
+	for(; frame + 4 <= length; frame += 4)
+	{
+		uint32x4_t words = vld1q_u32(array + frame);
+		for(unsigned int c = 0; c < numChannels; ++c)
+		{
+			unsigned int k = channels[c];
+			uint32x4_t bits = vandq_u32(vshlq_u32(words, vdupq_n_s32(-(int)(k + 16))), one);
+			vst1q_f32(out + k * stride + frame, vcvtq_f32_u32(bits));
+		}
+	}
+#elif defined(__SSE2__)
+	const __m128i one = _mm_set1_epi32(1);
+	for(; frame + 4 <= length; frame += 4)
+	{
+		__m128i words = _mm_loadu_si128((const __m128i*)(array + frame));
+		for(unsigned int c = 0; c < numChannels; ++c)
+		{
+			unsigned int k = channels[c];
+			__m128i bits = _mm_and_si128(_mm_srl_epi32(words, _mm_cvtsi32_si128(k + 16)), one);
+			_mm_storeu_ps(out + k * stride + frame, _mm_cvtepi32_ps(bits));
+		}
+	}
+#endif
+	for(; frame < length; ++frame)
+	{
+		uint32_t word = array[frame];
+		for(unsigned int c = 0; c < numChannels; ++c)
+		{
+			unsigned int k = channels[c];
+			out[k * stride + frame] = (word >> (k + 16)) & 1;
+		}
+	}
+}
+
+void DigitalChannelManager::processSignalRateOutput(uint32_t* array, unsigned int length, const float* in, unsigned int stride, unsigned int maxChannels)
+{
+	const uint8_t* channels = signalRateOutputChannels;
+	unsigned int numChannels = numSignalRateOutputChannels;
+	while(numChannels && channels[numChannels - 1] >= maxChannels)
+		--numChannels;
+	if(numChannels == 0)
+		return;
+	uint32_t keepMask = ~0u;
+	for(unsigned int c = 0; c < numChannels; ++c)
+		keepMask &= ~(1u << (channels[c] + 16));
+	unsigned int frame = 0;
+	// one pass over the frames, 4 frames at a time: the comparison
+	// results of all channels are ORed together and then merged
+	// into the words
+#if defined(__ARM_NEON__)
+	const float32x4_t threshold = vdupq_n_f32(0.5f);
+	const uint32x4_t keep = vdupq_n_u32(keepMask);
+	for(; frame + 4 <= length; frame += 4)
+	{
+		uint32x4_t bits = vdupq_n_u32(0);
+		for(unsigned int c = 0; c < numChannels; ++c)
+		{
+			unsigned int k = channels[c];
+			uint32x4_t high = vcgtq_f32(vld1q_f32(in + k * stride + frame), threshold);
+			bits = vorrq_u32(bits, vandq_u32(high, vdupq_n_u32(1u << (k + 16))));
+		}
+		uint32x4_t words = vandq_u32(vld1q_u32(array + frame), keep);
+		vst1q_u32(array + frame, vorrq_u32(words, bits));
+	}
+#elif defined(__SSE2__)
+	const __m128 threshold = _mm_set1_ps(0.5f);
+	const __m128i keep = _mm_set1_epi32(keepMask);
+	for(; frame + 4 <= length; frame += 4)
+	{
+		__m128i bits = _mm_setzero_si128();
+		for(unsigned int c = 0; c < numChannels; ++c)
+		{
+			unsigned int k = channels[c];
+			__m128i high = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(in + k * stride + frame), threshold));
+			bits = _mm_or_si128(bits, _mm_and_si128(high, _mm_set1_epi32((int)(1u << (k + 16)))));
+		}
+		__m128i words = _mm_and_si128(_mm_loadu_si128((const __m128i*)(array + frame)), keep);
+		_mm_storeu_si128((__m128i*)(array + frame), _mm_or_si128(words, bits));
+	}
+#endif
+	for(; frame < length; ++frame)
+	{
+		uint32_t bits = 0;
+		for(unsigned int c = 0; c < numChannels; ++c)
+		{
+			unsigned int k = channels[c];
+			bits |= (uint32_t)(in[k * stride + frame] > 0.5f) << (k + 16);
+		}
+		array[frame] = (array[frame] & keepMask) | bits;
+	}
+}
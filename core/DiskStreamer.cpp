@@ -0,0 +1,741 @@
+/***** DiskStreamer.cpp *****/
+#include <DiskStreamer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Size of the scratch buffer used by process(), in frames
+#define kDiskStreamerMixFrames 64
+
+DiskStreamer::DiskStreamer() :
+	voices(NULL),
+	numVoices(0),
+	numThreads(0),
+	maxChannels(0),
+	bufferFrames(0),
+	chunkFrames(0),
+	sampleRate(44100),
+	buffers(NULL),
+	stopping(false)
+{
+	for(unsigned int n = 0; n < kMaxDiskStreamerThreads; ++n)
+	{
+		threads[n].that = this;
+		threads[n].index = n;
+	}
+}
+
+DiskStreamer::~DiskStreamer()
+{
+	cleanup();
+	delete[] voices;
+	free(buffers);
+}
+
+int DiskStreamer::setup(unsigned int maxVoices, unsigned int newMaxChannels, unsigned int newBufferFrames,
+		float newSampleRate, unsigned int newNumThreads, int priority, SampleRateConverterQuality quality)
+{
+	if(newNumThreads < 1 || newNumThreads > kMaxDiskStreamerThreads || newBufferFrames < 2 || newMaxChannels < 1)
+	{
+		fprintf(stderr, "DiskStreamer: invalid arguments\n");
+		return -1;
+	}
+	cleanup();
+	delete[] voices;
+	free(buffers);
+	numVoices = maxVoices;
+	maxChannels = newMaxChannels;
+	bufferFrames = newBufferFrames;
+	// read in large chunks, so that each read is efficient, while
+	// still making sure that a nearly empty buffer is refilled quickly
+	chunkFrames = bufferFrames / 4;
+	if(chunkFrames < 1)
+		chunkFrames = 1;
+	sampleRate = newSampleRate;
+	numThreads = newNumThreads;
+	voices = new Voice[numVoices];
+	if(posix_memalign((void**)&buffers, 16, sizeof(float) * numVoices * bufferFrames * maxChannels))
+	{
+		fprintf(stderr, "DiskStreamer: unable to allocate the buffers\n");
+		buffers = NULL;
+		return -1;
+	}
+	memset(buffers, 0, sizeof(float) * numVoices * bufferFrames * maxChannels);
+	for(unsigned int n = 0; n < numVoices; ++n)
+	{
+		Voice& v = voices[n];
+		v.active = false;
+		v.claimed = false;
+		v.written = 0;
+		v.consumed = 0;
+		v.position = 0;
+		v.file = 0;
+		v.loop = false;
+		v.gain = 1;
+		v.fade = 1;
+		v.fadeIncrement = 0;
+		v.underruns = 0;
+		v.buffer = buffers + n * bufferFrames * maxChannels;
+		v.resampling = false;
+		v.padding = 0;
+		if(v.converter.setup(maxChannels, kDiskStreamerMixFrames * kDiskStreamerMaxRatio, 1, quality, kDiskStreamerMaxRatio))
+			return -1;
+	}
+	mixBuffer.resize(kDiskStreamerMixFrames * maxChannels);
+	if(numVoices)
+		resampleInput.resize(voices[0].converter.getMaxInputFramesNeeded(kDiskStreamerMixFrames) * maxChannels);
+	resampleOutput.resize(kDiskStreamerMixFrames * maxChannels);
+	stopping = false;
+	for(unsigned int n = 0; n < numThreads; ++n)
+	{
+		if(threads[n].worker.start(ioLoop, &threads[n], priority, "bela-disk-streamer"))
+		{
+			fprintf(stderr, "DiskStreamer: unable to create the I/O thread\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Look for the "data" chunk of a RIFF/WAVE file.
+// Returns 0 if the file is not a WAV file or the chunk is not found.
+static size_t findWavData(const char* data, size_t size, size_t* dataSize)
+{
+	if(size < 12 || memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4))
+		return 0;
+	size_t pos = 12;
+	while(pos + 8 <= size)
+	{
+		const unsigned char* p = (const unsigned char*)data + pos;
+		size_t chunkSize = p[4] | (p[5] << 8) | (p[6] << 16) | ((size_t)p[7] << 24);
+		if(!memcmp(p, "data", 4))
+		{
+			*dataSize = chunkSize;
+			return pos + 8;
+		}
+		pos += 8 + chunkSize + (chunkSize & 1);
+	}
+	return 0;
+}
+
+int DiskStreamer::addFile(const char* path, unsigned int preloadFrames)
+{
+	if(!numThreads)
+	{
+		fprintf(stderr, "DiskStreamer: call setup() before addFile()\n");
+		return -1;
+	}
+	File f;
+	memset(f.sndfiles, 0, sizeof(f.sndfiles));
+	f.mapping = NULL;
+	f.dataOffset = 0;
+	f.bytesPerSample = 0;
+	f.fd = open(path, O_RDONLY);
+	if(f.fd < 0)
+	{
+		fprintf(stderr, "DiskStreamer: unable to open %s\n", path);
+		return -1;
+	}
+	struct stat st;
+	fstat(f.fd, &st);
+	f.fileSize = st.st_size;
+	SF_INFO info;
+	memset(&info, 0, sizeof(info));
+	SNDFILE* sndfile = sf_open(path, SFM_READ, &info);
+	if(!sndfile)
+	{
+		fprintf(stderr, "DiskStreamer: unable to open %s: %s\n", path, sf_strerror(NULL));
+		::close(f.fd);
+		return -1;
+	}
+	if((unsigned int)info.channels > maxChannels)
+	{
+		fprintf(stderr, "DiskStreamer: %s has %d channels, but at most %u are supported\n", path, info.channels, maxChannels);
+		sf_close(sndfile);
+		::close(f.fd);
+		return -1;
+	}
+	f.channels = info.channels;
+	f.frames = info.frames;
+	f.sampleRate = info.samplerate;
+	f.sndfiles[0] = sndfile;
+
+	// uncompressed little-endian WAV files are read straight from a mapping
+	int subformat = info.format & SF_FORMAT_SUBMASK;
+	if((info.format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV && (info.format & SF_FORMAT_ENDMASK) != SF_ENDIAN_BIG)
+	{
+		if(subformat == SF_FORMAT_PCM_16)
+			f.bytesPerSample = 2;
+		else if(subformat == SF_FORMAT_PCM_24)
+			f.bytesPerSample = 3;
+		else if(subformat == SF_FORMAT_FLOAT)
+			f.bytesPerSample = 4;
+	}
+	if(f.bytesPerSample)
+	{
+		void* ptr = mmap(0, f.fileSize, PROT_READ, MAP_SHARED, f.fd, 0); // NOWRAP
+		size_t dataSize = 0;
+		if(ptr != MAP_FAILED)
+		{
+			f.mapping = (const char*)ptr;
+			f.dataOffset = findWavData(f.mapping, f.fileSize, &dataSize);
+		}
+		if(!f.dataOffset || f.dataOffset + f.frames * f.channels * f.bytesPerSample > f.fileSize)
+		{
+			// fall back to libsndfile
+			if(f.mapping)
+				munmap((void*)f.mapping, f.fileSize); // NOWRAP
+			f.mapping = NULL;
+			f.dataOffset = 0;
+			f.bytesPerSample = 0;
+		}
+	}
+	if(f.mapping)
+	{
+		sf_close(sndfile);
+		f.sndfiles[0] = NULL;
+	} else {
+		for(unsigned int n = 1; n < numThreads; ++n)
+		{
+			f.sndfiles[n] = sf_open(path, SFM_READ, &info);
+			if(!f.sndfiles[n])
+			{
+				fprintf(stderr, "DiskStreamer: unable to open %s: %s\n", path, sf_strerror(NULL));
+				closeFile(f);
+				return -1;
+			}
+		}
+	}
+
+	if(preloadFrames > f.frames)
+		preloadFrames = f.frames;
+	f.preloadFrames = preloadFrames;
+	f.preload.resize(preloadFrames * f.channels);
+	readFrames(f, 0, 0, f.preload.data(), preloadFrames);
+	if(f.preloadFrames < f.frames)
+		hint(f, f.preloadFrames, bufferFrames);
+	files.push_back(f);
+	return files.size() - 1;
+}
+
+void DiskStreamer::closeFile(File& f)
+{
+	for(unsigned int n = 0; n < kMaxDiskStreamerThreads; ++n)
+	{
+		if(f.sndfiles[n])
+			sf_close(f.sndfiles[n]);
+		f.sndfiles[n] = NULL;
+	}
+	if(f.mapping)
+		munmap((void*)f.mapping, f.fileSize); // NOWRAP
+	f.mapping = NULL;
+	if(f.fd >= 0)
+		::close(f.fd);
+	f.fd = -1;
+}
+
+void DiskStreamer::cleanup()
+{
+	// serviceVoices() returns at the next voice once `stopping` is set
+	stopping = true;
+	for(unsigned int n = 0; n < kMaxDiskStreamerThreads; ++n)
+		threads[n].worker.stop();
+	for(unsigned int n = 0; n < numVoices; ++n)
+		voices[n].active = false;
+	for(unsigned int n = 0; n < files.size(); ++n)
+		closeFile(files[n]);
+	files.clear();
+}
+
+void DiskStreamer::readFrames(File& f, unsigned int thread, uint64_t start, float* dest, unsigned int frames)
+{
+	unsigned int samples = frames * f.channels;
+	if(f.mapping)
+	{
+		const char* src = f.mapping + f.dataOffset + start * f.channels * f.bytesPerSample;
+		switch(f.bytesPerSample)
+		{
+			case 2:
+			{
+				const int16_t* s = (const int16_t*)src;
+				for(unsigned int n = 0; n < samples; ++n)
+					dest[n] = s[n] * (1.f / 32768.f);
+				break;
+			}
+			case 3:
+			{
+				const unsigned char* s = (const unsigned char*)src;
+				for(unsigned int n = 0; n < samples; ++n)
+				{
+					int32_t value = ((uint32_t)s[0] << 8 | (uint32_t)s[1] << 16 | (uint32_t)s[2] << 24);
+					dest[n] = (value >> 8) * (1.f / 8388608.f);
+					s += 3;
+				}
+				break;
+			}
+			case 4:
+				memcpy(dest, src, sizeof(float) * samples);
+				break;
+		}
+	} else {
+		SNDFILE* sndfile = f.sndfiles[thread];
+		sf_count_t read = 0;
+		if(sf_seek(sndfile, start, SEEK_SET) >= 0)
+			read = sf_readf_float(sndfile, dest, frames);
+		if(read < 0)
+			read = 0;
+		// pad with silence if the file is shorter than reported
+		if((unsigned int)read < frames)
+			memset(dest + read * f.channels, 0, sizeof(float) * (frames - read) * f.channels);
+	}
+}
+
+void DiskStreamer::hint(File& f, uint64_t start, unsigned int frames)
+{
+	if(start + frames > f.frames)
+		frames = f.frames - start;
+	if(!frames)
+		return;
+	off_t offset;
+	off_t length;
+	if(f.bytesPerSample)
+	{
+		offset = f.dataOffset + start * f.channels * f.bytesPerSample;
+		length = frames * f.channels * f.bytesPerSample;
+	} else {
+		// the position of compressed frames is not known: assume a constant bit rate
+		offset = (double)start / f.frames * f.fileSize;
+		length = (double)frames / f.frames * f.fileSize + 1;
+	}
+	// ask the kernel to start reading the next region in the background,
+	// so that the next refill finds it in the page cache
+	posix_fadvise(f.fd, offset, length, POSIX_FADV_WILLNEED);
+}
+
+uint64_t DiskStreamer::fileFrame(File& f, uint64_t position, bool loop)
+{
+	return loop ? position % f.frames : position;
+}
+
+unsigned int DiskStreamer::framesToRead(Voice& v)
+{
+	File& f = files[v.file];
+	if(f.preloadFrames >= f.frames)
+		return 0; // the whole file is in memory
+	uint64_t written = v.written.load(std::memory_order_relaxed);
+	uint64_t consumed = v.consumed.load(std::memory_order_acquire);
+	unsigned int space = bufferFrames - (written - consumed);
+	if(!v.loop)
+	{
+		uint64_t remaining = f.frames - f.preloadFrames - written;
+		if(remaining < space)
+		{
+			// the last frames of the file are read in one go
+			return remaining;
+		}
+	}
+	return space >= chunkFrames ? chunkFrames : 0;
+}
+
+bool DiskStreamer::fillVoice(Voice& v, unsigned int thread)
+{
+	unsigned int frames = framesToRead(v);
+	if(!frames)
+		return false;
+	File& f = files[v.file];
+	uint64_t written = v.written.load(std::memory_order_relaxed);
+	unsigned int done = 0;
+	while(done < frames)
+	{
+		// split the read where the ring buffer or the file wrap around
+		uint64_t start = fileFrame(f, f.preloadFrames + written + done, v.loop);
+		unsigned int offset = (written + done) % bufferFrames;
+		unsigned int count = frames - done;
+		if(count > bufferFrames - offset)
+			count = bufferFrames - offset;
+		if(count > f.frames - start)
+			count = f.frames - start;
+		readFrames(f, thread, start, v.buffer + offset * f.channels, count);
+		done += count;
+	}
+	v.written.store(written + frames, std::memory_order_release);
+	hint(f, fileFrame(f, f.preloadFrames + written + frames, v.loop), bufferFrames);
+	return true;
+}
+
+void DiskStreamer::ioLoop(void* arg)
+{
+	IoThread* t = (IoThread*)arg;
+	t->that->serviceVoices(t->index);
+}
+
+void DiskStreamer::serviceVoices(unsigned int thread)
+{
+	while(!gShouldStop && !stopping)
+	{
+		// serve the voice that will run out of data first
+		int best = -1;
+		uint64_t bestBuffered = 0;
+		for(unsigned int n = 0; n < numVoices; ++n)
+		{
+			Voice& v = voices[n];
+			if(!v.active.load(std::memory_order_acquire) || v.claimed.load(std::memory_order_relaxed))
+				continue;
+			if(!framesToRead(v))
+				continue;
+			uint64_t buffered = v.written.load(std::memory_order_relaxed) - v.consumed.load(std::memory_order_relaxed);
+			if(best < 0 || buffered < bestBuffered)
+			{
+				best = n;
+				bestBuffered = buffered;
+			}
+		}
+		if(best < 0)
+			break;
+		Voice& v = voices[best];
+		bool expected = false;
+		if(!v.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+			continue; // another thread got there first
+		// the voice may have been stopped in the meantime
+		if(v.active.load(std::memory_order_acquire))
+			fillVoice(v, thread);
+		v.claimed.store(false, std::memory_order_release);
+	}
+}
+
+void DiskStreamer::scheduleIo()
+{
+	for(unsigned int n = 0; n < numVoices; ++n)
+	{
+		Voice& v = voices[n];
+		if(v.active.load(std::memory_order_relaxed) && framesToRead(v))
+		{
+			for(unsigned int t = 0; t < numThreads; ++t)
+				threads[t].worker.schedule();
+			return;
+		}
+	}
+}
+
+int DiskStreamer::play(unsigned int file, float gain, float fadeIn, bool loop)
+{
+	if(file >= files.size())
+		return -1;
+	for(unsigned int n = 0; n < numVoices; ++n)
+	{
+		Voice& v = voices[n];
+		// a voice that has just been stopped may still be in the hands of an I/O thread
+		if(v.active.load(std::memory_order_relaxed) || v.claimed.load(std::memory_order_acquire))
+			continue;
+		v.file = file;
+		v.loop = loop && files[file].frames > 0;
+		v.gain = gain;
+		v.position = 0;
+		v.written.store(0, std::memory_order_relaxed);
+		v.consumed.store(0, std::memory_order_relaxed);
+		v.underruns = 0;
+		v.padding = 0;
+		// files at a different sample rate are resampled
+		double ratio = (double)files[file].sampleRate / sampleRate;
+		v.resampling = ratio != 1;
+		if(v.resampling)
+		{
+			v.converter.setNumChannels(files[file].channels);
+			v.converter.setRatio(ratio);
+		}
+		if(fadeIn > 0)
+		{
+			v.fade = 0;
+			v.fadeIncrement = 1.f / (fadeIn * sampleRate);
+		} else {
+			v.fade = 1;
+			v.fadeIncrement = 0;
+		}
+		v.active.store(true, std::memory_order_release);
+		return n;
+	}
+	return -1;
+}
+
+void DiskStreamer::stop(unsigned int voice, float fadeOut)
+{
+	if(voice >= numVoices)
+		return;
+	Voice& v = voices[voice];
+	if(fadeOut > 0 && v.fade > 0)
+		v.fadeIncrement = -1.f / (fadeOut * sampleRate);
+	else
+		v.active.store(false, std::memory_order_release);
+}
+
+void DiskStreamer::setGain(unsigned int voice, float gain)
+{
+	if(voice < numVoices)
+		voices[voice].gain = gain;
+}
+
+void DiskStreamer::setRate(unsigned int voice, float rate, float rampTime)
+{
+	if(voice >= numVoices)
+		return;
+	Voice& v = voices[voice];
+	if(!v.active.load(std::memory_order_relaxed))
+		return;
+	double ratio = (double)files[v.file].sampleRate / sampleRate;
+	if(!v.resampling)
+	{
+		if(1 == rate)
+			return;
+		// start resampling from the current position. The first output
+		// frame of the converter is the next frame of the file, so there is no jump.
+		v.resampling = true;
+		v.converter.setNumChannels(files[v.file].channels);
+		v.converter.setRatio(ratio);
+	}
+	v.converter.setRatio(ratio * rate, rampTime * sampleRate);
+}
+
+uint64_t DiskStreamer::getFrames(Voice& v, const float** src, bool* fromRing)
+{
+	File& f = files[v.file];
+	const unsigned int channels = f.channels;
+	*fromRing = false;
+	if(v.position < f.preloadFrames)
+	{
+		*src = &f.preload[v.position * channels];
+		return f.preloadFrames - v.position;
+	}
+	if(f.preloadFrames >= f.frames)
+	{
+		// the whole file is in memory and we are looping
+		uint64_t frame = v.position % f.frames;
+		*src = &f.preload[frame * channels];
+		return f.frames - frame;
+	}
+	uint64_t consumed = v.position - f.preloadFrames;
+	uint64_t written = v.written.load(std::memory_order_acquire);
+	if(consumed >= written)
+		return 0; // the I/O threads did not keep up
+	unsigned int offset = consumed % bufferFrames;
+	*src = v.buffer + offset * channels;
+	*fromRing = true;
+	uint64_t available = written - consumed;
+	if(available > bufferFrames - offset)
+		available = bufferFrames - offset;
+	return available;
+}
+
+void DiskStreamer::consume(Voice& v, unsigned int frames, bool fromRing)
+{
+	v.position += frames;
+	if(fromRing)
+		v.consumed.store(v.position - files[v.file].preloadFrames, std::memory_order_release);
+}
+
+unsigned int DiskStreamer::mix(Voice& v, const float* src, float* dest, unsigned int frames, unsigned int channels)
+{
+	if(v.fadeIncrement == 0)
+	{
+		const float gain = v.gain * v.fade;
+		for(unsigned int n = 0; n < frames * channels; ++n)
+			dest[n] += src[n] * gain;
+		return frames;
+	}
+	for(unsigned int n = 0; n < frames; ++n)
+	{
+		const float gain = v.gain * v.fade;
+		for(unsigned int c = 0; c < channels; ++c)
+			dest[n * channels + c] += src[n * channels + c] * gain;
+		v.fade += v.fadeIncrement;
+		if(v.fade >= 1)
+		{
+			v.fade = 1;
+			v.fadeIncrement = 0;
+		} else if(v.fade <= 0) {
+			// faded out
+			v.fade = 0;
+			return n + 1;
+		}
+	}
+	return frames;
+}
+
+unsigned int DiskStreamer::processVoice(unsigned int voice, float* out, unsigned int frames)
+{
+	if(voice >= numVoices)
+		return 0;
+	Voice& v = voices[voice];
+	if(!v.active.load(std::memory_order_relaxed))
+		return 0;
+	if(v.resampling)
+		return processResampled(v, out, frames);
+	File& f = files[v.file];
+	const unsigned int channels = f.channels;
+	unsigned int done = 0;
+	bool stopped = false;
+	while(done < frames)
+	{
+		if(!v.loop && v.position >= f.frames)
+		{
+			stopped = true;
+			break;
+		}
+		const float* src;
+		bool fromRing;
+		uint64_t available = getFrames(v, &src, &fromRing);
+		if(!available)
+		{
+			// the I/O threads did not keep up: output silence
+			// and resume from the same position next time
+			++v.underruns;
+			break;
+		}
+		unsigned int count = frames - done;
+		if(count > available)
+			count = available;
+		unsigned int mixed = mix(v, src, out + done * channels, count, channels);
+		consume(v, mixed, fromRing);
+		done += mixed;
+		if(mixed < count)
+		{
+			stopped = true;
+			break;
+		}
+	}
+	if(stopped)
+		v.active.store(false, std::memory_order_release);
+	return done;
+}
+
+unsigned int DiskStreamer::processResampled(Voice& v, float* out, unsigned int frames)
+{
+	File& f = files[v.file];
+	const unsigned int channels = f.channels;
+	unsigned int done = 0;
+	bool stopped = false;
+	while(done < frames && !stopped)
+	{
+		unsigned int chunk = frames - done;
+		if(chunk > kDiskStreamerMixFrames)
+			chunk = kDiskStreamerMixFrames;
+		// gather the input frames the converter needs for this chunk
+		unsigned int needed = v.converter.getInputFramesNeeded(chunk);
+		unsigned int got = 0;
+		bool underrun = false;
+		while(got < needed)
+		{
+			float* dest = resampleInput.data() + got * channels;
+			if(!v.loop && v.position >= f.frames)
+			{
+				// silence after the end of the file, to flush the converter
+				memset(dest, 0, sizeof(float) * (needed - got) * channels);
+				v.padding += needed - got;
+				got = needed;
+				break;
+			}
+			const float* src;
+			bool fromRing;
+			uint64_t available = getFrames(v, &src, &fromRing);
+			if(!available)
+			{
+				underrun = true;
+				break;
+			}
+			unsigned int count = needed - got;
+			if(count > available)
+				count = available;
+			memcpy(dest, src, sizeof(float) * count * channels);
+			consume(v, count, fromRing);
+			got += count;
+		}
+		// on an underrun, the converter keeps the input it got and
+		// generates fewer frames
+		unsigned int generated = v.converter.process(resampleInput.data(), got, resampleOutput.data(), chunk);
+		unsigned int mixed = mix(v, resampleOutput.data(), out + done * channels, generated, channels);
+		done += mixed;
+		if(mixed < generated)
+			stopped = true;
+		// the end of the file has gone through the filter
+		if(v.padding >= 2 * v.converter.getLatency())
+			stopped = true;
+		if(underrun)
+		{
+			++v.underruns;
+			break;
+		}
+	}
+	if(stopped)
+		v.active.store(false, std::memory_order_release);
+	return done;
+}
+
+void DiskStreamer::process(BelaContext* context)
+{
+	const unsigned int outChannels = context->audioOutChannels;
+	const bool interleaved = context->flags & BELA_FLAG_INTERLEAVED;
+	const unsigned int frameStride = interleaved ? outChannels : 1;
+	const unsigned int channelStride = interleaved ? 1 : context->audioFrames;
+	for(unsigned int voice = 0; voice < numVoices; ++voice)
+	{
+		Voice& v = voices[voice];
+		if(!v.active.load(std::memory_order_relaxed))
+			continue;
+		const unsigned int channels = files[v.file].channels;
+		for(unsigned int start = 0; start < context->audioFrames; start += kDiskStreamerMixFrames)
+		{
+			unsigned int frames = context->audioFrames - start;
+			if(frames > kDiskStreamerMixFrames)
+				frames = kDiskStreamerMixFrames;
+			memset(mixBuffer.data(), 0, sizeof(float) * frames * channels);
+			unsigned int generated = processVoice(voice, mixBuffer.data(), frames);
+			for(unsigned int c = 0; c < outChannels; ++c)
+			{
+				// a mono file goes to all the outputs
+				const float* src = mixBuffer.data() + (c % channels);
+				float* dest = context->audioOut + c * channelStride + start * frameStride;
+				for(unsigned int n = 0; n < generated; ++n)
+					dest[n * frameStride] += src[n * channels];
+			}
+			if(generated < frames)
+				break;
+		}
+	}
+	scheduleIo();
+}
+
+bool DiskStreamer::isPlaying(unsigned int voice)
+{
+	return voice < numVoices && voices[voice].active.load(std::memory_order_relaxed);
+}
+
+unsigned int DiskStreamer::getUnderruns(unsigned int voice)
+{
+	return voice < numVoices ? voices[voice].underruns : 0;
+}
+
+unsigned int DiskStreamer::getBufferedFrames(unsigned int voice)
+{
+	if(voice >= numVoices)
+		return 0;
+	Voice& v = voices[voice];
+	return v.written.load(std::memory_order_relaxed) - v.consumed.load(std::memory_order_relaxed);
+}
+
+unsigned int DiskStreamer::getNumChannels(unsigned int file)
+{
+	return file < files.size() ? files[file].channels : 0;
+}
+
+uint64_t DiskStreamer::getNumFrames(unsigned int file)
+{
+	return file < files.size() ? files[file].frames : 0;
+}
+
+float DiskStreamer::getSampleRate(unsigned int file)
+{
+	return file < files.size() ? files[file].sampleRate : 0;
+}
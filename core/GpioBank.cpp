@@ -0,0 +1,84 @@
+/***** GpioBank.cpp *****/
+#include <GpioBank.h>
+#include <Bela.h>
+#include <string.h>
+
+GpioBank::GpioBank() :
+	fd(-1),
+	mapSize(0)
+{
+	for(unsigned int b = 0; b < kNumBanks; ++b)
+		banks[b] = NULL;
+}
+
+GpioBank::~GpioBank()
+{
+	close();
+}
+
+int GpioBank::open(const char* memFile)
+{
+	if(fd != -1)
+		close();
+	bool standIn = memFile != NULL;
+	fd = ::open(standIn ? memFile : "/dev/mem", O_RDWR);
+	if(fd < 0)
+	{
+		fprintf(stderr, "GpioBank: unable to open %s\n", standIn ? memFile : "/dev/mem");
+		fd = -1;
+		return -1;
+	}
+	mapSize = standIn ? kStandInBankSize : GPIO_SIZE;
+	for(unsigned int b = 0; b < kNumBanks; ++b)
+	{
+		off_t offset = standIn ? b * kStandInBankSize : GPIO_ADDRESSES[b];
+		void* ptr = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset); // NOWRAP
+		if(ptr == MAP_FAILED)
+		{
+			fprintf(stderr, "GpioBank: unable to map GPIO bank %u\n", b);
+			close();
+			return -2;
+		}
+		banks[b] = (volatile uint32_t*)ptr;
+	}
+	return 0;
+}
+
+void GpioBank::close()
+{
+	for(unsigned int b = 0; b < kNumBanks; ++b)
+	{
+		if(banks[b])
+			munmap((void*)banks[b], mapSize); // NOWRAP
+		banks[b] = NULL;
+	}
+	if(fd != -1)
+		::close(fd);
+	fd = -1;
+}
+
+void GpioBank::setDirectionMask(unsigned int bank, uint32_t mask, unsigned int direction)
+{
+	// in the OE register, 0 is output and 1 is input
+	if(direction == OUTPUT)
+		banks[bank][GPIO_OE] &= ~mask;
+	else
+		banks[bank][GPIO_OE] |= mask;
+}
+
+int GpioBank::resolvePins(const unsigned int* pins, unsigned int numPins, GpioPins& out)
+{
+	memset(&out, 0, sizeof(out));
+	if(numPins > GPIO_BANK_MAX_PINS)
+		return -1;
+	for(unsigned int n = 0; n < numPins; ++n)
+	{
+		if(pins[n] >= kNumBanks * 32)
+			return -1;
+		out.bank[n] = pins[n] / 32;
+		out.mask[n] = 1u << (pins[n] % 32);
+		out.bankMasks[out.bank[n]] |= out.mask[n];
+	}
+	out.numPins = numPins;
+	return 0;
+}
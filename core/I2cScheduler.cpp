@@ -0,0 +1,361 @@
+/***** I2cScheduler.cpp *****/
+#include <I2cScheduler.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <system_error>
+
+// Marks the middle buffer as containing data that the reader has not seen yet
+#define kTripleBufferNew 4
+#define kTripleBufferIndex 3
+
+I2cDevAdapter::I2cDevAdapter() :
+	fd(-1)
+{}
+
+I2cDevAdapter::~I2cDevAdapter()
+{
+	close();
+}
+
+int I2cDevAdapter::open(int bus)
+{
+	close();
+	char name[MAX_BUF_NAME];
+	snprintf(name, sizeof(name), "/dev/i2c-%d", bus);
+	fd = ::open(name, O_RDWR);
+	if(fd < 0)
+	{
+		fprintf(stderr, "Failed to open %s I2C Bus\n", name);
+		return -1;
+	}
+	return 0;
+}
+
+void I2cDevAdapter::close()
+{
+	if(fd >= 0)
+		::close(fd);
+	fd = -1;
+}
+
+int I2cDevAdapter::transfer(struct i2c_msg* messages, unsigned int count)
+{
+	struct i2c_rdwr_ioctl_data data;
+	data.msgs = messages;
+	data.nmsgs = count;
+	if(ioctl(fd, I2C_RDWR, &data) != (int)count) // NOWRAP
+		return -1;
+	return 0;
+}
+
+I2cFakeAdapter::I2cFakeAdapter() :
+	numTransfers(0),
+	numMessages(0)
+{}
+
+I2cFakeAdapter::Device* I2cFakeAdapter::findDevice(uint16_t address)
+{
+	for(unsigned int n = 0; n < devices.size(); ++n)
+		if(devices[n].address == address)
+			return &devices[n];
+	return NULL;
+}
+
+void I2cFakeAdapter::setRegisters(uint16_t address, unsigned int reg, const uint8_t* data, unsigned int length)
+{
+	Device* d = findDevice(address);
+	if(!d)
+	{
+		Device device;
+		memset(&device, 0, sizeof(device));
+		device.address = address;
+		devices.push_back(device);
+		d = &devices.back();
+	}
+	for(unsigned int n = 0; n < length; ++n)
+		d->registers[(reg + n) & 255] = data[n];
+}
+
+const uint8_t* I2cFakeAdapter::getRegisters(uint16_t address)
+{
+	Device* d = findDevice(address);
+	return d ? d->registers : NULL;
+}
+
+void I2cFakeAdapter::setFailing(uint16_t address, bool failing)
+{
+	Device* d = findDevice(address);
+	if(d)
+		d->failing = failing;
+}
+
+int I2cFakeAdapter::transfer(struct i2c_msg* messages, unsigned int count)
+{
+	++numTransfers;
+	for(unsigned int m = 0; m < count; ++m)
+	{
+		++numMessages;
+		struct i2c_msg& msg = messages[m];
+		Device* d = findDevice(msg.addr);
+		// like a real bus, stop at the first message that is not acknowledged
+		if(!d || d->failing)
+			return -ENXIO;
+		uint8_t* buf = (uint8_t*)msg.buf;
+		if(msg.flags & I2C_M_RD)
+		{
+			for(unsigned int n = 0; n < msg.len; ++n)
+				buf[n] = d->registers[d->pointer++];
+		} else {
+			for(unsigned int n = 0; n < msg.len; ++n)
+			{
+				if(n == 0)
+					d->pointer = buf[0];
+				else
+					d->registers[d->pointer++] = buf[n];
+			}
+		}
+	}
+	return 0;
+}
+
+I2cScheduler::I2cScheduler() :
+	adapter(NULL),
+	priority(0),
+	running(false)
+{}
+
+I2cScheduler::~I2cScheduler()
+{
+	stop();
+	for(unsigned int n = 0; n < transactions.size(); ++n)
+		delete transactions[n];
+}
+
+int I2cScheduler::setup(int bus, int newPriority)
+{
+	if(devAdapter.open(bus))
+		return -1;
+	return setup(&devAdapter, newPriority);
+}
+
+int I2cScheduler::setup(I2cAdapter* newAdapter, int newPriority)
+{
+	adapter = newAdapter;
+	priority = newPriority;
+	return 0;
+}
+
+int I2cScheduler::addTransaction(uint16_t address, const uint8_t* writeData, unsigned int writeLength,
+		unsigned int readLength, float rate)
+{
+	if(running)
+	{
+		fprintf(stderr, "I2cScheduler: transactions cannot be added while running\n");
+		return -1;
+	}
+	if(rate <= 0 || (!writeLength && !readLength))
+	{
+		fprintf(stderr, "I2cScheduler: invalid transaction\n");
+		return -1;
+	}
+	Transaction* t = new Transaction;
+	t->address = address;
+	t->writeData.assign(writeData, writeData + writeLength);
+	t->readLength = readLength;
+	t->period = 1000000.f / rate;
+	if(t->period < 1)
+		t->period = 1;
+	t->nextTime = 0;
+	t->errors = 0;
+	t->buffers.assign(3 * readLength, 0);
+	memset(t->timestamps, 0, sizeof(t->timestamps));
+	t->back = 0;
+	t->middle = 1;
+	t->front = 2;
+	t->received = false;
+	transactions.push_back(t);
+	due.reserve(transactions.size());
+	return transactions.size() - 1;
+}
+
+int I2cScheduler::start()
+{
+	if(!adapter)
+	{
+		fprintf(stderr, "I2cScheduler: call setup() before start()\n");
+		return -1;
+	}
+	stop();
+	running = true;
+	uint64_t now = getTime();
+	for(unsigned int n = 0; n < transactions.size(); ++n)
+		transactions[n]->nextTime = now;
+	try {
+		thread = std::thread(loop, this);
+	} catch(std::system_error& e) {
+		fprintf(stderr, "I2cScheduler: unable to create the I2C thread: %s\n", e.what());
+		running = false;
+		return -1;
+	}
+	if(priority > 0)
+	{
+		struct sched_param param;
+		param.sched_priority = priority;
+		if(int ret = pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param)) // NOWRAP
+			fprintf(stderr, "I2cScheduler: unable to set the priority of the I2C thread: %s\n", strerror(ret));
+	}
+	return 0;
+}
+
+void I2cScheduler::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	wakeup.notify_one();
+	if(thread.joinable())
+		thread.join();
+}
+
+uint64_t I2cScheduler::getTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts); // NOWRAP
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void I2cScheduler::loop(void* arg)
+{
+	I2cScheduler* that = (I2cScheduler*)arg;
+	std::unique_lock<std::mutex> lock(that->mutex);
+	while(!gShouldStop && that->running)
+	{
+		lock.unlock();
+		uint64_t now = getTime();
+		uint64_t next = that->poll(now);
+		lock.lock();
+		// don't sleep for too long, so that gShouldStop is checked regularly
+		if(next > now + 100000)
+			next = now + 100000;
+		// getTime() and std::chrono::steady_clock both use CLOCK_MONOTONIC
+		std::chrono::steady_clock::time_point wakeTime{std::chrono::microseconds(next)};
+		that->wakeup.wait_until(lock, wakeTime, [that] { return !that->running; });
+	}
+}
+
+unsigned int I2cScheduler::addMessages(Transaction* t, struct i2c_msg* msgs)
+{
+	unsigned int count = 0;
+	if(t->writeData.size())
+	{
+		msgs[count].addr = t->address;
+		msgs[count].flags = 0;
+		msgs[count].len = t->writeData.size();
+		msgs[count].buf = (i2c_char_t*)t->writeData.data();
+		++count;
+	}
+	if(t->readLength)
+	{
+		// read straight into the buffer owned by the I2C thread
+		msgs[count].addr = t->address;
+		msgs[count].flags = I2C_M_RD;
+		msgs[count].len = t->readLength;
+		msgs[count].buf = (i2c_char_t*)&t->buffers[t->back * t->readLength];
+		++count;
+	}
+	return count;
+}
+
+void I2cScheduler::publish(Transaction* t, uint64_t now)
+{
+	t->timestamps[t->back] = now;
+	t->back = t->middle.exchange(t->back | kTripleBufferNew, std::memory_order_acq_rel) & kTripleBufferIndex;
+}
+
+void I2cScheduler::runBatch(unsigned int numDue, unsigned int numMessages, uint64_t now)
+{
+	if(!numDue)
+		return;
+	if(adapter->transfer(messages, numMessages) == 0)
+	{
+		for(unsigned int n = 0; n < numDue; ++n)
+			publish(due[n], now);
+		return;
+	}
+	// find out which of the devices failed
+	for(unsigned int n = 0; n < numDue; ++n)
+	{
+		Transaction* t = due[n];
+		unsigned int count = addMessages(t, messages);
+		if(adapter->transfer(messages, count) == 0)
+			publish(t, now);
+		else
+			t->errors.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+uint64_t I2cScheduler::poll(uint64_t now)
+{
+	if(!adapter)
+		return now + 10000;
+	uint64_t next = UINT64_MAX;
+	unsigned int numMessages = 0;
+	due.clear();
+	for(unsigned int n = 0; n < transactions.size(); ++n)
+	{
+		Transaction* t = transactions[n];
+		if(t->nextTime <= now)
+		{
+			unsigned int count = (t->writeData.size() ? 1 : 0) + (t->readLength ? 1 : 0);
+			if(numMessages + count > kI2cSchedulerMaxMessages)
+			{
+				runBatch(due.size(), numMessages, now);
+				due.clear();
+				numMessages = 0;
+			}
+			numMessages += addMessages(t, messages + numMessages);
+			due.push_back(t);
+			// keep a steady rate, unless we have fallen behind by more than a period
+			t->nextTime += t->period;
+			if(t->nextTime <= now)
+				t->nextTime = now + t->period;
+		}
+		if(t->nextTime < next)
+			next = t->nextTime;
+	}
+	runBatch(due.size(), numMessages, now);
+	if(next == UINT64_MAX)
+		next = now + 10000;
+	return next;
+}
+
+int I2cScheduler::read(unsigned int transaction, const uint8_t** data, uint64_t* timestamp)
+{
+	if(transaction >= transactions.size())
+		return -1;
+	Transaction* t = transactions[transaction];
+	int ret = 0;
+	if(t->middle.load(std::memory_order_relaxed) & kTripleBufferNew)
+	{
+		t->front = t->middle.exchange(t->front, std::memory_order_acq_rel) & kTripleBufferIndex;
+		t->received = true;
+		ret = 1;
+	}
+	if(!t->received)
+		return -1;
+	*data = t->buffers.data() + t->front * t->readLength;
+	if(timestamp)
+		*timestamp = t->timestamps[t->front];
+	return ret;
+}
+
+unsigned int I2cScheduler::getErrors(unsigned int transaction)
+{
+	if(transaction >= transactions.size())
+		return 0;
+	return transactions[transaction]->errors.load(std::memory_order_relaxed);
+}
@@ -16,7 +16,8 @@
 
 #define TLV320_DSP_MODE
 I2c_Codec::I2c_Codec(int i2cBus, int i2cAddress, bool isVerbose /*= false*/)
-: dacVolumeHalfDbs(0), adcVolumeHalfDbs(0), hpVolumeHalfDbs(0), running(false)
+: dacVolumeHalfDbs(0), adcVolumeHalfDbs(0), hpVolumeHalfDbs(0), running(false),
+  batching(false), batchFailed(false), batchLength(0)
 {
 	setVerbose(isVerbose);
 	initI2C_RW(i2cBus, i2cAddress, -1);
@@ -39,10 +40,45 @@ int I2c_Codec::initCodec()
 }
 
 // Tell the codec to start generating audio
-// See the TLV320AIC3106 datasheet for full details of the registers
 // The dual_rate flag, when true, runs the codec at 88.2kHz; otherwise
 // it runs at 44.1kHz
 int I2c_Codec::startAudio(int dual_rate)
+{
+	unsigned int settleUs;
+	if(startAudioBegin(dual_rate, &settleUs))
+		return 1;
+	usleep(settleUs);
+	return startAudioEnd();
+}
+
+// Power up the codec and start the PLL. The outputs are unmuted by
+// startAudioEnd(), which should be called after settleUs microseconds.
+int I2c_Codec::startAudioBegin(int dual_rate, unsigned int* settleUs)
+{
+	beginBatch();
+	int ret = writeStartRegisters(dual_rate);
+	if(endBatch() || ret)
+		return 1;
+	// wait for the codec to stabilize before unmuting the HP amp.
+	// this gets rid of the loud pop.
+	*settleUs = 10000;
+	// note : a small click persists, but it is unavoidable
+	// (i.e.: fading in the hpVolumeHalfDbs after it is turned on does not remove it).
+	return 0;
+}
+
+int I2c_Codec::startAudioEnd()
+{
+	beginBatch();
+	int ret = writeUnmuteRegisters();
+	if(endBatch() || ret)
+		return 1;
+	running = true;
+	return 0;
+}
+
+// See the TLV320AIC3106 datasheet for full details of the registers
+int I2c_Codec::writeStartRegisters(int dual_rate)
 {
 	// As a best-practice it's safer not to assume the implementer has issued initCodec()
 	// or has not otherwise modified codec registers since that call.
@@ -113,14 +149,11 @@ int I2c_Codec::startAudio(int dual_rate)
 		return 1;
 	if(writeRegister(25, 0b10000000))	// Enable mic bias 2.5V
 		return 1;
+	return 0;
+}
 
-	
-	// wait for the codec to stabilize before unmuting the HP amp.
-	// this gets rid of the loud pop.
-	usleep(10000);
-	// note : a small click persists, but it is unavoidable
-	// (i.e.: fading in the hpVolumeHalfDbs after it is turned on does not remove it).
-
+int I2c_Codec::writeUnmuteRegisters()
+{
 	if(writeRegister(0x33, 0x0D))	// HPLOUT output level control: output level = 0dB, not muted, powered up
 		return 1;
 	if(writeRegister(0x41, 0x0D))	// HPROUT output level control: output level = 0dB, not muted, powered up
@@ -137,8 +170,6 @@ int I2c_Codec::startAudio(int dual_rate)
 
 	if(writeADCVolumeRegisters(false))	// Unmute and set ADC volume
 		return 1;
-
-	running = true;
 	return 0;
 }
 
@@ -470,35 +501,107 @@ int I2c_Codec::writeHPVolumeRegisters()
 // This tells the codec to stop generating audio and mute the outputs
 int I2c_Codec::stopAudio()
 {
-	if(writeDACVolumeRegisters(true))	// Mute the DACs
-		return 1;
-	if(writeADCVolumeRegisters(true))	// Mute the ADCs
+	beginBatch();
+	writeDACVolumeRegisters(true);	// Mute the DACs
+	writeADCVolumeRegisters(true);	// Mute the ADCs
+	if(endBatch())
 		return 1;
 
 	usleep(10000);
 
-	if(writeRegister(0x33, 0x0C))		// HPLOUT output level register: muted
-		return 1;
-	if(writeRegister(0x41, 0x0C))		// HPROUT output level register: muted
-		return 1;
-	if(writeRegister(0x56, 0x08))		// LEFT_LOP output level control: muted
-		return 1;
-	if(writeRegister(0x5D, 0x08))		// RIGHT_LOP output level control: muted
-		return 1;
-	if(writeRegister(0x25, 0x00))		// DAC power/driver register: power off
-		return 1;
-	if(writeRegister(0x03, 0x11))		// PLL register A: disable
-		return 1;
-	if(writeRegister(0x01, 0x80))		// Reset codec to defaults
+	beginBatch();
+	writeRegister(0x33, 0x0C);		// HPLOUT output level register: muted
+	writeRegister(0x41, 0x0C);		// HPROUT output level register: muted
+	writeRegister(0x56, 0x08);		// LEFT_LOP output level control: muted
+	writeRegister(0x5D, 0x08);		// RIGHT_LOP output level control: muted
+	writeRegister(0x25, 0x00);		// DAC power/driver register: power off
+	writeRegister(0x03, 0x11);		// PLL register A: disable
+	writeRegister(0x01, 0x80);		// Reset codec to defaults
+	if(endBatch())
 		return 1;
 
 	running = false;
 	return 0;
 }
 
+void I2c_Codec::beginBatch()
+{
+	batching = true;
+	batchFailed = false;
+	batchLength = 0;
+}
+
+// Send the queued writes. Writes to consecutive registers are merged into
+// a single message, as the codec auto-increments the register address.
+// A page select (register 0) or reset (register 1) always ends a message,
+// and all the messages go in one I2C_RDWR transfer, instead of one write() each.
+static int sendRegisters(int file, int address, const unsigned char* registers, const unsigned char* values, unsigned int length)
+{
+	const unsigned int kMaxMessages = 42; // I2C_RDWR_IOCTL_MAX_MSGS
+	struct i2c_msg msgs[kMaxMessages];
+	unsigned char data[2 * kI2cCodecMaxBatch];
+	unsigned int numMessages = 0;
+	unsigned int pos = 0;
+	for(unsigned int n = 0; n < length; ++n)
+	{
+		bool merge = n > 0 && numMessages > 0
+			&& registers[n] == registers[n - 1] + 1
+			&& registers[n - 1] > 0x01;
+		if(!merge)
+		{
+			if(numMessages == kMaxMessages)
+			{
+				struct i2c_rdwr_ioctl_data rdwr = { msgs, numMessages };
+				if(ioctl(file, I2C_RDWR, &rdwr) != (int)numMessages) // NOWRAP
+					return 1;
+				numMessages = 0;
+			}
+			msgs[numMessages].addr = address;
+			msgs[numMessages].flags = 0;
+			msgs[numMessages].len = 1;
+			msgs[numMessages].buf = (i2c_char_t*)&data[pos];
+			data[pos++] = registers[n];
+			++numMessages;
+		}
+		data[pos++] = values[n];
+		++msgs[numMessages - 1].len;
+	}
+	if(!numMessages)
+		return 0;
+	struct i2c_rdwr_ioctl_data rdwr = { msgs, numMessages };
+	if(ioctl(file, I2C_RDWR, &rdwr) != (int)numMessages) // NOWRAP
+		return 1;
+	return 0;
+}
+
+int I2c_Codec::endBatch()
+{
+	batching = false;
+	if(!batchFailed && sendRegisters(i2C_file, i2C_address, batchRegisters, batchValues, batchLength))
+	{
+		verbose && fprintf(stderr, "Failed to write %u registers on I2c codec\n", batchLength);
+		batchFailed = true;
+	}
+	batchLength = 0;
+	return batchFailed;
+}
+
 // Write a specific register on the codec
 int I2c_Codec::writeRegister(unsigned int reg, unsigned int value)
 {
+	if(batching)
+	{
+		if(batchLength == kI2cCodecMaxBatch)
+		{
+			if(!batchFailed && sendRegisters(i2C_file, i2C_address, batchRegisters, batchValues, batchLength))
+				batchFailed = true;
+			batchLength = 0;
+		}
+		batchRegisters[batchLength] = reg & 0xFF;
+		batchValues[batchLength] = value & 0xFF;
+		++batchLength;
+		return batchFailed;
+	}
 	char buf[2] = { static_cast<char>(reg & 0xFF), static_cast<char>(value & 0xFF) };
 
 	if(write(i2C_file, buf, 2) != 2)
@@ -8,6 +8,7 @@
 
 
 #include "I2c_TouchKey.h"
+#include <string.h>
 
 #undef DEBUG_I2C_TOUCHKEY
 
@@ -74,6 +75,19 @@ int I2c_TouchKey::readI2C()
 		fprintf(stderr, "Failure to read Byte Stream\n");
 		return 2;
 	}
+	parseData();
+	return 0;
+}
+
+void I2c_TouchKey::processData(const uint8_t* data)
+{
+	memcpy(dataBuffer, data, numBytesToRead);
+	bytesRead = numBytesToRead;
+	parseData();
+}
+
+void I2c_TouchKey::parseData()
+{
 	/*printf("%d bytes read\n", NUM_BYTES);
 	for(int j=0; j<9; j++)
 		printf("\t %d", (int)dataBuffer[j]);
@@ -162,8 +176,6 @@ int I2c_TouchKey::readI2C()
 	}
 	printf("H = %d\n", sliderPositionH);
 #endif
-
-	return 0;
 }
 
 
@@ -45,7 +45,7 @@ void IirFilter::dealloc(){
 	for(int n = 0; n < numberOfStages; n++){
 		delete stages[n];
 	}
-	delete stages;
+	delete[] stages;
 	stages = 0;
 	numberOfStages = 0;
 }
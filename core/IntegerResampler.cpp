@@ -0,0 +1,208 @@
+/***** IntegerResampler.cpp *****/
+#include <IntegerResampler.h>
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+
+IntegerResampler::IntegerResampler() :
+	numChannels(0),
+	factor(1),
+	maxInputFrames(0),
+	tapsPerPhase(0),
+	historyStride(0),
+	quality(kResamplerHold),
+	upsample(true)
+{}
+
+int IntegerResampler::setup(unsigned int newNumChannels, unsigned int newFactor, bool newUpsample,
+		unsigned int newMaxInputFrames, ResamplerQuality newQuality, unsigned int newTapsPerPhase)
+{
+	if(newFactor < 1 || newTapsPerPhase < 1)
+	{
+		fprintf(stderr, "IntegerResampler: invalid factor %u or taps per phase %u\n", newFactor, newTapsPerPhase);
+		return -1;
+	}
+	numChannels = newNumChannels;
+	factor = newFactor;
+	upsample = newUpsample;
+	maxInputFrames = newMaxInputFrames;
+	tapsPerPhase = newTapsPerPhase;
+
+	// Windowed-sinc prototype, running at the higher of the two rates,
+	// with the cutoff slightly below the Nyquist frequency of the lower rate.
+	unsigned int length = tapsPerPhase * factor;
+	std::vector<float> prototype(length);
+	float fc = 0.45f / factor;
+	float center = (length - 1) * 0.5f;
+	double sum = 0;
+	for(unsigned int n = 0; n < length; ++n)
+	{
+		float x = n - center;
+		float sinc = x == 0 ? 1 : sinf(2.f * (float)M_PI * fc * x) / (2.f * (float)M_PI * fc * x);
+		// Blackman window
+		float w = 0.42f - 0.5f * cosf(2.f * (float)M_PI * (n + 0.5f) / length)
+			+ 0.08f * cosf(4.f * (float)M_PI * (n + 0.5f) / length);
+		prototype[n] = sinc * w;
+		sum += prototype[n];
+	}
+	// unity gain at DC: each phase sums to 1 when upsampling,
+	// the whole filter sums to 1 when downsampling
+	float gain = (upsample ? factor : 1) / sum;
+	filter.resize(length);
+	if(upsample)
+	{
+		// filter[p][j] = h[(T - 1 - j) * L + p], so that each
+		// output sample is a forward dot product on the history
+		for(unsigned int p = 0; p < factor; ++p)
+			for(unsigned int j = 0; j < tapsPerPhase; ++j)
+				filter[p * tapsPerPhase + j] = prototype[(tapsPerPhase - 1 - j) * factor + p] * gain;
+	} else {
+		// time-reversed prototype
+		for(unsigned int j = 0; j < length; ++j)
+			filter[j] = prototype[length - 1 - j] * gain;
+	}
+
+	// the history is sized for the most demanding quality, so that
+	// setQuality() never has to allocate
+	historyStride = getHistoryLength() + maxInputFrames;
+	history.resize(historyStride * numChannels);
+	lastSample.resize(numChannels);
+	setQuality(newQuality);
+	return 0;
+}
+
+unsigned int IntegerResampler::getHistoryLength()
+{
+	return upsample ? tapsPerPhase - 1 : tapsPerPhase * factor - 1;
+}
+
+void IntegerResampler::setQuality(ResamplerQuality newQuality)
+{
+	quality = newQuality;
+	reset();
+}
+
+void IntegerResampler::reset()
+{
+	memset(history.data(), 0, sizeof(history[0]) * history.size());
+	memset(lastSample.data(), 0, sizeof(lastSample[0]) * lastSample.size());
+}
+
+float IntegerResampler::getLatency()
+{
+	switch(quality)
+	{
+		case kResamplerHold:
+			// when downsampling, each output frame is the last of its
+			// group of input frames
+			return upsample ? 0 : (factor - 1) / (float)factor;
+		case kResamplerLinear:
+			return upsample ? factor - 1 : (factor - 1) * 0.5f / factor;
+		case kResamplerPolyphase:
+		{
+			float delay = (tapsPerPhase * factor - 1) * 0.5f;
+			return upsample ? delay : delay / factor;
+		}
+	}
+	return 0;
+}
+
+void IntegerResampler::process(unsigned int channel, const float* in, unsigned int inputFrames, float* out)
+{
+	if(inputFrames > maxInputFrames)
+		inputFrames = maxInputFrames;
+	if(upsample)
+		processUp(channel, in, inputFrames, out);
+	else
+		processDown(channel, in, inputFrames, out);
+}
+
+void IntegerResampler::processUp(unsigned int channel, const float* in, unsigned int inputFrames, float* out)
+{
+	switch(quality)
+	{
+		case kResamplerHold:
+			for(unsigned int n = 0; n < inputFrames; ++n)
+				for(unsigned int p = 0; p < factor; ++p)
+					out[n * factor + p] = in[n];
+			break;
+		case kResamplerLinear:
+		{
+			float previous = lastSample[channel];
+			float step = 1.f / factor;
+			for(unsigned int n = 0; n < inputFrames; ++n)
+			{
+				float diff = (in[n] - previous) * step;
+				for(unsigned int p = 0; p < factor; ++p)
+					out[n * factor + p] = previous + diff * (p + 1);
+				previous = in[n];
+			}
+			lastSample[channel] = previous;
+			break;
+		}
+		case kResamplerPolyphase:
+		{
+			unsigned int historyLength = getHistoryLength();
+			float* buf = &history[channel * historyStride];
+			memcpy(buf + historyLength, in, sizeof(in[0]) * inputFrames);
+			const float* f = filter.data();
+			unsigned int taps = tapsPerPhase;
+			for(unsigned int n = 0; n < inputFrames; ++n)
+			{
+				const float* x = buf + n;
+				for(unsigned int p = 0; p < factor; ++p)
+				{
+					const float* h = f + p * taps;
+					float acc = 0;
+					for(unsigned int j = 0; j < taps; ++j)
+						acc += h[j] * x[j];
+					out[n * factor + p] = acc;
+				}
+			}
+			memmove(buf, buf + inputFrames, sizeof(buf[0]) * historyLength);
+			break;
+		}
+	}
+}
+
+void IntegerResampler::processDown(unsigned int channel, const float* in, unsigned int inputFrames, float* out)
+{
+	unsigned int outputFrames = inputFrames / factor;
+	switch(quality)
+	{
+		case kResamplerHold:
+			for(unsigned int n = 0; n < outputFrames; ++n)
+				out[n] = in[n * factor + factor - 1];
+			break;
+		case kResamplerLinear:
+		{
+			float scale = 1.f / factor;
+			for(unsigned int n = 0; n < outputFrames; ++n)
+			{
+				float acc = 0;
+				for(unsigned int p = 0; p < factor; ++p)
+					acc += in[n * factor + p];
+				out[n] = acc * scale;
+			}
+			break;
+		}
+		case kResamplerPolyphase:
+		{
+			unsigned int historyLength = getHistoryLength();
+			float* buf = &history[channel * historyStride];
+			memcpy(buf + historyLength, in, sizeof(in[0]) * inputFrames);
+			const float* h = filter.data();
+			unsigned int length = historyLength + 1;
+			for(unsigned int n = 0; n < outputFrames; ++n)
+			{
+				const float* x = buf + n * factor + factor - 1;
+				float acc = 0;
+				for(unsigned int j = 0; j < length; ++j)
+					acc += h[j] * x[j];
+				out[n] = acc;
+			}
+			memmove(buf, buf + inputFrames, sizeof(buf[0]) * historyLength);
+			break;
+		}
+	}
+}
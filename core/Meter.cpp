@@ -0,0 +1,322 @@
+/***** Meter.cpp *****/
+#include <Meter.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// the RMS is computed over this many seconds
+static const float kRmsWindow = 0.3;
+// the short-term loudness is computed over this many seconds
+static const float kShortTermWindow = 3;
+
+Meter::Meter() :
+	numChannels(0),
+	paddedChannels(0),
+	maxFrames(0),
+	truePeakEnabled(false),
+	numSlots(0),
+	rmsSlots(0),
+	slot(0),
+	filledSlots(0),
+	slotFrames(0),
+	slotCount(0),
+	frameCount(0),
+	sequence(0)
+{
+	memset(&snapshot, 0, sizeof(snapshot));
+}
+
+int Meter::setup(unsigned int newNumChannels, float sampleRate, unsigned int newMaxFrames,
+		float interval, bool enableTruePeak)
+{
+	if(newNumChannels < 1 || newNumChannels > kMaxMeterChannels || !newMaxFrames
+			|| sampleRate <= 0 || interval <= 0 || interval > kShortTermWindow)
+	{
+		fprintf(stderr, "Meter: invalid arguments\n");
+		return -1;
+	}
+	numChannels = newNumChannels;
+	paddedChannels = (numChannels + kLanes - 1) / kLanes * kLanes;
+	maxFrames = newMaxFrames;
+	truePeakEnabled = enableTruePeak;
+	input.assign((kTruePeakTaps - 1 + maxFrames) * paddedChannels, 0);
+	weighted.assign(maxFrames * paddedChannels, 0);
+	peak.assign(paddedChannels, 0);
+	truePeak.assign(paddedChannels, 0);
+	sum.assign(paddedChannels, 0);
+	weightedSum.assign(paddedChannels, 0);
+
+	slotFrames = interval * sampleRate + 0.5f;
+	if(slotFrames < 1)
+		slotFrames = 1;
+	numSlots = kShortTermWindow / interval + 0.5f;
+	rmsSlots = kRmsWindow / interval + 0.5f;
+	if(rmsSlots < 1)
+		rmsSlots = 1;
+	if(rmsSlots > numSlots)
+		rmsSlots = numSlots;
+	sumSlots.assign(numSlots * numChannels, 0);
+	weightedSumSlots.assign(numSlots * numChannels, 0);
+
+	// K-weighting filter (ITU-R BS.1770-4): a high shelf followed by a
+	// high pass, designed from their analog prototypes for this sample rate
+	float k[2 * BiquadCascade<float>::kCoefficients];
+	{
+		double f0 = 1681.974450955533;
+		double gain = 3.999843853973347;
+		double q = 0.7071752369554196;
+		double K = tan(M_PI * f0 / sampleRate);
+		double vh = pow(10, gain / 20);
+		double vb = pow(vh, 0.4996667741545416);
+		double a0 = 1 + K / q + K * K;
+		k[0] = (vh + vb * K / q + K * K) / a0;
+		k[1] = 2 * (K * K - vh) / a0;
+		k[2] = (vh - vb * K / q + K * K) / a0;
+		k[3] = 2 * (K * K - 1) / a0;
+		k[4] = (1 - K / q + K * K) / a0;
+	}
+	{
+		double f0 = 38.13547087602444;
+		double q = 0.5003270373238773;
+		double K = tan(M_PI * f0 / sampleRate);
+		double a0 = 1 + K / q + K * K;
+		k[5] = 1;
+		k[6] = -2;
+		k[7] = 1;
+		k[8] = 2 * (K * K - 1) / a0;
+		k[9] = (1 - K / q + K * K) / a0;
+	}
+	kWeighting.setup(2, paddedChannels, maxFrames);
+	kWeighting.setCoefficients(k);
+
+	// 4x interpolator for the true peak: the three phases between
+	// samples of a Hann-windowed sinc. The fourth phase is the sample itself.
+	for(unsigned int p = 0; p < 3; ++p)
+	{
+		float total = 0;
+		for(unsigned int j = 0; j < kTruePeakTaps; ++j)
+		{
+			// tap j multiplies the sample at (j - kTruePeakTaps / 2 + 1)
+			// from the sample before the interpolated position
+			float t = (p + 1) / 4.f - ((int)j - (int)kTruePeakTaps / 2 + 1);
+			float sinc = sinf(M_PI * t) / (M_PI * t);
+			float window = 0.5f + 0.5f * cosf(M_PI * t / (kTruePeakTaps / 2));
+			truePeakCoefficients[p][j] = sinc * window;
+			total += sinc * window;
+		}
+		for(unsigned int j = 0; j < kTruePeakTaps; ++j)
+			truePeakCoefficients[p][j] /= total;
+	}
+
+	reset();
+	return 0;
+}
+
+void Meter::reset()
+{
+	memset(input.data(), 0, sizeof(input[0]) * input.size());
+	kWeighting.reset();
+	memset(peak.data(), 0, sizeof(peak[0]) * peak.size());
+	memset(truePeak.data(), 0, sizeof(truePeak[0]) * truePeak.size());
+	memset(sum.data(), 0, sizeof(sum[0]) * sum.size());
+	memset(weightedSum.data(), 0, sizeof(weightedSum[0]) * weightedSum.size());
+	memset(sumSlots.data(), 0, sizeof(sumSlots[0]) * sumSlots.size());
+	memset(weightedSumSlots.data(), 0, sizeof(weightedSumSlots[0]) * weightedSumSlots.size());
+	slot = 0;
+	filledSlots = 0;
+	slotCount = 0;
+	frameCount = 0;
+}
+
+void Meter::processAudioIn(BelaContext* context)
+{
+	if(context->audioInChannels < numChannels)
+		return;
+	if(context->flags & BELA_FLAG_INTERLEAVED)
+		process(context->audioIn, context->audioFrames, 1, context->audioInChannels);
+	else
+		process(context->audioIn, context->audioFrames, context->audioFrames, 1);
+}
+
+void Meter::processAudioOut(BelaContext* context)
+{
+	if(context->audioOutChannels < numChannels)
+		return;
+	if(context->flags & BELA_FLAG_INTERLEAVED)
+		process(context->audioOut, context->audioFrames, 1, context->audioOutChannels);
+	else
+		process(context->audioOut, context->audioFrames, context->audioFrames, 1);
+}
+
+void Meter::process(const float* buffer, unsigned int frames, unsigned int channelStride, unsigned int frameStride)
+{
+	if(!numChannels)
+		return;
+	while(frames)
+	{
+		// do not go past maxFrames or the end of the update interval
+		unsigned int chunk = frames;
+		if(chunk > maxFrames)
+			chunk = maxFrames;
+		if(chunk > slotFrames - slotCount)
+			chunk = slotFrames - slotCount;
+		processChunk(buffer, chunk, channelStride, frameStride);
+		buffer += chunk * frameStride;
+		frames -= chunk;
+		frameCount += chunk;
+		slotCount += chunk;
+		if(slotCount == slotFrames)
+		{
+			slotCount = 0;
+			publish();
+		}
+	}
+}
+
+void Meter::processChunk(const float* buffer, unsigned int frames, unsigned int channelStride, unsigned int frameStride)
+{
+	const unsigned int history = kTruePeakTaps - 1;
+	const unsigned int pc = paddedChannels;
+	// gather the channels side by side, after the history
+	float* in = input.data() + history * pc;
+	for(unsigned int c = 0; c < numChannels; ++c)
+	{
+		const float* src = buffer + c * channelStride;
+		for(unsigned int n = 0; n < frames; ++n)
+			in[n * pc + c] = src[n * frameStride];
+	}
+
+	// sample peak and sum of squares
+	for(unsigned int g = 0; g < pc; g += kLanes)
+	{
+		float* __restrict__ p = &peak[g];
+		float* __restrict__ s = &sum[g];
+		for(unsigned int n = 0; n < frames; ++n)
+		{
+			const float* __restrict__ x = in + n * pc + g;
+			for(unsigned int l = 0; l < kLanes; ++l)
+			{
+				float a = fabsf(x[l]);
+				p[l] = a > p[l] ? a : p[l];
+				s[l] += x[l] * x[l];
+			}
+		}
+	}
+
+	// true peak: interpolate between the samples
+	if(truePeakEnabled)
+	{
+		for(unsigned int g = 0; g < pc; g += kLanes)
+		{
+			float* __restrict__ tp = &truePeak[g];
+			for(unsigned int n = 0; n < frames; ++n)
+			{
+				// the window ending with the current sample
+				const float* x = input.data() + n * pc + g;
+				for(unsigned int ph = 0; ph < 3; ++ph)
+				{
+					const float* h = truePeakCoefficients[ph];
+					float acc[kLanes] = {0};
+					for(unsigned int j = 0; j < kTruePeakTaps; ++j)
+					{
+						const float* __restrict__ xj = x + j * pc;
+						for(unsigned int l = 0; l < kLanes; ++l)
+							acc[l] += h[j] * xj[l];
+					}
+					for(unsigned int l = 0; l < kLanes; ++l)
+					{
+						float a = fabsf(acc[l]);
+						tp[l] = a > tp[l] ? a : tp[l];
+					}
+				}
+			}
+		}
+	}
+
+	// K-weighted sum of squares
+	memcpy(weighted.data(), in, sizeof(weighted[0]) * frames * pc);
+	kWeighting.processInterleaved(weighted.data(), frames);
+	for(unsigned int g = 0; g < pc; g += kLanes)
+	{
+		float* __restrict__ s = &weightedSum[g];
+		for(unsigned int n = 0; n < frames; ++n)
+		{
+			const float* __restrict__ y = &weighted[n * pc + g];
+			for(unsigned int l = 0; l < kLanes; ++l)
+				s[l] += y[l] * y[l];
+		}
+	}
+
+	// keep the last samples as history for the interpolator
+	memmove(input.data(), input.data() + frames * pc, sizeof(input[0]) * history * pc);
+}
+
+void Meter::publish()
+{
+	double* sums = &sumSlots[slot * numChannels];
+	double* weightedSums = &weightedSumSlots[slot * numChannels];
+	for(unsigned int c = 0; c < numChannels; ++c)
+	{
+		sums[c] = sum[c];
+		weightedSums[c] = weightedSum[c];
+	}
+	if(filledSlots < numSlots)
+		++filledSlots;
+
+	unsigned int s = sequence.load(std::memory_order_relaxed);
+	sequence.store(s + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	snapshot.frame = frameCount;
+	snapshot.numChannels = numChannels;
+	unsigned int rmsCount = filledSlots < rmsSlots ? filledSlots : rmsSlots;
+	for(unsigned int c = 0; c < numChannels; ++c)
+	{
+		double rmsSum = 0;
+		double loudnessSum = 0;
+		for(unsigned int n = 0; n < filledSlots; ++n)
+		{
+			unsigned int i = (slot + numSlots - n) % numSlots;
+			if(n < rmsCount)
+				rmsSum += sumSlots[i * numChannels + c];
+			loudnessSum += weightedSumSlots[i * numChannels + c];
+		}
+		MeterReading& r = snapshot.channels[c];
+		r.peak = peak[c];
+		r.truePeak = truePeakEnabled && truePeak[c] > peak[c] ? truePeak[c] : peak[c];
+		r.rms = sqrt(rmsSum / (rmsCount * slotFrames));
+		double meanSquare = loudnessSum / (filledSlots * slotFrames);
+		r.loudness = meanSquare > 0 ? -0.691 + 10 * log10(meanSquare) : kMeterMinLoudness;
+		if(r.loudness < kMeterMinLoudness)
+			r.loudness = kMeterMinLoudness;
+	}
+	sequence.store(s + 2, std::memory_order_release);
+
+	if(++slot >= numSlots)
+		slot = 0;
+	memset(peak.data(), 0, sizeof(peak[0]) * peak.size());
+	memset(truePeak.data(), 0, sizeof(truePeak[0]) * truePeak.size());
+	memset(sum.data(), 0, sizeof(sum[0]) * sum.size());
+	memset(weightedSum.data(), 0, sizeof(weightedSum[0]) * weightedSum.size());
+}
+
+unsigned int Meter::getSnapshot(MeterSnapshot& out)
+{
+	while(1)
+	{
+		unsigned int s = sequence.load(std::memory_order_acquire);
+		if(s & 1)
+			continue; // being written
+		memcpy(&out, &snapshot, sizeof(out));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(sequence.load(std::memory_order_relaxed) == s)
+			return s / 2;
+	}
+}
+
+float Meter::toDb(float linear)
+{
+	if(linear <= 0)
+		return kMeterMinLoudness;
+	float db = 20 * log10f(linear);
+	return db < kMeterMinLoudness ? kMeterMinLoudness : db;
+}
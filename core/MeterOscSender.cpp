@@ -0,0 +1,79 @@
+/***** MeterOscSender.cpp *****/
+#include <MeterOscSender.h>
+#include <stdio.h>
+
+MeterOscSender::MeterOscSender() :
+	meter(NULL),
+	lastSnapshot(0)
+{}
+
+int MeterOscSender::setup(Meter* newMeter, int port, const char* address, const char* path)
+{
+	if(!newMeter || !newMeter->getNumChannels())
+	{
+		fprintf(stderr, "MeterOscSender: the meter is not set up\n");
+		return -1;
+	}
+	meter = newMeter;
+	peakPath = std::string(path) + "/peak";
+	rmsPath = std::string(path) + "/rms";
+	truePeakPath = std::string(path) + "/truepeak";
+	loudnessPath = std::string(path) + "/loudness";
+	lastSnapshot = meter->getNumSnapshots();
+	// messages are sent straight away by our own thread
+	client.setup(port, address, false);
+	// task names have to be unique
+	static unsigned int instances = 0;
+	taskName = "bela-meter-osc-" + std::to_string(instances++);
+	task.create(taskName.c_str(), sendLoop, this);
+	return 0;
+}
+
+void MeterOscSender::update()
+{
+	if(!meter)
+		return;
+	unsigned int count = meter->getNumSnapshots();
+	if(count != lastSnapshot)
+	{
+		lastSnapshot = count;
+		task.schedule();
+	}
+}
+
+void MeterOscSender::sendLoop(void* arg)
+{
+	((MeterOscSender*)arg)->send();
+}
+
+void MeterOscSender::send()
+{
+	meter->getSnapshot(snapshot);
+	const std::string* paths[4] = {&peakPath, &rmsPath, &truePeakPath, &loudnessPath};
+	for(unsigned int k = 0; k < 4; ++k)
+	{
+		client.newMessage.to(*paths[k]);
+		for(unsigned int c = 0; c < snapshot.numChannels; ++c)
+		{
+			const MeterReading& r = snapshot.channels[c];
+			float value;
+			switch(k)
+			{
+			case 0:
+				value = Meter::toDb(r.peak);
+				break;
+			case 1:
+				value = Meter::toDb(r.rms);
+				break;
+			case 2:
+				value = Meter::toDb(r.truePeak);
+				break;
+			default:
+				value = r.loudness;
+				break;
+			}
+			client.newMessage.add(value);
+		}
+		client.sendMessageNow(client.newMessage.end());
+	}
+}
@@ -0,0 +1,282 @@
+/***** MultiplexerCapture.cpp *****/
+#include <MultiplexerCapture.h>
+#include <string.h>
+#include <stdio.h>
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+MultiplexerCapture::MultiplexerCapture() :
+	buffer(NULL),
+	times(NULL),
+	weights(NULL),
+	length(0),
+	cycleSize(0),
+	analogInChannels(0),
+	multiplexerChannels(0),
+	mode(kMultiplexerCaptureRaw),
+	written(0),
+	read(0),
+	current(NULL),
+	currentTime(0),
+	nextChannel(0),
+	nextFrame(0),
+	hasPrevious(false),
+	overruns(0),
+	discontinuities(0)
+{
+	raw[0] = raw[1] = NULL;
+}
+
+MultiplexerCapture::~MultiplexerCapture()
+{
+	cleanup();
+}
+
+int MultiplexerCapture::setup(BelaContext* context, unsigned int newLength, MultiplexerCaptureMode newMode)
+{
+	cleanup();
+	if(!context->multiplexerChannels || !context->multiplexerAnalogIn)
+	{
+		fprintf(stderr, "MultiplexerCapture: the multiplexer capelet is not enabled\n");
+		return -1;
+	}
+	if(context->analogFrames * 2 != context->audioFrames)
+	{
+		fprintf(stderr, "MultiplexerCapture: the analog inputs cannot be resampled to the audio rate\n");
+		return -1;
+	}
+	if(!newLength)
+		return -1;
+	length = newLength;
+	mode = newMode;
+	analogInChannels = context->analogInChannels;
+	multiplexerChannels = context->multiplexerChannels;
+	cycleSize = analogInChannels * multiplexerChannels;
+	buffer = new float[length * cycleSize];
+	times = new uint64_t[length];
+	raw[0] = new float[cycleSize];
+	raw[1] = new float[cycleSize];
+	weights = new float[cycleSize];
+	// the previous sample of multiplexer channel m was read M - m frames
+	// before the start of the cycle, and the current one m frames after it
+	for(unsigned int m = 0; m < multiplexerChannels; ++m)
+	{
+		for(unsigned int c = 0; c < analogInChannels; ++c)
+			weights[m * analogInChannels + c] = (multiplexerChannels - m) / (float)multiplexerChannels;
+	}
+	written = 0;
+	read = 0;
+	current = NULL;
+	hasPrevious = false;
+	overruns = 0;
+	discontinuities = 0;
+	return 0;
+}
+
+void MultiplexerCapture::cleanup()
+{
+	delete[] buffer;
+	delete[] times;
+	delete[] raw[0];
+	delete[] raw[1];
+	delete[] weights;
+	buffer = NULL;
+	times = NULL;
+	raw[0] = raw[1] = NULL;
+	weights = NULL;
+	length = 0;
+}
+
+// Copy consecutive frames of analog inputs to consecutive multiplexer
+// channels of a cycle. For interleaved buffers this is a straight copy,
+// otherwise the channels are transposed four frames and four channels at a time.
+static void demultiplexFrames(const float* in, unsigned int inFrames, bool interleaved,
+		unsigned int startFrame, unsigned int frames, unsigned int channels, float* out)
+{
+	if(interleaved)
+	{
+		memcpy(out, in + startFrame * channels, frames * channels * sizeof(float));
+		return;
+	}
+	unsigned int f = 0;
+#if defined(__ARM_NEON__) || defined(__SSE2__)
+	if((channels & 3) == 0)
+	{
+		for(; f + 4 <= frames; f += 4)
+		{
+			for(unsigned int c = 0; c < channels; c += 4)
+			{
+				const float* src = in + c * inFrames + startFrame + f;
+				float* dst = out + f * channels + c;
+#if defined(__ARM_NEON__)
+				float32x4x2_t t0 = vtrnq_f32(vld1q_f32(src), vld1q_f32(src + inFrames));
+				float32x4x2_t t1 = vtrnq_f32(vld1q_f32(src + 2 * inFrames), vld1q_f32(src + 3 * inFrames));
+				vst1q_f32(dst, vcombine_f32(vget_low_f32(t0.val[0]), vget_low_f32(t1.val[0])));
+				vst1q_f32(dst + channels, vcombine_f32(vget_low_f32(t0.val[1]), vget_low_f32(t1.val[1])));
+				vst1q_f32(dst + 2 * channels, vcombine_f32(vget_high_f32(t0.val[0]), vget_high_f32(t1.val[0])));
+				vst1q_f32(dst + 3 * channels, vcombine_f32(vget_high_f32(t0.val[1]), vget_high_f32(t1.val[1])));
+#else
+				__m128 r0 = _mm_loadu_ps(src);
+				__m128 r1 = _mm_loadu_ps(src + inFrames);
+				__m128 r2 = _mm_loadu_ps(src + 2 * inFrames);
+				__m128 r3 = _mm_loadu_ps(src + 3 * inFrames);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(dst, r0);
+				_mm_storeu_ps(dst + channels, r1);
+				_mm_storeu_ps(dst + 2 * channels, r2);
+				_mm_storeu_ps(dst + 3 * channels, r3);
+#endif
+			}
+		}
+	}
+#endif
+	for(; f < frames; ++f)
+	{
+		for(unsigned int c = 0; c < channels; ++c)
+			out[f * channels + c] = in[c * inFrames + startFrame + f];
+	}
+}
+
+// out = previous + (current - previous) * weights
+static void interpolateCycle(const float* previous, const float* current, const float* weights,
+		float* out, unsigned int size)
+{
+	unsigned int n = 0;
+#if defined(__ARM_NEON__)
+	for(; n + 4 <= size; n += 4)
+	{
+		float32x4_t p = vld1q_f32(previous + n);
+		vst1q_f32(out + n, vmlaq_f32(p, vsubq_f32(vld1q_f32(current + n), p), vld1q_f32(weights + n)));
+	}
+#elif defined(__SSE2__)
+	for(; n + 4 <= size; n += 4)
+	{
+		__m128 p = _mm_loadu_ps(previous + n);
+		__m128 d = _mm_sub_ps(_mm_loadu_ps(current + n), p);
+		_mm_storeu_ps(out + n, _mm_add_ps(p, _mm_mul_ps(d, _mm_loadu_ps(weights + n))));
+	}
+#endif
+	for(; n < size; ++n)
+		out[n] = previous[n] + (current[n] - previous[n]) * weights[n];
+}
+
+void MultiplexerCapture::startCycle(uint64_t time)
+{
+	currentTime = time;
+	if(mode == kMultiplexerCaptureInterpolated)
+	{
+		current = raw[0];
+		return;
+	}
+	// demultiplex straight into the ring buffer if there is space
+	uint64_t w = written.load(std::memory_order_relaxed);
+	if(w - read.load(std::memory_order_acquire) < length)
+		current = buffer + (w % length) * cycleSize;
+	else
+		current = raw[0];
+}
+
+void MultiplexerCapture::endCycle()
+{
+	uint64_t w = written.load(std::memory_order_relaxed);
+	if(mode == kMultiplexerCaptureInterpolated)
+	{
+		if(hasPrevious)
+		{
+			if(w - read.load(std::memory_order_acquire) < length)
+			{
+				interpolateCycle(raw[1], raw[0], weights, buffer + (w % length) * cycleSize, cycleSize);
+				times[w % length] = currentTime;
+				written.store(w + 1, std::memory_order_release);
+			} else {
+				++overruns;
+			}
+		}
+		float* tmp = raw[1];
+		raw[1] = raw[0];
+		raw[0] = tmp;
+		hasPrevious = true;
+	} else {
+		if(current != raw[0])
+		{
+			times[w % length] = currentTime;
+			written.store(w + 1, std::memory_order_release);
+		} else {
+			++overruns;
+		}
+	}
+	current = NULL;
+}
+
+void MultiplexerCapture::process(BelaContext* context)
+{
+	if(!buffer)
+		return;
+	unsigned int frames = context->analogFrames;
+	uint64_t blockStart = context->audioFramesElapsed * frames / context->audioFrames;
+	unsigned int channel = context->multiplexerStartingChannel;
+	if(current && (blockStart != nextFrame || channel != nextChannel))
+	{
+		// a block went missing in the middle of a cycle
+		++discontinuities;
+		current = NULL;
+		hasPrevious = false;
+	}
+	if(!current && blockStart != nextFrame)
+		hasPrevious = false;
+	bool interleaved = context->flags & BELA_FLAG_INTERLEAVED;
+	unsigned int frame = 0;
+	while(frame < frames)
+	{
+		unsigned int run = multiplexerChannels - channel;
+		if(run > frames - frame)
+			run = frames - frame;
+		if(channel == 0)
+			startCycle(blockStart + frame);
+		if(current)
+		{
+			demultiplexFrames(context->analogIn, frames, interleaved, frame, run,
+					analogInChannels, current + channel * analogInChannels);
+			if(channel + run == multiplexerChannels)
+				endCycle();
+		}
+		frame += run;
+		channel = (channel + run) % multiplexerChannels;
+	}
+	nextFrame = blockStart + frames;
+	nextChannel = channel;
+}
+
+unsigned int MultiplexerCapture::getAvailable()
+{
+	return written.load(std::memory_order_acquire) - read.load(std::memory_order_relaxed);
+}
+
+const float* MultiplexerCapture::getCycle(unsigned int n, uint64_t* time)
+{
+	unsigned int index = (read.load(std::memory_order_relaxed) + n) % length;
+	if(time)
+		*time = times[index];
+	return buffer + index * cycleSize;
+}
+
+void MultiplexerCapture::getRegions(const float** first, unsigned int* firstCycles, const float** second, unsigned int* secondCycles)
+{
+	unsigned int available = getAvailable();
+	unsigned int start = read.load(std::memory_order_relaxed) % length;
+	*firstCycles = available < length - start ? available : length - start;
+	*first = buffer + start * cycleSize;
+	*second = buffer;
+	*secondCycles = available - *firstCycles;
+}
+
+void MultiplexerCapture::consume(unsigned int cycles)
+{
+	unsigned int available = getAvailable();
+	if(cycles > available)
+		cycles = available;
+	read.store(read.load(std::memory_order_relaxed) + cycles, std::memory_order_release);
+}
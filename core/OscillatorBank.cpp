@@ -0,0 +1,519 @@
+/***** OscillatorBank.cpp *****/
+#include <OscillatorBank.h>
+#include <math.h>
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static int allocate(float** ptr, int length, const char* name)
+{
+	if(posix_memalign((void **)ptr, 16, length * sizeof(float))) {
+		fprintf(stderr, "Error allocating %s buffer\n", name);
+		return -1;
+	}
+	memset(*ptr, 0, length * sizeof(float));
+	return 0;
+}
+
+// Oscillator bank reading from the mipmaps: each oscillator
+// reads from its own table, starting at tableOffsets[n].
+// The same structure as oscillator_bank_neon() is retained: the outer loop
+// iterates over groups of 4 oscillators, the inner loop over the frames, with
+// the state of the 4 oscillators in vector registers. The 4 table reads of
+// each interpolation point are gathered into a vector, then the
+// interpolation and the phase, frequency and amplitude updates are done on
+// all 4 oscillators at once.
+template <bool cubic>
+static void oscillator_bank_tables(int numAudioFrames, float *audioOut,
+		int activePartialNum, int lookupTableSize,
+		float *phases, float *frequencies, float *amplitudes,
+		float *freqDerivatives, float *ampDerivatives,
+		const float *tables, const int* tableOffsets)
+{
+	for(int osc = 0; osc < activePartialNum; osc += 4)
+	{
+		const float* table[4];
+		for(int l = 0; l < 4; ++l)
+			table[l] = tables + tableOffsets[osc + l];
+#if defined(__ARM_NEON__)
+		float32x4_t phase = vld1q_f32(phases + osc);
+		float32x4_t freq = vld1q_f32(frequencies + osc);
+		float32x4_t amp = vld1q_f32(amplitudes + osc);
+		const float32x4_t dFreq = vld1q_f32(freqDerivatives + osc);
+		const float32x4_t dAmp = vld1q_f32(ampDerivatives + osc);
+		const float32x4_t size = vdupq_n_f32((float)lookupTableSize);
+		for(int n = 0; n < numAudioFrames; ++n)
+		{
+			int32x4_t index = vcvtq_s32_f32(phase);
+			float32x4_t t = vsubq_f32(phase, vcvtq_f32_s32(index));
+			int idx[4] __attribute__((aligned(16)));
+			vst1q_s32(idx, index);
+			const float* x[4] = { table[0] + idx[0], table[1] + idx[1], table[2] + idx[2], table[3] + idx[3] };
+			// gather the samples around each phase
+			float32x4_t x0 = vld1q_lane_f32(x[0], vdupq_n_f32(0), 0);
+			x0 = vld1q_lane_f32(x[1], x0, 1);
+			x0 = vld1q_lane_f32(x[2], x0, 2);
+			x0 = vld1q_lane_f32(x[3], x0, 3);
+			float32x4_t x1 = vld1q_lane_f32(x[0] + 1, vdupq_n_f32(0), 0);
+			x1 = vld1q_lane_f32(x[1] + 1, x1, 1);
+			x1 = vld1q_lane_f32(x[2] + 1, x1, 2);
+			x1 = vld1q_lane_f32(x[3] + 1, x1, 3);
+			float32x4_t value;
+			if(cubic)
+			{
+				float32x4_t xm1 = vld1q_lane_f32(x[0] - 1, vdupq_n_f32(0), 0);
+				xm1 = vld1q_lane_f32(x[1] - 1, xm1, 1);
+				xm1 = vld1q_lane_f32(x[2] - 1, xm1, 2);
+				xm1 = vld1q_lane_f32(x[3] - 1, xm1, 3);
+				float32x4_t x2 = vld1q_lane_f32(x[0] + 2, vdupq_n_f32(0), 0);
+				x2 = vld1q_lane_f32(x[1] + 2, x2, 1);
+				x2 = vld1q_lane_f32(x[2] + 2, x2, 2);
+				x2 = vld1q_lane_f32(x[3] + 2, x2, 3);
+				// 4-point, 3rd-order Hermite
+				float32x4_t c1 = vmulq_n_f32(vsubq_f32(x1, xm1), 0.5f);
+				float32x4_t c2 = vaddq_f32(vmlaq_n_f32(xm1, x0, -2.5f), vmlaq_n_f32(vmulq_n_f32(x1, 2.f), x2, -0.5f));
+				float32x4_t c3 = vmlaq_n_f32(vmulq_n_f32(vsubq_f32(x2, xm1), 0.5f), vsubq_f32(x0, x1), 1.5f);
+				value = vmlaq_f32(x0, vmlaq_f32(c1, vmlaq_f32(c2, c3, t), t), t);
+			} else {
+				value = vmlaq_f32(x0, t, vsubq_f32(x1, x0));
+			}
+			value = vmulq_f32(value, amp);
+			// horizontal sum
+			float32x2_t sum = vpadd_f32(vget_low_f32(value), vget_high_f32(value));
+			audioOut[n] += vget_lane_f32(vpadd_f32(sum, sum), 0);
+			phase = vaddq_f32(phase, freq);
+			freq = vaddq_f32(freq, dFreq);
+			amp = vaddq_f32(amp, dAmp);
+			// keep phases in table range
+			phase = vsubq_f32(phase, vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(phase, size), vreinterpretq_u32_f32(size))));
+		}
+		vst1q_f32(phases + osc, phase);
+		vst1q_f32(frequencies + osc, freq);
+		vst1q_f32(amplitudes + osc, amp);
+#elif defined(__SSE2__)
+		__m128 phase = _mm_load_ps(phases + osc);
+		__m128 freq = _mm_load_ps(frequencies + osc);
+		__m128 amp = _mm_load_ps(amplitudes + osc);
+		const __m128 dFreq = _mm_load_ps(freqDerivatives + osc);
+		const __m128 dAmp = _mm_load_ps(ampDerivatives + osc);
+		const __m128 size = _mm_set1_ps((float)lookupTableSize);
+		for(int n = 0; n < numAudioFrames; ++n)
+		{
+			__m128i index = _mm_cvttps_epi32(phase);
+			__m128 t = _mm_sub_ps(phase, _mm_cvtepi32_ps(index));
+			int idx[4] __attribute__((aligned(16)));
+			_mm_store_si128((__m128i*)idx, index);
+			const float* x[4] = { table[0] + idx[0], table[1] + idx[1], table[2] + idx[2], table[3] + idx[3] };
+			// gather the samples around each phase
+			__m128 x0 = _mm_setr_ps(x[0][0], x[1][0], x[2][0], x[3][0]);
+			__m128 x1 = _mm_setr_ps(x[0][1], x[1][1], x[2][1], x[3][1]);
+			__m128 value;
+			if(cubic)
+			{
+				__m128 xm1 = _mm_setr_ps(x[0][-1], x[1][-1], x[2][-1], x[3][-1]);
+				__m128 x2 = _mm_setr_ps(x[0][2], x[1][2], x[2][2], x[3][2]);
+				// 4-point, 3rd-order Hermite
+				__m128 c1 = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(x1, xm1));
+				__m128 c2 = _mm_add_ps(_mm_sub_ps(xm1, _mm_mul_ps(_mm_set1_ps(2.5f), x0)),
+						_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.f), x1), _mm_mul_ps(_mm_set1_ps(0.5f), x2)));
+				__m128 c3 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(x2, xm1)),
+						_mm_mul_ps(_mm_set1_ps(1.5f), _mm_sub_ps(x0, x1)));
+				value = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c3, t), c2), t), c1), t), x0);
+			} else {
+				value = _mm_add_ps(x0, _mm_mul_ps(t, _mm_sub_ps(x1, x0)));
+			}
+			value = _mm_mul_ps(value, amp);
+			// horizontal sum
+			value = _mm_add_ps(value, _mm_movehl_ps(value, value));
+			value = _mm_add_ss(value, _mm_shuffle_ps(value, value, 1));
+			audioOut[n] += _mm_cvtss_f32(value);
+			phase = _mm_add_ps(phase, freq);
+			freq = _mm_add_ps(freq, dFreq);
+			amp = _mm_add_ps(amp, dAmp);
+			// keep phases in table range
+			phase = _mm_sub_ps(phase, _mm_and_ps(_mm_cmpge_ps(phase, size), size));
+		}
+		_mm_store_ps(phases + osc, phase);
+		_mm_store_ps(frequencies + osc, freq);
+		_mm_store_ps(amplitudes + osc, amp);
+#else
+		const float size = lookupTableSize;
+		float phase[4];
+		float freq[4];
+		float amp[4];
+		for(int l = 0; l < 4; ++l)
+		{
+			phase[l] = phases[osc + l];
+			freq[l] = frequencies[osc + l];
+			amp[l] = amplitudes[osc + l];
+		}
+		const float* dFreq = freqDerivatives + osc;
+		const float* dAmp = ampDerivatives + osc;
+		for(int n = 0; n < numAudioFrames; ++n)
+		{
+			float sum = 0;
+			for(int l = 0; l < 4; ++l)
+			{
+				int index = (int)phase[l];
+				float t = phase[l] - index;
+				const float* x = table[l] + index;
+				float value;
+				if(cubic)
+				{
+					// 4-point, 3rd-order Hermite
+					float c1 = 0.5f * (x[1] - x[-1]);
+					float c2 = x[-1] - 2.5f * x[0] + 2.f * x[1] - 0.5f * x[2];
+					float c3 = 0.5f * (x[2] - x[-1]) + 1.5f * (x[0] - x[1]);
+					value = ((c3 * t + c2) * t + c1) * t + x[0];
+				} else {
+					value = x[0] + t * (x[1] - x[0]);
+				}
+				sum += value * amp[l];
+				phase[l] += freq[l];
+				freq[l] += dFreq[l];
+				amp[l] += dAmp[l];
+				phase[l] = phase[l] >= size ? phase[l] - size : phase[l];
+			}
+			audioOut[n] += sum;
+		}
+		for(int l = 0; l < 4; ++l)
+		{
+			phases[osc + l] = phase[l];
+			frequencies[osc + l] = freq[l];
+			amplitudes[osc + l] = amp[l];
+		}
+#endif
+	}
+}
+
+int OscillatorBank::init(int newWavetableLength, int newNumOscillators, float newSampleRate){
+	dealloc();
+	wavetableLength = newWavetableLength;
+	numOscillators = newNumOscillators;
+	// the inner loop works on groups of 4 oscillators
+	paddedOscillators = (numOscillators + 3) & ~3;
+	sampleRate = newSampleRate;
+	// Initialise the sine wavetable
+	if(posix_memalign((void **)&wavetable, 8, (wavetableLength + 1) * sizeof(float))) {
+		fprintf(stderr, "Error allocating wavetable\n");
+		return -1;
+	}
+
+	// Allocate the other buffers
+	if(allocate(&phases, paddedOscillators, "phase")
+		|| allocate(&frequencies, paddedOscillators, "frequency")
+		|| allocate(&amplitudes, paddedOscillators, "amplitude")
+		|| allocate(&dFrequencies, paddedOscillators, "frequency derivative")
+		|| allocate(&dAmplitudes, paddedOscillators, "amplitude derivative")
+		|| allocate(&activePhases, paddedOscillators, "active phase")
+		|| allocate(&activeFrequencies, paddedOscillators, "active frequency")
+		|| allocate(&activeAmplitudes, paddedOscillators, "active amplitude")
+		|| allocate(&activeDFrequencies, paddedOscillators, "active frequency derivative")
+		|| allocate(&activeDAmplitudes, paddedOscillators, "active amplitude derivative"))
+		return -1;
+	if(posix_memalign((void **)&activeIndices, 16, paddedOscillators * sizeof(int))) {
+		fprintf(stderr, "Error allocating active index buffer\n");
+		return -1;
+	}
+	if(posix_memalign((void **)&tableOffsets, 16, paddedOscillators * sizeof(int))) {
+		fprintf(stderr, "Error allocating table offset buffer\n");
+		return -1;
+	}
+	clearArrays();
+	return 0;
+}
+
+void OscillatorBank::dealloc(){
+	free(wavetable);
+	free(phases);
+	free(frequencies);
+	free(amplitudes);
+	free(dFrequencies);
+	free(dAmplitudes);
+	free(activeIndices);
+	free(activePhases);
+	free(activeFrequencies);
+	free(activeAmplitudes);
+	free(activeDFrequencies);
+	free(activeDAmplitudes);
+	free(mipmaps);
+	free(tableOffsets);
+	mipmaps = NULL;
+	tableOffsets = NULL;
+	numMipmaps = 0;
+	wavetable = phases = frequencies = amplitudes = dFrequencies = dAmplitudes = NULL;
+	activePhases = activeFrequencies = activeAmplitudes = activeDFrequencies = activeDAmplitudes = NULL;
+	activeIndices = NULL;
+}
+
+int OscillatorBank::generateMipmaps(int maxMipmaps){
+	int length = wavetableLength;
+	int harmonics = length / 2;
+	int levels = 0;
+	while((harmonics >> levels) >= 1)
+		++levels;
+	if(maxMipmaps > 0 && maxMipmaps < levels)
+		levels = maxMipmaps;
+	float* newMipmaps;
+	int stride = length + 3;
+	if(posix_memalign((void **)&newMipmaps, 16, levels * stride * sizeof(float))) {
+		fprintf(stderr, "Error allocating mipmaps\n");
+		return -1;
+	}
+	// analyse the wavetable
+	float* cosTable = new float[length];
+	float* sinTable = new float[length];
+	float* re = new float[harmonics + 1];
+	float* im = new float[harmonics + 1];
+	for(int n = 0; n < length; ++n)
+	{
+		cosTable[n] = cos(2 * M_PI * n / length);
+		sinTable[n] = sin(2 * M_PI * n / length);
+	}
+	for(int h = 0; h <= harmonics; ++h)
+	{
+		double r = 0;
+		double i = 0;
+		for(int n = 0; n < length; ++n)
+		{
+			int idx = (int)(((long long)h * n) % length);
+			r += wavetable[n] * cosTable[idx];
+			i += wavetable[n] * sinTable[idx];
+		}
+		re[h] = r;
+		im[h] = i;
+	}
+	for(int k = 0; k < levels; ++k)
+	{
+		float* table = newMipmaps + k * stride + 1;
+		if(k == 0)
+		{
+			// the full-band table is the wavetable itself
+			memcpy(table, wavetable, length * sizeof(float));
+		} else {
+			// resynthesise with the harmonics that do not alias
+			// for frequencies up to 2^k samples per sample
+			int maxHarmonic = harmonics >> k;
+			for(int n = 0; n < length; ++n)
+			{
+				double sum = re[0];
+				for(int h = 1; h <= maxHarmonic; ++h)
+				{
+					int idx = (int)(((long long)h * n) % length);
+					sum += 2 * (re[h] * cosTable[idx] + im[h] * sinTable[idx]);
+				}
+				table[n] = sum / length;
+			}
+		}
+		// guard points, so that the interpolation never has to wrap
+		table[-1] = table[length - 1];
+		table[length] = table[0];
+		table[length + 1] = table[1];
+	}
+	delete[] cosTable;
+	delete[] sinTable;
+	delete[] re;
+	delete[] im;
+	free(mipmaps);
+	mipmaps = newMipmaps;
+	numMipmaps = levels;
+	return 0;
+}
+
+void OscillatorBank::disableMipmaps(){
+	free(mipmaps);
+	mipmaps = NULL;
+	numMipmaps = 0;
+}
+
+int OscillatorBank::prepare(int frames){
+	numActive = 0;
+	for(int n = 0; n < numOscillators; ++n)
+	{
+		if(amplitudes[n] != 0 || dAmplitudes[n] != 0)
+			activeIndices[numActive++] = n;
+	}
+	// When (almost) all the oscillators are active, compacting
+	// them would only add overhead.
+	compacted = numActive < paddedOscillators - 4;
+	if(!compacted)
+	{
+		computeTableOffsets(frequencies, paddedOscillators);
+		return paddedOscillators;
+	}
+
+	float tableLength = wavetableLength;
+	float frameSum = frames * (frames - 1) * 0.5f;
+	int active = 0;
+	for(int n = 0; n < numOscillators; ++n)
+	{
+		if(active < numActive && activeIndices[active] == n)
+		{
+			activePhases[active] = phases[n];
+			activeFrequencies[active] = frequencies[n];
+			activeAmplitudes[active] = amplitudes[n];
+			activeDFrequencies[active] = dFrequencies[n];
+			activeDAmplitudes[active] = dAmplitudes[n];
+			++active;
+		} else {
+			// silent: only advance the phase as the inner loop would
+			float phase = phases[n] + frames * frequencies[n] + frameSum * dFrequencies[n];
+			phases[n] = phase - floorf(phase / tableLength) * tableLength;
+			frequencies[n] += frames * dFrequencies[n];
+		}
+	}
+	// pad to a multiple of 4 with silent oscillators
+	int padded = (numActive + 3) & ~3;
+	for(int n = numActive; n < padded; ++n)
+	{
+		activePhases[n] = 0;
+		activeFrequencies[n] = 0;
+		activeAmplitudes[n] = 0;
+		activeDFrequencies[n] = 0;
+		activeDAmplitudes[n] = 0;
+	}
+	computeTableOffsets(activeFrequencies, padded);
+	return padded;
+}
+
+void OscillatorBank::computeTableOffsets(const float* freqs, int count){
+	if(!numMipmaps)
+		return;
+	int stride = wavetableLength + 3;
+	for(int n = 0; n < count; ++n)
+	{
+		// mipmap k does not alias up to 2^k table samples per output sample
+		float f = fabsf(freqs[n]);
+		int level = f <= 1 ? 0 : (int)ceilf(log2f(f));
+		if(level >= numMipmaps)
+			level = numMipmaps - 1;
+		tableOffsets[n] = level * stride + 1;
+	}
+}
+
+void OscillatorBank::processChunk(int frames, float* output, int begin, int end){
+	if(end <= begin)
+		return;
+	float* p = compacted ? activePhases : phases;
+	float* f = compacted ? activeFrequencies : frequencies;
+	float* a = compacted ? activeAmplitudes : amplitudes;
+	float* df = compacted ? activeDFrequencies : dFrequencies;
+	float* da = compacted ? activeDAmplitudes : dAmplitudes;
+	if(numMipmaps)
+	{
+		if(kOscillatorBankCubic == interpolation)
+			oscillator_bank_tables<true>(frames, output, end - begin, wavetableLength,
+					p + begin, f + begin, a + begin, df + begin, da + begin,
+					mipmaps, tableOffsets + begin);
+		else
+			oscillator_bank_tables<false>(frames, output, end - begin, wavetableLength,
+					p + begin, f + begin, a + begin, df + begin, da + begin,
+					mipmaps, tableOffsets + begin);
+		return;
+	}
+#ifdef __ARM_NEON__
+	oscillator_bank_neon(frames, output,
+#else
+	oscillator_bank_portable(frames, output,
+#endif /* __ARM_NEON__ */
+			end - begin, wavetableLength,
+			p + begin, f + begin, a + begin,
+			df + begin, da + begin,
+			wavetable);
+}
+
+void OscillatorBank::finish(){
+	if(!compacted)
+		return;
+	for(int n = 0; n < numActive; ++n)
+	{
+		int idx = activeIndices[n];
+		phases[idx] = activePhases[n];
+		frequencies[idx] = activeFrequencies[n];
+		amplitudes[idx] = activeAmplitudes[n];
+	}
+}
+
+void oscillator_bank_portable(int numAudioFrames, float *audioOut,
+		int activePartialNum, int lookupTableSize,
+		float *phases, float *frequencies, float *amplitudes,
+		float *freqDerivatives, float *ampDerivatives,
+		float *lookupTable)
+{
+	// Same structure as the NEON routine: the outer loop iterates over
+	// groups of 4 oscillators, the inner loop over the frames, with the state
+	// of the 4 oscillators in registers.
+	for(int osc = 0; osc < activePartialNum; osc += 4)
+	{
+#ifdef __SSE2__
+		__m128 phase = _mm_load_ps(phases + osc);
+		__m128 freq = _mm_load_ps(frequencies + osc);
+		__m128 amp = _mm_load_ps(amplitudes + osc);
+		const __m128 dFreq = _mm_load_ps(freqDerivatives + osc);
+		const __m128 dAmp = _mm_load_ps(ampDerivatives + osc);
+		const __m128 size = _mm_set1_ps((float)lookupTableSize);
+		for(int n = 0; n < numAudioFrames; ++n)
+		{
+			__m128i index = _mm_cvttps_epi32(phase);
+			__m128 fraction = _mm_sub_ps(phase, _mm_cvtepi32_ps(index));
+			int idx[4] __attribute__((aligned(16)));
+			_mm_store_si128((__m128i*)idx, index);
+			// gather the samples before and after each phase
+			__m128 before = _mm_setr_ps(lookupTable[idx[0]], lookupTable[idx[1]], lookupTable[idx[2]], lookupTable[idx[3]]);
+			__m128 after = _mm_setr_ps(lookupTable[idx[0] + 1], lookupTable[idx[1] + 1], lookupTable[idx[2] + 1], lookupTable[idx[3] + 1]);
+			__m128 sample = _mm_add_ps(before, _mm_mul_ps(fraction, _mm_sub_ps(after, before)));
+			sample = _mm_mul_ps(sample, amp);
+			// horizontal sum
+			sample = _mm_add_ps(sample, _mm_movehl_ps(sample, sample));
+			sample = _mm_add_ss(sample, _mm_shuffle_ps(sample, sample, 1));
+			audioOut[n] += _mm_cvtss_f32(sample);
+			phase = _mm_add_ps(phase, freq);
+			freq = _mm_add_ps(freq, dFreq);
+			amp = _mm_add_ps(amp, dAmp);
+			// keep phases in table range
+			phase = _mm_sub_ps(phase, _mm_and_ps(_mm_cmpge_ps(phase, size), size));
+		}
+		_mm_store_ps(phases + osc, phase);
+		_mm_store_ps(frequencies + osc, freq);
+		_mm_store_ps(amplitudes + osc, amp);
+#else /* __SSE2__ */
+		float phase[4];
+		float freq[4];
+		float amp[4];
+		for(int l = 0; l < 4; ++l)
+		{
+			phase[l] = phases[osc + l];
+			freq[l] = frequencies[osc + l];
+			amp[l] = amplitudes[osc + l];
+		}
+		const float* dFreq = freqDerivatives + osc;
+		const float* dAmp = ampDerivatives + osc;
+		for(int n = 0; n < numAudioFrames; ++n)
+		{
+			float sum = 0;
+			for(int l = 0; l < 4; ++l)
+			{
+				int index = (int)phase[l];
+				float fraction = phase[l] - index;
+				float before = lookupTable[index];
+				float after = lookupTable[index + 1];
+				sum += (before + fraction * (after - before)) * amp[l];
+				phase[l] += freq[l];
+				freq[l] += dFreq[l];
+				amp[l] += dAmp[l];
+				if(phase[l] >= lookupTableSize)
+					phase[l] -= lookupTableSize;
+			}
+			audioOut[n] += sum;
+		}
+		for(int l = 0; l < 4; ++l)
+		{
+			phases[osc + l] = phase[l];
+			frequencies[osc + l] = freq[l];
+			amplitudes[osc + l] = amp[l];
+		}
+#endif /* __SSE2__ */
+	}
+}
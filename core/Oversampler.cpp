@@ -0,0 +1,385 @@
+/***** Oversampler.cpp *****/
+#include <Oversampler.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The filters of the 2x stages, from the original rate upwards. The first
+// stage passes up to 0.45 of its input rate; the next ones only have to
+// reject the images of the original band, which is at most a quarter and an
+// eighth of their input rates.
+// kOversamplerFir: half the number of non-zero coefficients, besides the central one
+static const unsigned int kFirHalfTaps[Oversampler::kMaxStages] = { 32, 8, 6 };
+// the Kaiser window, for an attenuation of about 95dB
+static const double kFirKaiserBeta = 9.5;
+// kOversamplerIir: the number of allpass coefficients and the transition
+// bandwidth, relative to the higher rate
+static const unsigned int kIirCoefficients[Oversampler::kMaxStages] = { 10, 6, 5 };
+static const double kIirTransition[Oversampler::kMaxStages] = { 0.025, 0.125, 0.1875 };
+
+// Modified Bessel function of the first kind, order 0
+static double besselI0(double x)
+{
+	double sum = 1;
+	double term = 1;
+	for(unsigned int k = 1; k < 50; ++k)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if(term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+// The coefficients of a half-band filter made of two chains of first-order
+// allpass filters, with an elliptic response, from:
+// Valenzuela and Constantinides, "Digital signal processing schemes for
+// efficient interpolation and decimation", IEE Proceedings G, 1983.
+static void computeAllpassCoefficients(float* coefficients, unsigned int numCoefficients, double transition)
+{
+	double k = tan((1 - transition * 2) * M_PI / 4);
+	k *= k;
+	double kSqrt = pow(1 - k * k, 0.25);
+	double e = 0.5 * (1 - kSqrt) / (1 + kSqrt);
+	double e2 = e * e;
+	double e4 = e2 * e2;
+	double q = e * (1 + e4 * (2 + e4 * (15 + 150 * e4)));
+	unsigned int order = numCoefficients * 2 + 1;
+	for(unsigned int n = 0; n < numCoefficients; ++n)
+	{
+		unsigned int c = n + 1;
+		// the series of the elliptic functions converge very quickly
+		double num = 0;
+		int sign = 1;
+		for(unsigned int i = 0; i < 20; ++i)
+		{
+			num += pow(q, i * (i + 1)) * sin((i * 2 + 1) * c * M_PI / order) * sign;
+			sign = -sign;
+		}
+		double den = 0;
+		sign = -1;
+		for(unsigned int i = 1; i < 20; ++i)
+		{
+			den += pow(q, i * i) * cos(i * 2 * c * M_PI / order) * sign;
+			sign = -sign;
+		}
+		double ww = num * pow(q, 0.25) / (den + 0.5);
+		ww *= ww;
+		double x = sqrt((1 - ww * k) * (1 - ww / k)) / (1 + ww);
+		coefficients[n] = (1 - x) / (1 + x);
+	}
+}
+
+Oversampler::Oversampler() :
+	numStages(0),
+	numChannels(0),
+	factor(1),
+	maxFrames(0),
+	filter(kOversamplerFir),
+	latency(0),
+	stateSize(0)
+{
+	for(unsigned int s = 0; s < kMaxStages; ++s)
+	{
+		stages[s].halfTaps = 0;
+		stages[s].upState = 0;
+		stages[s].downState = 0;
+	}
+}
+
+int Oversampler::setup(unsigned int newNumChannels, unsigned int newFactor, unsigned int newMaxFrames,
+		OversamplerFilter newFilter)
+{
+	numStages = 0;
+	while((1u << numStages) < newFactor && numStages < kMaxStages)
+		++numStages;
+	if((1u << numStages) != newFactor || !newNumChannels || !newMaxFrames)
+	{
+		fprintf(stderr, "Oversampler: invalid factor %u, number of channels %u or of frames %u\n",
+				newFactor, newNumChannels, newMaxFrames);
+		numChannels = 0;
+		return -1;
+	}
+	numChannels = newNumChannels;
+	factor = newFactor;
+	maxFrames = newMaxFrames;
+	filter = newFilter;
+
+	stateSize = 0;
+	latency = 0;
+	unsigned int maxHistory = 0;
+	for(unsigned int s = 0; s < numStages; ++s)
+	{
+		Stage& stage = stages[s];
+		stage.upState = stateSize;
+		if(kOversamplerFir == filter)
+		{
+			// a half-band filter with 4 * K - 1 coefficients, whose central
+			// one is 0.5 and the others at an even distance from it are 0:
+			// keep the other polyphase component
+			unsigned int K = kFirHalfTaps[s];
+			stage.halfTaps = K;
+			stage.coefficients.resize(2 * K);
+			unsigned int length = 4 * K - 1;
+			double center = 2 * K - 1;
+			double i0Beta = besselI0(kFirKaiserBeta);
+			double sum = 0;
+			for(unsigned int j = 0; j < 2 * K; ++j)
+			{
+				double x = (2 * j - center) / 2;
+				double w = (2 * j - center) / (length + 1) * 2;
+				double window = besselI0(kFirKaiserBeta * sqrt(1 - w * w)) / i0Beta;
+				stage.coefficients[j] = sin(M_PI * x) / (M_PI * x) * window;
+				sum += stage.coefficients[j];
+			}
+			// this component sums to 0.5, as the central coefficient does
+			for(unsigned int j = 0; j < 2 * K; ++j)
+				stage.coefficients[j] *= 0.5 / sum;
+			// the upsampler keeps the last 2K - 1 input samples, the
+			// downsampler the last 2K - 1 even and K odd input samples
+			stateSize += 2 * K - 1;
+			stage.downState = stateSize;
+			stateSize += 3 * K - 1;
+			if(3 * K > maxHistory)
+				maxHistory = 3 * K;
+			// each filter delays by 2K - 1 samples at the higher rate
+			latency += (2 * K - 1) / (float)(1 << s);
+		}
+		else
+		{
+			unsigned int numCoefficients = kIirCoefficients[s];
+			stage.halfTaps = 0;
+			stage.coefficients.resize(numCoefficients);
+			computeAllpassCoefficients(stage.coefficients.data(), numCoefficients, kIirTransition[s]);
+			// an input and an output sample for each allpass, see allpassPairs()
+			stateSize += 2 * numCoefficients;
+			stage.downState = stateSize;
+			stateSize += 2 * numCoefficients;
+			// the delay of the allpass chains at DC, at the lower rate: each
+			// first-order allpass delays by (1 - a) / (1 + a), and the second
+			// polyphase component is delayed by half a sample
+			float delay = 0.25;
+			for(unsigned int n = 0; n < numCoefficients; ++n)
+			{
+				float a = stage.coefficients[n];
+				delay += 0.5f * (1 - a) / (1 + a);
+			}
+			// upsampling and downsampling, minus the half sample between
+			// the polyphase components of the downsampler
+			latency += (4 * delay - 1) / (float)(1 << (s + 1));
+		}
+	}
+	state.assign(numChannels * stateSize, 0);
+	oversampled.assign(numChannels * maxFrames * factor, 0);
+	stageBuffer.assign(2 * maxFrames * factor, 0);
+	work.assign(maxHistory + maxFrames * factor, 0);
+	scratch.assign(maxFrames * factor, 0);
+	return 0;
+}
+
+void Oversampler::reset()
+{
+	state.assign(state.size(), 0);
+}
+
+float* Oversampler::upsample(unsigned int channel, const float* in, unsigned int frames)
+{
+	if(channel >= numChannels || frames > maxFrames)
+		return NULL;
+	float* out = oversampled.data() + channel * maxFrames * factor;
+	if(!numStages)
+	{
+		memcpy(out, in, frames * sizeof(out[0]));
+		return out;
+	}
+	float* channelState = state.data() + channel * stateSize;
+	const float* stageIn = in;
+	for(unsigned int s = 0; s < numStages; ++s)
+	{
+		// the intermediate stages alternate between the two halves of stageBuffer
+		float* stageOut = s + 1 == numStages ? out : stageBuffer.data() + (s & 1) * maxFrames * factor;
+		if(kOversamplerFir == filter)
+			upsampleFir(stages[s], channelState + stages[s].upState, stageIn, frames << s, stageOut);
+		else
+			upsampleIir(stages[s], channelState + stages[s].upState, stageIn, frames << s, stageOut);
+		stageIn = stageOut;
+	}
+	return out;
+}
+
+void Oversampler::downsample(unsigned int channel, const float* in, float* out, unsigned int frames)
+{
+	if(channel >= numChannels || frames > maxFrames)
+		return;
+	if(!numStages)
+	{
+		memmove(out, in, frames * sizeof(out[0]));
+		return;
+	}
+	float* channelState = state.data() + channel * stateSize;
+	const float* stageIn = in;
+	for(int s = numStages - 1; s >= 0; --s)
+	{
+		float* stageOut = 0 == s ? out : stageBuffer.data() + (s & 1) * maxFrames * factor;
+		if(kOversamplerFir == filter)
+			downsampleFir(stages[s], channelState + stages[s].downState, stageIn, frames << s, stageOut);
+		else
+			downsampleIir(stages[s], channelState + stages[s].downState, stageIn, frames << s, stageOut);
+		stageIn = stageOut;
+	}
+}
+
+void Oversampler::upsampleFir(Stage& stage, float* stageState, const float* in, unsigned int frames, float* out)
+{
+	// out[2m] = 2 * sum_j(g[j] * in[m - j]), out[2m + 1] = in[m - K + 1]
+	unsigned int K = stage.halfTaps;
+	unsigned int history = 2 * K - 1;
+	float* w = work.data();
+	memcpy(w, stageState, history * sizeof(w[0]));
+	memcpy(w + history, in, frames * sizeof(w[0]));
+	float* __restrict__ even = scratch.data();
+	memset(even, 0, frames * sizeof(even[0]));
+	const float* g = stage.coefficients.data();
+	// one tap at a time over the whole block: this is vectorised
+	for(unsigned int j = 0; j < 2 * K; ++j)
+	{
+		float c = 2.f * g[j];
+		const float* __restrict__ x = w + history - j;
+		for(unsigned int m = 0; m < frames; ++m)
+			even[m] += c * x[m];
+	}
+	const float* odd = w + K;
+	for(unsigned int m = 0; m < frames; ++m)
+	{
+		out[2 * m] = even[m];
+		out[2 * m + 1] = odd[m];
+	}
+	memcpy(stageState, w + frames, history * sizeof(w[0]));
+}
+
+void Oversampler::downsampleFir(Stage& stage, float* stageState, const float* in, unsigned int frames, float* out)
+{
+	// out[m] = sum_j(g[j] * in[2m - 2j]) + 0.5 * in[2m - 2K + 1]
+	unsigned int K = stage.halfTaps;
+	unsigned int evenHistory = 2 * K - 1;
+	float* even = work.data();
+	float* odd = even + evenHistory + frames;
+	memcpy(even, stageState, evenHistory * sizeof(even[0]));
+	memcpy(odd, stageState + evenHistory, K * sizeof(odd[0]));
+	for(unsigned int m = 0; m < frames; ++m)
+	{
+		even[evenHistory + m] = in[2 * m];
+		odd[K + m] = in[2 * m + 1];
+	}
+	float* __restrict__ acc = scratch.data();
+	for(unsigned int m = 0; m < frames; ++m)
+		acc[m] = 0.5f * odd[m];
+	const float* g = stage.coefficients.data();
+	for(unsigned int j = 0; j < 2 * K; ++j)
+	{
+		float c = g[j];
+		const float* __restrict__ x = even + evenHistory - j;
+		for(unsigned int m = 0; m < frames; ++m)
+			acc[m] += c * x[m];
+	}
+	memcpy(stageState, even + frames, evenHistory * sizeof(even[0]));
+	memcpy(stageState + evenHistory, odd + frames, K * sizeof(odd[0]));
+	memcpy(out, acc, frames * sizeof(out[0]));
+}
+
+// A first-order allpass in z^-2 at the higher rate, which is z^-1 at the lower rate
+static inline float allpass(float x, float a, float* stageState)
+{
+	float y = a * (x - stageState[1]) + stageState[0];
+	stageState[0] = x;
+	stageState[1] = y;
+	return y;
+}
+
+// The allpass chains of the two polyphase components, side by side: the
+// even coefficients make the first component, the odd ones the second.
+// Coefficients 2p and 2p + 1 are processed together, with the state
+// { x first, x second, y first, y second } at 4p. With an odd number of
+// coefficients, the last one is in the first component only, and its
+// state { x, y } follows the pairs.
+static inline void allpassPairs(const float* a, unsigned int numCoefficients, float* stageState, float& first, float& second)
+{
+	unsigned int numPairs = numCoefficients / 2;
+#if defined(__ARM_NEON__)
+	float32x2_t x = vset_lane_f32(second, vdup_n_f32(first), 1);
+	for(unsigned int p = 0; p < numPairs; ++p)
+	{
+		float* s = stageState + 4 * p;
+		float32x2_t y = vmla_f32(vld1_f32(s), vld1_f32(a + 2 * p), vsub_f32(x, vld1_f32(s + 2)));
+		vst1_f32(s, x);
+		vst1_f32(s + 2, y);
+		x = y;
+	}
+	first = vget_lane_f32(x, 0);
+	second = vget_lane_f32(x, 1);
+#elif defined(__SSE2__)
+	// the two lower lanes are used
+	__m128 x = _mm_setr_ps(first, second, 0, 0);
+	for(unsigned int p = 0; p < numPairs; ++p)
+	{
+		float* s = stageState + 4 * p;
+		__m128 x1 = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)s);
+		__m128 y1 = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(s + 2));
+		__m128 c = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(a + 2 * p));
+		__m128 y = _mm_add_ps(_mm_mul_ps(c, _mm_sub_ps(x, y1)), x1);
+		_mm_storel_pi((__m64*)s, x);
+		_mm_storel_pi((__m64*)(s + 2), y);
+		x = y;
+	}
+	first = _mm_cvtss_f32(x);
+	second = _mm_cvtss_f32(_mm_shuffle_ps(x, x, 1));
+#else
+	for(unsigned int p = 0; p < numPairs; ++p)
+	{
+		float* s = stageState + 4 * p;
+		float y0 = a[2 * p] * (first - s[2]) + s[0];
+		float y1 = a[2 * p + 1] * (second - s[3]) + s[1];
+		s[0] = first;
+		s[1] = second;
+		s[2] = y0;
+		s[3] = y1;
+		first = y0;
+		second = y1;
+	}
+#endif
+	if(numCoefficients & 1)
+		first = allpass(first, a[numCoefficients - 1], stageState + 4 * numPairs);
+}
+
+void Oversampler::upsampleIir(Stage& stage, float* stageState, const float* in, unsigned int frames, float* out)
+{
+	unsigned int numCoefficients = stage.coefficients.size();
+	const float* a = stage.coefficients.data();
+	for(unsigned int m = 0; m < frames; ++m)
+	{
+		float first = in[m];
+		float second = in[m];
+		allpassPairs(a, numCoefficients, stageState, first, second);
+		out[2 * m] = first;
+		out[2 * m + 1] = second;
+	}
+}
+
+void Oversampler::downsampleIir(Stage& stage, float* stageState, const float* in, unsigned int frames, float* out)
+{
+	unsigned int numCoefficients = stage.coefficients.size();
+	const float* a = stage.coefficients.data();
+	for(unsigned int m = 0; m < frames; ++m)
+	{
+		float first = in[2 * m + 1];
+		float second = in[2 * m];
+		allpassPairs(a, numCoefficients, stageState, first, second);
+		out[m] = 0.5f * (first + second);
+	}
+}
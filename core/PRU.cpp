@@ -397,6 +397,10 @@ void PRU::cleanupGPIO()
 int PRU::initialise(BelaHw newBelaHw, int pru_num, bool uniformSampleRate, int mux_channels, bool capeButtonMonitoring, bool enableLed)
 {
 	belaHw = newBelaHw;
+	// On Salt, the analog outputs are inverted and scaled in loop() before
+	// they are smoothed: the targets have to go through the same transform
+	if(belaHw == BelaHw_Salt)
+		analog_out_smoothing.setTransform(-0.93f, 0.93f);
 	// Initialise the GPIO pins, including possibly the digital pins in the render routines
 	if(prepareGPIO(enableLed)) {
 		fprintf(stderr, "Error: unable to prepare GPIO for PRU audio\n");
@@ -1022,6 +1026,9 @@ void PRU::loop(void *userData, void(*render)(BelaContext*, void*), bool highPerf
 				}
 			}
 			
+			// whether the audio expander filter and the Salt inversion have been
+			// applied during the format conversion
+			bool analogInFused = false;
 #ifdef USE_NEON_FORMAT_CONVERSION
 			// TODO: add support for different analogs_per_audio ratios
 			int16_to_float_analog(context->analogInChannels * context->analogFrames, 
@@ -1061,29 +1068,12 @@ void PRU::loop(void *userData, void(*render)(BelaContext*, void*), bool highPerf
 			}
 			else if (!uniform_sample_rate || analogs_per_audio == 1)
 			{
-				if(interleaved)
-				{
-					for(unsigned int n = 0;
-						n < context->analogInChannels * context->analogFrames;
-						++n)
-					{
-						float value = (float)analogInRaw[n] / 65536.0f;
-						context->analogIn[n] = value;
-					}
-				}
-				else
-				{
-					for(unsigned int f = 0; f < context->analogFrames; ++f)
-					{
-						for(unsigned int c = 0; c < context->analogInChannels; ++c)
-						{
-							unsigned int srcIdx = context->analogInChannels * f + c;
-							unsigned int dstIdx = context->analogFrames * c + f;
-							float value = (float)analogInRaw[srcIdx] / 65536.0f;
-							context->analogIn[dstIdx] = value;
-						}
-					}
-				}
+				// convert, invert (Salt) and DC-block (audio expander) in a single pass
+				analogInputsToFloat(analogInRaw, context->analogIn, context->analogFrames,
+						context->analogInChannels, interleaved, belaHw == BelaHw_Salt,
+						context->audioExpanderEnabled & 0x0000FFFF, audio_expander_filter_coeff,
+						audio_expander_input_history, audio_expander_output_history);
+				analogInFused = true;
 			}
 			else if (uniform_sample_rate && analogs_per_audio == 2)
 			{
@@ -1114,7 +1104,7 @@ void PRU::loop(void *userData, void(*render)(BelaContext*, void*), bool highPerf
 					}
 				}
 			}
-			if(belaHw == BelaHw_Salt) {
+			if(!analogInFused && belaHw == BelaHw_Salt) {
 				const float analogInMax = 65535.f/65536.f;
 				for(unsigned int n = 0; n < context->analogInChannels * context->analogFrames; ++n)
 				{
@@ -1127,7 +1117,7 @@ void PRU::loop(void *userData, void(*render)(BelaContext*, void*), bool highPerf
 			}
 #endif /* USE_NEON_FORMAT_CONVERSION */
 			
-			if((context->audioExpanderEnabled & 0x0000FFFF) != 0) {
+			if(!analogInFused && (context->audioExpanderEnabled & 0x0000FFFF) != 0) {
 				// Audio expander enabled on at least one analog input
 				if(interleaved)
 				{
@@ -1243,7 +1233,15 @@ void PRU::loop(void *userData, void(*render)(BelaContext*, void*), bool highPerf
 				}
 			}
 			
-			if((context->audioExpanderEnabled & 0xFFFF0000) != 0) {
+			// The smoothing and the scaling of the audio expander outputs are done during
+			// the format conversion, unless the sample rate is converted there
+			bool analogOutFused = !uniform_sample_rate || analogs_per_audio == 1;
+#ifdef USE_NEON_FORMAT_CONVERSION
+			analogOutFused = false;
+#endif
+			if(!analogOutFused)
+				analog_out_smoothing.process(context->analogOut, context->analogFrames, context->analogOutChannels, interleaved);
+			if(!analogOutFused && (context->audioExpanderEnabled & 0xFFFF0000) != 0) {
 				// Audio expander enabled on at least one analog output
 				// We expect the range to be -1 to 1; rescale to
 				// 0 to 0.93, the top value being designed to avoid a
@@ -1316,33 +1314,10 @@ void PRU::loop(void *userData, void(*render)(BelaContext*, void*), bool highPerf
 			}
 			else if(!uniform_sample_rate || analogs_per_audio == 1)
 			{
-				unsigned int frames = context->analogFrames;
-				unsigned int channels = context->analogOutChannels;
-				if(interleaved)
-				{
-					for(unsigned int n = 0; n < frames * channels; ++n)
-					{
-						int out = context->analogOut[n] * 65536.0f;
-						if(out < 0) out = 0;
-						else if(out > 65535) out = 65535;
-						analogOutRaw[n] = (uint16_t)out;
-					}
-				}
-				else
-				{
-					for(unsigned int f = 0; f < frames; ++f)
-					{
-						for(unsigned int c = 0; c < channels; ++c)
-						{
-							unsigned int srcIdx = c * frames + f;
-							unsigned int dstIdx = f * channels + c;
-							int out = context->analogOut[srcIdx] * 65536.0f;
-							if(out < 0) out = 0;
-							else if(out > 65535) out = 65535;
-							analogOutRaw[dstIdx] = (uint16_t)out;
-						}
-					}
-				}
+				// smooth, scale (audio expander) and convert in a single pass
+				analogOutputsToInt(context->analogOut, analogOutRaw, context->analogFrames,
+						context->analogOutChannels, interleaved, context->audioExpanderEnabled >> 16,
+						&analog_out_smoothing);
 			}
 			else if(uniform_sample_rate && analogs_per_audio == 2)
 			{
@@ -0,0 +1,537 @@
+/***** PatchRuntime.cpp *****/
+#include <PatchRuntime.h>
+#include <xenomai_wraps.h>
+#include <stdio.h>
+#include <string.h>
+#include <sstream>
+#include <algorithm>
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+enum { minFirstDigitalChannel = 10 };
+
+PatchRuntime::PatchRuntime() :
+	blockSize(0),
+	numInputs(0),
+	numOutputs(0),
+	firstAnalogChannel(0),
+	firstDigitalChannel(0),
+	firstScopeChannel(0),
+	numScopeChannels(0),
+	digitalChannelOffset(0),
+	numDigitalChannels(0),
+	numDigitalSignalInputs(0),
+	numDigitalSignalOutputs(0),
+	digitalEnabled(false),
+	digitalInputCallback(NULL),
+	digitalInputCallbackArg(NULL),
+	lastDigitalInputs(0),
+	analogFramesPerBlock(0),
+	analogResampling(false),
+	scope(NULL),
+	lastMidiInputTime(0),
+	numMidiEvents(0),
+	multiplexerActive(false),
+	multiplexerArraySize(0),
+	multiplexerCounter(0)
+{}
+
+PatchRuntime::~PatchRuntime()
+{
+	cleanup();
+}
+
+int PatchRuntime::setup(BelaContext* context, unsigned int newBlockSize, int newNumInputs, int newNumOutputs, bool analogBlocks)
+{
+	if(context->flags & BELA_FLAG_INTERLEAVED)
+	{
+		fprintf(stderr, "PatchRuntime: the audio and analog channels must not be interleaved.\n");
+		return -1;
+	}
+	if(!newBlockSize || context->audioFrames % newBlockSize)
+	{
+		fprintf(stderr, "Error: the block size must be a multiple of the engine's block size (%u)\n", newBlockSize);
+		return -1;
+	}
+	cleanup();
+	blockSize = newBlockSize;
+
+	// Channel distribution
+	firstAnalogChannel = std::max(context->audioInChannels, context->audioOutChannels);
+	firstDigitalChannel = firstAnalogChannel + std::max(context->analogInChannels, context->analogOutChannels);
+	if(firstDigitalChannel < minFirstDigitalChannel)
+		firstDigitalChannel = minFirstDigitalChannel; //for backwards compatibility
+	digitalChannelOffset = firstDigitalChannel + 1;
+	digitalEnabled = context->digitalFrames > 0 && context->digitalChannels > 0;
+	numDigitalChannels = digitalEnabled ? context->digitalChannels : 0;
+	firstScopeChannel = firstDigitalChannel + numDigitalChannels;
+	numInputs = newNumInputs < 0 ? firstScopeChannel + kPatchDefaultScopeChannels : newNumInputs;
+	numOutputs = newNumOutputs < 0 ? firstScopeChannel + kPatchDefaultScopeChannels : newNumOutputs;
+	numScopeChannels = numOutputs > firstScopeChannel ? numOutputs - firstScopeChannel : 0;
+	numDigitalSignalInputs = numInputs > firstDigitalChannel ? std::min(numInputs - firstDigitalChannel, numDigitalChannels) : 0;
+	numDigitalSignalOutputs = numOutputs > firstDigitalChannel ? std::min(numOutputs - firstDigitalChannel, numDigitalChannels) : 0;
+
+	// digital setup. The inputs managed at message rate are checked for
+	// changes by processInputs(), in its pass over the frames.
+	for(unsigned int ch = 0; ch < numDigitalChannels; ++ch)
+	{
+		digitalInputNames.push_back("bela_digitalIn" + std::to_string(ch + digitalChannelOffset));
+		digitalOutputNames.push_back("bela_digitalOut" + std::to_string(ch + digitalChannelOffset));
+	}
+	lastDigitalInputs = 0;
+	dcm.setVerbose(false);
+
+	// The engine runs at the audio rate. If the analog channels run at a
+	// different rate, resample them to/from it.
+	analogFramesPerBlock = analogBlocks ? blockSize : 0;
+	analogResampling = false;
+	if(analogBlocks && context->analogFrames && context->analogFrames != context->audioFrames)
+	{
+		bool analogIsSlower = context->analogFrames < context->audioFrames;
+		unsigned int factor = analogIsSlower ?
+			context->audioFrames / context->analogFrames :
+			context->analogFrames / context->audioFrames;
+		analogFramesPerBlock = analogIsSlower ? blockSize / factor : blockSize * factor;
+		if(analogFramesPerBlock * context->audioFrames != blockSize * context->analogFrames || analogFramesPerBlock == 0)
+		{
+			fprintf(stderr, "Unsupported ratio between analog and audio sample rate. Try running with --uniform-sample-rate\n");
+			return -1;
+		}
+		// analog inputs are upsampled when the analog rate is lower than
+		// the audio rate, analog outputs are downsampled, and vice versa
+		if(analogInResampler.setup(context->analogInChannels, factor, analogIsSlower, analogFramesPerBlock)
+			|| analogOutResampler.setup(context->analogOutChannels, factor, !analogIsSlower, blockSize))
+		{
+			fprintf(stderr, "Unable to initialise analog resampler\n");
+			return -1;
+		}
+		analogResampling = true;
+		printf("Analog channels are resampled by a factor of %u\n", factor);
+	}
+
+	if(numScopeChannels)
+	{
+		scope = new Scope();
+		scope->setup(numScopeChannels, context->audioSampleRate);
+		scopeFrame.resize(numScopeChannels);
+	}
+
+	multiplexerActive = context->multiplexerChannels > 0;
+	multiplexerArraySize = context->multiplexerChannels * context->analogInChannels;
+	multiplexerCounter = 0;
+	return 0;
+}
+
+void PatchRuntime::cleanup()
+{
+	for(auto m : midi)
+		delete m;
+	midi.clear();
+	for(auto q : midiQueues)
+		delete q;
+	midiQueues.clear();
+	midiPortNames.clear();
+	delete scope;
+	scope = NULL;
+	digitalInputNames.clear();
+	digitalOutputNames.clear();
+	numMidiEvents = 0;
+}
+
+// DIGITAL_FORMAT_ASSUMPTION: see DigitalChannelManager. The values of the
+// inputs are the upper half-word, masked by the directions in the lower one.
+static inline uint16_t getDigitalInputs(uint32_t word)
+{
+	return (word >> 16) & word;
+}
+
+void PatchRuntime::reportDigitalChanges(uint16_t changed, uint16_t values)
+{
+	// in ascending channel order
+	while(changed)
+	{
+		unsigned int channel = __builtin_ctz(changed);
+		if(digitalInputCallback)
+			digitalInputCallback(digitalInputNames[channel].c_str(), (values >> channel) & 1, digitalInputCallbackArg);
+		changed &= changed - 1;
+	}
+}
+
+void PatchRuntime::processInputs(BelaContext* context, unsigned int tick, float* in)
+{
+	// the audio inputs, and the analog ones when they run at the audio rate,
+	// are copied as they are
+	unsigned int audioChannels = std::min(context->audioInChannels, numInputs);
+	const float* audioIn = context->audioIn + tick * blockSize;
+	unsigned int analogChannels = 0;
+	if(analogFramesPerBlock && numInputs > firstAnalogChannel)
+		analogChannels = std::min(context->analogInChannels, numInputs - firstAnalogChannel);
+	unsigned int copiedAnalogChannels = analogResampling ? 0 : analogChannels;
+	const float* analogIn = context->analogIn + tick * analogFramesPerBlock;
+	float* engineAnalogIn = in + firstAnalogChannel * blockSize;
+
+	// the digital inputs managed at signal rate are unpacked, and those
+	// managed at message rate are checked for changes
+	const uint32_t* digital = NULL;
+	uint8_t signalRateChannels[16];
+	unsigned int numSignalRateChannels = 0;
+	uint16_t messageRateMask = 0;
+	if(digitalEnabled)
+	{
+		digital = context->digital + tick * blockSize;
+		for(unsigned int k = 0; k < numDigitalChannels; ++k)
+		{
+			if(!dcm.isInput(k))
+				continue;
+			if(dcm.isSignalRate(k) && k < numDigitalSignalInputs)
+				signalRateChannels[numSignalRateChannels++] = k;
+			else if(dcm.isMessageRate(k))
+				messageRateMask |= 1u << k;
+		}
+	}
+	float* engineDigitalIn = in + firstDigitalChannel * blockSize;
+
+	// one pass over the frames, 4 at a time, so that each digital word is
+	// loaded once and the audio and analog samples are copied alongside
+	unsigned int frame = 0;
+	for(; frame + 4 <= blockSize; frame += 4)
+	{
+		for(unsigned int c = 0; c < audioChannels; ++c)
+		{
+			const float* src = audioIn + c * context->audioFrames + frame;
+			float* dst = in + c * blockSize + frame;
+			for(unsigned int n = 0; n < 4; ++n)
+				dst[n] = src[n];
+		}
+		for(unsigned int c = 0; c < copiedAnalogChannels; ++c)
+		{
+			const float* src = analogIn + c * context->analogFrames + frame;
+			float* dst = engineAnalogIn + c * blockSize + frame;
+			for(unsigned int n = 0; n < 4; ++n)
+				dst[n] = src[n];
+		}
+		if(!digital)
+			continue;
+#if defined(__ARM_NEON__)
+		uint32x4_t words = vld1q_u32(digital + frame);
+		for(unsigned int c = 0; c < numSignalRateChannels; ++c)
+		{
+			unsigned int k = signalRateChannels[c];
+			uint32x4_t bits = vandq_u32(vshlq_u32(words, vdupq_n_s32(-(int)(k + 16))), vdupq_n_u32(1));
+			vst1q_f32(engineDigitalIn + k * blockSize + frame, vcvtq_f32_u32(bits));
+		}
+#elif defined(__SSE2__)
+		__m128i words = _mm_loadu_si128((const __m128i*)(digital + frame));
+		for(unsigned int c = 0; c < numSignalRateChannels; ++c)
+		{
+			unsigned int k = signalRateChannels[c];
+			__m128i bits = _mm_and_si128(_mm_srl_epi32(words, _mm_cvtsi32_si128(k + 16)), _mm_set1_epi32(1));
+			_mm_storeu_ps(engineDigitalIn + k * blockSize + frame, _mm_cvtepi32_ps(bits));
+		}
+#else
+		for(unsigned int c = 0; c < numSignalRateChannels; ++c)
+		{
+			unsigned int k = signalRateChannels[c];
+			for(unsigned int n = 0; n < 4; ++n)
+				engineDigitalIn[k * blockSize + frame + n] = (digital[frame + n] >> (k + 16)) & 1;
+		}
+#endif
+		if(messageRateMask)
+		{
+			for(unsigned int n = frame; n < frame + 4; ++n)
+			{
+				uint16_t values = getDigitalInputs(digital[n]);
+				reportDigitalChanges((values ^ lastDigitalInputs) & messageRateMask, values);
+				lastDigitalInputs = values;
+			}
+		}
+	}
+	for(; frame < blockSize; ++frame)
+	{
+		for(unsigned int c = 0; c < audioChannels; ++c)
+			in[c * blockSize + frame] = audioIn[c * context->audioFrames + frame];
+		for(unsigned int c = 0; c < copiedAnalogChannels; ++c)
+			engineAnalogIn[c * blockSize + frame] = analogIn[c * context->analogFrames + frame];
+		if(!digital)
+			continue;
+		uint32_t word = digital[frame];
+		for(unsigned int c = 0; c < numSignalRateChannels; ++c)
+		{
+			unsigned int k = signalRateChannels[c];
+			engineDigitalIn[k * blockSize + frame] = (word >> (k + 16)) & 1;
+		}
+		uint16_t values = getDigitalInputs(word);
+		reportDigitalChanges((values ^ lastDigitalInputs) & messageRateMask, values);
+		lastDigitalInputs = values;
+	}
+	// the first frame of the next block is compared with the last of this one
+	if(digital && !messageRateMask && blockSize)
+		lastDigitalInputs = getDigitalInputs(digital[blockSize - 1]);
+
+	// the analog inputs at another rate go through the resampler
+	for(unsigned int c = 0; analogResampling && c < analogChannels; ++c)
+		analogInResampler.process(c, analogIn + c * context->analogFrames, analogFramesPerBlock, engineAnalogIn + c * blockSize);
+}
+
+void PatchRuntime::processOutputs(BelaContext* context, unsigned int tick, const float* out)
+{
+	// digital output, at signal rate and at message rate
+	if(digitalEnabled)
+	{
+		uint32_t* digital = context->digital + tick * blockSize;
+		if(numDigitalSignalOutputs)
+			dcm.processSignalRateOutput(digital, blockSize, out + firstDigitalChannel * blockSize, blockSize, numDigitalSignalOutputs);
+		dcm.processOutput(digital, blockSize);
+	}
+
+	// scope output
+	if(scope)
+	{
+		const float* scopeOut = out + firstScopeChannel * blockSize;
+		for(unsigned int n = 0; n < blockSize; ++n)
+		{
+			for(unsigned int k = 0; k < numScopeChannels; ++k)
+				scopeFrame[k] = scopeOut[k * blockSize + n];
+			scope->log(scopeFrame.data());
+		}
+	}
+
+	// audio output
+	unsigned int audioChannels = std::min(context->audioOutChannels, numOutputs);
+	for(unsigned int n = 0; n < audioChannels; ++n)
+	{
+		memcpy(
+			context->audioOut + tick * blockSize + n * context->audioFrames,
+			out + n * blockSize,
+			sizeof(context->audioOut[0]) * blockSize
+		);
+	}
+
+	// analog output
+	for(unsigned int n = 0; analogFramesPerBlock && n < context->analogOutChannels && firstAnalogChannel + n < numOutputs; ++n)
+	{
+		float* analogOut = context->analogOut + tick * analogFramesPerBlock + n * context->analogFrames;
+		const float* engineOut = out + (firstAnalogChannel + n) * blockSize;
+		if(analogResampling)
+			analogOutResampler.process(n, engineOut, blockSize, analogOut);
+		else
+			memcpy(analogOut, engineOut, sizeof(context->analogOut[0]) * blockSize);
+	}
+}
+
+void PatchRuntime::setDigitalCallback(DigitalInputCallback callback, void* arg)
+{
+	digitalInputCallback = callback;
+	digitalInputCallbackArg = arg;
+}
+
+void PatchRuntime::setDigital(const char* direction, int patchChannel, const char* rate)
+{
+	bool isMessageRate = true; // defaults to message rate
+	bool isInput;
+	if(strcmp(direction, "in") == 0){
+		isInput = true;
+	} else if(strcmp(direction, "out") == 0){
+		isInput = false;
+	} else if(strcmp(direction, "disable") == 0){
+		int channel = patchChannel - digitalChannelOffset;
+		if(channel >= 0 && channel < (int)numDigitalChannels)
+			dcm.unmanage(channel);
+		return;
+	} else {
+		return;
+	}
+	int channel = patchChannel - digitalChannelOffset;
+	if(channel < 0 || channel >= (int)numDigitalChannels)
+		return;
+	if(rate && (strcmp(rate, "~") == 0 || strncmp(rate, "sig", 3) == 0))
+		isMessageRate = false;
+	dcm.manage(channel, isInput ? INPUT : OUTPUT, isMessageRate);
+}
+
+bool PatchRuntime::setDigitalOutput(const char* receiverName, float value)
+{
+	// let's make this as optimized as possible for built-in digital Out parsing
+	// the built-in digital receivers are of the form "bela_digitalOutXX" where XX is between digitalChannelOffset and (digitalChannelOffset+numDigitalChannels)
+	static const int prefixLength = 15; // strlen("bela_digitalOut")
+	if(strncmp(receiverName, "bela_digitalOut", prefixLength) != 0)
+		return false;
+	if(receiverName[prefixLength] != 0 && receiverName[prefixLength + 1] != 0){
+		// quickly convert the suffix to integer, assuming they are numbers, avoiding to call atoi
+		int receiver = (receiverName[prefixLength] - '0') * 10;
+		receiver += receiverName[prefixLength + 1] - '0';
+		unsigned int channel = receiver - digitalChannelOffset; // go back to the actual Bela digital channel number
+		if(channel < numDigitalChannels)
+			dcm.setValue(channel, value != 0);
+	}
+	return true;
+}
+
+int PatchRuntime::openMidiPort(const std::string& name, bool verbose)
+{
+	Midi* newMidi = new Midi();
+	MidiInputQueue* queue = new MidiInputQueue;
+	queue->written = 0;
+	queue->read = 0;
+	// the messages are stamped as soon as they are parsed, in the MIDI
+	// input thread
+	newMidi->setParserCallback(midiMessageReceived, queue);
+	newMidi->readFrom(name.c_str());
+	newMidi->writeTo(name.c_str());
+	if(verbose && newMidi->isOutputEnabled())
+		printf("Opened MIDI device %s as output\n", name.c_str());
+	if(verbose && newMidi->isInputEnabled())
+		printf("Opened MIDI device %s as input\n", name.c_str());
+	if(!newMidi->isInputEnabled() && !newMidi->isOutputEnabled())
+	{
+		if(verbose)
+			fprintf(stderr, "Failed to open  MIDI device %s\n", name.c_str());
+		delete newMidi;
+		delete queue;
+		return -1;
+	}
+	midi.push_back(newMidi);
+	midiQueues.push_back(queue);
+	midiPortNames.push_back(name);
+	return 0;
+}
+
+void PatchRuntime::addMidiPort(const char* symbol, int num0, int num1, int num2)
+{
+	std::ostringstream deviceName;
+	deviceName << symbol << ":" << num0 << "," << num1 << "," << num2;
+	printf("Adding Midi device: %s\n", deviceName.str().c_str());
+	openMidiPort(deviceName.str(), true);
+	dumpMidi();
+}
+
+void PatchRuntime::dumpMidi()
+{
+	if(midi.size() == 0)
+	{
+		printf("No MIDI device enabled\n");
+		return;
+	}
+	printf("The following MIDI devices are enabled:\n");
+	printf("%4s%20s %3s %3s %s\n",
+			"Num",
+			"Name",
+			"In",
+			"Out",
+			"Pd channels"
+	      );
+	for(unsigned int n = 0; n < midi.size(); ++n)
+	{
+		printf("[%2d]%20s %3s %3s (%d-%d)\n",
+			n,
+			midiPortNames[n].c_str(),
+			midi[n]->isInputEnabled() ? "x" : "_",
+			midi[n]->isOutputEnabled() ? "x" : "_",
+			n * 16,
+			n * 16 + 15
+		);
+	}
+}
+
+void PatchRuntime::midiMessageReceived(MidiChannelMessage message, void* arg)
+{
+	MidiInputQueue* q = (MidiInputQueue*)arg;
+	uint64_t w = q->written.load(std::memory_order_relaxed);
+	if(w - q->read.load(std::memory_order_acquire) >= kMaxPatchMidiEvents)
+		return; // the queue is full: drop it
+	unsigned int index = w % kMaxPatchMidiEvents;
+	q->times[index] = task_get_time_ns();
+	q->messages[index] = message;
+	q->written.store(w + 1, std::memory_order_release);
+}
+
+void PatchRuntime::processMidiInput(BelaContext* context)
+{
+	// the time since the previous call is mapped onto the frames of this block
+	uint64_t now = task_get_time_ns();
+	uint64_t elapsed = now - lastMidiInputTime;
+	numMidiEvents = 0;
+	for(unsigned int port = 0; port < midiQueues.size(); ++port)
+	{
+		MidiInputQueue* q = midiQueues[port];
+		uint64_t w = q->written.load(std::memory_order_acquire);
+		for(uint64_t r = q->read.load(std::memory_order_relaxed); r < w; ++r)
+		{
+			if(numMidiEvents >= kMaxPatchMidiEvents)
+				break; // the queue is full: drop the rest
+			unsigned int index = r % kMaxPatchMidiEvents;
+			uint64_t time = q->times[index];
+			uint64_t offset = 0;
+			if(lastMidiInputTime && time > lastMidiInputTime)
+				offset = (time - lastMidiInputTime) * context->audioFrames / elapsed;
+			if(offset >= context->audioFrames)
+				offset = context->audioFrames - 1;
+			uint64_t frame = context->audioFramesElapsed + offset;
+			// the messages of each port are in order: merge them with
+			// those of the other ports
+			unsigned int n = numMidiEvents++;
+			while(n > 0 && midiEvents[n - 1].frame > frame)
+			{
+				midiEvents[n] = midiEvents[n - 1];
+				--n;
+			}
+			PatchMidiEvent& e = midiEvents[n];
+			e.frame = frame;
+			e.port = port;
+			e.message = q->messages[index];
+		}
+		q->read.store(w, std::memory_order_release);
+	}
+	lastMidiInputTime = now;
+}
+
+Midi* PatchRuntime::getMidiOutputPort(int* channel)
+{
+	if(midi.size() == 0)
+		return NULL;
+	unsigned int port = 0;
+	while(*channel > 16){
+		*channel -= 16;
+		port += 1;
+	}
+	if(port >= midi.size()){
+		// if the port number exceeds the number of ports available, send out
+		// of the first port
+		rt_fprintf(stderr, "Port out of range, using port 0 instead\n");
+		port = 0;
+	}
+	return midi[port];
+}
+
+Midi* PatchRuntime::getMidiPort(int port)
+{
+	if(midi.size() == 0)
+		return NULL;
+	if(port < 0 || port >= (int)midi.size()){
+		// if the port is out of range, redirect to the first port.
+		rt_fprintf(stderr, "Port out of range, using port 0 instead\n");
+		port = 0;
+	}
+	return midi[port];
+}
+
+bool PatchRuntime::isMultiplexerUpdateDue()
+{
+	if(!multiplexerActive)
+		return false;
+	if(++multiplexerCounter >= multiplexerArraySize)
+	{
+		multiplexerCounter = 0;
+		return true;
+	}
+	return false;
+}
+
+void PatchRuntime::setResamplingQuality(ResamplerQuality quality)
+{
+	analogInResampler.setQuality(quality);
+	analogOutResampler.setQuality(quality);
+}
@@ -23,6 +23,8 @@
 #include <vector>
 
 #include <sys/mman.h>
+#include <time.h>
+#include <stdint.h>
 
 #include "../include/Bela.h"
 #include "../include/bela_hw_settings.h"
@@ -189,6 +191,42 @@ unsigned int gAuxiliaryTaskStackSize;
 // Context which holds all the audio/sensor data passed to the render routines
 InternalBelaContext gContext;
 
+// Time spent in each stage of the startup, printed when verbose
+#define kMaxStartupStages 16
+static const char* gStartupStageNames[kMaxStartupStages];
+static uint64_t gStartupStageTimes[kMaxStartupStages];
+static unsigned int gNumStartupStages = 0;
+
+static uint64_t startupClock()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts); // NOWRAP
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Record the end of a startup stage. Passing NULL starts a new breakdown.
+static void startupStage(const char* name)
+{
+	if(!name)
+		gNumStartupStages = 0;
+	if(gNumStartupStages < kMaxStartupStages)
+	{
+		gStartupStageNames[gNumStartupStages] = name;
+		gStartupStageTimes[gNumStartupStages] = startupClock();
+		++gNumStartupStages;
+	}
+}
+
+static void printStartupStages()
+{
+	if(!gNumStartupStages)
+		return;
+	printf("Startup timing:\n");
+	for(unsigned int n = 1; n < gNumStartupStages; ++n)
+		printf("  %-28s %8.2fms\n", gStartupStageNames[n], (gStartupStageTimes[n] - gStartupStageTimes[n - 1]) / 1000.f);
+	printf("  %-28s %8.2fms\n", "total", (gStartupStageTimes[gNumStartupStages - 1] - gStartupStageTimes[0]) / 1000.f);
+}
+
 // User data passed in from main()
 void *gUserData;
 void (*gBelaRender)(BelaContext*, void*);
@@ -240,6 +278,7 @@ int Bela_initAudio(BelaInitSettings *settings, void *userData)
 	rt_print_auto_init(1);
 #endif
 
+	startupStage(NULL);
 	// reset this, in case it has been set before
 	gShouldStop = 0;
 	gAudioThreadStackSize = settings->audioThreadStackSize;
@@ -313,6 +352,8 @@ int Bela_initAudio(BelaInitSettings *settings, void *userData)
 		}
 	}
 
+	startupStage("preliminary checks and GPIO");
+
 	if(settings->numAnalogInChannels != settings->numAnalogOutChannels){
 		fprintf(stderr, "Error: TODO: a different number of channels for inputs and outputs is not yet supported\n");
 		return 1;
@@ -328,6 +369,7 @@ int Bela_initAudio(BelaInitSettings *settings, void *userData)
 
 	// Initialise the rendering environment: sample rates, frame counts, numbers of channels
 	BelaHw belaHw = Bela_detectHw();
+	startupStage("hardware detection");
 	if(gRTAudioVerbose==1)	
 		printf("Detected hardware: %s\n", getBelaHwName(belaHw).c_str());
 	// Check for user-selected hardware
@@ -423,6 +465,8 @@ int Bela_initAudio(BelaInitSettings *settings, void *userData)
 	if(settings->detectUnderruns)
 		gContext.flags |= BELA_FLAG_DETECT_UNDERRUNS;
 
+	startupStage("hardware configuration");
+
 	// Use PRU for audio
 	gPRU = new PRU(&gContext, gAudioCodec);
 
@@ -432,11 +476,13 @@ int Bela_initAudio(BelaInitSettings *settings, void *userData)
 		fprintf(stderr, "Error: unable to initialise PRU\n");
 		return 1;
 	}
+	startupStage("PRU initialisation");
 
 	if(gAudioCodec->initCodec()) {
 		cerr << "Error: unable to initialise audio codec\n";
 		return 1;
 	}
+	startupStage("codec initialisation");
 
 	// Set default volume levels
 	Bela_setDACLevel(settings->dacLevel);
@@ -456,6 +502,7 @@ int Bela_initAudio(BelaInitSettings *settings, void *userData)
 		fprintf(stderr, "Couldn't initialise audio rendering\n");
 		return 1;
 	}
+	startupStage("user setup()");
 	return 0;
 }
 
@@ -485,17 +532,33 @@ static int startAudioInline(){
 	// make sure we have everything
 	assert(gAudioCodec != 0 && gPRU != 0);
 
-	// power up and initialize audio codec
-	if(gAudioCodec->startAudio(0)) {
+	startupStage("before Bela_startAudio()");
+	// power up and initialize audio codec. The outputs are unmuted
+	// only once it has settled, in the meantime we load the PRU
+	unsigned int settleUs;
+	if(gAudioCodec->startAudioBegin(0, &settleUs)) {
 		fprintf(stderr, "Error: unable to start I2C audio codec\n");
 		return -1;
 	}
+	uint64_t settleEnd = startupClock() + settleUs;
+	startupStage("codec power up");
 
 	// initialize and run the PRU
 	if(gPRU->start(gPRUFilename)) {
 		fprintf(stderr, "Error: unable to start PRU from %s\n", gPRUFilename[0] ? "embedded binary" : gPRUFilename);
 		return -1;
 	}
+	startupStage("PRU start");
+
+	uint64_t now = startupClock();
+	if(now < settleEnd)
+		usleep(settleEnd - now);
+	startupStage("codec settling (remaining)");
+	if(gAudioCodec->startAudioEnd()) {
+		fprintf(stderr, "Error: unable to start I2C audio codec\n");
+		return -1;
+	}
+	startupStage("codec unmute");
 
 	if(!gAmplifierShouldBeginMuted) {
 		// First unmute the amplifier
@@ -505,6 +568,9 @@ static int startAudioInline(){
 		}
 	}
 
+	if(gRTAudioVerbose)
+		printStartupStages();
+
 	// ready to go
 	gShouldStop = 0;
 	return 0;
@@ -646,6 +712,22 @@ void Bela_cleanupAudio()
 	gAmplifierMutePin = -1;
 }
 
+// Analog output smoothing: the state lives in the PRU object, which applies
+// it when converting the outputs
+void analogWriteTarget(BelaContext *context, int channel, float value, unsigned int rampFrames)
+{
+	if(gPRU == 0 || channel < 0 || channel >= (int)context->analogOutChannels)
+		return;
+	gPRU->getAnalogOutSmoothing()->setTarget(channel, value, rampFrames);
+}
+
+void analogSetSmoothing(BelaContext *context, int channel, float maxStep, float timeConstant)
+{
+	if(gPRU == 0 || channel < 0 || channel >= (int)context->analogOutChannels)
+		return;
+	gPRU->getAnalogOutSmoothing()->setSmoothing(channel, maxStep, timeConstant);
+}
+
 // Set the level of the DAC; affects all outputs (headphone, line, speaker)
 // 0dB is the maximum, -63.5dB is the minimum; 0.5dB steps
 int Bela_setDACLevel(float decibels)
@@ -58,7 +58,7 @@ struct option gDefaultLongOptions[] =
 	{"disable-led", 0, NULL, OPT_DISABLE_LED},
 	{"disable-cape-button-monitoring", 0, NULL, OPT_DISABLE_CAPE_BUTTON},
 	{"high-performance-mode", 0, NULL, OPT_HIGH_PERFORMANCE_MODE},
-	{"uniform-sample-rate", 0, NULL, OPT_UNIFORM_SAMPLE_RATE},
+	{"uniform-sample-rate", 2, NULL, OPT_UNIFORM_SAMPLE_RATE},
 	{"board", 1, NULL, OPT_BOARD},
 	{NULL, 0, NULL, 0}
 };
@@ -318,8 +318,11 @@ int Bela_getopt_long(int argc, char *argv[], const char *customShortOptions, con
 			settings->highPerformanceMode = 1;
 			break;
 		case OPT_UNIFORM_SAMPLE_RATE:
-			settings->uniformSampleRate = 1;
-			printf("Uniform sample rate\n");
+			// --uniform-sample-rate=0 turns it off, e.g. when the
+			// program enables it in Bela_userSettings()
+			settings->uniformSampleRate = optarg ? atoi(optarg) : 1;
+			if(settings->uniformSampleRate)
+				printf("Uniform sample rate\n");
 			break;
 		case OPT_BOARD:
 			if(strlen(optarg) < MAX_BOARDNAME_LENGTH)
@@ -361,7 +364,7 @@ void Bela_usage()
 	std::cerr << "   --disable-led                       Disable the blinking LED indicator\n";
 	std::cerr << "   --disable-cape-button-monitoring    Disable the monitoring of the Bela cape button (which otherwise stops the running program)\n";
 	std::cerr << "   --high-performance-mode             Gives more CPU to the Bela process. The system may become unresponsive and you will have to use the button on the Bela cape when you want to stop it.\n";
-	std::cerr << "   --uniform-sample-rate               Internally resample the analog channels so that they match the audio sample rate\n";
+	std::cerr << "   --uniform-sample-rate[=val]         Internally resample the analog channels so that they match the audio sample rate (options: 0 or 1, default with no value: 1)\n";
 	std::cerr << "   --board val:                        Select a different board to work with\n";
 	std::cerr << "   --verbose [-v]:                     Enable verbose logging information\n";
 }
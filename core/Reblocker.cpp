@@ -0,0 +1,135 @@
+/***** Reblocker.cpp *****/
+#include <Reblocker.h>
+#include <stdio.h>
+#include <string.h>
+
+Reblocker::Reblocker() :
+	blockSize(0),
+	periodSize(0),
+	numInputs(0),
+	numOutputs(0),
+	callback(NULL),
+	callbackArg(NULL),
+	engineIn(NULL),
+	engineOut(NULL),
+	inputCount(0),
+	fifoMask(0),
+	fifoRead(0),
+	fifoWrite(0),
+	latency(0)
+{}
+
+unsigned int Reblocker::computeLatency(unsigned int blockSize, unsigned int periodSize)
+{
+	// after k periods the engine has produced floor(k * P / B) * B frames,
+	// which falls short of k * P by (k * P) % B. The largest value this
+	// takes is B - gcd(B, P).
+	unsigned int a = blockSize;
+	unsigned int b = periodSize;
+	while(b)
+	{
+		unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+	return blockSize - a;
+}
+
+int Reblocker::setup(unsigned int newBlockSize, unsigned int newPeriodSize,
+		unsigned int newNumInputs, unsigned int newNumOutputs,
+		ProcessCallback newCallback, void* arg,
+		float* newEngineIn, float* newEngineOut)
+{
+	if(!newBlockSize || !newPeriodSize || !newCallback)
+	{
+		fprintf(stderr, "Reblocker: invalid arguments\n");
+		return -1;
+	}
+	blockSize = newBlockSize;
+	periodSize = newPeriodSize;
+	numInputs = newNumInputs;
+	numOutputs = newNumOutputs;
+	callback = newCallback;
+	callbackArg = arg;
+	latency = computeLatency(blockSize, periodSize);
+
+	ownEngineIn.clear();
+	ownEngineOut.clear();
+	engineIn = newEngineIn;
+	engineOut = newEngineOut;
+	if(!engineIn)
+	{
+		ownEngineIn.resize(numInputs * blockSize);
+		engineIn = ownEngineIn.data();
+	}
+	if(!engineOut)
+	{
+		ownEngineOut.resize(numOutputs * blockSize);
+		engineOut = ownEngineOut.data();
+	}
+
+	// at most latency + one block + one period frames are in the FIFO
+	unsigned int size = 1;
+	while(size < latency + blockSize + periodSize)
+		size <<= 1;
+	fifoMask = size - 1;
+	fifo.resize(numOutputs * size);
+	reset();
+	return 0;
+}
+
+void Reblocker::reset()
+{
+	inputCount = 0;
+	memset(engineIn, 0, sizeof(engineIn[0]) * numInputs * blockSize);
+	memset(fifo.data(), 0, sizeof(fifo[0]) * fifo.size());
+	fifoRead = 0;
+	fifoWrite = latency;
+}
+
+void Reblocker::process(const float* in, float* out)
+{
+	unsigned int size = fifoMask + 1;
+	unsigned int n = 0;
+	while(n < periodSize)
+	{
+		// fill the engine's input block as far as possible
+		unsigned int run = blockSize - inputCount;
+		if(run > periodSize - n)
+			run = periodSize - n;
+		for(unsigned int ch = 0; ch < numInputs; ++ch)
+			memcpy(engineIn + ch * blockSize + inputCount, in + ch * periodSize + n, sizeof(in[0]) * run);
+		n += run;
+		inputCount += run;
+		if(inputCount < blockSize)
+			break;
+		inputCount = 0;
+
+		// run the engine and append its output to the FIFO
+		callback(engineIn, engineOut, callbackArg);
+		unsigned int first = size - fifoWrite;
+		if(first > blockSize)
+			first = blockSize;
+		for(unsigned int ch = 0; ch < numOutputs; ++ch)
+		{
+			float* ring = fifo.data() + ch * size;
+			const float* src = engineOut + ch * blockSize;
+			memcpy(ring + fifoWrite, src, sizeof(src[0]) * first);
+			memcpy(ring, src + first, sizeof(src[0]) * (blockSize - first));
+		}
+		fifoWrite = (fifoWrite + blockSize) & fifoMask;
+	}
+
+	// read one period from the FIFO
+	unsigned int first = size - fifoRead;
+	if(first > periodSize)
+		first = periodSize;
+	for(unsigned int ch = 0; ch < numOutputs; ++ch)
+	{
+		const float* ring = fifo.data() + ch * size;
+		float* dst = out + ch * periodSize;
+		memcpy(dst, ring + fifoRead, sizeof(dst[0]) * first);
+		memcpy(dst + first, ring, sizeof(dst[0]) * (periodSize - first));
+	}
+	fifoRead = (fifoRead + periodSize) & fifoMask;
+}
@@ -0,0 +1,405 @@
+/***** SampleRateConverter.cpp *****/
+#include <SampleRateConverter.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+// the number of phases of the polyphase filter bank
+static const unsigned int kSrcPhases = 128;
+// the number of points per zero crossing of the sinc table
+static const unsigned int kSrcTableResolution = 512;
+
+// Modified Bessel function of the first kind, order 0
+static double besselI0(double x)
+{
+	double sum = 1;
+	double term = 1;
+	for(unsigned int k = 1; k < 50; ++k)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if(term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+SampleRateConverter::SampleRateConverter() :
+	numChannels(0),
+	maxChannels(0),
+	halfTaps(0),
+	maxHalfWidth(0),
+	capacity(0),
+	fill(0),
+	position(0),
+	fraction(0),
+	ratio(1),
+	targetRatio(1),
+	ratioIncrement(0),
+	rampFrames(0),
+	maxRatio(1),
+	quality(kSrcLinear)
+{}
+
+int SampleRateConverter::setup(unsigned int newNumChannels, unsigned int maxInputFrames, double newRatio,
+		SampleRateConverterQuality newQuality, double newMaxRatio)
+{
+	if(!newNumChannels || !maxInputFrames || newRatio < 0 || newMaxRatio < 0 || newQuality > kSrcBest)
+	{
+		fprintf(stderr, "SampleRateConverter: invalid arguments\n");
+		return -1;
+	}
+	numChannels = maxChannels = newNumChannels;
+	quality = newQuality;
+	maxRatio = newMaxRatio > 0 ? newMaxRatio : newRatio;
+	if(maxRatio <= 0)
+		maxRatio = 1;
+
+	// the length of the filter, the cutoff relative to the Nyquist
+	// frequency of the lower of the two rates and the shape of the window
+	float rolloff = 1;
+	float beta = 0;
+	switch(quality)
+	{
+		case kSrcLinear:
+			halfTaps = 1;
+			break;
+		case kSrcFast:
+			halfTaps = 4;
+			rolloff = 0.85;
+			beta = 6;
+			break;
+		case kSrcMedium:
+			halfTaps = 8;
+			rolloff = 0.9;
+			beta = 8;
+			break;
+		case kSrcBest:
+			halfTaps = 16;
+			rolloff = 0.94;
+			beta = 10;
+			break;
+	}
+	if(kSrcLinear == quality)
+		maxHalfWidth = ceil(maxRatio) > 1 ? ceil(maxRatio) : 1;
+	else
+		maxHalfWidth = ceil(halfTaps * (maxRatio > 1 ? maxRatio : 1));
+
+	// one side of the windowed sinc, as a function of the distance from its
+	// centre, in input samples. It is zero-padded so that a lookup never
+	// has to check the bounds.
+	table.assign((halfTaps + 1) * kSrcTableResolution + 2, 0);
+	if(kSrcLinear != quality)
+	{
+		double i0Beta = besselI0(beta);
+		for(unsigned int n = 0; n <= halfTaps * kSrcTableResolution; ++n)
+		{
+			double v = n / (double)kSrcTableResolution;
+			double x = M_PI * rolloff * v;
+			double sinc = n ? sin(x) / x : 1;
+			double w = v / halfTaps;
+			double window = besselI0(beta * sqrt(w < 1 ? 1 - w * w : 0)) / i0Beta;
+			table[n] = rolloff * sinc * window;
+		}
+	}
+	// the same filter, as a polyphase bank: phase p holds the coefficients for
+	// a fractional position of p / kSrcPhases. There is an extra phase at the
+	// end, so that we can interpolate between phase p and p + 1.
+	unsigned int taps = 2 * halfTaps;
+	bank.assign((kSrcPhases + 1) * taps, 0);
+	for(unsigned int p = 0; p <= kSrcPhases && kSrcLinear != quality; ++p)
+	{
+		for(unsigned int j = 0; j < taps; ++j)
+		{
+			double u = fabs((double)j - halfTaps + 1 - p / (double)kSrcPhases);
+			double v = u * kSrcTableResolution;
+			unsigned int i = v;
+			bank[p * taps + j] = table[i] + (v - i) * (table[i + 1] - table[i]);
+		}
+	}
+
+	capacity = 2 * maxHalfWidth + 2 + maxInputFrames;
+	history.assign(numChannels * capacity, 0);
+	coefficients.assign(2 * maxHalfWidth, 0);
+	positions.assign(2 * maxHalfWidth, 0);
+	ratio = targetRatio = newRatio > maxRatio ? maxRatio : newRatio;
+	ratioIncrement = 0;
+	rampFrames = 0;
+	reset();
+	return 0;
+}
+
+void SampleRateConverter::reset()
+{
+	memset(history.data(), 0, sizeof(history[0]) * history.size());
+	// the history starts with silence, so that the first input frame is
+	// at the position of the first output frame
+	fill = maxHalfWidth - 1;
+	position = maxHalfWidth - 1;
+	fraction = 0;
+}
+
+int SampleRateConverter::setNumChannels(unsigned int newNumChannels)
+{
+	if(!newNumChannels || newNumChannels > maxChannels)
+		return -1;
+	numChannels = newNumChannels;
+	reset();
+	return 0;
+}
+
+void SampleRateConverter::setRatio(double newRatio, unsigned int newRampFrames)
+{
+	if(newRatio < 0)
+		newRatio = 0;
+	if(newRatio > maxRatio)
+		newRatio = maxRatio;
+	targetRatio = newRatio;
+	if(newRampFrames)
+	{
+		ratioIncrement = (targetRatio - ratio) / newRampFrames;
+		rampFrames = newRampFrames;
+	} else {
+		ratio = targetRatio;
+		ratioIncrement = 0;
+		rampFrames = 0;
+	}
+}
+
+unsigned int SampleRateConverter::getHalfWidth()
+{
+	// while ramping, the filter has to be long enough for the whole ramp
+	double largest = ratio > targetRatio ? ratio : targetRatio;
+	unsigned int halfWidth;
+	if(kSrcLinear == quality)
+		halfWidth = largest > 1 ? ceil(largest) : 1;
+	else
+		halfWidth = largest > 1 ? ceil(halfTaps * largest) : halfTaps;
+	return halfWidth > maxHalfWidth ? maxHalfWidth : halfWidth;
+}
+
+unsigned int SampleRateConverter::getLatency()
+{
+	return getHalfWidth();
+}
+
+void SampleRateConverter::advance()
+{
+	fraction += ratio;
+	unsigned int frames = fraction;
+	position += frames;
+	fraction -= frames;
+	if(rampFrames && !--rampFrames)
+		ratio = targetRatio;
+	else if(rampFrames)
+		ratio += ratioIncrement;
+}
+
+unsigned int SampleRateConverter::getInputFramesNeeded(unsigned int outputFrames)
+{
+	if(!outputFrames || !numChannels)
+		return 0;
+	unsigned int halfWidth = getHalfWidth();
+	// run advance() on a copy of the state, up to the last output frame
+	unsigned int savedPosition = position;
+	double savedFraction = fraction;
+	double savedRatio = ratio;
+	unsigned int savedRampFrames = rampFrames;
+	for(unsigned int n = 1; n < outputFrames; ++n)
+		advance();
+	unsigned int last = position + halfWidth + 1;
+	position = savedPosition;
+	fraction = savedFraction;
+	ratio = savedRatio;
+	rampFrames = savedRampFrames;
+	return last > fill ? last - fill : 0;
+}
+
+unsigned int SampleRateConverter::getMaxInputFramesNeeded(unsigned int outputFrames)
+{
+	// the position moves by at most maxRatio per frame, and the
+	// converter always holds at least maxHalfWidth - 1 frames
+	return ceil(outputFrames * maxRatio) + maxHalfWidth + 2;
+}
+
+unsigned int SampleRateConverter::getMaxOutputFrames(unsigned int inputFrames)
+{
+	unsigned int halfWidth = getHalfWidth();
+	if(fill + inputFrames <= position + halfWidth)
+		return 0;
+	double available = fill + inputFrames - position - halfWidth - fraction;
+	double smallest = ratio < targetRatio ? ratio : targetRatio;
+	if(smallest * UINT_MAX <= available)
+		return UINT_MAX;
+	return available / smallest + 1;
+}
+
+void SampleRateConverter::computeCoefficients(unsigned int halfWidth)
+{
+	float* __restrict__ c = coefficients.data();
+	unsigned int taps = 2 * halfWidth;
+	float f = fraction;
+	if(halfWidth == halfTaps && ratio <= 1)
+	{
+		// interpolate between two phases of the bank
+		float phase = f * kSrcPhases;
+		unsigned int p = phase;
+		if(p >= kSrcPhases)
+			p = kSrcPhases - 1; // the fraction was rounded up to 1
+		float a = phase - p;
+		const float* __restrict__ h0 = &bank[p * taps];
+		const float* __restrict__ h1 = h0 + taps;
+		for(unsigned int j = 0; j < taps; ++j)
+			c[j] = h0[j] + a * (h1[j] - h0[j]);
+	} else {
+		// stretch the sinc by the ratio, so that its cutoff follows the
+		// output rate. First compute where each tap falls in the table ...
+		float scale = ratio > 1 ? 1 / ratio : 1;
+		float* __restrict__ v = positions.data();
+		float offset = (float)halfWidth - 1 + f;
+		// while the ratio is ramping down, the outer taps can be outside
+		// of the sinc: send them to the zero padding at the end of the table
+		const float end = (halfTaps + 1) * kSrcTableResolution;
+		for(unsigned int j = 0; j < taps; ++j)
+		{
+			float x = fabsf((float)j - offset) * scale * kSrcTableResolution;
+			v[j] = x < end ? x : end;
+		}
+		// ... then look it up
+		const float* t = table.data();
+		for(unsigned int j = 0; j < taps; ++j)
+		{
+			unsigned int i = v[j];
+			float a = v[j] - i;
+			c[j] = t[i] + a * (t[i + 1] - t[i]);
+		}
+	}
+	// normalise the gain, to remove the ripple due to the finite
+	// resolution of the table and to the stretching
+	float sum = 0;
+	for(unsigned int j = 0; j < taps; ++j)
+		sum += c[j];
+	if(sum > 0)
+	{
+		float gain = 1 / sum;
+		for(unsigned int j = 0; j < taps; ++j)
+			c[j] *= gain;
+	}
+}
+
+unsigned int SampleRateConverter::produce(float* out, unsigned int outputFrames, unsigned int halfWidth)
+{
+	unsigned int produced = 0;
+	const unsigned int taps = 2 * halfWidth;
+	while(produced < outputFrames && position + halfWidth < fill)
+	{
+		float* o = out + produced * numChannels;
+		if(kSrcLinear == quality)
+		{
+			float f = fraction;
+			for(unsigned int ch = 0; ch < numChannels; ++ch)
+			{
+				const float* x = &history[ch * capacity + position];
+				o[ch] = x[0] + f * (x[1] - x[0]);
+			}
+		} else {
+			computeCoefficients(halfWidth);
+			const float* __restrict__ c = coefficients.data();
+			for(unsigned int ch = 0; ch < numChannels; ++ch)
+			{
+				const float* __restrict__ x = &history[ch * capacity + position - halfWidth + 1];
+				float acc = 0;
+				for(unsigned int j = 0; j < taps; ++j)
+					acc += c[j] * x[j];
+				o[ch] = acc;
+			}
+		}
+		advance();
+		++produced;
+	}
+	return produced;
+}
+
+unsigned int SampleRateConverter::process(const float* in, unsigned int inputFrames, float* out,
+		unsigned int outputFrames, unsigned int* inputUsed)
+{
+	if(!numChannels)
+		return 0;
+	unsigned int halfWidth = getHalfWidth();
+	unsigned int used = 0;
+	unsigned int produced = 0;
+	while(1)
+	{
+		// store as much input as fits, one channel after the other
+		unsigned int count = inputFrames - used;
+		if(count > capacity - fill)
+			count = capacity - fill;
+		const float* src = in + used * numChannels;
+		for(unsigned int ch = 0; ch < numChannels; ++ch)
+		{
+			float* __restrict__ dest = &history[ch * capacity + fill];
+			for(unsigned int n = 0; n < count; ++n)
+				dest[n] = src[n * numChannels + ch];
+		}
+		fill += count;
+		used += count;
+
+		produced += produce(out + produced * numChannels, outputFrames - produced, halfWidth);
+
+		// drop the frames that are not needed any more
+		unsigned int shift = position - (maxHalfWidth - 1);
+		if(shift)
+		{
+			for(unsigned int ch = 0; ch < numChannels; ++ch)
+			{
+				float* buf = &history[ch * capacity];
+				memmove(buf, buf + shift, sizeof(buf[0]) * (fill - shift));
+			}
+			fill -= shift;
+			position -= shift;
+		}
+		if(used == inputFrames)
+			break;
+		if(produced == outputFrames && fill == capacity)
+			break;
+	}
+	if(inputUsed)
+		*inputUsed = used;
+	return produced;
+}
+
+int SampleRateConverter::convert(const float* in, unsigned int inputFrames, unsigned int numChannels,
+		double ratio, std::vector<float>& out, SampleRateConverterQuality quality)
+{
+	if(ratio <= 0 || !numChannels)
+	{
+		fprintf(stderr, "SampleRateConverter: invalid arguments\n");
+		return -1;
+	}
+	const unsigned int chunk = 1024;
+	SampleRateConverter converter;
+	if(converter.setup(numChannels, chunk, ratio, quality))
+		return -1;
+	unsigned int outputFrames = ceil(inputFrames / ratio);
+	out.resize(outputFrames * numChannels);
+	// silence after the end of the input, for the last frames
+	std::vector<float> padding(chunk * numChannels);
+	unsigned int read = 0;
+	unsigned int written = 0;
+	while(written < outputFrames)
+	{
+		const float* src = padding.data();
+		unsigned int count = chunk;
+		if(read < inputFrames)
+		{
+			src = in + read * numChannels;
+			if(count > inputFrames - read)
+				count = inputFrames - read;
+		}
+		unsigned int used;
+		written += converter.process(src, count, &out[written * numChannels], outputFrames - written, &used);
+		read += used;
+	}
+	return 0;
+}
@@ -0,0 +1,342 @@
+/***** Stft.cpp *****/
+#include <Stft.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static unsigned int nextPowerOfTwo(unsigned int n)
+{
+	unsigned int p = 1;
+	while(p < n)
+		p <<= 1;
+	return p;
+}
+
+Stft::Stft() :
+	fftSize(0),
+	hopSize(0),
+	workerLatency(0),
+	callback(NULL),
+	callbackArg(NULL),
+	fftScale(1),
+	analysisWindow(NULL),
+	synthesisWindow(NULL),
+	inputBuffer(NULL),
+	inputMask(0),
+	outputBuffer(NULL),
+	outputMask(0),
+	inputCount(0),
+	outputCount(0),
+	hopCount(0),
+	frames(NULL),
+	numFrames(0),
+	numWorkers(0),
+	nextWorker(0),
+	lateFrames(0),
+	droppedFrames(0),
+	stopping(false)
+{
+	for(unsigned int n = 0; n < kMaxStftWorkers; ++n)
+	{
+		workers[n].that = this;
+		workers[n].cfg = NULL;
+		workers[n].spectrum = NULL;
+	}
+}
+
+Stft::~Stft()
+{
+	cleanup();
+}
+
+int Stft::setup(unsigned int newFftSize, unsigned int newHopSize, unsigned int newWorkerLatency,
+		ProcessCallback processCallback, void* arg, unsigned int newNumWorkers, int priority)
+{
+	if(newFftSize < 4 || (newFftSize & (newFftSize - 1)) || newHopSize < 1 || newHopSize > newFftSize
+			|| !processCallback || newNumWorkers < 1 || newNumWorkers > kMaxStftWorkers)
+	{
+		fprintf(stderr, "Stft: invalid arguments\n");
+		return -1;
+	}
+	cleanup();
+	fftSize = newFftSize;
+	hopSize = newHopSize;
+	workerLatency = newWorkerLatency;
+	callback = processCallback;
+	callbackArg = arg;
+	numWorkers = newNumWorkers;
+
+	inputMask = nextPowerOfTwo(fftSize) - 1;
+	inputBuffer = new float[inputMask + 1];
+	memset(inputBuffer, 0, sizeof(float) * (inputMask + 1));
+	// frames are added up to fftSize + workerLatency samples ahead of the output
+	outputMask = nextPowerOfTwo(fftSize + workerLatency + 1) - 1;
+	outputBuffer = new float[outputMask + 1];
+	memset(outputBuffer, 0, sizeof(float) * (outputMask + 1));
+	analysisWindow = new float[fftSize];
+	synthesisWindow = new float[fftSize];
+
+	// enough frames for those queued in the last workerLatency samples and
+	// in the current block (which is at most workerLatency samples long)
+	numFrames = 2 * workerLatency / hopSize + 2 + numWorkers;
+	frames = new Frame[numFrames];
+	for(unsigned int n = 0; n < numFrames; ++n)
+	{
+		frames[n].state = kFrameFree;
+		frames[n].outputStart = 0;
+		frames[n].late = false;
+		frames[n].samples = (float*) NE10_MALLOC(fftSize * sizeof(float));
+	}
+	for(unsigned int n = 0; n < numWorkers; ++n)
+	{
+		workers[n].cfg = ne10_fft_alloc_r2c_float32(fftSize);
+		workers[n].spectrum = (ne10_fft_cpx_float32_t*) NE10_MALLOC((fftSize / 2 + 1) * sizeof(ne10_fft_cpx_float32_t));
+		if(!workers[n].cfg || !workers[n].spectrum)
+		{
+			fprintf(stderr, "Stft: unable to allocate the FFT\n");
+			return -1;
+		}
+	}
+
+	// depending on the version of NE10, the inverse FFT may or may not be
+	// scaled by 1 / fftSize: find out with an impulse
+	float* impulse = frames[0].samples;
+	memset(impulse, 0, fftSize * sizeof(float));
+	impulse[0] = 1;
+	ne10_fft_r2c_1d_float32_neon(workers[0].spectrum, impulse, workers[0].cfg);
+	ne10_fft_c2r_1d_float32_neon(impulse, workers[0].spectrum, workers[0].cfg);
+	fftScale = impulse[0] ? 1.f / impulse[0] : 1.f / fftSize;
+
+	std::vector<float> window(fftSize);
+	makeWindow(kStftWindowSqrtHann, window.data(), fftSize);
+	setWindows(window.data(), window.data());
+
+	inputCount = 0;
+	outputCount = 0;
+	hopCount = 0;
+	nextWorker = 0;
+	lateFrames = 0;
+	droppedFrames = 0;
+	stopping = false;
+	for(unsigned int n = 0; n < numWorkers; ++n)
+	{
+		if(workers[n].worker.start(workerLoop, &workers[n], priority, "bela-stft"))
+		{
+			fprintf(stderr, "Stft: unable to create the worker thread\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void Stft::setWindows(const float* analysis, const float* synthesis)
+{
+	// normalise the synthesis window so that the windows overlap-add to 1
+	float sum = 0;
+	for(unsigned int n = 0; n < fftSize; ++n)
+		sum += analysis[n] * synthesis[n];
+	float gain = sum ? hopSize / sum * fftScale : fftScale;
+	for(unsigned int n = 0; n < fftSize; ++n)
+	{
+		analysisWindow[n] = analysis[n];
+		synthesisWindow[n] = synthesis[n] * gain;
+	}
+}
+
+void Stft::makeWindow(StftWindowType type, float* window, unsigned int length)
+{
+	for(unsigned int n = 0; n < length; ++n)
+	{
+		float hann = 0.5f - 0.5f * cosf(2.f * (float)M_PI * n / length);
+		switch(type)
+		{
+		case kStftWindowHann:
+			window[n] = hann;
+			break;
+		case kStftWindowSqrtHann:
+			window[n] = sqrtf(hann);
+			break;
+		case kStftWindowRectangular:
+		default:
+			window[n] = 1;
+			break;
+		}
+	}
+}
+
+void Stft::cleanup()
+{
+	// processFrames() returns after the current frame once `stopping` is
+	// set: once the workers are stopped, none of them touches the buffers
+	stopping = true;
+	for(unsigned int n = 0; n < kMaxStftWorkers; ++n)
+		workers[n].worker.stop();
+	for(unsigned int n = 0; n < numFrames; ++n)
+		NE10_FREE(frames[n].samples);
+	for(unsigned int n = 0; n < numWorkers; ++n)
+	{
+		NE10_FREE(workers[n].cfg);
+		NE10_FREE(workers[n].spectrum);
+		workers[n].cfg = NULL;
+		workers[n].spectrum = NULL;
+	}
+	delete[] frames;
+	delete[] inputBuffer;
+	delete[] outputBuffer;
+	delete[] analysisWindow;
+	delete[] synthesisWindow;
+	frames = NULL;
+	inputBuffer = NULL;
+	outputBuffer = NULL;
+	analysisWindow = NULL;
+	synthesisWindow = NULL;
+	numFrames = 0;
+}
+
+void Stft::workerLoop(void* arg)
+{
+	Worker* w = (Worker*)arg;
+	w->that->processFrames(*w);
+}
+
+void Stft::processFrames(Worker& w)
+{
+	while(!gShouldStop && !stopping)
+	{
+		// process the frame that is due first
+		int best = -1;
+		uint64_t bestStart = 0;
+		for(unsigned int n = 0; n < numFrames; ++n)
+		{
+			if(frames[n].state.load(std::memory_order_acquire) != kFrameQueued)
+				continue;
+			uint64_t start = frames[n].outputStart.load(std::memory_order_relaxed);
+			if(best < 0 || start < bestStart)
+			{
+				best = n;
+				bestStart = start;
+			}
+		}
+		if(best < 0)
+			break;
+		Frame& f = frames[best];
+		int expected = kFrameQueued;
+		if(!f.state.compare_exchange_strong(expected, kFrameProcessing, std::memory_order_acquire))
+			continue; // another worker got there first, or the audio thread gave up on it
+		ne10_fft_r2c_1d_float32_neon(w.spectrum, f.samples, w.cfg);
+		callback(w.spectrum, fftSize / 2 + 1, callbackArg);
+		ne10_fft_c2r_1d_float32_neon(f.samples, w.spectrum, w.cfg);
+		for(unsigned int n = 0; n < fftSize; ++n)
+			f.samples[n] *= synthesisWindow[n];
+		f.state.store(kFrameDone, std::memory_order_release);
+	}
+}
+
+void Stft::collectFrames()
+{
+	for(unsigned int n = 0; n < numFrames; ++n)
+	{
+		Frame& f = frames[n];
+		int state = f.state.load(std::memory_order_acquire);
+		if(state == kFrameFree)
+			continue;
+		if(f.late)
+		{
+			// already counted: wait for the worker to give it back
+			if(state == kFrameDone)
+			{
+				f.late = false;
+				f.state.store(kFrameFree, std::memory_order_release);
+			}
+			continue;
+		}
+		uint64_t outputStart = f.outputStart.load(std::memory_order_relaxed);
+		if(outputStart < outputCount)
+		{
+			// some of its output would have been played already: adding
+			// the rest would leave a discontinuity, so drop it altogether
+			++lateFrames;
+			if(state == kFrameQueued && f.state.compare_exchange_strong(state, kFrameFree))
+				continue;
+			if(state == kFrameDone)
+				f.state.store(kFrameFree, std::memory_order_release);
+			else
+				f.late = true; // a worker has it
+			continue;
+		}
+		if(state != kFrameDone)
+			continue;
+		float* out = outputBuffer;
+		unsigned int start = outputStart & outputMask;
+		unsigned int first = outputMask + 1 - start;
+		if(first > fftSize)
+			first = fftSize;
+		for(unsigned int s = 0; s < first; ++s)
+			out[start + s] += f.samples[s];
+		for(unsigned int s = first; s < fftSize; ++s)
+			out[s - first] += f.samples[s];
+		f.state.store(kFrameFree, std::memory_order_release);
+	}
+}
+
+void Stft::queueFrame()
+{
+	Frame* f = NULL;
+	for(unsigned int n = 0; n < numFrames; ++n)
+	{
+		if(frames[n].state.load(std::memory_order_acquire) == kFrameFree)
+		{
+			f = &frames[n];
+			break;
+		}
+	}
+	if(!f)
+	{
+		++droppedFrames;
+		return;
+	}
+	unsigned int start = (inputCount - fftSize) & inputMask;
+	for(unsigned int n = 0; n < fftSize; ++n)
+		f->samples[n] = inputBuffer[(start + n) & inputMask] * analysisWindow[n];
+	// the frame holds input from inputCount - fftSize, which goes out
+	// fftSize + workerLatency samples later
+	f->outputStart.store(inputCount + workerLatency, std::memory_order_relaxed);
+	f->late = false;
+	f->state.store(kFrameQueued, std::memory_order_release);
+	workers[nextWorker].worker.schedule();
+	if(++nextWorker >= numWorkers)
+		nextWorker = 0;
+}
+
+void Stft::process(const float* input, float* output, unsigned int length)
+{
+	if(!frames)
+		return;
+	collectFrames();
+	unsigned int n = 0;
+	while(n < length)
+	{
+		// run up to the next frame boundary
+		unsigned int run = hopSize - hopCount;
+		if(run > length - n)
+			run = length - n;
+		for(unsigned int s = 0; s < run; ++s)
+		{
+			float in = input[n + s];
+			unsigned int o = (outputCount + s) & outputMask;
+			output[n + s] = outputBuffer[o];
+			outputBuffer[o] = 0;
+			inputBuffer[(inputCount + s) & inputMask] = in;
+		}
+		n += run;
+		inputCount += run;
+		outputCount += run;
+		hopCount += run;
+		if(hopCount == hopSize)
+		{
+			hopCount = 0;
+			queueFrame();
+		}
+	}
+}
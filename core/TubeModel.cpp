@@ -0,0 +1,325 @@
+/***** TubeModel.cpp *****/
+#include <TubeModel.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+TubeModel::TubeModel() :
+	numVoices(0),
+	numGroups(0),
+	numSegments(0),
+	sideLength(0),
+	sideJunction(0),
+	maxFrames(0),
+	stepsPerFrame(1),
+	groupSize(0),
+	reflectionsSize(0),
+	current(0),
+	startReflection(0.75),
+	endReflection(-0.85),
+	tubeDamping(0.999),
+	sideDamping(1)
+{}
+
+int TubeModel::setup(unsigned int newNumVoices, unsigned int newNumSegments, unsigned int newMaxFrames,
+		unsigned int newStepsPerFrame, unsigned int newSideLength, unsigned int newSideJunction)
+{
+	if(!newNumVoices || newNumSegments < 3 || !newMaxFrames || !newStepsPerFrame
+		|| (newSideLength && (newSideJunction < 1 || newSideJunction >= newNumSegments)))
+	{
+		fprintf(stderr, "TubeModel: invalid number of voices %u, of segments %u, of frames %u, of steps %u or side junction %u\n",
+				newNumVoices, newNumSegments, newMaxFrames, newStepsPerFrame, newSideJunction);
+		numVoices = 0;
+		return -1;
+	}
+	numVoices = newNumVoices;
+	numGroups = (numVoices + kLanes - 1) / kLanes;
+	numSegments = newNumSegments;
+	sideLength = newSideLength;
+	sideJunction = newSideLength ? newSideJunction : 0;
+	maxFrames = newMaxFrames;
+	stepsPerFrame = newStepsPerFrame;
+	groupSize = numSegments * kLanes;
+	reflectionsSize = (numSegments + sideLength + 3) * kLanes;
+	current = 0;
+
+	right.assign(2 * numGroups * groupSize, 0);
+	left.assign(2 * numGroups * groupSize, 0);
+	sideRight.assign(2 * numGroups * sideLength * kLanes, 0);
+	sideLeft.assign(2 * numGroups * sideLength * kLanes, 0);
+	reflection.assign(numGroups * reflectionsSize, 0);
+	reflectionDelta.assign(numGroups * reflectionsSize, 0);
+	targetReflection.assign(numGroups * reflectionsSize, 0);
+	area.assign(numVoices * numSegments, 1);
+	sideArea.assign(numVoices * sideLength, 1);
+	noiseSegment.assign(numGroups * kLanes, 0);
+	noiseFraction.assign(numGroups * kLanes, 0);
+	excitationLanes.assign(maxFrames * kLanes, 0);
+	noiseLanes.assign(maxFrames * kLanes, 0);
+	outputLanes.assign(maxFrames * kLanes, 0);
+	// the default shape is a uniform tube and side branch
+	for(unsigned int v = 0; v < numVoices; ++v)
+		computeJunctionReflections(v);
+	reflection = targetReflection;
+	return 0;
+}
+
+float TubeModel::computeReflection(float previousArea, float area)
+{
+	// as in the Pink Trombone, to prevent some bad behaviour when the tube is closed
+	if(0 == area)
+		return 0.999;
+	return (previousArea - area) / (previousArea + area);
+}
+
+void TubeModel::computeJunctionReflections(unsigned int voice)
+{
+	if(!sideLength)
+		return;
+	unsigned int lane = voice % kLanes;
+	float* r = targetReflection.data() + (voice / kLanes) * reflectionsSize + (numSegments + sideLength) * kLanes;
+	float leftArea = area[voice * numSegments + sideJunction - 1];
+	float rightArea = area[voice * numSegments + sideJunction];
+	float branchArea = sideArea[voice * sideLength];
+	float sum = leftArea + rightArea + branchArea;
+	if(0 == sum)
+	{
+		// all closed: reflect everything
+		r[lane] = r[kLanes + lane] = r[2 * kLanes + lane] = -1;
+		return;
+	}
+	r[lane] = (2 * leftArea - sum) / sum;
+	r[kLanes + lane] = (2 * rightArea - sum) / sum;
+	r[2 * kLanes + lane] = (2 * branchArea - sum) / sum;
+}
+
+void TubeModel::setDiameters(unsigned int voice, const float* diameters)
+{
+	if(voice >= numVoices)
+		return;
+	float* a = area.data() + voice * numSegments;
+	for(unsigned int n = 0; n < numSegments; ++n)
+		a[n] = diameters[n] * diameters[n];
+	unsigned int lane = voice % kLanes;
+	float* r = targetReflection.data() + (voice / kLanes) * reflectionsSize;
+	for(unsigned int n = 1; n < numSegments; ++n)
+		r[n * kLanes + lane] = computeReflection(a[n - 1], a[n]);
+	computeJunctionReflections(voice);
+}
+
+void TubeModel::setSideDiameters(unsigned int voice, const float* diameters)
+{
+	if(voice >= numVoices || !sideLength)
+		return;
+	float* a = sideArea.data() + voice * sideLength;
+	for(unsigned int n = 0; n < sideLength; ++n)
+		a[n] = diameters[n] * diameters[n];
+	unsigned int lane = voice % kLanes;
+	float* r = targetReflection.data() + (voice / kLanes) * reflectionsSize + numSegments * kLanes;
+	for(unsigned int n = 1; n < sideLength; ++n)
+		r[n * kLanes + lane] = computeReflection(a[n - 1], a[n]);
+	computeJunctionReflections(voice);
+}
+
+void TubeModel::setEndReflections(float start, float end)
+{
+	startReflection = start;
+	endReflection = end;
+}
+
+void TubeModel::setDamping(float tube, float side)
+{
+	tubeDamping = tube;
+	sideDamping = side;
+}
+
+void TubeModel::setNoisePosition(unsigned int voice, float position)
+{
+	if(voice >= numVoices)
+		return;
+	// the noise goes to segments floor(position) + 1 and floor(position) + 2
+	float maxPosition = numSegments - 3;
+	if(position < 0)
+		position = 0;
+	if(position > maxPosition)
+		position = maxPosition;
+	unsigned int segment = (unsigned int)position;
+	noiseSegment[voice] = segment;
+	noiseFraction[voice] = position - segment;
+}
+
+void TubeModel::reset()
+{
+	memset(right.data(), 0, right.size() * sizeof(right[0]));
+	memset(left.data(), 0, left.size() * sizeof(left[0]));
+	memset(sideRight.data(), 0, sideRight.size() * sizeof(sideRight[0]));
+	memset(sideLeft.data(), 0, sideLeft.size() * sizeof(sideLeft[0]));
+	reflection = targetReflection;
+}
+
+void TubeModel::process(const float* excitation, const float* noise, float* output, unsigned int frames)
+{
+	if(!numVoices || frames > maxFrames)
+	{
+		memset(output, 0, numVoices * frames * sizeof(output[0]));
+		return;
+	}
+	// the reflections move linearly towards the target over the block
+	bool moving = false;
+	for(unsigned int n = 0; n < reflection.size(); ++n)
+	{
+		reflectionDelta[n] = targetReflection[n] - reflection[n];
+		moving |= (reflectionDelta[n] != 0);
+	}
+	unsigned int initialBuffer = current;
+	for(unsigned int g = 0; g < numGroups; ++g)
+	{
+		// gather the inputs of the voices of the group, frame by frame
+		unsigned int lanes = numVoices - g * kLanes < kLanes ? numVoices - g * kLanes : kLanes;
+		memset(excitationLanes.data(), 0, frames * kLanes * sizeof(float));
+		memset(noiseLanes.data(), 0, frames * kLanes * sizeof(float));
+		for(unsigned int l = 0; l < lanes; ++l)
+		{
+			const float* in = excitation + (g * kLanes + l) * frames;
+			for(unsigned int n = 0; n < frames; ++n)
+				excitationLanes[n * kLanes + l] = in[n];
+			if(noise)
+			{
+				in = noise + (g * kLanes + l) * frames;
+				for(unsigned int n = 0; n < frames; ++n)
+					noiseLanes[n * kLanes + l] = in[n];
+			}
+		}
+		// all groups start from the same buffers
+		current = initialBuffer;
+		processGroup(g, frames, noise != NULL, moving);
+		for(unsigned int l = 0; l < lanes; ++l)
+		{
+			float* out = output + (g * kLanes + l) * frames;
+			for(unsigned int n = 0; n < frames; ++n)
+				out[n] = outputLanes[n * kLanes + l];
+		}
+	}
+	reflection = targetReflection;
+}
+
+// Scatter the waves at each junction of a tube, for all the lanes at once:
+// the wave leaving a junction to the right goes into the segment after it,
+// the one leaving it to the left into the segment before it. `size` is the
+// number of segments times kLanes.
+static void scatter(const float* __restrict__ reflection, const float* __restrict__ rightOld,
+		const float* __restrict__ leftOld, float* __restrict__ rightNew, float* __restrict__ leftNew,
+		unsigned int size, float damping)
+{
+	const unsigned int K = TubeModel::kLanes;
+	for(unsigned int i = K; i < size; ++i)
+	{
+		float w = reflection[i] * (rightOld[i - K] + leftOld[i]);
+		rightNew[i] = (rightOld[i - K] - w) * damping;
+		leftNew[i - K] = (leftOld[i] + w) * damping;
+	}
+}
+
+// The same, while the reflections move from `reflection` by `lambda * delta`
+static void scatterMoving(const float* __restrict__ reflection, const float* __restrict__ delta, float lambda,
+		const float* __restrict__ rightOld, const float* __restrict__ leftOld,
+		float* __restrict__ rightNew, float* __restrict__ leftNew, unsigned int size, float damping)
+{
+	const unsigned int K = TubeModel::kLanes;
+	for(unsigned int i = K; i < size; ++i)
+	{
+		float w = (reflection[i] + delta[i] * lambda) * (rightOld[i - K] + leftOld[i]);
+		rightNew[i] = (rightOld[i - K] - w) * damping;
+		leftNew[i - K] = (leftOld[i] + w) * damping;
+	}
+}
+
+void TubeModel::processGroup(unsigned int group, unsigned int frames, bool hasNoise, bool moving)
+{
+	const unsigned int K = kLanes;
+	const unsigned int size = groupSize * numGroups;
+	const unsigned int sideSize = sideLength * K * numGroups;
+	const unsigned int lastSegment = (numSegments - 1) * K;
+	const unsigned int lastSide = sideLength ? (sideLength - 1) * K : 0;
+	const float* reflectionStart = reflection.data() + group * reflectionsSize;
+	const float* delta = reflectionDelta.data() + group * reflectionsSize;
+	const float* sideStart = reflectionStart + numSegments * K;
+	const float* sideDelta = delta + numSegments * K;
+	const float* junctionStart = sideStart + sideLength * K;
+	const float* junctionDelta = sideDelta + sideLength * K;
+	const unsigned int* segment = noiseSegment.data() + group * K;
+	const float* fraction = noiseFraction.data() + group * K;
+	const float lambdaStep = 1.f / (frames * stepsPerFrame);
+	const unsigned int junction = sideJunction * K;
+	float* outputs = outputLanes.data();
+
+	for(unsigned int n = 0; n < frames; ++n)
+	{
+		const float* exc = excitationLanes.data() + n * K;
+		const float* noise = noiseLanes.data() + n * K;
+		float* out = outputs + n * K;
+		for(unsigned int l = 0; l < K; ++l)
+			out[l] = 0;
+		for(unsigned int s = 0; s < stepsPerFrame; ++s)
+		{
+			const float lambda = (n * stepsPerFrame + s) * lambdaStep;
+			float* ro = right.data() + current * size + group * groupSize;
+			float* lo = left.data() + current * size + group * groupSize;
+			float* rn = right.data() + (1 - current) * size + group * groupSize;
+			float* ln = left.data() + (1 - current) * size + group * groupSize;
+			if(hasNoise)
+			{
+				for(unsigned int l = 0; l < K; ++l)
+				{
+					float noise0 = noise[l] * (1 - fraction[l]) * 0.5f;
+					float noise1 = noise[l] * fraction[l] * 0.5f;
+					unsigned int i = (segment[l] + 1) * K + l;
+					ro[i] += noise0;
+					lo[i] += noise0;
+					ro[i + K] += noise1;
+					lo[i + K] += noise1;
+				}
+			}
+			// the ends of the tube
+			for(unsigned int l = 0; l < K; ++l)
+			{
+				rn[l] = (lo[l] * startReflection + exc[l]) * tubeDamping;
+				ln[lastSegment + l] = ro[lastSegment + l] * endReflection * tubeDamping;
+			}
+			if(moving)
+				scatterMoving(reflectionStart, delta, lambda, ro, lo, rn, ln, groupSize, tubeDamping);
+			else
+				scatter(reflectionStart, ro, lo, rn, ln, groupSize, tubeDamping);
+			if(sideLength)
+			{
+				float* sro = sideRight.data() + current * sideSize + group * sideLength * K;
+				float* slo = sideLeft.data() + current * sideSize + group * sideLength * K;
+				float* srn = sideRight.data() + (1 - current) * sideSize + group * sideLength * K;
+				float* sln = sideLeft.data() + (1 - current) * sideSize + group * sideLength * K;
+				// the junction with the side branch replaces the one computed above
+				for(unsigned int l = 0; l < K; ++l)
+				{
+					float rL = junctionStart[l] + junctionDelta[l] * lambda;
+					float rR = junctionStart[K + l] + junctionDelta[K + l] * lambda;
+					float rS = junctionStart[2 * K + l] + junctionDelta[2 * K + l] * lambda;
+					float fromLeft = ro[junction - K + l];
+					float fromRight = lo[junction + l];
+					float fromSide = slo[l];
+					ln[junction - K + l] = (rL * fromLeft + (1 + rL) * (fromSide + fromRight)) * tubeDamping;
+					rn[junction + l] = (rR * fromRight + (1 + rR) * (fromLeft + fromSide)) * tubeDamping;
+					srn[l] = (rS * fromSide + (1 + rS) * (fromRight + fromLeft)) * sideDamping;
+					sln[lastSide + l] = sro[lastSide + l] * endReflection * sideDamping;
+				}
+				if(moving)
+					scatterMoving(sideStart, sideDelta, lambda, sro, slo, srn, sln, sideLength * K, sideDamping);
+				else
+					scatter(sideStart, sro, slo, srn, sln, sideLength * K, sideDamping);
+				for(unsigned int l = 0; l < K; ++l)
+					out[l] += srn[lastSide + l];
+			}
+			for(unsigned int l = 0; l < K; ++l)
+				out[l] += rn[lastSegment + l];
+			current = 1 - current;
+		}
+	}
+}
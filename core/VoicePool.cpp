@@ -0,0 +1,593 @@
+/***** VoicePool.cpp *****/
+#include <VoicePool.h>
+#include <xenomai_wraps.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+VoicePool::VoicePool() :
+	pitchBendRange(2),
+	callback(NULL),
+	callbackArg(NULL),
+	stealing(kVoiceStealOldest),
+	silenceThreshold(0.0001),
+	numVoices(0),
+	paddedVoices(0),
+	numChannels(0),
+	maxFrames(0),
+	groupSize(1),
+	numActiveVoices(0),
+	numRenderedGroups(0),
+	numStolenVoices(0),
+	numWorkerTimeouts(0),
+	nextAge(0),
+	chunkFrames(0),
+	numWorkers(0),
+	workersLate(false),
+	unclaimedGroups(0),
+	renderedGroups(0),
+	stopping(false)
+{
+	memset(&voices, 0, sizeof(voices));
+	for(unsigned int n = 0; n < kVoicePoolMidiChannels; ++n)
+	{
+		sustain[n] = false;
+		pitchBend[n] = 0;
+	}
+	for(unsigned int n = 0; n < kMaxVoicePoolWorkers; ++n)
+	{
+		workers[n].that = this;
+		workers[n].index = n + 1;
+		workers[n].busy = false;
+	}
+}
+
+VoicePool::~VoicePool()
+{
+	cleanup();
+}
+
+int VoicePool::setup(unsigned int newNumVoices, unsigned int newNumChannels, unsigned int newMaxFrames,
+		RenderCallback renderCallback, void* arg, VoiceStealing newStealing,
+		unsigned int newGroupSize, unsigned int newNumWorkers, int priority)
+{
+	cleanup();
+	if(!newNumVoices || !newNumChannels || !newMaxFrames || !renderCallback
+			|| !newGroupSize || newNumWorkers > kMaxVoicePoolWorkers)
+	{
+		fprintf(stderr, "VoicePool: invalid parameters\n");
+		return -1;
+	}
+	// a worker only helps if it runs at the same time as the audio thread.
+	// On a single core the audio thread would preempt a worker that has
+	// claimed a group, and then wait for it until the timeout.
+	long numCores = sysconf(_SC_NPROCESSORS_ONLN);
+	if(numCores > 0 && newNumWorkers > (unsigned long)numCores - 1)
+	{
+		fprintf(stderr, "VoicePool: %ld core(s) available, using %ld worker thread(s) instead of %u\n",
+				numCores, numCores - 1, newNumWorkers);
+		newNumWorkers = numCores - 1;
+	}
+	numVoices = newNumVoices;
+	numChannels = newNumChannels;
+	maxFrames = newMaxFrames;
+	callback = renderCallback;
+	callbackArg = arg;
+	stealing = newStealing;
+	groupSize = newGroupSize;
+	numWorkers = newNumWorkers;
+	unsigned int numGroups = (numVoices + groupSize - 1) / groupSize;
+	paddedVoices = numGroups * groupSize;
+
+	frequency.assign(paddedVoices, 0);
+	velocity.assign(paddedVoices, 0);
+	gate.assign(paddedVoices, 0);
+	level.assign(paddedVoices, 0);
+	triggered.assign(paddedVoices, 0);
+	state.assign(paddedVoices, kVoiceFree);
+	note.assign(paddedVoices, 0);
+	channel.assign(paddedVoices, 0);
+	age.assign(paddedVoices, 0);
+	voices.frequency = frequency.data();
+	voices.velocity = velocity.data();
+	voices.gate = gate.data();
+	voices.level = level.data();
+	voices.triggered = triggered.data();
+	voices.state = state.data();
+	voices.note = note.data();
+	voices.channel = channel.data();
+	voices.age = age.data();
+	groupVoices.assign(numGroups, 0);
+	activeGroups.assign(numGroups, 0);
+	ownGroups.assign(numGroups, 0);
+	lateGroups.assign(numGroups, 0);
+	noteVoices.assign(kVoicePoolMidiChannels * 128, -1);
+	mix.assign((numWorkers + 1) * numChannels * maxFrames, 0);
+	numActiveVoices = 0;
+	numRenderedGroups = 0;
+	numStolenVoices = 0;
+	numWorkerTimeouts = 0;
+	nextAge = 0;
+
+	stopping = false;
+	unclaimedGroups = 0;
+	for(unsigned int n = 0; n < numWorkers; ++n)
+	{
+		workers[n].busy = false;
+		if(workers[n].worker.start(workerLoop, &workers[n], priority, "bela-voices"))
+		{
+			fprintf(stderr, "VoicePool: unable to create the worker thread\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void VoicePool::cleanup()
+{
+	stopping = true;
+	for(unsigned int n = 0; n < kMaxVoicePoolWorkers; ++n)
+		workers[n].worker.stop();
+	numWorkers = 0;
+	workersLate = false;
+}
+
+void VoicePool::setPitchBendRange(float semitones)
+{
+	pitchBendRange = semitones;
+	for(unsigned int v = 0; v < numVoices; ++v)
+	{
+		if(state[v] != kVoiceFree)
+			updateFrequency(v);
+	}
+}
+
+void VoicePool::updateFrequency(unsigned int v)
+{
+	float semitones = note[v] - 69 + pitchBend[channel[v]] * pitchBendRange;
+	frequency[v] = 440.f * powf(2.f, semitones / 12.f);
+}
+
+int VoicePool::findVoice()
+{
+	// a free voice, from a group that is already sounding if there is one
+	int firstFree = -1;
+	unsigned int numGroups = groupVoices.size();
+	for(unsigned int g = 0; g < numGroups; ++g)
+	{
+		if(groupVoices[g] == groupSize)
+			continue;
+		if(firstFree >= 0 && !groupVoices[g])
+			continue;
+		for(unsigned int v = g * groupSize; v < (g + 1) * groupSize && v < numVoices; ++v)
+		{
+			if(state[v] != kVoiceFree)
+				continue;
+			if(groupVoices[g])
+				return v;
+			firstFree = v;
+			break;
+		}
+	}
+	if(firstFree >= 0)
+		return firstFree;
+	if(kVoiceStealNone == stealing)
+		return -1;
+
+	// steal the quietest of the voices that are fading out
+	int best = -1;
+	for(unsigned int v = 0; v < numVoices; ++v)
+	{
+		if(kVoiceReleased == state[v] && (best < 0 || level[v] < level[best]))
+			best = v;
+	}
+	if(best < 0)
+	{
+		for(unsigned int v = 0; v < numVoices; ++v)
+		{
+			if(best < 0)
+			{
+				best = v;
+				continue;
+			}
+			bool better;
+			switch(stealing)
+			{
+			case kVoiceStealQuietest:
+				better = level[v] < level[best];
+				break;
+			case kVoiceStealLowest:
+				better = note[v] < note[best];
+				break;
+			case kVoiceStealHighest:
+				better = note[v] > note[best];
+				break;
+			case kVoiceStealOldest:
+			default:
+				// this works across the wrap-around of the counter
+				better = (int)(age[v] - age[best]) < 0;
+				break;
+			}
+			if(better)
+				best = v;
+		}
+	}
+	++numStolenVoices;
+	return best;
+}
+
+void VoicePool::startVoice(unsigned int v, unsigned int newChannel, unsigned int newNote, unsigned int newVelocity)
+{
+	if(kVoiceFree == state[v])
+	{
+		++groupVoices[v / groupSize];
+		++numActiveVoices;
+	}
+	else
+	{
+		int& previous = noteVoices[channel[v] * 128 + note[v]];
+		if(previous == (int)v)
+			previous = -1;
+	}
+	state[v] = kVoiceHeld;
+	note[v] = newNote;
+	channel[v] = newChannel;
+	velocity[v] = newVelocity / 127.f;
+	gate[v] = 1;
+	triggered[v] = 1;
+	age[v] = nextAge++;
+	noteVoices[newChannel * 128 + newNote] = v;
+	updateFrequency(v);
+}
+
+void VoicePool::releaseVoice(unsigned int v)
+{
+	state[v] = kVoiceReleased;
+	gate[v] = 0;
+}
+
+void VoicePool::freeVoice(unsigned int v)
+{
+	int& previous = noteVoices[channel[v] * 128 + note[v]];
+	if(previous == (int)v)
+		previous = -1;
+	state[v] = kVoiceFree;
+	gate[v] = 0;
+	velocity[v] = 0;
+	--groupVoices[v / groupSize];
+	--numActiveVoices;
+}
+
+int VoicePool::noteOn(unsigned int newChannel, unsigned int newNote, unsigned int newVelocity)
+{
+	if(!numVoices || newChannel >= kVoicePoolMidiChannels || newNote > 127)
+		return -1;
+	if(!newVelocity)
+	{
+		noteOff(newChannel, newNote);
+		return -1;
+	}
+	// retrigger the voice if the note is already sounding
+	int v = noteVoices[newChannel * 128 + newNote];
+	if(v < 0)
+		v = findVoice();
+	if(v < 0)
+		return -1;
+	startVoice(v, newChannel, newNote, newVelocity);
+	return v;
+}
+
+void VoicePool::noteOff(unsigned int offChannel, unsigned int offNote)
+{
+	if(!numVoices || offChannel >= kVoicePoolMidiChannels || offNote > 127)
+		return;
+	int v = noteVoices[offChannel * 128 + offNote];
+	if(v < 0 || state[v] != kVoiceHeld)
+		return;
+	if(sustain[offChannel])
+		state[v] = kVoiceSustained;
+	else
+		releaseVoice(v);
+}
+
+void VoicePool::setSustain(unsigned int sustainChannel, bool on)
+{
+	if(sustainChannel >= kVoicePoolMidiChannels)
+		return;
+	sustain[sustainChannel] = on;
+	if(on)
+		return;
+	for(unsigned int v = 0; v < numVoices; ++v)
+	{
+		if(kVoiceSustained == state[v] && channel[v] == (int)sustainChannel)
+			releaseVoice(v);
+	}
+}
+
+void VoicePool::setPitchBend(unsigned int bendChannel, float bend)
+{
+	if(bendChannel >= kVoicePoolMidiChannels)
+		return;
+	pitchBend[bendChannel] = bend;
+	for(unsigned int v = 0; v < numVoices; ++v)
+	{
+		if(state[v] != kVoiceFree && channel[v] == (int)bendChannel)
+			updateFrequency(v);
+	}
+}
+
+void VoicePool::allNotesOff()
+{
+	for(unsigned int n = 0; n < kVoicePoolMidiChannels; ++n)
+		sustain[n] = false;
+	for(unsigned int v = 0; v < numVoices; ++v)
+	{
+		if(kVoiceHeld == state[v] || kVoiceSustained == state[v])
+			releaseVoice(v);
+	}
+}
+
+void VoicePool::reset()
+{
+	for(unsigned int n = 0; n < kVoicePoolMidiChannels; ++n)
+		sustain[n] = false;
+	for(unsigned int v = 0; v < numVoices; ++v)
+	{
+		if(state[v] != kVoiceFree)
+			freeVoice(v);
+		level[v] = 0;
+		triggered[v] = 0;
+	}
+}
+
+void VoicePool::processMessage(MidiChannelMessage& message)
+{
+	unsigned int messageChannel = message.getChannel();
+	switch(message.getType())
+	{
+	case kmmNoteOn:
+		noteOn(messageChannel, message.getDataByte(0), message.getDataByte(1));
+		break;
+	case kmmNoteOff:
+		noteOff(messageChannel, message.getDataByte(0));
+		break;
+	case kmmPitchBend:
+	{
+		int value = message.getDataByte(0) + (message.getDataByte(1) << 7);
+		setPitchBend(messageChannel, (value - 8192) / 8192.f);
+		break;
+	}
+	case kmmControlChange:
+	{
+		unsigned int controller = message.getDataByte(0);
+		if(64 == controller)
+		{
+			setSustain(messageChannel, message.getDataByte(1) >= 64);
+		}
+		else if(120 == controller || 123 == controller)
+		{
+			// all sound off frees the voices, all notes off releases
+			// the notes, which the sustain pedal may still hold
+			for(unsigned int v = 0; v < numVoices; ++v)
+			{
+				if(kVoiceFree == state[v] || channel[v] != (int)messageChannel)
+					continue;
+				if(120 == controller)
+					freeVoice(v);
+				else if(kVoiceHeld == state[v])
+					noteOff(messageChannel, note[v]);
+			}
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void VoicePool::processMidi(MidiParser* parser)
+{
+	if(!parser)
+		return;
+	while(parser->numAvailableMessages() > 0)
+	{
+		MidiChannelMessage message = parser->getNextChannelMessage();
+		processMessage(message);
+	}
+}
+
+void VoicePool::workerLoop(void* arg)
+{
+	Worker* w = (Worker*)arg;
+	if(gShouldStop || w->that->stopping)
+		return;
+	w->busy.store(true);
+	w->that->renderGroups(w->index);
+	w->busy.store(false, std::memory_order_release);
+}
+
+int VoicePool::claimGroup()
+{
+	// claim the groups from the end of activeGroups. activeGroups and
+	// chunkFrames are written before unclaimedGroups is, and they do not
+	// change while a worker may be rendering one of them.
+	unsigned int remaining = unclaimedGroups.load(std::memory_order_acquire);
+	do {
+		if(!remaining)
+			return -1;
+	} while(!unclaimedGroups.compare_exchange_weak(remaining, remaining - 1, std::memory_order_acq_rel, std::memory_order_acquire));
+	return remaining - 1;
+}
+
+void VoicePool::renderGroups(unsigned int mixIndex)
+{
+	float* out = mix.data() + mixIndex * numChannels * maxFrames;
+	int n;
+	while((n = claimGroup()) >= 0)
+	{
+		callback(*this, activeGroups[n] * groupSize, out, chunkFrames, callbackArg);
+		renderedGroups.fetch_add(1, std::memory_order_release);
+	}
+}
+
+void VoicePool::freeFadedVoices(unsigned int group)
+{
+	unsigned int start = group * groupSize;
+	for(unsigned int v = start; v < start + groupSize; ++v)
+	{
+		triggered[v] = 0;
+		if(kVoiceReleased == state[v] && level[v] <= silenceThreshold)
+			freeVoice(v);
+	}
+}
+
+void VoicePool::renderChunk(unsigned int frames)
+{
+	unsigned int numGroups = groupVoices.size();
+	unsigned int mixSize = numChannels * frames;
+	if(workersLate)
+	{
+		workersLate = false;
+		for(unsigned int n = 0; n < numWorkers; ++n)
+		{
+			if(workers[n].busy.load(std::memory_order_acquire))
+				workersLate = true;
+		}
+		if(!workersLate)
+			memset(lateGroups.data(), 0, numGroups);
+	}
+	if(workersLate)
+	{
+		// a worker may still be rendering one of the late groups, reading
+		// activeGroups and chunkFrames: render the others without them
+		memset(mix.data(), 0, mixSize * sizeof(mix[0]));
+		numRenderedGroups = 0;
+		for(unsigned int g = 0; g < numGroups; ++g)
+		{
+			if(!groupVoices[g] || lateGroups[g])
+				continue;
+			callback(*this, g * groupSize, mix.data(), frames, callbackArg);
+			freeFadedVoices(g);
+			++numRenderedGroups;
+		}
+		return;
+	}
+
+	unsigned int numActive = 0;
+	for(unsigned int g = 0; g < numGroups; ++g)
+	{
+		if(groupVoices[g])
+			activeGroups[numActive++] = g;
+	}
+	numRenderedGroups = numActive;
+	unsigned int numHelpers = numActive > 1 ? numActive - 1 : 0;
+	if(numHelpers > numWorkers)
+		numHelpers = numWorkers;
+	if(!numHelpers)
+	{
+		memset(mix.data(), 0, mixSize * sizeof(mix[0]));
+		for(unsigned int n = 0; n < numActive; ++n)
+			callback(*this, activeGroups[n] * groupSize, mix.data(), frames, callbackArg);
+	}
+	else
+	{
+		// a worker woken up for a previous block may claim a group, so
+		// all the mix buffers are used
+		unsigned int bufferSize = numChannels * maxFrames;
+		for(unsigned int b = 0; b <= numWorkers; ++b)
+			memset(mix.data() + b * bufferSize, 0, mixSize * sizeof(mix[0]));
+		memset(ownGroups.data(), 0, numActive);
+		chunkFrames = frames;
+		renderedGroups.store(0, std::memory_order_relaxed);
+		unclaimedGroups.store(numActive, std::memory_order_release);
+		for(unsigned int n = 0; n < numHelpers; ++n)
+			workers[n].worker.schedule();
+		unsigned int numOwn = 0;
+		int n;
+		while((n = claimGroup()) >= 0)
+		{
+			callback(*this, activeGroups[n] * groupSize, mix.data(), frames, callbackArg);
+			ownGroups[n] = 1;
+			++numOwn;
+		}
+		// only wait for the groups that the workers have claimed and are
+		// rendering: they run on other cores, so this is short unless a
+		// worker has been preempted
+		time_ns_t deadline = task_get_time_ns() + kVoicePoolWorkerTimeout;
+		while(renderedGroups.load(std::memory_order_acquire) != numActive - numOwn)
+		{
+			if(task_get_time_ns() > deadline)
+			{
+				workersLate = true;
+				break;
+			}
+		}
+		if(workersLate)
+		{
+			++numWorkerTimeouts;
+			numRenderedGroups = numOwn;
+			for(unsigned int n = 0; n < numActive; ++n)
+			{
+				if(!ownGroups[n])
+					lateGroups[activeGroups[n]] = 1;
+			}
+		}
+		else
+		{
+			float* __restrict__ out = mix.data();
+			for(unsigned int b = 1; b <= numWorkers; ++b)
+			{
+				const float* __restrict__ in = mix.data() + b * bufferSize;
+				for(unsigned int n = 0; n < mixSize; ++n)
+					out[n] += in[n];
+			}
+		}
+	}
+
+	// free the released voices that have faded out
+	for(unsigned int n = 0; n < numActive; ++n)
+	{
+		if(!lateGroups[activeGroups[n]])
+			freeFadedVoices(activeGroups[n]);
+	}
+}
+
+void VoicePool::render(float* out, unsigned int frames)
+{
+	if(!numVoices)
+		return;
+	for(unsigned int start = 0; start < frames; start += maxFrames)
+	{
+		unsigned int length = frames - start < maxFrames ? frames - start : maxFrames;
+		renderChunk(length);
+		for(unsigned int c = 0; c < numChannels; ++c)
+			memcpy(out + c * frames + start, mix.data() + c * length, length * sizeof(out[0]));
+	}
+}
+
+void VoicePool::render(BelaContext* context)
+{
+	if(!numVoices)
+		return;
+	unsigned int frames = context->audioFrames;
+	for(unsigned int start = 0; start < frames; start += maxFrames)
+	{
+		unsigned int length = frames - start < maxFrames ? frames - start : maxFrames;
+		renderChunk(length);
+		for(unsigned int ch = 0; ch < context->audioOutChannels; ++ch)
+		{
+			if(numChannels > 1 && ch >= numChannels)
+				break;
+			const float* in = mix.data() + (numChannels > 1 ? ch : 0) * length;
+			for(unsigned int n = 0; n < length; ++n)
+			{
+				unsigned int frame = start + n;
+				if(context->flags & BELA_FLAG_INTERLEAVED)
+					context->audioOut[frame * context->audioOutChannels + ch] += in[n];
+				else
+					context->audioOut[ch * frames + frame] += in[n];
+			}
+		}
+	}
+}
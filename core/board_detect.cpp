@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include "../include/Bela.h"
 #include <iostream>
 #include <fstream>
@@ -29,8 +30,15 @@ static void read_eeprom(){
 	fclose(fp);
 }
 
+static bool eeprom_read = false;
+static void read_eeprom_once(){
+	if(!eeprom_read)
+		read_eeprom();
+	eeprom_read = true;
+}
+
 static int is_belamini(){
-	read_eeprom();
+	read_eeprom_once();
 	if (strstr(eeprom_str, "A335PBGL") != NULL){
 		return 1;
 	}
@@ -75,6 +83,53 @@ static bool detectTlv32()
 	// return true if detected, false otherwise
 }
 
+// Returns true if something acknowledges on the address of the Tlv32 codec.
+// Unlike detectTlv32(), this does not reset the codec, so it is quick enough
+// to validate the cached hardware configuration.
+static bool probeTlv32()
+{
+	char name[MAX_BUF_NAME];
+	snprintf(name, sizeof(name), "/dev/i2c-%d", codecI2cBus);
+	int fd = open(name, O_RDWR);
+	if(fd < 0)
+		return false;
+	bool found = false;
+	char reg = 0; // page select register: reading it has no side effects
+	char value;
+	if(ioctl(fd, I2C_SLAVE, codecI2cAddress) >= 0 && write(fd, &reg, 1) == 1 && read(fd, &value, 1) == 1) // NOWRAP
+		found = true;
+	close(fd);
+	return found;
+}
+
+static bool hasTlv32(BelaHw hw)
+{
+	return hw != BelaHw_CtagFace && hw != BelaHw_CtagBeast && hw != BelaHw_NoHw;
+}
+
+// The value detectCtag() returns on a given hardware
+static int getCtagCodecs(BelaHw hw)
+{
+	if(hw == BelaHw_CtagFace || hw == BelaHw_CtagFaceBela)
+		return 1;
+	if(hw == BelaHw_CtagBeast || hw == BelaHw_CtagBeastBela)
+		return 2;
+	return 0;
+}
+
+// Returns true if the spidev devices used by the CTAG codecs of the given
+// hardware exist. Unlike detectCtag(), this does not reset or probe the
+// codecs, so it is quick enough to validate the cached hardware configuration.
+static bool hasCtagDevices(BelaHw hw)
+{
+	int codecs = getCtagCodecs(hw);
+	if(codecs >= 1 && access(ctagSpidevGpioCs0, F_OK))
+		return false;
+	if(codecs >= 2 && access(ctagSpidevGpioCs1, F_OK))
+		return false;
+	return true;
+}
+
 // Returns:
 //	0 if no Spi codec
 //	1 if has only master
@@ -194,12 +249,90 @@ static int write_config_file(std::string path, BelaHw hardware)
 	return -1;
 }
 
+// The content of the board EEPROM (name, revision and serial number), used
+// to tell whether the persistent cache was written on this board.
+static std::string get_board_key()
+{
+	read_eeprom_once();
+	std::string key;
+	char hex[3];
+	for(int n = 0; n < EEPROM_NUMCHARS; ++n)
+	{
+		snprintf(hex, sizeof(hex), "%02x", (unsigned char)eeprom_str[n]);
+		key += hex;
+	}
+	return key;
+}
+
+static std::string parse_config_string(std::string path, std::string searchStr)
+{
+	std::ifstream inputFile;
+	std::string line;
+	inputFile.open(path.c_str());
+	if(!inputFile.fail())
+	{
+		while (std::getline(inputFile, line))
+		{
+			auto vec = split(line, '=');
+			if(vec.size() == 2 && trim(vec[0]) == searchStr)
+				return trim(vec[1]);
+		}
+	}
+	return "";
+}
+
+// The detection in /run/bela/belaconfig is lost at every power cycle, so we
+// also keep it in persistent storage, together with the board it was detected on.
+// It is only used if the board is the same, the Tlv32 codec is still (or still not)
+// there and, for a CTAG configuration, the spidev devices of its codecs exist,
+// which catches the cape being removed, added or swapped and the CTAG
+// overlay going away. Adding a CTAG board to a board that had none is not
+// noticed: delete the cache to detect it again.
+static const char* persistentCachePath = "/var/cache/bela/belaconfig";
+
+static BelaHw read_persistent_cache()
+{
+	BelaHw hw = parse_config_file(persistentCachePath, "HARDWARE");
+	if(hw == BelaHw_NoHw)
+		return hw;
+	if(parse_config_string(persistentCachePath, "BOARD_KEY") != get_board_key())
+		return BelaHw_NoHw;
+	if(hasTlv32(hw) != probeTlv32())
+		return BelaHw_NoHw;
+	if(!hasCtagDevices(hw))
+		return BelaHw_NoHw;
+	return hw;
+}
+
+static int write_persistent_cache(BelaHw hardware)
+{
+	std::string path = persistentCachePath;
+	std::ofstream outputFile;
+	system(("bash -c \"mkdir -p `dirname "+path+"`\"").c_str());
+	outputFile.open(path.c_str());
+	if(outputFile.is_open())
+	{
+		outputFile << "HARDWARE=" << getBelaHwName(hardware) << "\n";
+		outputFile << "BOARD_KEY=" << get_board_key() << "\n";
+		outputFile.close();
+		return 0;
+	}
+	fprintf(stderr, "File %s could not be opened\n.", path.c_str());
+	return -1;
+}
+
 BelaHw Bela_detectHw()
 {
 	std::string configPath = "/run/bela/belaconfig";
 	BelaHw hw = parse_config_file(configPath, "HARDWARE");
 	if(hw != BelaHw_NoHw)
 		return hw;
+	hw = read_persistent_cache();
+	if(hw != BelaHw_NoHw)
+	{
+		write_config_file(configPath, hw);
+		return hw;
+	}
 	if(is_belamini())
 	{
 		hw =  BelaHw_BelaMini;
@@ -228,7 +361,10 @@ BelaHw Bela_detectHw()
 		}
 	}
 	if(hw != BelaHw_NoHw)
+	{
 		write_config_file(configPath, hw);
+		write_persistent_cache(hw);
+	}
 	return hw;
 }
 
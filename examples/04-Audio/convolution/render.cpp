@@ -0,0 +1,121 @@
+/*
+ ____  _____ _        _    
+| __ )| ____| |      / \   
+|  _ \|  _| | |     / _ \  
+| |_) | |___| |___ / ___ \ 
+|____/|_____|_____/_/   \_\
+
+The platform for ultra-low latency audio and sensor processing
+
+http://bela.io
+
+A project of the Augmented Instruments Laboratory within the
+Centre for Digital Music at Queen Mary University of London.
+http://www.eecs.qmul.ac.uk/~andrewm
+
+(c) 2016 Augmented Instruments Laboratory: Andrew McPherson,
+    Astrid Bin, Liam Donovan, Christian Heinrichs, Robert Jack,
+    Giulio Moro, Laurel Pardue, Victor Zappi. All rights reserved.
+
+The Bela software is distributed under the GNU Lesser General Public License
+(LGPL 3.0), available here: https://www.gnu.org/licenses/lgpl-3.0.txt
+*/
+
+
+#include <Bela.h>
+#include <Convolver.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#define NUM_CHANNELS 2
+
+float gReverbTime = 2;       // the time it takes the impulse response to decay by 60dB, in seconds
+float gDryWet = 0.3;         // the amount of reverb in the output
+
+ConvolverIr gImpulseResponse;
+Convolver gConvolvers[NUM_CHANNELS];
+std::vector<float> gWet;
+
+// Fill an impulse response with exponentially decaying noise
+void makeReverb(float* ir, unsigned int length, float sampleRate, float reverbTime)
+{
+	float decay = powf(0.001f, 1.f / (reverbTime * sampleRate));
+	float gain = 0.1f;
+	for(unsigned int n = 0; n < length; ++n)
+	{
+		ir[n] = gain * (rand() / (float)RAND_MAX * 2.f - 1.f);
+		gain *= decay;
+	}
+}
+
+bool setup(BelaContext *context, void *userData)
+{
+	if(context->audioInChannels < NUM_CHANNELS || context->audioOutChannels < NUM_CHANNELS)
+	{
+		rt_printf("Error: this example needs %d audio inputs and outputs\n", NUM_CHANNELS);
+		return false;
+	}
+	// one impulse response, shared by the convolvers of all the channels
+	std::vector<float> ir(gReverbTime * context->audioSampleRate);
+	makeReverb(ir.data(), ir.size(), context->audioSampleRate, gReverbTime);
+	if(gImpulseResponse.setup(ir.data(), ir.size()))
+		return false;
+	for(unsigned int ch = 0; ch < NUM_CHANNELS; ++ch)
+	{
+		if(gConvolvers[ch].setup(&gImpulseResponse))
+			return false;
+	}
+	gWet.resize(context->audioFrames);
+	return true;
+}
+
+void render(BelaContext *context, void *userData)
+{
+	for(unsigned int ch = 0; ch < NUM_CHANNELS; ++ch)
+	{
+		for(unsigned int n = 0; n < context->audioFrames; ++n)
+			gWet[n] = audioRead(context, n, ch);
+		gConvolvers[ch].process(gWet.data(), gWet.data(), context->audioFrames);
+		for(unsigned int n = 0; n < context->audioFrames; ++n)
+		{
+			float dry = audioRead(context, n, ch);
+			audioWrite(context, n, ch, dry * (1 - gDryWet) + gWet[n] * gDryWet);
+		}
+	}
+}
+
+void cleanup(BelaContext *context, void *userData)
+{
+	for(unsigned int ch = 0; ch < NUM_CHANNELS; ++ch)
+	{
+		if(gConvolvers[ch].getLateBlocks())
+			printf("Channel %u: %u blocks of the reverb tail were late\n", ch, gConvolvers[ch].getLateBlocks());
+		gConvolvers[ch].cleanup();
+	}
+}
+
+/**
+\example convolution/render.cpp
+
+Convolution reverb
+------------------
+
+This example applies a two-second reverb to the audio inputs by convolving
+them with a long impulse response, using the `Convolver` class.
+
+Convolving with an impulse response of N taps in the time domain (as in the
+`filter-FIR` example) costs N multiply-adds per sample, which is far too
+expensive for a reverb. `Convolver` splits the impulse response into
+partitions: the first few taps are applied in the time domain, so that there
+is no added latency, the next ones with short FFTs on the audio thread, and
+the long tail with large FFTs on a lower priority thread, which has plenty
+of time to compute them. All the channels share the same `ConvolverIr`,
+which holds the spectra of the partitions, while each channel has its own
+`Convolver`.
+
+The audio thread therefore only pays for the head and the body, whatever the
+length of the impulse response. To see how `Convolver` compares with the
+time-domain convolution, run the `convolution` benchmark of the
+`dsp-benchmarks` project in `terminal-only`.
+*/
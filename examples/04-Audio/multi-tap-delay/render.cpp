@@ -0,0 +1,155 @@
+/*
+ ____  _____ _        _    
+| __ )| ____| |      / \   
+|  _ \|  _| | |     / _ \  
+| |_) | |___| |___ / ___ \ 
+|____/|_____|_____/_/   \_\
+
+The platform for ultra-low latency audio and sensor processing
+
+http://bela.io
+
+A project of the Augmented Instruments Laboratory within the
+Centre for Digital Music at Queen Mary University of London.
+http://www.eecs.qmul.ac.uk/~andrewm
+
+(c) 2016 Augmented Instruments Laboratory: Andrew McPherson,
+    Astrid Bin, Liam Donovan, Christian Heinrichs, Robert Jack,
+    Giulio Moro, Laurel Pardue, Victor Zappi. All rights reserved.
+
+The Bela software is distributed under the GNU Lesser General Public License
+(LGPL 3.0), available here: https://www.gnu.org/licenses/lgpl-3.0.txt
+*/
+
+
+
+#include <Bela.h>
+#include <DelayLine.h>
+#include <cmath>
+#include <vector>
+
+#define NUM_CHANNELS 2
+#define NUM_TAPS 4
+
+float gMaxDelayTime = 1;       // the longest delay, in seconds
+float gPatternInterval = 4;    // how often the taps move, in seconds
+float gCrossfadeTime = 0.05;   // how long the taps take to move, in seconds
+float gChorusDepth = 0.003;    // the depth of the chorus, in seconds
+float gChorusRate = 0.4;       // the rate of the chorus, in Hz
+float gFeedback = 0.35;        // the amount of the chorus fed back into the delay line
+float gDryWet = 0.4;           // the amount of the taps in the output
+
+// the tap times of each pattern, as fractions of gMaxDelayTime
+const float gPatterns[][NUM_TAPS] = {
+	{ 0.125, 0.25, 0.5, 0.75 },
+	{ 0.1875, 0.375, 0.5625, 0.9375 },
+	{ 0.1, 0.3, 0.55, 0.8 },
+};
+const float gTapGains[NUM_TAPS] = { 0.6, 0.45, 0.3, 0.2 };
+
+DelayLine<float> gDelayLine;
+DelayLineTap gTaps[NUM_CHANNELS][NUM_TAPS];
+std::vector<float> gIn;
+std::vector<float> gWet;
+std::vector<float> gChorus;
+std::vector<float> gChorusDelays;
+float gChorusPhase = 0;
+unsigned int gPattern = 0;
+unsigned int gPatternCount = 0;
+
+bool setup(BelaContext *context, void *userData)
+{
+	if(context->audioInChannels < NUM_CHANNELS || context->audioOutChannels < NUM_CHANNELS)
+	{
+		rt_printf("Error: this example needs %d audio inputs and outputs\n", NUM_CHANNELS);
+		return false;
+	}
+
+	unsigned int maxDelay = gMaxDelayTime * context->audioSampleRate;
+	gDelayLine.setup(maxDelay, NUM_CHANNELS, context->audioFrames);
+	for(unsigned int ch = 0; ch < NUM_CHANNELS; ++ch)
+	{
+		for(unsigned int k = 0; k < NUM_TAPS; ++k)
+			gTaps[ch][k].setDelay(gPatterns[0][k] * maxDelay, 0);
+	}
+	gIn.resize(context->audioFrames);
+	gWet.resize(context->audioFrames);
+	gChorus.resize(context->audioFrames);
+	gChorusDelays.resize(context->audioFrames);
+	return true;
+}
+
+void render(BelaContext *context, void *userData)
+{
+	// move the taps to the next pattern, crossfading to avoid clicks
+	gPatternCount += context->audioFrames;
+	if(gPatternCount >= gPatternInterval * context->audioSampleRate)
+	{
+		gPatternCount = 0;
+		gPattern = (gPattern + 1) % (sizeof(gPatterns) / sizeof(gPatterns[0]));
+		unsigned int maxDelay = gMaxDelayTime * context->audioSampleRate;
+		for(unsigned int ch = 0; ch < NUM_CHANNELS; ++ch)
+		{
+			for(unsigned int k = 0; k < NUM_TAPS; ++k)
+			{
+				// spread the taps of the two channels a little
+				float time = gPatterns[gPattern][k] * (1 - 0.02f * ch);
+				gTaps[ch][k].setDelay(time * maxDelay, gCrossfadeTime * context->audioSampleRate);
+			}
+		}
+	}
+
+	// the chorus delay is modulated by a sine LFO, in quadrature between the channels
+	float phaseIncrement = 2 * (float)M_PI * gChorusRate / context->audioSampleRate;
+	float centre = 2 * gChorusDepth * context->audioSampleRate + context->audioFrames + 2;
+	float depth = gChorusDepth * context->audioSampleRate;
+	for(unsigned int ch = 0; ch < NUM_CHANNELS; ++ch)
+	{
+		float phase = gChorusPhase + ch * 0.5f * (float)M_PI;
+		for(unsigned int n = 0; n < context->audioFrames; ++n)
+			gChorusDelays[n] = centre + depth * sinf(phase + n * phaseIncrement);
+		// the chorus delay is longer than the block, so it can be read
+		// before the block is written and fed back into the input
+		gDelayLine.readModulated(ch, gChorus.data(), context->audioFrames, gChorusDelays.data(), kDelayInterpolationAllpass);
+		for(unsigned int n = 0; n < context->audioFrames; ++n)
+			gIn[n] = audioRead(context, n, ch) + gFeedback * gChorus[n];
+		gDelayLine.write(ch, gIn.data(), context->audioFrames);
+		gDelayLine.readTaps(ch, gWet.data(), context->audioFrames, gTaps[ch], gTapGains, NUM_TAPS);
+		for(unsigned int n = 0; n < context->audioFrames; ++n)
+		{
+			float dry = audioRead(context, n, ch);
+			audioWrite(context, n, ch, dry * (1 - gDryWet) + (gWet[n] + gChorus[n]) * gDryWet);
+		}
+	}
+	gDelayLine.advance(context->audioFrames);
+	gChorusPhase += context->audioFrames * phaseIncrement;
+	if(gChorusPhase > 2 * (float)M_PI)
+		gChorusPhase -= 2 * (float)M_PI;
+}
+
+void cleanup(BelaContext *context, void *userData)
+{
+}
+
+/**
+\example multi-tap-delay/render.cpp
+
+Multi-tap delay with chorus
+---------------------------
+
+This example runs a multi-tap delay and a chorus on the audio inputs, using
+the `DelayLine` class.
+
+Each channel has four taps, which jump to a new rhythmic pattern every few
+seconds: a `DelayLineTap` crossfades from the old delay time to the new one
+over a few milliseconds, instead of jumping, which would click. A chorus is
+read from the same delay line, with a delay modulated by a slow sine and
+interpolated with an allpass filter, and fed back into the input.
+
+`DelayLine` processes a block at a time: its buffers have a power-of-two
+size, so positions wrap with a mask, and the start of each buffer is copied
+after its end, so that reading a block at a constant delay is a loop over
+contiguous memory, which the compiler vectorises. The `delay` benchmark in
+`terminal-only/dsp-benchmarks` measures how this compares with a delay line
+that processes one sample at a time.
+*/
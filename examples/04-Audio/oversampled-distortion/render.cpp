@@ -0,0 +1,116 @@
+/*
+ ____  _____ _        _    
+| __ )| ____| |      / \   
+|  _ \|  _| | |     / _ \  
+| |_) | |___| |___ / ___ \ 
+|____/|_____|_____/_/   \_\
+
+The platform for ultra-low latency audio and sensor processing
+
+http://bela.io
+
+A project of the Augmented Instruments Laboratory within the
+Centre for Digital Music at Queen Mary University of London.
+http://www.eecs.qmul.ac.uk/~andrewm
+
+(c) 2016 Augmented Instruments Laboratory: Andrew McPherson,
+    Astrid Bin, Liam Donovan, Christian Heinrichs, Robert Jack,
+    Giulio Moro, Laurel Pardue, Victor Zappi. All rights reserved.
+
+The Bela software is distributed under the GNU Lesser General Public License
+(LGPL 3.0), available here: https://www.gnu.org/licenses/lgpl-3.0.txt
+*/
+
+
+#include <Bela.h>
+#include <Oversampler.h>
+#include <cmath>
+#include <vector>
+
+#define NUM_CHANNELS 2
+
+unsigned int gFactor = 4;                 // the oversampling factor: 1, 2, 4 or 8
+OversamplerFilter gFilter = kOversamplerIir; // kOversamplerFir for a linear-phase response
+float gDrive = 4;                         // the gain before the wave folder
+float gOutputGain = 0.5;
+
+Oversampler gOversampler;
+std::vector<float> gBuffer;
+
+// A rational approximation of tanh(), which the compiler can vectorise
+static inline float saturate(float x)
+{
+	x = x > 3.f ? 3.f : (x < -3.f ? -3.f : x);
+	float x2 = x * x;
+	return x * (27.f + x2) / (27.f + 9.f * x2);
+}
+
+// Fold the signal back into [-1, 1], then saturate it: this generates
+// harmonics far above the Nyquist frequency, which alias without oversampling
+void distort(float* samples, unsigned int frames, float drive)
+{
+	for(unsigned int n = 0; n < frames; ++n)
+	{
+		float x = samples[n] * drive * 0.25f + 0.25f;
+		x -= floorf(x);
+		x = 4.f * fabsf(x - 0.5f) - 1.f; // a triangle wave of the input
+		samples[n] = saturate(1.5f * x);
+	}
+}
+
+bool setup(BelaContext *context, void *userData)
+{
+	if(context->audioInChannels < NUM_CHANNELS || context->audioOutChannels < NUM_CHANNELS)
+	{
+		fprintf(stderr, "This example needs %u audio inputs and outputs\n", NUM_CHANNELS);
+		return false;
+	}
+	if(gOversampler.setup(NUM_CHANNELS, gFactor, context->audioFrames, gFilter))
+		return false;
+	gBuffer.resize(context->audioFrames);
+	rt_printf("Oversampling by %u, latency: %.2f samples\n", gFactor, gOversampler.getLatency());
+	return true;
+}
+
+void render(BelaContext *context, void *userData)
+{
+	float drive = gDrive;
+	for(unsigned int ch = 0; ch < NUM_CHANNELS; ++ch)
+	{
+		for(unsigned int n = 0; n < context->audioFrames; ++n)
+			gBuffer[n] = audioRead(context, n, ch);
+		// the lambda runs at gFactor times the sample rate
+		gOversampler.process(ch, gBuffer.data(), gBuffer.data(), context->audioFrames,
+				[drive](float* samples, unsigned int frames) { distort(samples, frames, drive); });
+		for(unsigned int n = 0; n < context->audioFrames; ++n)
+			audioWrite(context, n, ch, gBuffer[n] * gOutputGain);
+	}
+}
+
+void cleanup(BelaContext *context, void *userData)
+{
+}
+
+/**
+\example oversampled-distortion/render.cpp
+
+Oversampled wave folding
+------------------------
+
+This example runs the audio inputs through a wave folder followed by a
+saturator. Non-linear processing like this generates harmonics far above
+the Nyquist frequency, which fold back into the audible range as inharmonic
+aliasing, unless the processing runs at a higher sample rate.
+
+The `Oversampler` class upsamples each block by `gFactor`, calls a function,
+here a lambda, on the upsampled samples, and downsamples the result back. The
+resampling is done by a cascade of 2x half-band filters: linear-phase FIRs
+with `kOversamplerFir`, or cheaper allpass-based IIRs with a lower latency with
+`kOversamplerIir`.
+
+The latency of the resampling filters is printed when the program starts:
+try the two filters and the different factors, and listen to how the
+aliasing of a high note changes. The `oversampling` benchmark in
+`terminal-only/dsp-benchmarks` measures the CPU usage, the aliasing left and
+the latency of each setting, next to linear interpolation and averaging.
+*/
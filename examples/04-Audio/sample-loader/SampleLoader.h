@@ -95,3 +95,16 @@ int getNumFrames(string file) {
 	return sfinfo.frames;
 }
 
+int getSampleRate(string file) {
+    
+    SNDFILE *sndfile ;
+	SF_INFO sfinfo ;
+	sfinfo.format = 0;
+	if (!(sndfile = sf_open (file.c_str(), SFM_READ, &sfinfo))) {
+		cout << "Couldn't open file " << file << ": " << sf_strerror(sndfile) << endl;
+		return -1;
+	}
+	sf_close(sndfile);
+
+	return sfinfo.samplerate;
+}
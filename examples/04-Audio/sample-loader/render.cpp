@@ -26,6 +26,8 @@ The Bela software is distributed under the GNU Lesser General Public License
 #include <cmath>
 #include <SampleLoader.h>
 #include <SampleData.h>
+#include <SampleRateConverter.h>
+#include <vector>
 
 #define NUM_CHANNELS 2
 
@@ -45,10 +47,25 @@ bool setup(BelaContext *context, void *userData)
     // SampleData is a struct that contains an array of floats and an int declared in SampleData.h
     
     gFrameRange = gEndFrame-gStartFrame;
+    int fileSampleRate = getSampleRate(gFilename);
     for(int ch=0;ch<NUM_CHANNELS;ch++) {
-        gSampleData[ch].sampleLen = getNumFrames(gFilename);
+        gSampleData[ch].sampleLen = gFrameRange;
     	gSampleData[ch].samples = new float[gFrameRange];
         getSamples(gFilename,gSampleData[ch].samples,ch,gStartFrame,gEndFrame);
+        
+        // if the file is not at the sample rate of the audio device,
+        // convert it once, now, rather than every time it is played
+        if(fileSampleRate > 0 && fileSampleRate != context->audioSampleRate) {
+            std::vector<float> converted;
+            if(SampleRateConverter::convert(gSampleData[ch].samples, gFrameRange, 1,
+                    fileSampleRate / context->audioSampleRate, converted))
+                return false;
+            delete[] gSampleData[ch].samples;
+            gSampleData[ch].sampleLen = converted.size();
+            gSampleData[ch].samples = new float[converted.size()];
+            for(unsigned int n=0;n<converted.size();n++)
+                gSampleData[ch].samples[n] = converted[n];
+        }
     }
 
 	return true;
@@ -58,8 +75,8 @@ void render(BelaContext *context, void *userData)
 {
     for(unsigned int n = 0; n < context->audioFrames; n++) {
         
-        // Increment read pointer and reset to 0 when end of file is reached
-        if(++gReadPtr > 22050)
+        // Increment read pointer and reset to 0 when the end of the samples is reached
+        if(++gReadPtr >= gSampleData[0].sampleLen)
             gReadPtr = 0;
 
     	for(unsigned int channel = 0; channel < context->audioOutChannels; channel++) {
@@ -90,4 +107,8 @@ helper functions provided in SampleLoader.h. This should ideally be used when wo
 with small wav files. See sampleStreamer and sampleStreamerMulti for more elaborate ways
 of loading and playing back larger files.
 
+If the sample rate of the file differs from that of the audio device, the
+samples are converted once, when they are loaded, with
+`SampleRateConverter::convert()`.
+
 */
@@ -1,10 +1,16 @@
 /***** SampleStream.cpp *****/
 #include <SampleStream.h>
 
-SampleStream::SampleStream(const char* filename, int numChannels, int bufferLength) {
+// number of frames generated at a time by the sample rate converter
+#define RESAMPLE_BLOCK 32
+// the largest ratio between the rate of the file (times the playback rate) and that of the device
+#define MAX_RESAMPLE_RATIO 4
+
+SampleStream::SampleStream(const char* filename, int numChannels, int bufferLength, float sampleRate) {
     
     gSampleBuf[0] = NULL;
     gSampleBuf[1] = NULL;
+    gSampleRate = sampleRate;
     
     openFile(filename,numChannels,bufferLength);
     
@@ -74,6 +80,18 @@ int SampleStream::openFile(const char* filename, int numChannels, int bufferLeng
         return 1;
     }
     
+    // resample files that are not at the sample rate of the device
+    double ratio = (double)sfinfo.samplerate / gSampleRate;
+    gResampling = ratio != 1;
+    if(gConverter.setup(gNumChannels, RESAMPLE_BLOCK * MAX_RESAMPLE_RATIO, ratio, kSrcMedium, MAX_RESAMPLE_RATIO)) {
+        printf("error setting up the sample rate converter\n");
+        return 1;
+    }
+    gConverterInput.resize(gConverter.getMaxInputFramesNeeded(RESAMPLE_BLOCK) * gNumChannels);
+    gResampled.resize(RESAMPLE_BLOCK * gNumChannels);
+    gResampledPtr = 0;
+    gResampledFrames = 0;
+    
     for(int ch=0;ch<gNumChannels;ch++) {
         for(int i=0;i<2;i++) {
             gSampleBuf[i][ch].sampleLen = gBufferLength;
@@ -96,35 +114,78 @@ int SampleStream::openFile(const char* filename, int numChannels, int bufferLeng
 void SampleStream::processFrame() {
     
     if(gFadeAmount<1 && gFadeAmount>0) {
-        gFadeAmount += (gFadeDirection*((1.0/gFadeLengthInSeconds)/44100.0));
+        gFadeAmount += (gFadeDirection*((1.0/gFadeLengthInSeconds)/gSampleRate));
     }
     else if(gFadeAmount < 0)
         gPlaying = 0;
     
     if(gPlaying) {
-        // Increment read pointer and reset to 0 when end of file is reached
-        if(++gReadPtr >= gBufferLength) {
-            // if(!gDoneLoadingBuffer)
-            //     rt_printf("Couldn't load buffer in time :( -- try increasing buffer size!");
-            gDoneLoadingBuffer = 0;
-            gReadPtr = 0;
-            gActiveBuffer = !gActiveBuffer;
-            gBufferToBeFilled = 1;
+        if(gResampling) {
+            if(++gResampledPtr >= gResampledFrames)
+                resample();
         }
+        else
+            nextInputFrame();
     }
     
 }
 
+void SampleStream::nextInputFrame() {
+    
+    // Increment read pointer and reset to 0 when end of file is reached
+    if(++gReadPtr >= gBufferLength) {
+        // if(!gDoneLoadingBuffer)
+        //     rt_printf("Couldn't load buffer in time :( -- try increasing buffer size!");
+        gDoneLoadingBuffer = 0;
+        gReadPtr = 0;
+        gActiveBuffer = !gActiveBuffer;
+        gBufferToBeFilled = 1;
+    }
+}
+
+void SampleStream::resample() {
+    
+    // read as many frames from the buffers as the converter needs
+    int needed = gConverter.getInputFramesNeeded(RESAMPLE_BLOCK);
+    for(int n=0;n<needed;n++) {
+        nextInputFrame();
+        for(int ch=0;ch<gNumChannels;ch++)
+            gConverterInput[n*gNumChannels+ch] = gSampleBuf[gActiveBuffer][ch].samples[gReadPtr];
+    }
+    gResampledFrames = gConverter.process(gConverterInput.data(), needed, gResampled.data(), RESAMPLE_BLOCK);
+    gResampledPtr = 0;
+}
+
 float SampleStream::getSample(int channel) {
     if(gPlaying) {
         // Wrap channel index in case there are more audio output channels than the file contains
-        float out = gSampleBuf[gActiveBuffer][channel%gNumChannels].samples[gReadPtr];
+        float out;
+        if(gResampling)
+            out = gResampled[gResampledPtr*gNumChannels + channel%gNumChannels];
+        else
+            out = gSampleBuf[gActiveBuffer][channel%gNumChannels].samples[gReadPtr];
     	return out * gFadeAmount * gFadeAmount;
     }
     return 0;
 	
 }
 
+void SampleStream::setPlaybackRate(float rate, float rampLengthInSeconds) {
+    
+    double ratio = (double)sfinfo.samplerate / gSampleRate;
+    if(!gResampling) {
+        if(rate == 1)
+            return;
+        // the converter starts from the next frame of the file, so there is no jump
+        gResampling = 1;
+        gConverter.reset();
+        gConverter.setRatio(ratio);
+        gResampledPtr = 0;
+        gResampledFrames = 0;
+    }
+    gConverter.setRatio(ratio * rate, rampLengthInSeconds * gSampleRate);
+}
+
 void SampleStream::fillBuffer() {
     
     if(!gBusy) {
@@ -185,7 +246,7 @@ void SampleStream::togglePlaybackWithFade(int toggle, float fadeLengthInSeconds)
     if(fadeLengthInSeconds<=0)
         fadeLengthInSeconds = 0.00001;
     gFadeLengthInSeconds = fadeLengthInSeconds;
-    gFadeAmount += (gFadeDirection*((1.0/gFadeLengthInSeconds)/44100.0));
+    gFadeAmount += (gFadeDirection*((1.0/gFadeLengthInSeconds)/gSampleRate));
     if(gFadeDirection)
         gPlaying = 1;
 }
@@ -201,7 +262,7 @@ void SampleStream::togglePlaybackWithFade(float fadeLengthInSeconds) {
     if(fadeLengthInSeconds<=0)
         fadeLengthInSeconds = 0.00001;
     gFadeLengthInSeconds = fadeLengthInSeconds;
-    gFadeAmount += (gFadeDirection*((1.0/gFadeLengthInSeconds)/44100.0));
+    gFadeAmount += (gFadeDirection*((1.0/gFadeLengthInSeconds)/gSampleRate));
     if(gFadeDirection)
         gPlaying = 1;
 }
@@ -6,7 +6,9 @@
 #define SAMPLESTREAM_H_
 
 #include <SampleData.h>
+#include <SampleRateConverter.h>
 #include <string>
+#include <vector>
 #include <Bela.h>
 
 #include <sndfile.h>	// to load audio files
@@ -20,7 +22,9 @@ class SampleStream
 
 public:
     
-    SampleStream(const char* filename, int numChannels, int bufferLength);
+    // sampleRate is the sample rate of the audio device: files at a different
+    // sample rate are resampled while they play
+    SampleStream(const char* filename, int numChannels, int bufferLength, float sampleRate = 44100);
     ~SampleStream();
     int openFile(const char* filename, int numChannels, int bufferLength);
     void fillBuffer();
@@ -32,6 +36,8 @@ public:
     void togglePlayback(int toggle);
     void togglePlaybackWithFade(int toggle, float fadeLengthInSeconds);
     int isPlaying();
+    // 1 is the original speed and pitch, 2 is an octave up
+    void setPlaybackRate(float rate, float rampLengthInSeconds = 0);
     
 private:
 
@@ -40,6 +46,11 @@ private:
     int getNumChannels(const char* file);
     int getNumFrames(const char* file);
 
+    // move to the next frame of the file, switching buffers when needed
+    void nextInputFrame();
+    // fill gResampled with the next frames from the converter
+    void resample();
+
     // Two buffers for each channel:
     // one of them loads the next chunk of audio while the other one is used for playback
     SampleData *gSampleBuf[2];
@@ -66,6 +77,16 @@ private:
     
     int gBusy;
     
+    float gSampleRate;
+    // the frames go through gConverter when the file is at a different sample
+    // rate or the playback rate is not 1
+    int gResampling;
+    SampleRateConverter gConverter;
+    std::vector<float> gConverterInput;
+    std::vector<float> gResampled;
+    int gResampledPtr;
+    int gResampledFrames;
+    
     SNDFILE *sndfile = NULL;
 	SF_INFO sfinfo ;
     
@@ -47,7 +47,9 @@ bool setup(BelaContext *context, void *userData)
 {
     
     for(int i=0;i<NUM_STREAMS;i++) {
-        sampleStream[i] = new SampleStream("waves.wav",NUM_CHANNELS,BUFFER_LEN);
+        // the streams know the sample rate of the device, so that files
+        // at a different rate are resampled
+        sampleStream[i] = new SampleStream("waves.wav",NUM_CHANNELS,BUFFER_LEN,context->audioSampleRate);
     }
     
     // Initialise auxiliary tasks
@@ -72,6 +74,9 @@ void render(BelaContext *context, void *userData)
             // the above function can also be overloaded specifying the state
             // of playback to toggle - i.e. togglePlaybackWithFade(1,0.1)
             // same applies to togglePlayback()
+        // randomly changes the playback rate, gliding to the new one over 0.5 seconds
+        if((rand() / (float)RAND_MAX)>0.9999)
+            sampleStream[i]->setPlaybackRate(0.5 + rand() / (float)RAND_MAX, 0.5);
         /*
          * demonstrates dynamically reloading samples
          * (TODO: this should really be done in a separate thread)
@@ -126,5 +131,9 @@ files, managing buffers, retrieving samples etc. is built into the `sampleStream
 class, making it easier to have multiple playback streams at the same time.
 Streams can be paused/unpaused with the option of fading in/out the playback.
 
+Files whose sample rate differs from that of the audio device are resampled
+while they play with a `SampleRateConverter`, which also allows changing the
+playback rate of each stream with `setPlaybackRate()`.
+
 
 */
@@ -0,0 +1,183 @@
+/*
+ ____  _____ _        _    
+| __ )| ____| |      / \   
+|  _ \|  _| | |     / _ \  
+| |_) | |___| |___ / ___ \ 
+|____/|_____|_____/_/   \_\
+
+The platform for ultra-low latency audio and sensor processing
+
+http://bela.io
+
+A project of the Augmented Instruments Laboratory within the
+Centre for Digital Music at Queen Mary University of London.
+http://www.eecs.qmul.ac.uk/~andrewm
+
+(c) 2016 Augmented Instruments Laboratory: Andrew McPherson,
+    Astrid Bin, Liam Donovan, Christian Heinrichs, Robert Jack,
+    Giulio Moro, Laurel Pardue, Victor Zappi. All rights reserved.
+
+The Bela software is distributed under the GNU Lesser General Public License
+(LGPL 3.0), available here: https://www.gnu.org/licenses/lgpl-3.0.txt
+*/
+
+
+#include <Bela.h>
+#include <Midi.h>
+#include <VoicePool.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#define NUM_VOICES 64
+#define GROUP_SIZE 4 // voices rendered side by side: a NEON register
+
+float gAttackTime = 0.005;  // in seconds
+float gReleaseTime = 0.15;  // in seconds
+float gGain = 0.1;          // of each voice
+bool gDemo = true;          // play random notes if there is no MIDI input
+float gDemoInterval = 0.15; // between the notes of the demo, in seconds
+
+// The state of the oscillator and envelope of each voice, as
+// structure-of-arrays, like the state in VoicePoolVoices
+struct SynthVoices {
+	std::vector<float> phase; // between -1 and 1
+	std::vector<float> envelope;
+	float inverseSampleRate;
+	float attackCoefficient;
+	float releaseCoefficient;
+};
+
+VoicePool gPool;
+SynthVoices gSynth;
+Midi gMidi;
+const char* gMidiPort0 = "hw:1,0,0";
+bool gMidiEnabled = false;
+unsigned int gDemoCount = 0;
+int gDemoNotes[4] = { -1, -1, -1, -1 };
+unsigned int gDemoNote = 0;
+
+void setupSynth(SynthVoices& synth, float sampleRate)
+{
+	synth.phase.assign(NUM_VOICES, 0);
+	synth.envelope.assign(NUM_VOICES, 0);
+	synth.inverseSampleRate = 1.f / sampleRate;
+	synth.attackCoefficient = 1.f - expf(-1.f / (gAttackTime * sampleRate));
+	synth.releaseCoefficient = 1.f - expf(-1.f / (gReleaseTime * sampleRate));
+}
+
+// Render a group of `lanes` voices: the inner loops are over the voices of
+// the group, so that the compiler processes them side by side
+template <unsigned int lanes>
+void renderVoices(VoicePool& pool, unsigned int firstVoice, float* out, unsigned int frames, void* arg)
+{
+	SynthVoices& synth = *(SynthVoices*)arg;
+	VoicePoolVoices& voices = pool.getVoices();
+	float increment[lanes];
+	float target[lanes];
+	float coefficient[lanes];
+	float phase[lanes];
+	float envelope[lanes];
+	for(unsigned int l = 0; l < lanes; ++l)
+	{
+		unsigned int v = firstVoice + l;
+		// the phase goes from -1 to 1: twice the frequency
+		increment[l] = 2.f * voices.frequency[v] * synth.inverseSampleRate;
+		target[l] = voices.gate[v] * voices.velocity[v];
+		coefficient[l] = voices.gate[v] ? synth.attackCoefficient : synth.releaseCoefficient;
+		// a retriggered voice carries on from its current phase and level, so that it does not click
+		phase[l] = synth.phase[v];
+		envelope[l] = synth.envelope[v];
+	}
+	for(unsigned int n = 0; n < frames; ++n)
+	{
+		float sum = 0;
+		for(unsigned int l = 0; l < lanes; ++l)
+		{
+			phase[l] += increment[l];
+			phase[l] -= phase[l] >= 1.f ? 2.f : 0.f;
+			envelope[l] += (target[l] - envelope[l]) * coefficient[l];
+			// a parabolic approximation of a sine
+			float x = phase[l];
+			sum += 4.f * x * (1.f - fabsf(x)) * envelope[l];
+		}
+		out[n] += sum * gGain;
+	}
+	for(unsigned int l = 0; l < lanes; ++l)
+	{
+		unsigned int v = firstVoice + l;
+		synth.phase[v] = phase[l];
+		synth.envelope[v] = envelope[l];
+		voices.level[v] = envelope[l];
+	}
+}
+
+bool setup(BelaContext *context, void *userData)
+{
+	setupSynth(gSynth, context->audioSampleRate);
+	if(gPool.setup(NUM_VOICES, 1, context->audioFrames, renderVoices<GROUP_SIZE>, &gSynth,
+			kVoiceStealOldest, GROUP_SIZE))
+		return false;
+	gMidiEnabled = gMidi.readFrom(gMidiPort0) > 0;
+	if(gMidiEnabled)
+		gMidi.enableParser(true);
+	else
+		rt_printf("Unable to open MIDI port %s\n", gMidiPort0);
+	return true;
+}
+
+void render(BelaContext *context, void *userData)
+{
+	if(gMidiEnabled)
+		gPool.processMidi(gMidi.getParser());
+	if(gDemo && !gMidiEnabled)
+	{
+		// every gDemoInterval, release the note started four intervals ago
+		// and start a new one from a pentatonic scale
+		gDemoCount += context->audioFrames;
+		if(gDemoCount >= gDemoInterval * context->audioSampleRate)
+		{
+			static const int scale[] = { 0, 3, 5, 7, 10 };
+			gDemoCount = 0;
+			if(gDemoNotes[gDemoNote] >= 0)
+				gPool.noteOff(0, gDemoNotes[gDemoNote]);
+			gDemoNotes[gDemoNote] = 48 + 12 * (rand() % 3) + scale[rand() % 5];
+			gPool.noteOn(0, gDemoNotes[gDemoNote], 40 + rand() % 80);
+			gDemoNote = (gDemoNote + 1) % 4;
+		}
+	}
+	gPool.render(context);
+}
+
+void cleanup(BelaContext *context, void *userData)
+{
+	gPool.cleanup();
+}
+
+/**
+\example MIDI-voice-pool/render.cpp
+
+A polyphonic MIDI synth with a voice pool
+-----------------------------------------
+
+This example is a 64-voice synth, played from the MIDI port `"hw:1,0,0"`
+(see the `MIDI` example), which uses the `VoicePool` class to allocate its
+voices. If the port cannot be opened, it plays random notes instead.
+
+`VoicePool` turns the note on and note off messages from the MIDI parser
+into voices: it handles the sustain pedal and the pitch bend, and when all
+voices are in use it steals one, here the oldest. The state of the voices
+(frequency, velocity, gate, level...) is kept as structure-of-arrays, and so
+is the state of the oscillators and envelopes of the synth. The voices are
+rendered by `renderVoices()` in groups of four, processed side by side, so
+that the compiler maps each group to SIMD registers. Only the groups with a
+sounding voice are rendered: once a note is released, its voice is freed as
+soon as its envelope has faded out.
+
+`VoicePool` can also share the groups with worker threads, by passing
+the number of workers to `setup()`. This only helps on a board with more
+than one core, and when many voices are sounding: on a single core the
+groups are always rendered by the audio thread. The `voices` benchmark in
+`terminal-only/dsp-benchmarks` times this synth against one that renders
+every voice, sounding or not, one sample at a time.
+*/
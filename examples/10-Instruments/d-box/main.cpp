@@ -64,6 +64,7 @@ bool forceSensors	= true;		    		// activate/deactivate sensor control
 bool forceLog		= false;				// activate/deactivate log on boot partition
 bool useSD   		= false;    			// activate/deactivate file loading from SD [as opposed to emmc]
 bool useAudioTest   = false;    			// activate/deactivate sensors and test audio only
+bool convertFiles	= false;				// convert the analysis files to the binary format and exit
 
 // audio settings
 unsigned int gPeriodSize = 8;				// period size for audio
@@ -100,7 +101,16 @@ struct arg_data
 arg_data args;
 
 
-int readFiles()
+// name of the binary [.sprb] version of an analysis file
+string binaryFileName(const string& name)
+{
+	size_t dot = name.rfind('.');
+	if(dot == string::npos)
+		return name + ".sprb";
+	return name.substr(0, dot) + ".sprb";
+}
+
+int readFiles(bool preferBinary = true)
 {
 	if(useSD)
 		gDirName = gUserDirName;
@@ -129,6 +139,8 @@ int readFiles()
 				dboxFile = true;
 			if( (name[len-4]=='.') && (name[len-3]=='t') && (name[len-2]=='x') && (name[len-1]=='t') )
 				dboxFile = true;
+			if( (len>5) && (name.compare(len-5, 5, ".sprb")==0) )
+				dboxFile = true;
 
 			if(dboxFile)
 			{
@@ -147,9 +159,23 @@ int readFiles()
 	// order by name
 	std::sort( files.begin(), files.end() );
 
+	// when a file has been converted to the binary format, load the converted one only
+	if(preferBinary)
+	{
+		for(int i=fileCnt-1; i>=0; i--)
+		{
+			string binaryName = binaryFileName(files[i]);
+			if( (binaryName != files[i]) && std::binary_search(files.begin(), files.end(), binaryName) )
+			{
+				files.erase(files.begin()+i);
+				fileCnt--;
+			}
+		}
+	}
+
 	if(fileCnt==0)
 	{
-		fprintf(stderr, "No .dbx or .txt files in %s!\n", gDirName);
+		fprintf(stderr, "No .dbx, .txt or .sprb files in %s!\n", gDirName);
 		return 1;
 	}
 
@@ -250,6 +276,38 @@ int initSoundFiles()
 	return 0;
 }
 
+// Convert all the .txt and .dbx analysis files to the binary format, which is memory-mapped
+// instead of being parsed when the files are loaded
+int convertSoundFiles()
+{
+	if(useSD)
+	{
+		if(mountSDuserPartition()!=0)
+			return -1;
+	}
+
+	if(readFiles(false)!=0)
+		return 1;
+
+	int errors = 0;
+	for(int i=0; i<fileCnt; i++)
+	{
+		string name = string(gDirName) + "/" + files[i];
+		string binaryName = binaryFileName(name);
+		if(binaryName == name)
+			continue;	// already binary
+		Spear_parser parser;
+		if(!parser.parseFile(name) || !parser.saveBinary(binaryName.c_str()))
+		{
+			fprintf(stderr, "Unable to convert %s\n", name.c_str());
+			errors++;
+			continue;
+		}
+		printf("Converted %s to %s\n", name.c_str(), binaryName.c_str());
+	}
+	return errors ? 1 : 0;
+}
+
 //---------------------------------------------------------------------------------------------------------
 
 // Handle Ctrl-C
@@ -269,6 +327,7 @@ void parseArguments(arg_data args, BelaInitSettings *settings)
 	gPartialFilename = strdup("D-Box_sound_250_60_40_h88_2.txt");
 
 	const int kOptionAudioTest = 1000;
+	const int kOptionConvert = 1001;
 
 	// TODO: complete this
 	struct option long_option[] =
@@ -278,6 +337,7 @@ void parseArguments(arg_data args, BelaInitSettings *settings)
 		{"file", 1, NULL, 'f'},
 		{"keyboard", 1, NULL, 'k'},
 		{"audio-test", 0, NULL, kOptionAudioTest},
+		{"convert", 0, NULL, kOptionConvert},
 		{"sensor-type", 1, NULL, 't'},
 		{"sensor0", 1, NULL, 'q'},
 		{"sensor1", 1, NULL, 'r'},
@@ -322,6 +382,9 @@ void parseArguments(arg_data args, BelaInitSettings *settings)
 			case kOptionAudioTest:
 				useAudioTest = true;
 				break;
+			case kOptionConvert:
+				convertFiles = true;
+				break;
 			case 't':
 				sensorType = atoi(optarg);
 				break;
@@ -377,6 +440,11 @@ int main(int argc, char *argv[])
 	args.argv = argv;
 	parseArguments(args, settings);
 
+	if(convertFiles) {
+		Bela_InitSettings_free(settings);
+		return convertSoundFiles();
+	}
+
 	Bela_setVerboseLevel(gVerbose);
 	if(gVerbose == 1 && useAudioTest)
 		cout << "main() : running in audio test mode" << endl;
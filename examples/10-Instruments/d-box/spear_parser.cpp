@@ -6,6 +6,11 @@
  */
 
 #include "spear_parser.h"
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
@@ -30,11 +35,26 @@ Partials::Partials()
 	activePartialNum	= NULL;
 //	activePartials		= NULL;
 
+	mapping		= NULL;
+	mappingSize	= 0;
+
 	currentSample = -1;
 }
 
 Partials::~Partials()
 {
+	if(mapping != NULL)
+	{
+		// only the row pointers were allocated, the data is in the mapped file
+		delete[] partialFrequencies;
+		delete[] partialAmplitudes;
+		delete[] partialFreqDelta;
+		delete[] partialAmpDelta;
+		delete[] activePartials;
+		munmap((void *)mapping, mappingSize);
+		return;
+	}
+
 	if(partialFrequencies != NULL)			// check on one is enough
 	{
 		if(partialFrequencies[0] != NULL)	// check on one is enough
@@ -202,6 +222,8 @@ bool Spear_parser::parser(char *filename, int hopsize, int samplerate)
 	// invoke correct parser according to the type of file...just checking the extension, crude but functional
 	if( (name[len-4]=='.') && (name[len-3]=='d') && (name[len-2]=='b') && (name[len-1]=='x') )
 		return DBXparser(filename, samplerate);				// .dbox
+	else if( (len>5) && (name.compare(len-5, 5, ".sprb")==0) )
+		return SPRBparser(filename, samplerate);			// .sprb, memory-mapped
 	else
 		return TXTparser(filename, hopSize, samplerate);	// .txt, or whatever
 }
@@ -309,6 +331,237 @@ bool Spear_parser::DBXparser(char *filename, int samplerate)
 
 
 
+static uint64_t align16(uint64_t n)
+{
+	return (n + 15) & ~(uint64_t)15;
+}
+
+static uint32_t roundUp4(uint32_t n)
+{
+	return (n + 3) & ~(uint32_t)3;
+}
+
+// whether a section of `count` elements at `offset` is aligned to its elements and within the file
+static bool sectionFits(uint64_t offset, uint64_t count, size_t elementSize, size_t size)
+{
+	return (offset % elementSize == 0) && (offset <= size) && (count*elementSize <= size - offset);
+}
+
+// map the file and point the partials data structure into it: nothing is parsed or copied,
+// and the pages are shared with any other process that maps the same file
+bool Spear_parser::SPRBparser(char *filename, int samplerate)
+{
+	fileSampleRate 	= samplerate;
+
+	//----------------------------------------------------------------------------------------
+	// map the file
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		cout << "Parser Error: file not found" << endl;	// exit if file not found
+		return false;
+	}
+
+	gettimeofday(&start, NULL);
+
+	struct stat st;
+	if( (fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(SprbHeader)) )
+	{
+		cout << "Parser Error: bad binary file" << endl;
+		close(fd);
+		return false;
+	}
+	size_t size = st.st_size;
+	void *ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);	// the mapping stays valid
+	if(ptr == MAP_FAILED)
+	{
+		cout << "Parser Error: unable to map file" << endl;
+		return false;
+	}
+	const char *base = (const char *)ptr;
+
+	//----------------------------------------------------------------------------------------
+	// general data
+	const SprbHeader *header = (const SprbHeader *)base;
+	uint32_t frameNum = header->hopNum + 1;
+	if( memcmp(header->magic, SPRB_MAGIC, 4) || (header->version != SPRB_VERSION) || (header->fileSize != size)
+		|| !sectionFits(header->partialStartFrameOffset, header->parNum, sizeof(uint32_t), size)
+		|| !sectionFits(header->partialNumFramesOffset, header->parNum, sizeof(uint32_t), size)
+		|| !sectionFits(header->partialFreqMeanOffset, header->parNum, sizeof(float), size)
+		|| !sectionFits(header->partialRowOffsetOffset, header->parNum, sizeof(uint32_t), size)
+		|| !sectionFits(header->frameDataOffset, 4*(uint64_t)header->dataStride, sizeof(float), size)
+		|| !sectionFits(header->activePartialNumOffset, frameNum, sizeof(uint16_t), size)
+		|| !sectionFits(header->activeRowOffsetOffset, frameNum, sizeof(uint32_t), size)
+		|| !sectionFits(header->activePartialsOffset, header->activeCount, sizeof(uint32_t), size) )
+	{
+		cout << "Parser Error: bad or unsupported binary file" << endl;
+		munmap(ptr, size);
+		return false;
+	}
+
+	unsigned int parNum		= header->parNum;
+	hopSize					= header->hopSize;
+	calculateDeltaTime();
+
+	partials.parNum				= parNum;
+	partials.hopNum				= header->hopNum;
+	partials.hopSize			= hopSize;
+	partials.maxActiveParNum	= header->maxActiveParNum;
+	partials.mapping			= base;
+	partials.mappingSize		= size;
+
+	//----------------------------------------------------------------------------------------
+	// partial data
+	partials.partialStartFrame	= (unsigned int *)(base + header->partialStartFrameOffset);
+	partials.partialNumFrames	= (unsigned int *)(base + header->partialNumFramesOffset);
+	partials.partialFreqMean	= (float *)(base + header->partialFreqMeanOffset);
+	const uint32_t *rowOffset	= (const uint32_t *)(base + header->partialRowOffsetOffset);
+	float *frameData			= (float *)(base + header->frameDataOffset);
+	uint32_t stride				= header->dataStride;
+
+	partials.partialAmplitudes	= new float *[parNum];
+	partials.partialFrequencies	= new float *[parNum];
+	partials.partialAmpDelta	= new float *[parNum];
+	partials.partialFreqDelta	= new float *[parNum];
+	partials.activePartials		= new unsigned int *[frameNum];
+
+	bool valid = true;
+	for(unsigned int par=0; par<parNum; par++)
+	{
+		valid = valid && ( (uint64_t)rowOffset[par] + partials.partialNumFrames[par] <= stride )
+				&& ( (uint64_t)partials.partialStartFrame[par] + partials.partialNumFrames[par] <= frameNum );
+		partials.partialAmplitudes[par]		= frameData + rowOffset[par];
+		partials.partialFrequencies[par]	= frameData + stride + rowOffset[par];
+		partials.partialAmpDelta[par]		= frameData + 2*stride + rowOffset[par];
+		partials.partialFreqDelta[par]		= frameData + 3*stride + rowOffset[par];
+	}
+
+	//----------------------------------------------------------------------------------------
+	// frame data
+	partials.activePartialNum			= (unsigned short *)(base + header->activePartialNumOffset);
+	const uint32_t *activeRowOffset		= (const uint32_t *)(base + header->activeRowOffsetOffset);
+	unsigned int *activeData			= (unsigned int *)(base + header->activePartialsOffset);
+	for(unsigned int frame=0; frame<frameNum; frame++)
+	{
+		valid = valid && ( (uint64_t)activeRowOffset[frame] + partials.activePartialNum[frame] <= header->activeCount );
+		partials.activePartials[frame] = activeData + activeRowOffset[frame];
+	}
+	// the active partials are used as indices into the partial data
+	for(unsigned int n=0; valid && n<header->activeCount; n++)
+		valid = activeData[n] < parNum;
+
+	if(!valid)
+	{
+		cout << "Parser Error: bad binary file" << endl;
+		return false;	// the destructor releases the mapping
+	}
+
+	gettimeofday(&stop, NULL);
+	parserT = ( (stop.tv_sec*1000000+stop.tv_usec) - (start.tv_sec*1000000+start.tv_usec) );
+
+	printf("\n-----------------------\n");
+	printf("\nFile: %s\n", filename);
+	printf("\n-----------------------\n");
+	printf("Profiler\n");
+	printf("-----------------------\n");
+	printf("File mapping:\t\t\t%lu usec\n", parserT);
+	printf("-----------------------\n");
+
+	return true;
+}
+
+
+// write the current partials in the binary format, to be loaded by SPRBparser()
+bool Spear_parser::saveBinary(const char *filename)
+{
+	unsigned int parNum		= partials.parNum;
+	unsigned int frameNum	= partials.hopNum+1;
+
+	if( (partials.partialFrequencies == NULL) || (partials.activePartialNum == NULL) )
+	{
+		cout << "Parser Error: no partials to save" << endl;
+		return false;
+	}
+
+	// each partial and each frame of active partials starts on a 16-byte boundary
+	vector<uint32_t> rowOffset(parNum);
+	uint32_t stride = 0;
+	for(unsigned int par=0; par<parNum; par++)
+	{
+		rowOffset[par] = stride;
+		stride += roundUp4(partials.partialNumFrames[par]);
+	}
+	vector<uint32_t> activeRowOffset(frameNum);
+	uint32_t activeCount = 0;
+	for(unsigned int frame=0; frame<frameNum; frame++)
+	{
+		activeRowOffset[frame] = activeCount;
+		activeCount += roundUp4(partials.activePartialNum[frame]);
+	}
+
+	SprbHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SPRB_MAGIC, 4);
+	header.version			= SPRB_VERSION;
+	header.parNum			= parNum;
+	header.hopNum			= partials.hopNum;
+	header.hopSize			= partials.hopSize;
+	header.maxActiveParNum	= partials.maxActiveParNum;
+	header.dataStride		= stride;
+	header.activeCount		= activeCount;
+
+	uint64_t pos = align16(sizeof(header));
+	header.partialStartFrameOffset	= pos;	pos = align16(pos + parNum*sizeof(uint32_t));
+	header.partialNumFramesOffset	= pos;	pos = align16(pos + parNum*sizeof(uint32_t));
+	header.partialFreqMeanOffset	= pos;	pos = align16(pos + parNum*sizeof(float));
+	header.partialRowOffsetOffset	= pos;	pos = align16(pos + parNum*sizeof(uint32_t));
+	header.frameDataOffset			= pos;	pos = align16(pos + 4*(uint64_t)stride*sizeof(float));
+	header.activePartialNumOffset	= pos;	pos = align16(pos + frameNum*sizeof(uint16_t));
+	header.activeRowOffsetOffset	= pos;	pos = align16(pos + frameNum*sizeof(uint32_t));
+	header.activePartialsOffset		= pos;	pos = pos + (uint64_t)activeCount*sizeof(uint32_t);
+	header.fileSize					= pos;
+
+	// build the whole file in memory, padding included
+	vector<char> data(pos, 0);
+	char *base = &data[0];
+	memcpy(base, &header, sizeof(header));
+	memcpy(base + header.partialStartFrameOffset, partials.partialStartFrame, parNum*sizeof(uint32_t));
+	memcpy(base + header.partialNumFramesOffset, partials.partialNumFrames, parNum*sizeof(uint32_t));
+	memcpy(base + header.partialFreqMeanOffset, partials.partialFreqMean, parNum*sizeof(float));
+	memcpy(base + header.partialRowOffsetOffset, rowOffset.data(), parNum*sizeof(uint32_t));
+	float *frameData = (float *)(base + header.frameDataOffset);
+	for(unsigned int par=0; par<parNum; par++)
+	{
+		size_t bytes = partials.partialNumFrames[par]*sizeof(float);
+		memcpy(frameData + rowOffset[par], partials.partialAmplitudes[par], bytes);
+		memcpy(frameData + stride + rowOffset[par], partials.partialFrequencies[par], bytes);
+		memcpy(frameData + 2*stride + rowOffset[par], partials.partialAmpDelta[par], bytes);
+		memcpy(frameData + 3*stride + rowOffset[par], partials.partialFreqDelta[par], bytes);
+	}
+	memcpy(base + header.activePartialNumOffset, partials.activePartialNum, frameNum*sizeof(uint16_t));
+	memcpy(base + header.activeRowOffsetOffset, activeRowOffset.data(), frameNum*sizeof(uint32_t));
+	uint32_t *activeData = (uint32_t *)(base + header.activePartialsOffset);
+	for(unsigned int frame=0; frame<frameNum; frame++)
+		memcpy(activeData + activeRowOffset[frame], partials.activePartials[frame], partials.activePartialNum[frame]*sizeof(uint32_t));
+
+	ofstream fout;
+	fout.open(filename, ios::out | ios::binary);
+	if(!fout.good())
+	{
+		cout << "Parser Error: unable to create " << filename << endl;
+		return false;
+	}
+	fout.write(base, data.size());
+	bool ok = fout.good();
+	fout.close();
+	if(!ok)
+		cout << "Parser Error: unable to write " << filename << endl;
+	return ok;
+}
+
+
+
 bool Spear_parser::TXTparser(char *filename, int hopsize, int samplerate)
 {
 	hopSize 		= hopsize;
@@ -17,10 +17,56 @@
 #include <algorithm>	// std::fill
 
 #include <sys/time.h>
+#include <stdint.h>
+
 
 using namespace std;
 
 
+//------------------------------------------------------------------------------------------------
+// binary partials file [.sprb]
+//------------------------------------------------------------------------------------------------
+
+// All the data is stored in the native (little endian) byte order, in sections that start
+// on 16-byte boundaries, so that the file can be memory-mapped and used in place:
+//
+// - partialStartFrame	uint32[parNum]
+// - partialNumFrames	uint32[parNum]
+// - partialFreqMean	float[parNum]
+// - partialRowOffset	uint32[parNum]		offset of each partial in the frame data arrays,
+//											each partial starts on a 16-byte boundary
+// - frame data			float[4][dataStride]	amplitudes, frequencies, amplitude deltas
+//											and frequency deltas of all the partials
+// - activePartialNum	uint16[hopNum+1]
+// - activeRowOffset	uint32[hopNum+1]	offset of each frame in the active partials array,
+//											each frame starts on a 16-byte boundary
+// - activePartials		uint32[]			indices of the active partials at each frame
+
+#define SPRB_MAGIC "SPRB"
+#define SPRB_VERSION 1
+
+struct SprbHeader
+{
+	char magic[4];					// SPRB_MAGIC
+	uint32_t version;				// SPRB_VERSION
+	uint32_t parNum;
+	uint32_t hopNum;
+	uint32_t hopSize;
+	uint32_t maxActiveParNum;
+	uint32_t dataStride;			// number of floats in each of the frame data arrays
+	uint32_t activeCount;			// number of elements in the active partials array
+	uint64_t fileSize;
+	uint64_t partialStartFrameOffset;	// byte offsets of the sections
+	uint64_t partialNumFramesOffset;
+	uint64_t partialFreqMeanOffset;
+	uint64_t partialRowOffsetOffset;
+	uint64_t frameDataOffset;
+	uint64_t activePartialNumOffset;
+	uint64_t activeRowOffsetOffset;
+	uint64_t activePartialsOffset;
+};
+
+
 //------------------------------------------------------------------------------------------------
 // partials
 //------------------------------------------------------------------------------------------------
@@ -62,6 +108,9 @@ private:
 	unsigned int hopNum;
 	unsigned int maxActiveParNum;
 
+	const char *mapping;				// the mapped .sprb file, if any: the arrays point into it
+	size_t mappingSize;
+
 	void init(int parNum, int hopSize, bool isDBX=false);
 	void update(int parIndex, int frameNum);
 	void setFreqDelta(int parIndex, int frameNum, double delta);
@@ -124,6 +173,7 @@ public:
 
 	bool parseFile(string filename, int hopsize=-1, int samplerate = 44100);
 	bool parseFile(char *filename, int hopsize=-1, int samplerate = 44100);
+	bool saveBinary(const char *filename);	// write the parsed partials in the binary [.sprb] format
 	int getHopSize();
 	int getFileSampleRate();
 	double getDeltaTime();
@@ -142,6 +192,7 @@ private:
 	bool parser(char *filename, int hopsize=-1, int samplerate=44100);
 	bool DBXparser(char *filename, int samplerate=44100);
 	bool TXTparser(char *filename, int hopsize=-1, int samplerate=44100);
+	bool SPRBparser(char *filename, int samplerate=44100);
 	int fromTimeToSamples(float time);
 	int interpolateSamples(int parIndex, int *frameIndex, int missCnt, int nextSample,
 							double nextFreq, double nextAmp, double *prevFreq, double *prevAmp);
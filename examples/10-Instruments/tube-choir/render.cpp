@@ -0,0 +1,228 @@
+/*
+ ____  _____ _        _    
+| __ )| ____| |      / \   
+|  _ \|  _| | |     / _ \  
+| |_) | |___| |___ / ___ \ 
+|____/|_____|_____/_/   \_\
+
+The platform for ultra-low latency audio and sensor processing
+
+http://bela.io
+
+A project of the Augmented Instruments Laboratory within the
+Centre for Digital Music at Queen Mary University of London.
+http://www.eecs.qmul.ac.uk/~andrewm
+
+(c) 2016 Augmented Instruments Laboratory: Andrew McPherson,
+    Astrid Bin, Liam Donovan, Christian Heinrichs, Robert Jack,
+    Giulio Moro, Laurel Pardue, Victor Zappi. All rights reserved.
+
+The Bela software is distributed under the GNU Lesser General Public License
+(LGPL 3.0), available here: https://www.gnu.org/licenses/lgpl-3.0.txt
+*/
+
+
+#include <Bela.h>
+#include <TubeModel.h>
+#include <cmath>
+#include <vector>
+
+#define NUM_VOICES 6
+
+// The geometry of the vocal tract of the Pink Trombone
+#define TRACT_SEGMENTS 44
+#define NOSE_SEGMENTS 28
+#define NOSE_START (TRACT_SEGMENTS - NOSE_SEGMENTS + 1)
+#define BLADE_START 10
+#define TIP_START 32
+#define LIP_START 39
+
+float gFrequencies[NUM_VOICES] = { 110, 138.59, 164.81, 220, 277.18, 329.63 }; // an A major chord, in Hz
+float gBreathiness = 0.3;  // the amount of aspiration noise
+float gVowelRate = 0.15;   // how fast the tongues move, in Hz
+float gOutputGain = 0.3;
+
+TubeModel gTubes;
+std::vector<float> gExcitation; // [voice][frame]
+std::vector<float> gOutput; // [voice][frame]
+
+// A cheap white noise, between -1 and 1
+static inline float whiteNoise(unsigned int& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (int)seed * (1.f / 2147483648.f);
+}
+
+// A Rosenberg glottal pulse: the derivative of the flow through the glottis,
+// which drives the tract, plus aspiration noise during the open phase
+class Glottis {
+public:
+	Glottis() : phase(0), frequency(110), vibratoPhase(0), seed(1) {}
+	void setup(float newFrequency, unsigned int newSeed)
+	{
+		frequency = newFrequency;
+		seed = newSeed;
+		vibratoPhase = newSeed * 0.37f;
+	}
+	void process(float* out, unsigned int frames, float sampleRate, float breathiness)
+	{
+		const float opening = 0.4; // the fractions of the period when the glottis opens and closes
+		const float closing = 0.16;
+		vibratoPhase += 2 * M_PI * 5.1f * frames / sampleRate;
+		if(vibratoPhase > 2 * M_PI)
+			vibratoPhase -= 2 * M_PI;
+		float increment = frequency * (1 + 0.006f * sinf(vibratoPhase)) / sampleRate;
+		for(unsigned int n = 0; n < frames; ++n)
+		{
+			float flow;
+			float derivative;
+			if(phase < opening)
+			{
+				flow = 0.5f * (1 - cosf((float)M_PI * phase / opening));
+				derivative = closing / opening * sinf((float)M_PI * phase / opening);
+			} else if(phase < opening + closing) {
+				flow = cosf((float)M_PI * 0.5f * (phase - opening) / closing);
+				derivative = -sinf((float)M_PI * 0.5f * (phase - opening) / closing);
+			} else {
+				flow = 0;
+				derivative = 0;
+			}
+			out[n] = derivative + breathiness * flow * whiteNoise(seed);
+			phase += increment;
+			if(phase >= 1)
+				phase -= 1;
+		}
+	}
+private:
+	float phase;
+	float frequency;
+	float vibratoPhase;
+	unsigned int seed;
+};
+
+Glottis gGlottis[NUM_VOICES];
+float gVowelPhase[NUM_VOICES];
+
+// The diameters of the tract at rest, without the tongue
+void computeRestDiameters(float* diameters)
+{
+	for(unsigned int i = 0; i < TRACT_SEGMENTS; ++i)
+	{
+		if(i < 7 * TRACT_SEGMENTS / 44.f - 0.5f)
+			diameters[i] = 0.6;
+		else if(i < 12 * TRACT_SEGMENTS / 44.f)
+			diameters[i] = 1.1;
+		else
+			diameters[i] = 1.5;
+	}
+}
+
+// The diameters of the tract for a position of the tongue, as set by the
+// tongue control of the Pink Trombone
+void computeTractDiameters(float* diameters, float tongueIndex, float tongueDiameter)
+{
+	computeRestDiameters(diameters);
+	const float gridOffset = 1.7;
+	for(unsigned int i = BLADE_START; i < LIP_START; ++i)
+	{
+		float t = 1.1f * (float)M_PI * (tongueIndex - i) / (TIP_START - BLADE_START);
+		float fixedTongueDiameter = 2 + (tongueDiameter - 2) / 1.5f;
+		float curve = (1.5f - fixedTongueDiameter + gridOffset) * cosf(t);
+		if(i == BLADE_START || i == LIP_START - 2)
+			curve *= 0.94f;
+		if(i == LIP_START - 1)
+			curve *= 0.8f;
+		diameters[i] = 1.5f - curve;
+	}
+}
+
+// The diameters of the nasal cavity, with the velum (its opening) first
+void computeNoseDiameters(float* diameters, float velum)
+{
+	for(unsigned int i = 0; i < NOSE_SEGMENTS; ++i)
+	{
+		float d = 2.f * i / NOSE_SEGMENTS;
+		float diameter = d < 1 ? 0.4f + 1.6f * d : 0.5f + 1.5f * (2 - d);
+		diameters[i] = diameter < 1.9f ? diameter : 1.9f;
+	}
+	diameters[0] = velum;
+}
+
+bool setup(BelaContext *context, void *userData)
+{
+	if(gTubes.setup(NUM_VOICES, TRACT_SEGMENTS, context->audioFrames, 2, NOSE_SEGMENTS, NOSE_START))
+		return false;
+	gExcitation.resize(NUM_VOICES * context->audioFrames);
+	gOutput.resize(NUM_VOICES * context->audioFrames);
+	for(unsigned int v = 0; v < NUM_VOICES; ++v)
+	{
+		gGlottis[v].setup(gFrequencies[v], v + 1);
+		gVowelPhase[v] = 2 * M_PI * v / NUM_VOICES;
+	}
+	return true;
+}
+
+void render(BelaContext *context, void *userData)
+{
+	unsigned int frames = context->audioFrames;
+	float diameters[TRACT_SEGMENTS];
+	float noseDiameters[NOSE_SEGMENTS];
+	for(unsigned int v = 0; v < NUM_VOICES; ++v)
+	{
+		// move the tongue of each voice around the vowel space, each at its
+		// own pace, and open the velum from time to time for a nasal vowel
+		float rate = gVowelRate * (1 + 0.13f * v);
+		gVowelPhase[v] += 2 * M_PI * rate * frames / context->audioSampleRate;
+		if(gVowelPhase[v] > 2 * M_PI)
+			gVowelPhase[v] -= 2 * M_PI;
+		float tongueIndex = 20.5f + 8.5f * sinf(gVowelPhase[v]);
+		float tongueDiameter = 2.8f + 0.7f * cosf(gVowelPhase[v] * 2);
+		float velum = sinf(gVowelPhase[v] * 0.5f) > 0.8f ? 0.4f : 0.01f;
+		computeTractDiameters(diameters, tongueIndex, tongueDiameter);
+		computeNoseDiameters(noseDiameters, velum);
+		// the tract moves smoothly to the new shape over the block
+		gTubes.setDiameters(v, diameters);
+		gTubes.setSideDiameters(v, noseDiameters);
+		gGlottis[v].process(gExcitation.data() + v * frames, frames, context->audioSampleRate, gBreathiness);
+	}
+	gTubes.process(gExcitation.data(), NULL, gOutput.data(), frames);
+	// the Pink Trombone scales the sum of its two steps by 0.125
+	float gain = gOutputGain * 0.125f / sqrtf(NUM_VOICES);
+	for(unsigned int n = 0; n < frames; ++n)
+	{
+		float out = 0;
+		for(unsigned int v = 0; v < NUM_VOICES; ++v)
+			out += gOutput[v * frames + n];
+		for(unsigned int ch = 0; ch < context->audioOutChannels; ++ch)
+			audioWrite(context, n, ch, out * gain);
+	}
+}
+
+void cleanup(BelaContext *context, void *userData)
+{
+}
+
+/**
+\example tube-choir/render.cpp
+
+A choir of vocal tracts
+-----------------------
+
+This example sings a chord with several voices, each made of a glottal
+source and of the vocal tract and nasal cavity of the Pink Trombone example
+(`13-Salt/PinkTrombone`), with the tongue of each voice moving slowly from
+vowel to vowel.
+
+The tracts are simulated by `TubeModel`, a waveguide made of 44 segments,
+with a side branch of 28 segments for the nose. It processes the voices side
+by side, four at a time, so that the scattering of the waves at the
+junctions between segments is computed for four voices with each SIMD
+instruction, while the Pink Trombone runs one voice at a time. The shape of
+each tract is updated once per block with `setDiameters()` and
+`setSideDiameters()`, and `TubeModel` interpolates it over the block.
+
+To hear a single voice, set `NUM_VOICES` to 1; to try other chords, change
+`gFrequencies`. The `tube` benchmark in `terminal-only/dsp-benchmarks` checks
+`TubeModel` against a copy of the tract of the Pink Trombone and measures how
+many more voices it can run.
+*/
@@ -7,6 +7,7 @@
 // (c) V Lazzarini, 2018
 
 #include <Bela.h>
+#include <PatchRuntime.h>
 #include <csound/csound.hpp>
 #include <string>
 
@@ -18,6 +19,14 @@ struct CsData {
 };
   
 static CsData gCsData;
+// moves the audio (and analog) channels to and from Csound's buffers
+static PatchRuntime gRuntime;
+
+void Bela_userSettings(BelaInitSettings *settings)
+{
+  // PatchRuntime needs non-interleaved buffers
+  settings->interleave = 0;
+}
 
 bool setup(BelaContext *context, void *Data)
 {
@@ -45,6 +54,11 @@ bool setup(BelaContext *context, void *Data)
   // Compile orc code
   res = csound->CompileOrc(code.c_str());
   if(res == 0) {
+    // Csound runs its own ksmps-sized blocks, so let the runtime
+    // work one frame at a time. The analog channels are moved by the
+    // interleaved helpers, at any rate, so they do not need resampling
+    if(gRuntime.setup(context, 1, csound->GetNchnls(), csound->GetNchnls(), false))
+      return false;
     gCsData.res = res;
     gCsData.bframes = csound->GetKsmps();
     gCsData.frames = 0;
@@ -67,13 +81,8 @@ void render(BelaContext *context, void *Data)
     MYFLT* audioOut = csound->GetSpout();
     int nchnls = csound->GetNchnls();
 
-    // set the number of channels to
-    // write to output
-    nchnls = nchnls < context->audioOutChannels ?
-      nchnls : context->audioOutChannels;
-    
     // process 
-    for(n = 0; n < context->audioFrames; n++, frames++){
+    for(n = 0; n < context->audioFrames; n += i, frames += i){
 
       // if we run out of frames to output
       // call Csound to process another block
@@ -82,13 +91,15 @@ void render(BelaContext *context, void *Data)
           frames = 0;
 	else break;
       }
-      
-      // read/write audio data
-      for(i = 0; i < nchnls; i++) {
-        audioIn[frames*nchnls+i] = audioRead(context, n, i)*scal;
-	audioWrite(context, n, i, audioOut[frames*nchnls+i]/scal);
-      }
-      
+
+      // read/write as many frames as are left in
+      // this block or in Csound's block
+      i = bframes - frames < context->audioFrames - n ?
+        bframes - frames : context->audioFrames - n;
+      gRuntime.processInterleavedInputs(context, n, i,
+        audioIn + frames*nchnls, nchnls, scal);
+      gRuntime.processInterleavedOutputs(context, n, i,
+        audioOut + frames*nchnls, nchnls, scal);
     }
     gCsData.res = res;
     gCsData.frames = frames;
@@ -98,6 +109,7 @@ void render(BelaContext *context, void *Data)
 void cleanup(BelaContext *context, void *Data)
 {
   delete gCsData.csound;
+  gRuntime.cleanup();
 }
 
 
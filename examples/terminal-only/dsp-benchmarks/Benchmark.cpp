@@ -0,0 +1,23 @@
+/***** Benchmark.cpp *****/
+#include "Benchmark.h"
+
+// written by consume(), so that the outputs of the processes are used
+static volatile float gSink;
+
+Benchmark::Benchmark(float sampleRate, unsigned int blockSize, float seconds) :
+	sampleRate(sampleRate),
+	blockSize(blockSize),
+	worst(0)
+{
+	frames = (unsigned int)(seconds * sampleRate) / blockSize * blockSize;
+	if(!frames)
+		frames = blockSize;
+}
+
+void Benchmark::consume(const float* data, unsigned int length)
+{
+	float sum = 0;
+	for(unsigned int n = 0; n < length; ++n)
+		sum += data[n];
+	gSink = gSink + sum;
+}
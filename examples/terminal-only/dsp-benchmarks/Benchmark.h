@@ -0,0 +1,92 @@
+/***** Benchmark.h *****/
+#ifndef __Benchmark_H_INCLUDED__
+#define __Benchmark_H_INCLUDED__
+
+#include <chrono>
+#include <vector>
+
+/**
+ * Times a block-based process over a fixed duration of audio, at the sample
+ * rate and block size of the running Bela, and reports its CPU usage as a
+ * percentage of one core.
+ */
+class Benchmark {
+public:
+	/**
+	 * @param sampleRate the sample rate of the process.
+	 * @param blockSize the number of frames processed at a time.
+	 * @param seconds the duration of audio processed by each call to run().
+	 */
+	Benchmark(float sampleRate, unsigned int blockSize, float seconds);
+
+	/**
+	 * Call `process(frame)` once for each block, where `frame` is the index
+	 * of the first frame of the block, for getFrames() frames.
+	 *
+	 * @return the time spent in `process`, as a percentage of the duration
+	 * of the audio processed.
+	 */
+	template <typename Function>
+	float run(Function process)
+	{
+		double total = 0;
+		worst = 0;
+		for(unsigned int frame = 0; frame < frames; frame += blockSize)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			process(frame);
+			double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			total += time;
+			if(time > worst)
+				worst = time;
+		}
+		worst = worst / (blockSize / sampleRate) * 100;
+		return total / (frames / sampleRate) * 100;
+	}
+
+	/**
+	 * Get the CPU usage of the slowest block of the last call to run(), as a
+	 * percentage of the duration of a block.
+	 */
+	float getWorstBlock() { return worst; }
+
+	/**
+	 * Use the output of a process, so that the compiler cannot skip the work.
+	 */
+	void consume(const float* data, unsigned int length);
+
+	/**
+	 * Get the number of frames processed by run(): a whole number of blocks.
+	 */
+	unsigned int getFrames() { return frames; }
+	unsigned int getBlockSize() { return blockSize; }
+	float getSampleRate() { return sampleRate; }
+
+private:
+	float sampleRate;
+	unsigned int blockSize;
+	unsigned int frames;
+	double worst;
+};
+
+/**
+ * The options passed from main() to setup().
+ */
+struct BenchmarkOptions {
+	const char* name; ///< the benchmark to run, or "all"
+	float seconds; ///< the duration of audio processed by each measurement
+};
+
+// The benchmarks, each of which compares a class of the Bela core with a
+// simpler implementation of the same processing
+void benchmarkDigitalChannels(Benchmark& benchmark);
+void benchmarkBiquadCascade(Benchmark& benchmark);
+void benchmarkOscillatorBank(Benchmark& benchmark);
+void benchmarkConvolver(Benchmark& benchmark);
+void benchmarkDelayLine(Benchmark& benchmark);
+void benchmarkVoicePool(Benchmark& benchmark);
+void benchmarkOversampler(Benchmark& benchmark);
+void benchmarkTubeModel(Benchmark& benchmark);
+void benchmarkAnalogConversion(Benchmark& benchmark);
+
+#endif /* __Benchmark_H_INCLUDED__ */
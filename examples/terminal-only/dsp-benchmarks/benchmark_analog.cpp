@@ -0,0 +1,161 @@
+/***** benchmark_analog.cpp *****/
+#include "Benchmark.h"
+#include <Bela.h>
+#include <AnalogConversion.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+#define kMaxChannels 8
+// The audio expander is enabled on every other channel
+#define kExpanderMask 0x55
+
+// The analog input conversion of PRU::loop() before analogInputsToFloat():
+// one pass to convert, one to invert (Salt) and one per channel for the
+// DC blocker of the audio expander
+static void inputsInPasses(const uint16_t* raw, float* out, unsigned int frames, unsigned int channels,
+		bool interleaved, uint32_t dcBlockMask, float coeff, float* inputHistory, float* outputHistory)
+{
+	for(unsigned int f = 0; f < frames; ++f)
+		for(unsigned int c = 0; c < channels; ++c)
+			out[interleaved ? f * channels + c : c * frames + f] = (float)raw[f * channels + c] / 65536.0f;
+	const float analogInMax = 65535.f/65536.f;
+	for(unsigned int n = 0; n < channels * frames; ++n)
+		out[n] = analogInMax - out[n];
+	for(unsigned int c = 0; c < channels; ++c)
+	{
+		if(!(dcBlockMask & (1u << c)))
+			continue;
+		for(unsigned int f = 0; f < frames; ++f)
+		{
+			float& x = out[interleaved ? f * channels + c : c * frames + f];
+			float filteredOut = coeff * (outputHistory[c] + x - inputHistory[c]);
+			inputHistory[c] = x;
+			outputHistory[c] = filteredOut;
+			x = 2.0f * filteredOut;
+		}
+	}
+}
+
+// The analog output conversion of PRU::loop() before analogOutputsToInt():
+// one pass per channel for the scaling of the audio expander, in place, then
+// one to convert
+static void outputsInPasses(float* in, uint16_t* raw, unsigned int frames, unsigned int channels,
+		bool interleaved, uint32_t expanderMask)
+{
+	for(unsigned int c = 0; c < channels; ++c)
+	{
+		if(!(expanderMask & (1u << c)))
+			continue;
+		for(unsigned int f = 0; f < frames; ++f)
+		{
+			float& x = in[interleaved ? f * channels + c : c * frames + f];
+			x = (x + 1.f) * (0.93f/2.f);
+		}
+	}
+	for(unsigned int f = 0; f < frames; ++f)
+	{
+		for(unsigned int c = 0; c < channels; ++c)
+		{
+			int out = in[interleaved ? f * channels + c : c * frames + f] * 65536.0f;
+			if(out < 0) out = 0;
+			else if(out > 65535) out = 65535;
+			raw[f * channels + c] = (uint16_t)out;
+		}
+	}
+}
+
+// Compare the conversion of the analog inputs and outputs in several passes
+// with the fused analogInputsToFloat() and analogOutputsToInt(), on Salt with
+// the audio expander enabled on half of the channels, for 1 to kMaxChannels
+// channels, interleaved or not. The largest differences between the two are
+// measured over all the odd numbers of frames up to the block size, with the
+// state of the DC blockers carried from one call to the next.
+void benchmarkAnalogConversion(Benchmark& benchmark)
+{
+	const unsigned int blockSize = benchmark.getBlockSize();
+	const unsigned int frames = benchmark.getFrames();
+	const float coeff = 1.0 / ((2.0 * M_PI * 50 / benchmark.getSampleRate()) + 1.0);
+	std::vector<uint16_t> rawIn(kMaxChannels * frames);
+	std::vector<float> floatIn(kMaxChannels * frames);
+	for(unsigned int n = 0; n < rawIn.size(); ++n)
+	{
+		rawIn[n] = rand() & 0xffff;
+		// outside of -1..1, so that some values are clipped
+		floatIn[n] = rand() / (float)RAND_MAX * 2.4f - 1.2f;
+	}
+	std::vector<float> floats[2];
+	std::vector<uint16_t> raws[2];
+	for(unsigned int k = 0; k < 2; ++k)
+	{
+		floats[k].resize(kMaxChannels * blockSize);
+		raws[k].resize(kMaxChannels * blockSize);
+	}
+	float inputHistory[2][kMaxChannels];
+	float outputHistory[2][kMaxChannels];
+
+	rt_printf("Analog conversion, block size %u: %% of one core, passes / fused, and largest difference\n", blockSize);
+	rt_printf("%9s %12s %17s %11s %17s %11s\n", "channels", "interleaved", "inputs", "difference",
+			"outputs", "difference");
+	for(unsigned int channels = 1; channels <= kMaxChannels; ++channels)
+	{
+		for(unsigned int interleaved = 0; interleaved < 2; ++interleaved)
+		{
+			auto resetHistories = [&]() {
+				for(unsigned int k = 0; k < 2; ++k)
+					for(unsigned int c = 0; c < kMaxChannels; ++c)
+						inputHistory[k][c] = outputHistory[k][c] = 0;
+			};
+			resetHistories();
+			float inputsBefore = benchmark.run([&](unsigned int frame) {
+				inputsInPasses(&rawIn[frame * channels], floats[0].data(), blockSize, channels, interleaved,
+						kExpanderMask, coeff, inputHistory[0], outputHistory[0]);
+			});
+			benchmark.consume(floats[0].data(), channels * blockSize);
+			float inputsAfter = benchmark.run([&](unsigned int frame) {
+				analogInputsToFloat(&rawIn[frame * channels], floats[1].data(), blockSize, channels, interleaved,
+						true, kExpanderMask, coeff, inputHistory[1], outputHistory[1]);
+			});
+			benchmark.consume(floats[1].data(), channels * blockSize);
+			float inputDifference = 0;
+			resetHistories();
+			for(unsigned int length = 1, frame = 0; length <= blockSize && frame + length <= frames; frame += length, length += 2)
+			{
+				inputsInPasses(&rawIn[frame * channels], floats[0].data(), length, channels, interleaved,
+						kExpanderMask, coeff, inputHistory[0], outputHistory[0]);
+				analogInputsToFloat(&rawIn[frame * channels], floats[1].data(), length, channels, interleaved,
+						true, kExpanderMask, coeff, inputHistory[1], outputHistory[1]);
+				for(unsigned int n = 0; n < length * channels; ++n)
+					inputDifference = fmaxf(inputDifference, fabsf(floats[0][n] - floats[1][n]));
+			}
+
+			// the scaling is done in place: both sides copy their input first
+			auto load = [&](unsigned int frame, unsigned int length) {
+				for(unsigned int n = 0; n < length * channels; ++n)
+					floats[0][n] = floatIn[frame * channels + n];
+			};
+			float outputsBefore = benchmark.run([&](unsigned int frame) {
+				load(frame, blockSize);
+				outputsInPasses(floats[0].data(), raws[0].data(), blockSize, channels, interleaved, kExpanderMask);
+			});
+			float outputsAfter = benchmark.run([&](unsigned int frame) {
+				load(frame, blockSize);
+				analogOutputsToInt(floats[0].data(), raws[1].data(), blockSize, channels, interleaved, kExpanderMask);
+			});
+			int outputDifference = 0;
+			for(unsigned int length = 1, frame = 0; length <= blockSize && frame + length <= frames; frame += length, length += 2)
+			{
+				load(frame, length);
+				analogOutputsToInt(floats[0].data(), raws[1].data(), length, channels, interleaved, kExpanderMask);
+				outputsInPasses(floats[0].data(), raws[0].data(), length, channels, interleaved, kExpanderMask);
+				for(unsigned int n = 0; n < length * channels; ++n)
+				{
+					int difference = abs((int)raws[0][n] - (int)raws[1][n]);
+					outputDifference = difference > outputDifference ? difference : outputDifference;
+				}
+			}
+			rt_printf("%9u %12s   %6.2f / %6.2f %11.2g   %6.2f / %6.2f %11d\n", channels, interleaved ? "yes" : "no",
+					inputsBefore, inputsAfter, inputDifference, outputsBefore, outputsAfter, outputDifference);
+		}
+	}
+}
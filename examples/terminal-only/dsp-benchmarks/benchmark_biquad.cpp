@@ -0,0 +1,93 @@
+/***** benchmark_biquad.cpp *****/
+#include "Benchmark.h"
+#include <Bela.h>
+#include <BiquadCascade.h>
+#include <IirFilter.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+// Compare one IirFilter per channel with a BiquadCascade for all the channels,
+// in single and double precision, with the same low-pass stages
+void benchmarkBiquadCascade(Benchmark& benchmark)
+{
+	const unsigned int blockSize = benchmark.getBlockSize();
+	const unsigned int frames = benchmark.getFrames();
+	const unsigned int kMaxChannels = 16;
+	// a Butterworth low-pass at 1kHz, in the format of IirFilterStage
+	double w = 2 * M_PI * 1000 / benchmark.getSampleRate();
+	double alpha = sin(w) / (2 * sqrt(0.5));
+	double a0 = 1 + alpha;
+	double coefficients[BiquadCascade<double>::kCoefficients] = {
+		(1 - cos(w)) / 2 / a0, (1 - cos(w)) / a0, (1 - cos(w)) / 2 / a0,
+		-2 * cos(w) / a0, (1 - alpha) / a0,
+	};
+	float floatCoefficients[BiquadCascade<float>::kCoefficients];
+	for(unsigned int n = 0; n < BiquadCascade<float>::kCoefficients; ++n)
+		floatCoefficients[n] = coefficients[n];
+	std::vector<double> input(kMaxChannels * frames);
+	for(unsigned int n = 0; n < input.size(); ++n)
+		input[n] = rand() / (double)RAND_MAX - 0.5;
+	std::vector<double> doubleBuffer(kMaxChannels * blockSize);
+	std::vector<double> reference(kMaxChannels * blockSize);
+	std::vector<float> floatBuffer(kMaxChannels * blockSize);
+
+	rt_printf("Biquad cascades, block size %u: %% of one core\n", blockSize);
+	rt_printf("%9s %7s %10s %13s %13s %11s\n", "channels", "stages", "IirFilter",
+			"Cascade<dbl>", "Cascade<flt>", "difference");
+	const unsigned int numChannels[] = { 1, 2, 8, 16 };
+	const unsigned int numStages[] = { 2, 4, 8 };
+	for(unsigned int c = 0; c < sizeof(numChannels) / sizeof(numChannels[0]); ++c)
+	{
+		for(unsigned int s = 0; s < sizeof(numStages) / sizeof(numStages[0]); ++s)
+		{
+			const unsigned int channels = numChannels[c];
+			const unsigned int stages = numStages[s];
+			std::vector<IirFilter> filters(channels);
+			for(unsigned int ch = 0; ch < channels; ++ch)
+			{
+				filters[ch].setNumberOfStages(stages);
+				for(unsigned int st = 0; st < stages; ++st)
+					filters[ch].setCoefficients(coefficients, st);
+			}
+			BiquadCascade<double> doubleCascade;
+			BiquadCascade<float> floatCascade;
+			doubleCascade.setup(stages, channels, blockSize);
+			floatCascade.setup(stages, channels, blockSize);
+			for(unsigned int st = 0; st < stages; ++st)
+			{
+				doubleCascade.setCoefficients(st, coefficients);
+				floatCascade.setCoefficients(st, floatCoefficients);
+			}
+			// the blocks of input of each channel, non-interleaved
+			auto load = [&](unsigned int frame) {
+				for(unsigned int ch = 0; ch < channels; ++ch)
+					for(unsigned int n = 0; n < blockSize; ++n)
+						doubleBuffer[ch * blockSize + n] = input[ch * frames + frame + n];
+			};
+			float iir = benchmark.run([&](unsigned int frame) {
+				load(frame);
+				for(unsigned int ch = 0; ch < channels; ++ch)
+					filters[ch].process(doubleBuffer.data() + ch * blockSize, blockSize);
+			});
+			// the last block of the IirFilters
+			reference = doubleBuffer;
+			float cascadeDouble = benchmark.run([&](unsigned int frame) {
+				load(frame);
+				doubleCascade.process(doubleBuffer.data(), blockSize);
+			});
+			double difference = 0;
+			for(unsigned int n = 0; n < channels * blockSize; ++n)
+				difference = fmax(difference, fabs(doubleBuffer[n] - reference[n]));
+			float cascadeFloat = benchmark.run([&](unsigned int frame) {
+				for(unsigned int ch = 0; ch < channels; ++ch)
+					for(unsigned int n = 0; n < blockSize; ++n)
+						floatBuffer[ch * blockSize + n] = input[ch * frames + frame + n];
+				floatCascade.process(floatBuffer.data(), blockSize);
+			});
+			benchmark.consume(floatBuffer.data(), channels * blockSize);
+			rt_printf("%9u %7u %9.2f%% %12.2f%% %12.2f%% %11.2g\n", channels, stages,
+					iir, cascadeDouble, cascadeFloat, difference);
+		}
+	}
+}
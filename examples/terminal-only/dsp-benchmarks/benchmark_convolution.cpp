@@ -0,0 +1,100 @@
+/***** benchmark_convolution.cpp *****/
+#include "Benchmark.h"
+#include <Bela.h>
+#include <Convolver.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+// Direct convolution is too slow to be worth measuring on longer impulse responses
+#define kMaxDirectTaps 4096
+
+// Fill an impulse response with exponentially decaying noise, which
+// decays by 60dB in the length of the response
+static void makeReverb(float* ir, unsigned int length)
+{
+	float decay = powf(0.001f, 1.f / length);
+	float gain = 0.1f;
+	for(unsigned int n = 0; n < length; ++n)
+	{
+		ir[n] = gain * (rand() / (float)RAND_MAX * 2.f - 1.f);
+		gain *= decay;
+	}
+}
+
+// The block sizes compared: the partitions of the Convolver are as long as
+// the block, so its cost depends on the block size much more than that of
+// the direct convolution
+static const unsigned int kBlockSizes[] = { 16, 32, 64, 128 };
+
+// Compare a convolution in the time domain, as in the filter-FIR example,
+// with a Convolver, for impulse responses of increasing length. The tail of
+// the Convolver is computed in process(), so that all of its work is counted,
+// and the worst block shows the cost of the blocks in which the partitions
+// of the tail are computed.
+static void benchmarkConvolverBlockSize(Benchmark& benchmark)
+{
+	const unsigned int blockSize = benchmark.getBlockSize();
+	const unsigned int frames = benchmark.getFrames();
+	std::vector<float> input(frames);
+	for(unsigned int n = 0; n < frames; ++n)
+		input[n] = rand() / (float)RAND_MAX * 2.f - 1.f;
+	std::vector<float> output(blockSize);
+	// the input, preceded by the samples of the previous blocks, for the direct convolution
+	std::vector<float> history(kMaxDirectTaps - 1 + frames);
+
+	rt_printf("Convolution, block size %u: %% of one core for one channel\n", blockSize);
+	rt_printf("%8s %10s %10s %18s\n", "taps", "direct", "Convolver", "Convolver (worst)");
+	const unsigned int lengths[] = { 256, 1024, 4096, 16384, 65536 };
+	for(unsigned int l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l)
+	{
+		const unsigned int length = lengths[l];
+		std::vector<float> ir(length);
+		makeReverb(ir.data(), length);
+		rt_printf("%8u ", length);
+		if(length <= kMaxDirectTaps)
+		{
+			for(unsigned int n = 0; n < frames; ++n)
+				history[kMaxDirectTaps - 1 + n] = input[n];
+			float direct = benchmark.run([&](unsigned int frame) {
+				const float* x = &history[kMaxDirectTaps - 1 + frame];
+				for(unsigned int n = 0; n < blockSize; ++n)
+				{
+					const float* current = x + n;
+					float sum = 0;
+					for(unsigned int k = 0; k < length; ++k)
+						sum += ir[k] * *(current - k);
+					output[n] = sum;
+				}
+			});
+			benchmark.consume(output.data(), blockSize);
+			rt_printf("%9.2f%% ", direct);
+		} else {
+			rt_printf("%10s ", "-");
+		}
+		ConvolverIr convolverIr;
+		Convolver convolver;
+		if(convolverIr.setup(ir.data(), length) || convolver.setup(&convolverIr, false))
+		{
+			rt_printf("\n");
+			return;
+		}
+		float partitioned = benchmark.run([&](unsigned int frame) {
+			convolver.process(&input[frame], output.data(), blockSize);
+		});
+		benchmark.consume(output.data(), blockSize);
+		rt_printf("%9.2f%% %17.2f%%\n", partitioned, benchmark.getWorstBlock());
+	}
+}
+
+// Run the comparison at each of kBlockSizes, whatever the block size of
+// Bela, for the same duration of audio
+void benchmarkConvolver(Benchmark& benchmark)
+{
+	const float seconds = benchmark.getFrames() / benchmark.getSampleRate();
+	for(unsigned int n = 0; n < sizeof(kBlockSizes) / sizeof(kBlockSizes[0]); ++n)
+	{
+		Benchmark blockBenchmark(benchmark.getSampleRate(), kBlockSizes[n], seconds);
+		benchmarkConvolverBlockSize(blockBenchmark);
+	}
+}
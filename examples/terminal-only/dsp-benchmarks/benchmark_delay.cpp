@@ -0,0 +1,145 @@
+/***** benchmark_delay.cpp *****/
+#include "Benchmark.h"
+#include <Bela.h>
+#include <DelayLine.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+// The longest tap count, for the array of delays
+#define kMaxTaps 16
+
+// A delay line that processes one sample at a time, wrapping the
+// positions with a modulo and computing the interpolation for every sample,
+// with the same interpolators as DelayLine
+class NaiveDelayLine {
+public:
+	NaiveDelayLine(unsigned int size) : buffer(size), writePointer(0) {}
+	void write(float in){
+		buffer[writePointer] = in;
+		if(++writePointer >= buffer.size())
+			writePointer = 0;
+	}
+	float read(float delay, DelayInterpolation interpolation){
+		unsigned int d = (unsigned int)delay;
+		float f = delay - d;
+		if(kDelayInterpolationLagrange == interpolation)
+		{
+			// the same coefficients as DelayLine, oldest sample first
+			float h0 = (1 + f) * f * (f - 1) / 6;
+			float h1 = -(1 + f) * f * (f - 2) / 2;
+			float h2 = (1 + f) * (f - 1) * (f - 2) / 2;
+			float h3 = -f * (f - 1) * (f - 2) / 6;
+			return h0 * sample(d + 2) + h1 * sample(d + 1) + h2 * sample(d) + h3 * sample(d - 1);
+		}
+		return sample(d + 1) * f + sample(d) * (1 - f);
+	}
+private:
+	// the sample written `delay` samples before the last one
+	float sample(unsigned int delay){
+		return buffer[(writePointer + buffer.size() - 1 - delay) % buffer.size()];
+	}
+	std::vector<float> buffer;
+	unsigned int writePointer;
+};
+
+// Compare a multi-tap delay processed one sample at a time with
+// NaiveDelayLine and one block at a time with DelayLine, for several
+// numbers of channels and taps. Both sides use the same interpolation and,
+// in the modulated column, the same delays, which move with a sine LFO.
+void benchmarkDelayLine(Benchmark& benchmark)
+{
+	const unsigned int blockSize = benchmark.getBlockSize();
+	const unsigned int frames = benchmark.getFrames();
+	const float sampleRate = benchmark.getSampleRate();
+	const unsigned int maxDelay = 0.5f * sampleRate;
+	const float depth = 0.001f * sampleRate; // of the modulation, in samples
+	std::vector<float> in(frames);
+	std::vector<float> modulation(frames);
+	for(unsigned int n = 0; n < frames; ++n)
+	{
+		in[n] = rand() / (float)RAND_MAX * 2.f - 1.f;
+		modulation[n] = depth * (1 + sinf(2 * (float)M_PI * 0.5f * n / sampleRate));
+	}
+	std::vector<float> out(blockSize);
+	std::vector<float> tap(blockSize);
+	std::vector<float> delays(blockSize);
+
+	const DelayInterpolation interpolations[] = {
+		kDelayInterpolationLinear,
+		kDelayInterpolationLagrange,
+		kDelayInterpolationLinear,
+	};
+	rt_printf("Delay lines, block size %u: %% of one core, naive / DelayLine\n", blockSize);
+	rt_printf("%9s %5s %17s %17s %17s\n", "channels", "taps", "linear", "Lagrange", "modulated linear");
+	const unsigned int channelCounts[] = { 2, 8, 32 };
+	const unsigned int tapCounts[] = { 1, 4, kMaxTaps };
+	for(unsigned int c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); ++c)
+	{
+		const unsigned int numChannels = channelCounts[c];
+		for(unsigned int t = 0; t < sizeof(tapCounts) / sizeof(tapCounts[0]); ++t)
+		{
+			const unsigned int numTaps = tapCounts[t];
+			float tapDelays[kMaxTaps];
+			for(unsigned int k = 0; k < numTaps; ++k)
+				tapDelays[k] = (k + 1) * (maxDelay - 2 * depth - 4) / (float)numTaps + 0.37f;
+			rt_printf("%9u %5u", numChannels, numTaps);
+			for(unsigned int mode = 0; mode < 3; ++mode)
+			{
+				const DelayInterpolation interpolation = interpolations[mode];
+				const bool modulated = 2 == mode;
+
+				// one sample, one channel and one tap at a time
+				std::vector<NaiveDelayLine> naive(numChannels, NaiveDelayLine(maxDelay + 1));
+				float naiveUsage = benchmark.run([&](unsigned int frame) {
+					for(unsigned int n = 0; n < blockSize; ++n)
+					{
+						float offset = modulated ? modulation[frame + n] : 0;
+						for(unsigned int ch = 0; ch < numChannels; ++ch)
+						{
+							naive[ch].write(in[frame + n]);
+							float sum = 0;
+							for(unsigned int k = 0; k < numTaps; ++k)
+								sum += naive[ch].read(tapDelays[k] - offset, interpolation);
+							out[n] = sum;
+						}
+					}
+				});
+				benchmark.consume(out.data(), blockSize);
+
+				// one block and one channel at a time
+				DelayLine<float> delayLine;
+				delayLine.setup(maxDelay, numChannels, blockSize);
+				float blockUsage = benchmark.run([&](unsigned int frame) {
+					for(unsigned int ch = 0; ch < numChannels; ++ch)
+					{
+						delayLine.write(ch, &in[frame], blockSize);
+						for(unsigned int k = 0; k < numTaps; ++k)
+						{
+							if(modulated)
+							{
+								for(unsigned int n = 0; n < blockSize; ++n)
+									delays[n] = tapDelays[k] - modulation[frame + n];
+								// readModulated() cannot accumulate: sum the taps here
+								if(k)
+								{
+									delayLine.readModulated(ch, tap.data(), blockSize, delays.data(), interpolation);
+									for(unsigned int n = 0; n < blockSize; ++n)
+										out[n] += tap[n];
+								} else {
+									delayLine.readModulated(ch, out.data(), blockSize, delays.data(), interpolation);
+								}
+							} else {
+								delayLine.read(ch, out.data(), blockSize, tapDelays[k], interpolation, 1, k > 0);
+							}
+						}
+					}
+					delayLine.advance(blockSize);
+				});
+				benchmark.consume(out.data(), blockSize);
+				rt_printf("   %6.1f / %6.1f", naiveUsage, blockUsage);
+			}
+			rt_printf("\n");
+		}
+	}
+}
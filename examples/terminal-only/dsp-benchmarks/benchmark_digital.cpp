@@ -0,0 +1,81 @@
+/***** benchmark_digital.cpp *****/
+#include "Benchmark.h"
+#include <Bela.h>
+#include <DigitalChannelManager.h>
+#include <stdlib.h>
+#include <vector>
+
+// The signal-rate digital inputs and outputs of the libpd wrapper before
+// DigitalChannelManager::processSignalRateInput() and processSignalRateOutput():
+// every frame tests every channel, and reads or writes one bit at a time
+static void unpackPerBit(DigitalChannelManager& dcm, const uint32_t* digital, unsigned int frames, float* out, unsigned int stride)
+{
+	for(unsigned int j = 0; j < frames; ++j)
+		for(unsigned int k = 0; k < 16; ++k)
+			if(dcm.isSignalRate(k) && dcm.isInput(k))
+				out[k * stride + j] = getBit(digital[j], k + 16);
+}
+
+static void packPerBit(DigitalChannelManager& dcm, uint32_t* digital, unsigned int frames, const float* in, unsigned int stride)
+{
+	for(unsigned int j = 0; j < frames; ++j)
+	{
+		for(unsigned int k = 0; k < 16; ++k)
+		{
+			if(dcm.isSignalRate(k) && dcm.isOutput(k))
+			{
+				if(in[k * stride + j] > 0.5f)
+					digital[j] |= 1u << (k + 16);
+				else
+					digital[j] &= ~(1u << (k + 16));
+			}
+		}
+	}
+}
+
+void benchmarkDigitalChannels(Benchmark& benchmark)
+{
+	const unsigned int blockSize = benchmark.getBlockSize();
+	const unsigned int frames = benchmark.getFrames();
+	std::vector<uint32_t> digital(frames);
+	std::vector<float> buffers(16 * blockSize);
+	for(unsigned int n = 0; n < frames; ++n)
+		digital[n] = rand();
+
+	rt_printf("Signal-rate digitals, block size %u: %% of one core, per bit / DigitalChannelManager\n", blockSize);
+	rt_printf("%9s %20s %20s\n", "channels", "inputs", "outputs");
+	const unsigned int numChannels[] = { 1, 4, 8, 16 };
+	for(unsigned int c = 0; c < sizeof(numChannels) / sizeof(numChannels[0]); ++c)
+	{
+		DigitalChannelManager inputs;
+		DigitalChannelManager outputs;
+		inputs.setVerbose(false);
+		outputs.setVerbose(false);
+		for(unsigned int k = 0; k < numChannels[c]; ++k)
+		{
+			inputs.manage(k, INPUT, false);
+			outputs.manage(k, OUTPUT, false);
+		}
+		float inputBefore = benchmark.run([&](unsigned int frame) {
+			unpackPerBit(inputs, digital.data() + frame, blockSize, buffers.data(), blockSize);
+		});
+		benchmark.consume(buffers.data(), buffers.size());
+		float inputAfter = benchmark.run([&](unsigned int frame) {
+			inputs.processSignalRateInput(digital.data() + frame, blockSize, buffers.data(), blockSize);
+		});
+		benchmark.consume(buffers.data(), buffers.size());
+		float outputBefore = benchmark.run([&](unsigned int frame) {
+			packPerBit(outputs, digital.data() + frame, blockSize, buffers.data(), blockSize);
+		});
+		float outputAfter = benchmark.run([&](unsigned int frame) {
+			outputs.processSignalRateOutput(digital.data() + frame, blockSize, buffers.data(), blockSize);
+		});
+		rt_printf("%9u %9.3f%% %8.3f%% %9.3f%% %8.3f%%\n", numChannels[c],
+				inputBefore, inputAfter, outputBefore, outputAfter);
+	}
+	unsigned int check = 0;
+	for(unsigned int n = 0; n < frames; ++n)
+		check += digital[n];
+	float checkFloat = check;
+	benchmark.consume(&checkFloat, 1);
+}
@@ -0,0 +1,93 @@
+/***** benchmark_oscillators.cpp *****/
+#include "Benchmark.h"
+#include <Bela.h>
+#include <OscillatorBank.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+// A wavetable oscillator bank with linear interpolation, one oscillator at a
+// time, which computes all the oscillators, including the silent ones
+static void naiveOscillatorBank(unsigned int frames, float* output, unsigned int numOscillators,
+		const float* wavetable, unsigned int wavetableLength,
+		float* phases, const float* frequencies, const float* amplitudes)
+{
+	for(unsigned int n = 0; n < frames; ++n)
+		output[n] = 0;
+	for(unsigned int osc = 0; osc < numOscillators; ++osc)
+	{
+		float phase = phases[osc];
+		for(unsigned int n = 0; n < frames; ++n)
+		{
+			int index = (int)phase;
+			float fraction = phase - index;
+			output[n] += amplitudes[osc] * (wavetable[index] + fraction * (wavetable[index + 1] - wavetable[index]));
+			phase += frequencies[osc];
+			if(phase >= wavetableLength)
+				phase -= wavetableLength;
+		}
+		phases[osc] = phase;
+	}
+}
+
+// Compare the naive oscillator bank with OscillatorBank over a range of
+// numbers of partials, with all of them sounding and with a quarter of them
+// sounding, where OscillatorBank only computes the active ones
+void benchmarkOscillatorBank(Benchmark& benchmark)
+{
+	const unsigned int blockSize = benchmark.getBlockSize();
+	const float sampleRate = benchmark.getSampleRate();
+	const unsigned int kWavetableLength = 1024;
+	std::vector<float> output(blockSize);
+
+	rt_printf("Oscillator banks, block size %u: %% of one core\n", blockSize);
+	rt_printf("%9s %8s %10s %8s %15s\n", "partials", "active", "naive", "bank", "bank (mipmaps)");
+	const unsigned int numPartials[] = { 64, 256, 1024, 4096 };
+	for(unsigned int p = 0; p < sizeof(numPartials) / sizeof(numPartials[0]); ++p)
+	{
+		const unsigned int partials = numPartials[p];
+		OscillatorBank bank;
+		if(bank.init(kWavetableLength, partials, sampleRate))
+			return;
+		float* wavetable = bank.getWavetable();
+		for(unsigned int n = 0; n < kWavetableLength; ++n)
+			wavetable[n] = sinf(2 * M_PI * n / kWavetableLength);
+		wavetable[kWavetableLength] = wavetable[0];
+		std::vector<float> phases(partials);
+		std::vector<float> frequencies(partials);
+		std::vector<float> amplitudes(partials);
+		for(unsigned int activeEvery = 1; activeEvery <= 4; activeEvery *= 4)
+		{
+			bank.disableMipmaps();
+			bank.clearArrays();
+			for(unsigned int n = 0; n < partials; ++n)
+			{
+				// partials of a 50Hz tone, folded below half the sample rate
+				float frequency = fmodf(50.f * (n + 1), sampleRate * 0.45f) + 20;
+				float amplitude = n % activeEvery ? 0 : 1.f / partials;
+				bank.setFrequency(n, frequency);
+				bank.setAmplitude(n, amplitude);
+				phases[n] = 0;
+				frequencies[n] = frequency * kWavetableLength / sampleRate;
+				amplitudes[n] = amplitude;
+			}
+			float naive = benchmark.run([&](unsigned int) {
+				naiveOscillatorBank(blockSize, output.data(), partials, wavetable,
+						kWavetableLength, phases.data(), frequencies.data(), amplitudes.data());
+			});
+			benchmark.consume(output.data(), blockSize);
+			float oscillatorBank = benchmark.run([&](unsigned int) {
+				bank.process(blockSize, output.data());
+			});
+			benchmark.consume(output.data(), blockSize);
+			if(bank.generateMipmaps())
+				return;
+			float mipmaps = benchmark.run([&](unsigned int) {
+				bank.process(blockSize, output.data());
+			});
+			benchmark.consume(output.data(), blockSize);
+			rt_printf("%9u %8u %9.2f%% %7.2f%% %14.2f%%\n", partials, partials / activeEvery,
+					naive, oscillatorBank, mipmaps);
+		}
+	}
+}
@@ -0,0 +1,143 @@
+/***** benchmark_oversampler.cpp *****/
+#include "Benchmark.h"
+#include <Bela.h>
+#include <Oversampler.h>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#define kNumChannels 2
+
+// The wave folder and saturator of the oversampled-distortion example
+static void distort(float* samples, unsigned int frames, float drive)
+{
+	for(unsigned int n = 0; n < frames; ++n)
+	{
+		float x = samples[n] * drive * 0.25f + 0.25f;
+		x -= floorf(x);
+		x = 4.f * fabsf(x - 0.5f) - 1.f;
+		x = 1.5f * x;
+		x = x > 3.f ? 3.f : (x < -3.f ? -3.f : x);
+		samples[n] = x * (27.f + x * x) / (27.f + 9.f * x * x);
+	}
+}
+
+// Oversampling as it is often written by hand: linear interpolation to
+// upsample and the average of each group of samples to downsample
+class NaiveOversampler {
+public:
+	NaiveOversampler(unsigned int factor, unsigned int maxFrames) :
+		factor(factor), last(0), buffer(factor * maxFrames) {}
+	template <typename Function>
+	void process(const float* in, float* out, unsigned int frames, Function function)
+	{
+		for(unsigned int n = 0; n < frames; ++n)
+		{
+			for(unsigned int k = 0; k < factor; ++k)
+				buffer[n * factor + k] = last + (in[n] - last) * (k + 1) / factor;
+			last = in[n];
+		}
+		function(buffer.data(), frames * factor);
+		for(unsigned int n = 0; n < frames; ++n)
+		{
+			float sum = 0;
+			for(unsigned int k = 0; k < factor; ++k)
+				sum += buffer[n * factor + k];
+			out[n] = sum / factor;
+		}
+	}
+private:
+	unsigned int factor;
+	float last;
+	std::vector<float> buffer;
+};
+
+// The power of the aliasing in `x`, relative to the power of `x`, in dB.
+// `x` is one period of the output for a sine of `bin` cycles in `x.size()`
+// samples, with `bin` odd so that the aliases do not fall on a harmonic.
+static float measureAliasing(const std::vector<float>& x, unsigned int bin)
+{
+	unsigned int length = x.size();
+	double total = 0;
+	for(unsigned int n = 0; n < length; ++n)
+		total += x[n] * x[n];
+	// the power of the harmonics, from the DFT at each of their bins
+	double harmonics = 0;
+	for(unsigned int h = bin; h < length / 2; h += bin)
+	{
+		double re = 0;
+		double im = 0;
+		for(unsigned int n = 0; n < length; ++n)
+		{
+			double phase = 2 * M_PI * (double)((uint64_t)h * n % length) / length;
+			re += x[n] * cos(phase);
+			im += x[n] * sin(phase);
+		}
+		harmonics += 2 * (re * re + im * im) / length;
+	}
+	double aliasing = total - harmonics;
+	return aliasing > 0 ? 10 * log10(aliasing / total) : -200;
+}
+
+// Compare the naive oversampling with Oversampler, with either filter, for
+// each factor: the CPU usage for a stereo wave folder, the aliasing left in
+// the output for a 1kHz sine and the latency
+void benchmarkOversampler(Benchmark& benchmark)
+{
+	const unsigned int blockSize = benchmark.getBlockSize();
+	const unsigned int frames = benchmark.getFrames();
+	const float sampleRate = benchmark.getSampleRate();
+	const unsigned int period = 4096;
+	// the odd number of cycles per period closest to 1kHz
+	const unsigned int bin = 2 * (unsigned int)(1000.f * period / sampleRate / 2) + 1;
+	// the aliasing is measured on the last whole period, after the filters have settled
+	if(frames < 2 * period)
+	{
+		rt_printf("Oversampling: at least %u frames are needed to measure the aliasing\n", 2 * period);
+		return;
+	}
+	std::vector<float> in(frames);
+	std::vector<float> out(frames);
+	for(unsigned int n = 0; n < frames; ++n)
+		in[n] = 0.8f * sinf(2.f * (float)M_PI * bin * (n % period) / period);
+	std::vector<float> lastPeriod(period);
+	const float drive = 4;
+	auto function = [drive](float* samples, unsigned int length) { distort(samples, length, drive); };
+
+	rt_printf("Oversampling, block size %u, %u channels: %% of one core, aliasing (dB) and latency (samples)\n",
+			blockSize, kNumChannels);
+	rt_printf("%7s %22s %22s %22s\n", "factor", "naive", "half-band FIR", "half-band IIR");
+	for(unsigned int factor = 1; factor <= 8; factor *= 2)
+	{
+		rt_printf("%7u", factor);
+		for(unsigned int mode = 0; mode < 3; ++mode)
+		{
+			NaiveOversampler naive[kNumChannels] = {
+				NaiveOversampler(factor, blockSize),
+				NaiveOversampler(factor, blockSize),
+			};
+			Oversampler oversampler;
+			if(mode && oversampler.setup(kNumChannels, factor, blockSize, 2 == mode ? kOversamplerIir : kOversamplerFir))
+			{
+				rt_printf("\n");
+				return;
+			}
+			float usage = benchmark.run([&](unsigned int frame) {
+				for(unsigned int ch = 0; ch < kNumChannels; ++ch)
+				{
+					if(0 == mode)
+						naive[ch].process(&in[frame], &out[frame], blockSize, function);
+					else
+						oversampler.process(ch, &in[frame], &out[frame], blockSize, function);
+				}
+			});
+			// the last whole period of the output
+			unsigned int end = frames / period * period;
+			for(unsigned int n = 0; n < period; ++n)
+				lastPeriod[n] = out[end - period + n];
+			float latency = mode ? oversampler.getLatency() : (factor - 1) / (2.f * factor);
+			rt_printf(" %6.1f%% %6.1fdB %6.1f", usage, measureAliasing(lastPeriod, bin), latency);
+		}
+		rt_printf("\n");
+	}
+}
@@ -0,0 +1,252 @@
+/***** benchmark_tube.cpp *****/
+#include "Benchmark.h"
+#include <Bela.h>
+#include <TubeModel.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+// The geometry of the vocal tract of the Pink Trombone
+#define kTractSegments 44
+#define kNoseSegments 28
+#define kNoseStart (kTractSegments - kNoseSegments + 1)
+#define kMaxVoices 8
+// the moving shape: the half-width of the tongue, in segments, and the
+// number of blocks in which it goes back and forth
+#define kTongueWidth 6
+#define kTonguePeriod 50
+
+// The diameters of the tract at rest, without the tongue
+static void computeRestDiameters(float* diameters)
+{
+	for(unsigned int i = 0; i < kTractSegments; ++i)
+	{
+		if(i < 7 * kTractSegments / 44.f - 0.5f)
+			diameters[i] = 0.6;
+		else if(i < 12 * kTractSegments / 44.f)
+			diameters[i] = 1.1;
+		else
+			diameters[i] = 1.5;
+	}
+}
+
+// The shape at rest with a constriction made by the tongue around
+// `tongueIndex`. The segments up to kNoseStart + 1 are left at rest, so that
+// the shape stays the same on both sides of the junction with the nose.
+static void computeTongueDiameters(float* diameters, float tongueIndex, float tongueDiameter)
+{
+	computeRestDiameters(diameters);
+	for(unsigned int i = kNoseStart + 2; i < kTractSegments; ++i)
+	{
+		float x = (i - tongueIndex) / kTongueWidth;
+		if(fabsf(x) < 1)
+			diameters[i] += (tongueDiameter - diameters[i]) * 0.5f * (1 + cosf((float)M_PI * x));
+	}
+}
+
+// The diameters of the nasal cavity, with the velum first
+static void computeNoseDiameters(float* diameters, float velum)
+{
+	for(unsigned int i = 0; i < kNoseSegments; ++i)
+	{
+		float d = 2.f * i / kNoseSegments;
+		float diameter = d < 1 ? 0.4f + 1.6f * d : 0.5f + 1.5f * (2 - d);
+		diameters[i] = diameter < 1.9f ? diameter : 1.9f;
+	}
+	diameters[0] = velum;
+}
+
+// The vocal tract of the Pink Trombone example (TractClass::runStep()),
+// without the transients and the amplitude display: one voice at a time, in
+// scalar code
+class ScalarTract {
+public:
+	ScalarTract() :
+		R(n), L(n), reflection(n + 1), newReflection(n + 1),
+		junctionOutputR(n + 1), junctionOutputL(n + 1), A(n),
+		noseR(noseLength), noseL(noseLength), noseJunctionOutputR(noseLength + 1),
+		noseJunctionOutputL(noseLength + 1), noseReflection(noseLength + 1), noseA(noseLength),
+		reflectionLeft(0), reflectionRight(0), reflectionNose(0),
+		newReflectionLeft(0), newReflectionRight(0), newReflectionNose(0),
+		lipOutput(0), noseOutput(0)
+	{}
+	void setShape(const float* diameters, const float* noseDiameters)
+	{
+		for(int i = 0; i < noseLength; ++i)
+			noseA[i] = noseDiameters[i] * noseDiameters[i];
+		for(int i = 1; i < noseLength; ++i)
+			noseReflection[i] = (noseA[i - 1] - noseA[i]) / (noseA[i - 1] + noseA[i]);
+		moveShape(diameters);
+		reflection = newReflection;
+		reflectionLeft = newReflectionLeft;
+		reflectionRight = newReflectionRight;
+		reflectionNose = newReflectionNose;
+	}
+	// as TractClass::calculateReflections(), called before each block: the
+	// reflections move from the previous shape to this one over the block
+	void moveShape(const float* diameters)
+	{
+		for(int i = 0; i < n; ++i)
+			A[i] = diameters[i] * diameters[i];
+		for(int i = 1; i < n; ++i)
+		{
+			reflection[i] = newReflection[i];
+			newReflection[i] = A[i] == 0 ? 0.999f : (A[i - 1] - A[i]) / (A[i - 1] + A[i]);
+		}
+		reflectionLeft = newReflectionLeft;
+		reflectionRight = newReflectionRight;
+		reflectionNose = newReflectionNose;
+		float sum = A[noseStart] + A[noseStart + 1] + noseA[0];
+		newReflectionLeft = (2 * A[noseStart] - sum) / sum;
+		newReflectionRight = (2 * A[noseStart + 1] - sum) / sum;
+		newReflectionNose = (2 * noseA[0] - sum) / sum;
+	}
+	void runStep(float glottalOutput, float lambda)
+	{
+		junctionOutputR[0] = L[0] * glottalReflection + glottalOutput;
+		junctionOutputL[n] = R[n - 1] * lipReflection;
+		for(int i = 1; i < n; ++i)
+		{
+			float r = reflection[i] * (1 - lambda) + newReflection[i] * lambda;
+			float w = r * (R[i - 1] + L[i]);
+			junctionOutputR[i] = R[i - 1] - w;
+			junctionOutputL[i] = L[i] + w;
+		}
+		int i = noseStart;
+		float r = newReflectionLeft * (1 - lambda) + reflectionLeft * lambda;
+		junctionOutputL[i] = r * R[i - 1] + (1 + r) * (noseL[0] + L[i]);
+		r = newReflectionRight * (1 - lambda) + reflectionRight * lambda;
+		junctionOutputR[i] = r * L[i] + (1 + r) * (R[i - 1] + noseL[0]);
+		r = newReflectionNose * (1 - lambda) + reflectionNose * lambda;
+		noseJunctionOutputR[0] = r * noseL[0] + (1 + r) * (L[i] + R[i - 1]);
+		for(int i = 0; i < n; ++i)
+		{
+			R[i] = junctionOutputR[i] * 0.999f;
+			L[i] = junctionOutputL[i + 1] * 0.999f;
+		}
+		lipOutput = R[n - 1];
+		noseJunctionOutputL[noseLength] = noseR[noseLength - 1] * lipReflection;
+		for(int i = 1; i < noseLength; ++i)
+		{
+			float w = noseReflection[i] * (noseR[i - 1] + noseL[i]);
+			noseJunctionOutputR[i] = noseR[i - 1] - w;
+			noseJunctionOutputL[i] = noseL[i] + w;
+		}
+		for(int i = 0; i < noseLength; ++i)
+		{
+			noseR[i] = noseJunctionOutputR[i] * fade;
+			noseL[i] = noseJunctionOutputL[i + 1] * fade;
+		}
+		noseOutput = noseR[noseLength - 1];
+	}
+	// as in AudioSystemClass::doScriptProcessor(): two steps per sample
+	void process(const float* in, float* out, unsigned int frames)
+	{
+		for(unsigned int j = 0; j < frames; ++j)
+		{
+			float output = 0;
+			runStep(in[j], j / (float)frames);
+			output += lipOutput + noseOutput;
+			runStep(in[j], (j + 0.5f) / frames);
+			output += lipOutput + noseOutput;
+			out[j] = output;
+		}
+	}
+private:
+	static const int n = kTractSegments;
+	static const int noseLength = kNoseSegments;
+	static const int noseStart = kNoseStart;
+	static constexpr float glottalReflection = 0.75;
+	static constexpr float lipReflection = -0.85;
+	static constexpr float fade = 1;
+	std::vector<float> R, L, reflection, newReflection, junctionOutputR, junctionOutputL, A;
+	std::vector<float> noseR, noseL, noseJunctionOutputR, noseJunctionOutputL, noseReflection, noseA;
+	float reflectionLeft, reflectionRight, reflectionNose;
+	float newReflectionLeft, newReflectionRight, newReflectionNose;
+	float lipOutput, noseOutput;
+};
+
+// Compare the scalar tract, one instance per voice, with a TubeModel for
+// 1 to kMaxVoices voices, and check that they compute the same output. Both
+// run with the shape at rest, for which TubeModel skips the interpolation
+// of the reflections, and with the tongue of each voice moving in every
+// block. ScalarTract takes the areas at the junction with the nose one
+// segment further than TubeModel, and interpolates its reflections the
+// other way round: both shapes are the same on both sides of that junction,
+// where they do not move.
+void benchmarkTubeModel(Benchmark& benchmark)
+{
+	const unsigned int blockSize = benchmark.getBlockSize();
+	const unsigned int frames = benchmark.getFrames();
+	float diameters[kTractSegments];
+	float noseDiameters[kNoseSegments];
+	computeRestDiameters(diameters);
+	computeNoseDiameters(noseDiameters, 0.4);
+	// the input and outputs are stored block by block, in the layout of
+	// TubeModel::process(): [block][voice][frame]
+	std::vector<float> in(kMaxVoices * frames);
+	for(unsigned int n = 0; n < in.size(); ++n)
+		in[n] = rand() / (float)RAND_MAX * 2.f - 1.f;
+	std::vector<float> scalarOut(kMaxVoices * frames);
+	std::vector<float> tubeOut(kMaxVoices * frames);
+	// the tongue of each voice goes back and forth between the junction
+	// with the nose and the lips, out of phase with the other voices
+	auto computeShape = [](float* shape, unsigned int block, unsigned int voice) {
+		float phase = 2.f * (float)M_PI * ((block % kTonguePeriod) / (float)kTonguePeriod + voice / (float)kMaxVoices);
+		computeTongueDiameters(shape, 31.f + 7.f * sinf(phase), 0.8f);
+	};
+
+	rt_printf("Vocal tracts, block size %u: %% of one core\n", blockSize);
+	rt_printf("%7s %7s %10s %10s %8s %12s\n", "voices", "shape", "scalar", "TubeModel", "speedup", "difference");
+	for(unsigned int numVoices = 1; numVoices <= kMaxVoices; numVoices *= 2)
+	{
+		for(unsigned int moving = 0; moving < 2; ++moving)
+		{
+			std::vector<ScalarTract> scalar(numVoices);
+			TubeModel tubes;
+			if(tubes.setup(numVoices, kTractSegments, blockSize, 2, kNoseSegments, kNoseStart))
+				return;
+			for(unsigned int v = 0; v < numVoices; ++v)
+			{
+				scalar[v].setShape(diameters, noseDiameters);
+				tubes.setDiameters(v, diameters);
+				tubes.setSideDiameters(v, noseDiameters);
+			}
+			tubes.reset();
+			float shape[kTractSegments];
+			float scalarUsage = benchmark.run([&](unsigned int frame) {
+				unsigned int start = frame * kMaxVoices;
+				for(unsigned int v = 0; v < numVoices; ++v)
+				{
+					if(moving)
+					{
+						computeShape(shape, frame / blockSize, v);
+						scalar[v].moveShape(shape);
+					}
+					scalar[v].process(&in[start + v * blockSize], &scalarOut[start + v * blockSize], blockSize);
+				}
+			});
+			float tubeUsage = benchmark.run([&](unsigned int frame) {
+				unsigned int start = frame * kMaxVoices;
+				if(moving)
+				{
+					for(unsigned int v = 0; v < numVoices; ++v)
+					{
+						computeShape(shape, frame / blockSize, v);
+						tubes.setDiameters(v, shape);
+					}
+				}
+				tubes.process(&in[start], NULL, &tubeOut[start], blockSize);
+			});
+			float difference = 0;
+			for(unsigned int frame = 0; frame < frames; frame += blockSize)
+			{
+				unsigned int start = frame * kMaxVoices;
+				for(unsigned int k = 0; k < numVoices * blockSize; ++k)
+					difference = fmaxf(difference, fabsf(scalarOut[start + k] - tubeOut[start + k]));
+			}
+			rt_printf("%7u %7s %9.1f%% %9.1f%% %7.1fx %12.2g\n", numVoices, moving ? "moving" : "rest",
+					scalarUsage, tubeUsage, scalarUsage / tubeUsage, difference);
+		}
+	}
+}
@@ -0,0 +1,166 @@
+/***** benchmark_voices.cpp *****/
+#include "Benchmark.h"
+#include <Bela.h>
+#include <VoicePool.h>
+#include <math.h>
+#include <unistd.h>
+#include <vector>
+
+#define kNumVoices 64
+
+// The synth of the MIDI-voice-pool example: a parabolic sine with a
+// one-pole envelope, whose state is stored as structure-of-arrays
+struct SynthVoices {
+	std::vector<float> phase; // between -1 and 1
+	std::vector<float> envelope;
+	float inverseSampleRate;
+	float attackCoefficient;
+	float releaseCoefficient;
+};
+
+static void setupSynth(SynthVoices& synth, float sampleRate)
+{
+	synth.phase.assign(kNumVoices, 0);
+	synth.envelope.assign(kNumVoices, 0);
+	synth.inverseSampleRate = 1.f / sampleRate;
+	synth.attackCoefficient = 1.f - expf(-1.f / (0.005f * sampleRate));
+	synth.releaseCoefficient = 1.f - expf(-1.f / (0.15f * sampleRate));
+}
+
+// Render a group of `lanes` voices of a VoicePool, with the inner loops
+// over the voices of the group
+template <unsigned int lanes>
+static void renderVoices(VoicePool& pool, unsigned int firstVoice, float* out, unsigned int frames, void* arg)
+{
+	SynthVoices& synth = *(SynthVoices*)arg;
+	VoicePoolVoices& voices = pool.getVoices();
+	float increment[lanes];
+	float target[lanes];
+	float coefficient[lanes];
+	float phase[lanes];
+	float envelope[lanes];
+	for(unsigned int l = 0; l < lanes; ++l)
+	{
+		unsigned int v = firstVoice + l;
+		increment[l] = 2.f * voices.frequency[v] * synth.inverseSampleRate;
+		target[l] = voices.gate[v] * voices.velocity[v];
+		coefficient[l] = voices.gate[v] ? synth.attackCoefficient : synth.releaseCoefficient;
+		phase[l] = synth.phase[v];
+		envelope[l] = synth.envelope[v];
+	}
+	for(unsigned int n = 0; n < frames; ++n)
+	{
+		float sum = 0;
+		for(unsigned int l = 0; l < lanes; ++l)
+		{
+			phase[l] += increment[l];
+			phase[l] -= phase[l] >= 1.f ? 2.f : 0.f;
+			envelope[l] += (target[l] - envelope[l]) * coefficient[l];
+			float x = phase[l];
+			sum += 4.f * x * (1.f - fabsf(x)) * envelope[l];
+		}
+		out[n] += sum;
+	}
+	for(unsigned int l = 0; l < lanes; ++l)
+	{
+		unsigned int v = firstVoice + l;
+		synth.phase[v] = phase[l];
+		synth.envelope[v] = envelope[l];
+		voices.level[v] = envelope[l];
+	}
+}
+
+// The same synth with one struct per voice, rendering all the voices one
+// sample at a time, whether they are sounding or not
+struct NaiveVoice {
+	float phase;
+	float increment;
+	float envelope;
+	float target;
+	float coefficient;
+};
+
+static void renderNaive(std::vector<NaiveVoice>& voices, float* out, unsigned int frames)
+{
+	for(unsigned int n = 0; n < frames; ++n)
+	{
+		float sum = 0;
+		for(unsigned int v = 0; v < voices.size(); ++v)
+		{
+			NaiveVoice& voice = voices[v];
+			voice.phase += voice.increment;
+			if(voice.phase >= 1.f)
+				voice.phase -= 2.f;
+			voice.envelope += (voice.target - voice.envelope) * voice.coefficient;
+			sum += 4.f * voice.phase * (1.f - fabsf(voice.phase)) * voice.envelope;
+		}
+		out[n] = sum;
+	}
+}
+
+// Compare the naive synth with a VoicePool rendering its voices one at a
+// time and in groups of four, for several numbers of held notes. With more
+// than one core, the groups of four are also rendered with a worker thread
+// on each of the other cores: the time is then that of the audio thread,
+// waiting for the workers included.
+void benchmarkVoicePool(Benchmark& benchmark)
+{
+	const unsigned int blockSize = benchmark.getBlockSize();
+	const float sampleRate = benchmark.getSampleRate();
+	std::vector<float> out(blockSize);
+	long numCores = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int numWorkers = numCores > 1 ? numCores - 1 : 0;
+	if(numWorkers > kMaxVoicePoolWorkers)
+		numWorkers = kMaxVoicePoolWorkers;
+	const unsigned int numPools = numWorkers ? 3 : 2;
+
+	rt_printf("Voice pools, %u voices, block size %u: %% of one core\n", kNumVoices, blockSize);
+	rt_printf("%6s %10s %12s %12s", "notes", "naive", "groups of 1", "groups of 4");
+	if(numWorkers)
+		rt_printf(" %8s %u workers", "4 with", numWorkers);
+	rt_printf("\n");
+	const unsigned int noteCounts[] = { 0, 4, 16, kNumVoices };
+	for(unsigned int c = 0; c < sizeof(noteCounts) / sizeof(noteCounts[0]); ++c)
+	{
+		const unsigned int numNotes = noteCounts[c];
+		SynthVoices synth;
+		setupSynth(synth, sampleRate);
+		std::vector<NaiveVoice> naive(kNumVoices);
+		for(unsigned int v = 0; v < kNumVoices; ++v)
+		{
+			NaiveVoice& voice = naive[v];
+			voice.phase = 0;
+			voice.increment = 2.f * 440.f * powf(2.f, ((int)v - 24) / 12.f) / sampleRate;
+			voice.envelope = 0;
+			voice.target = v < numNotes ? 0.8f : 0.f;
+			voice.coefficient = synth.attackCoefficient;
+		}
+		float naiveUsage = benchmark.run([&](unsigned int) {
+			renderNaive(naive, out.data(), blockSize);
+		});
+		benchmark.consume(out.data(), blockSize);
+
+		float poolUsage[3];
+		for(unsigned int p = 0; p < numPools; ++p)
+		{
+			// the synth state is per voice: each pool starts from silence
+			setupSynth(synth, sampleRate);
+			VoicePool pool;
+			if(pool.setup(kNumVoices, 1, blockSize, p ? renderVoices<4> : renderVoices<1>,
+					&synth, kVoiceStealOldest, p ? 4 : 1, 2 == p ? numWorkers : 0))
+				return;
+			for(unsigned int k = 0; k < numNotes; ++k)
+				pool.noteOn(0, 45 + k, 100);
+			poolUsage[p] = benchmark.run([&](unsigned int) {
+				pool.render(out.data(), blockSize);
+			});
+			benchmark.consume(out.data(), blockSize);
+			if(pool.getNumWorkerTimeouts())
+				rt_printf("The workers timed out in %u blocks\n", pool.getNumWorkerTimeouts());
+		}
+		rt_printf("%6u %9.1f%% %11.1f%% %11.1f%%", numNotes, naiveUsage, poolUsage[0], poolUsage[1]);
+		if(numWorkers)
+			rt_printf(" %17.1f%%", poolUsage[2]);
+		rt_printf("\n");
+	}
+}
@@ -0,0 +1,136 @@
+/*
+ ____  _____ _        _    
+| __ )| ____| |      / \   
+|  _ \|  _| | |     / _ \  
+| |_) | |___| |___ / ___ \ 
+|____/|_____|_____/_/   \_\
+
+The platform for ultra-low latency audio and sensor processing
+
+http://bela.io
+
+A project of the Augmented Instruments Laboratory within the
+Centre for Digital Music at Queen Mary University of London.
+http://www.eecs.qmul.ac.uk/~andrewm
+
+(c) 2016 Augmented Instruments Laboratory: Andrew McPherson,
+  Astrid Bin, Liam Donovan, Christian Heinrichs, Robert Jack,
+  Giulio Moro, Laurel Pardue, Victor Zappi. All rights reserved.
+
+The Bela software is distributed under the GNU Lesser General Public License
+(LGPL 3.0), available here: https://www.gnu.org/licenses/lgpl-3.0.txt
+*/
+
+
+#include <unistd.h>
+#include <iostream>
+#include <cstdlib>
+#include <libgen.h>
+#include <signal.h>
+#include <getopt.h>
+#include <Bela.h>
+#include "Benchmark.h"
+
+using namespace std;
+
+// Handle Ctrl-C by requesting that the audio rendering stop
+void interrupt_handler(int var)
+{
+	gShouldStop = true;
+}
+
+// Print usage information
+void usage(const char * processName)
+{
+	cerr << "Usage: " << processName << " [options]" << endl;
+
+	Bela_usage();
+
+	cerr << "   --benchmark [-b] name:      Run only this benchmark (default: all)\n";
+	cerr << "   --seconds [-t] seconds:     The duration of audio processed by each measurement (default: 2)\n";
+	cerr << "   --help [-h]:                Print this menu\n";
+}
+
+int main(int argc, char *argv[])
+{
+	BelaInitSettings* settings = Bela_InitSettings_alloc();	// Standard audio settings
+	BenchmarkOptions options;
+	options.name = "all";
+	options.seconds = 2;
+
+	struct option customOptions[] =
+	{
+		{"help", 0, NULL, 'h'},
+		{"benchmark", 1, NULL, 'b'},
+		{"seconds", 1, NULL, 't'},
+		{NULL, 0, NULL, 0}
+	};
+
+	// Set default settings
+	Bela_defaultSettings(settings);
+	settings->setup = setup;
+	settings->render = render;
+	settings->cleanup = cleanup;
+
+	// Parse command-line arguments
+	while (1) {
+		int c = Bela_getopt_long(argc, argv, "hb:t:", customOptions, settings);
+		if (c < 0)
+			break;
+		int ret = -1;
+		switch (c) {
+			case 'h':
+				usage(basename(argv[0]));
+				ret = 0;
+				break;
+			case 'b':
+				options.name = optarg;
+				break;
+			case 't':
+				options.seconds = atof(optarg);
+				break;
+			default:
+				usage(basename(argv[0]));
+				ret = 1;
+				break;
+		}
+		if(ret >= 0)
+		{
+			Bela_InitSettings_free(settings);
+			return ret;
+		}
+	}
+
+	// The benchmarks run in setup(), with the sample rate and block size of
+	// the audio settings
+	if(Bela_initAudio(settings, &options) != 0) {
+		Bela_InitSettings_free(settings);
+		cout << "Error: unable to initialise audio" << endl;
+		return 1;
+	}
+	Bela_InitSettings_free(settings);
+
+	// Start the audio device running
+	if(Bela_startAudio()) {
+		cout << "Error: unable to start real-time audio" << endl;
+		return 1;
+	}
+
+	// Set up interrupt handler to catch Control-C and SIGTERM
+	signal(SIGINT, interrupt_handler);
+	signal(SIGTERM, interrupt_handler);
+
+	// Run until told to stop: setup() asks to stop once the benchmarks are done
+	while(!gShouldStop) {
+		usleep(100000);
+	}
+
+	// Stop the audio device
+	Bela_stopAudio();
+
+	// Clean up any resources allocated for audio
+	Bela_cleanupAudio();
+
+	// All done!
+	return 0;
+}
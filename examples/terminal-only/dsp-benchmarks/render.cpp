@@ -0,0 +1,138 @@
+/*
+ ____  _____ _        _    
+| __ )| ____| |      / \   
+|  _ \|  _| | |     / _ \  
+| |_) | |___| |___ / ___ \ 
+|____/|_____|_____/_/   \_\
+
+The platform for ultra-low latency audio and sensor processing
+
+http://bela.io
+
+A project of the Augmented Instruments Laboratory within the
+Centre for Digital Music at Queen Mary University of London.
+http://www.eecs.qmul.ac.uk/~andrewm
+
+(c) 2016 Augmented Instruments Laboratory: Andrew McPherson,
+    Astrid Bin, Liam Donovan, Christian Heinrichs, Robert Jack,
+    Giulio Moro, Laurel Pardue, Victor Zappi. All rights reserved.
+
+The Bela software is distributed under the GNU Lesser General Public License
+(LGPL 3.0), available here: https://www.gnu.org/licenses/lgpl-3.0.txt
+*/
+
+
+
+#include <Bela.h>
+#include <string.h>
+#include "Benchmark.h"
+
+struct BenchmarkEntry {
+	const char* name;
+	void (*function)(Benchmark& benchmark);
+};
+
+BenchmarkEntry gBenchmarks[] = {
+	{ "digital", benchmarkDigitalChannels },
+	{ "biquad", benchmarkBiquadCascade },
+	{ "oscillators", benchmarkOscillatorBank },
+	{ "convolution", benchmarkConvolver },
+	{ "delay", benchmarkDelayLine },
+	{ "voices", benchmarkVoicePool },
+	{ "oversampling", benchmarkOversampler },
+	{ "tube", benchmarkTubeModel },
+	{ "analog", benchmarkAnalogConversion },
+};
+
+bool setup(BelaContext *context, void *userData)
+{
+	BenchmarkOptions* options = (BenchmarkOptions*)userData;
+	bool found = false;
+	for(unsigned int n = 0; n < sizeof(gBenchmarks) / sizeof(gBenchmarks[0]); ++n)
+	{
+		if(strcmp(options->name, "all") && strcmp(options->name, gBenchmarks[n].name))
+			continue;
+		found = true;
+		Benchmark benchmark(context->audioSampleRate, context->audioFrames, options->seconds);
+		gBenchmarks[n].function(benchmark);
+		rt_printf("\n");
+	}
+	if(!found)
+	{
+		fprintf(stderr, "Unknown benchmark %s. The benchmarks are:", options->name);
+		for(unsigned int n = 0; n < sizeof(gBenchmarks) / sizeof(gBenchmarks[0]); ++n)
+			fprintf(stderr, " %s", gBenchmarks[n].name);
+		fprintf(stderr, "\n");
+		return false;
+	}
+	// the benchmarks are done: exit
+	gShouldStop = 1;
+	return true;
+}
+
+void render(BelaContext *context, void *userData)
+{
+}
+
+void cleanup(BelaContext *context, void *userData)
+{
+}
+
+/**
+\example dsp-benchmarks/render.cpp
+
+Benchmarks of the DSP classes
+-----------------------------
+
+This project measures the CPU usage of some of the classes of the Bela core
+against simpler implementations of the same processing, at the sample rate
+and block size of the audio settings (e.g.: `-p 16`). It runs the benchmarks
+in `setup()`, prints a table for each of them, and exits without processing
+any audio.
+
+By default all the benchmarks run. Pass `--benchmark name` to run only one of
+them, and `--seconds` to change the duration of audio processed by each
+measurement. The benchmarks are:
+
+- `digital`: unpacking and packing the signal-rate digital channels of the
+libpd wrapper one bit at a time, as it used to, and with
+`DigitalChannelManager::processSignalRateInput()` and `processSignalRateOutput()`.
+- `biquad`: a cascade of low-pass biquads on several channels, with one
+`IirFilter` per channel and with a `BiquadCascade` in double and single
+precision. It also prints the largest difference between the outputs of
+`IirFilter` and of the double-precision `BiquadCascade`.
+- `oscillators`: a wavetable oscillator bank written as a plain loop over the
+partials, and `OscillatorBank`, with and without mipmaps, from 64 to 4096
+partials, with all of them sounding and with only a quarter of them sounding.
+- `convolution`: a reverb impulse response of 256 to 65536 taps applied in the
+time domain, up to 4096 taps, and with a `Convolver`, at block sizes of 16, 32,
+64 and 128 frames, whatever the block size Bela runs at. For the `Convolver`, it
+also prints the slowest block, in which the partitions of the tail are
+computed: when running with the worker thread, that work is moved off the
+audio thread.
+- `delay`: a multi-tap delay on 2 to 32 channels with 1 to 16 taps, written
+as a delay line that processes one sample at a time and wraps its positions
+with a modulo, and with `DelayLine`, which processes a block at a time. Both
+use linear interpolation, then both use Lagrange interpolation, then both read
+delays modulated by the same sine with linear interpolation.
+- `voices`: the 64-voice synth of the `MIDI-voice-pool` example with 0 to 64
+held notes, written as a loop over all the voices for each sample, and with a
+`VoicePool` that renders only the sounding voices, one at a time and in groups
+of four. With more than one core, the groups of four are also rendered with a
+worker thread on each of the other cores.
+- `oversampling`: the wave folder of the `oversampled-distortion` example on
+two channels, oversampled 1 to 8 times by linear interpolation and averaging,
+and by an `Oversampler` with FIR and with IIR half-band filters. Next to the
+CPU usage, it prints how much aliasing is left for a 1kHz sine, relative to
+the whole output, and the latency.
+- `tube`: 1 to 8 vocal tracts with the nasal cavity, written as a copy of the
+tract of the Pink Trombone example, one instance per voice, and as a
+`TubeModel`, which runs four voices at a time, with the shape at rest and with
+the tongue moving in every block. It also prints the largest difference
+between their outputs.
+- `analog`: the conversion of the analog inputs and outputs on Salt, with the
+audio expander enabled on half of the channels, for 1 to 8 channels, written
+as the separate passes that the core used to make, and with the fused
+`analogInputsToFloat()` and `analogOutputsToInt()`. It also prints the largest
+difference between their outputs, over odd numbers of frames.
+*/
@@ -0,0 +1,139 @@
+/***** AnalogConversion.h *****/
+#ifndef __AnalogConversion_H_INCLUDED__
+#define __AnalogConversion_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// The maximum number of analog outputs handled by AnalogOutSmoothing
+#define kMaxAnalogOutSmoothingChannels 16
+
+/**
+ * The state of the smoothing applied to the analog outputs, so that
+ * outputs updated once per block do not step.
+ *
+ * Each channel follows either the values in context->analogOut, or a
+ * target set by setTarget(). It then goes through a one-pole lowpass and a slew rate
+ * limiter: the change from one frame to the next is `coeff * (input - value)`,
+ * limited to `step`. A linear ramp to a target is a slew rate limiter with
+ * the step that reaches the target in the given number of frames.
+ */
+struct AnalogOutSmoothing {
+	AnalogOutSmoothing();
+
+	/**
+	 * Smooth the values written to context->analogOut for a channel. This
+	 * also stops the channel from following its target.
+	 *
+	 * @param channel the analog output.
+	 * @param maxStep the maximum change from one frame to the next, or 0 for no limit.
+	 * @param timeConstant the time constant of the lowpass, in frames, or 0 for no lowpass.
+	 */
+	void setSmoothing(unsigned int channel, float maxStep, float timeConstant);
+
+	/**
+	 * Make a channel go to a value in a linear ramp, ignoring context->analogOut.
+	 *
+	 * @param channel the analog output.
+	 * @param value the target value.
+	 * @param rampFrames the duration of the ramp, in frames (0 to jump).
+	 */
+	void setTarget(unsigned int channel, float value, unsigned int rampFrames);
+
+	/**
+	 * Set the transform that the core applies to the values of
+	 * context->analogOut before the smoothing, e.g.: the inversion and
+	 * scaling of the outputs on Salt. The targets and the maximum steps
+	 * passed to setTarget() and setSmoothing() go through the same
+	 * transform, so that they match the values.
+	 *
+	 * @param gain the gain of the transform.
+	 * @param offset the offset added after the gain.
+	 */
+	void setTransform(float gain, float offset);
+
+	/**
+	 * Apply the smoothing in place, for when it cannot be done during
+	 * the format conversion.
+	 */
+	void process(float* values, unsigned int frames, unsigned int channels, bool interleaved);
+
+	/**
+	 * Smooth one value of a channel.
+	 */
+	inline float processSample(unsigned int channel, float x)
+	{
+		uint32_t bit = 1 << channel;
+		if(targetMask & bit)
+			x = target[channel];
+		if(!(activeMask & bit))
+			return value[channel] = x;
+		float d = coeff[channel] * (x - value[channel]);
+		if(d > step[channel])
+			d = step[channel];
+		else if(d < -step[channel])
+			d = -step[channel];
+		return value[channel] = value[channel] + d;
+	}
+
+	float coeff[kMaxAnalogOutSmoothingChannels];
+	float step[kMaxAnalogOutSmoothingChannels];
+	float target[kMaxAnalogOutSmoothingChannels];
+	float value[kMaxAnalogOutSmoothingChannels]; // the current output of each channel
+	uint32_t activeMask; // channels that are smoothed (including those following a target)
+	uint32_t targetMask; // channels that follow their target
+	float transformGain;
+	float transformOffset;
+};
+
+/**
+ * Convert the raw ADC samples (interleaved, as written by the PRU) to
+ * floats in a single pass, applying the audio expander processing to the
+ * enabled channels on the way.
+ *
+ * The value of each sample is `raw / 65536`, or `max - raw / 65536` if
+ * `invert` is set (Salt). On the channels in `dcBlockMask` it then goes through
+ * a one-pole DC-blocking high-pass filter and is scaled by 2, to go from 0..1
+ * to -1..1. The results are identical to converting first and filtering
+ * afterwards.
+ *
+ * When the number of channels is a multiple of 4, four channels are
+ * processed at a time with NEON (or SSE2), keeping the filter state in
+ * registers for the whole block.
+ *
+ * @param raw the raw samples, `frames * channels`, interleaved.
+ * @param out the destination, `frames * channels`.
+ * @param frames the number of frames.
+ * @param channels the number of channels.
+ * @param interleaved whether `out` is interleaved.
+ * @param invert whether to invert the values (Salt).
+ * @param dcBlockMask bit n set if the audio expander is enabled on channel n.
+ * @param coeff the coefficient of the high-pass filter.
+ * @param inputHistory the previous input of each channel's filter.
+ * @param outputHistory the previous output of each channel's filter.
+ */
+void analogInputsToFloat(const uint16_t* raw, float* out, unsigned int frames, unsigned int channels,
+		bool interleaved, bool invert, uint32_t dcBlockMask, float coeff, float* inputHistory, float* outputHistory);
+
+/**
+ * Convert floats to raw DAC samples (interleaved, as read by the PRU) in
+ * a single pass, applying the audio expander scaling to the enabled channels
+ * on the way.
+ *
+ * If `smoothing` is not NULL, the values first go through it. On the
+ * channels in `expanderMask`, values are then mapped from -1..1 to
+ * 0..0.93 as `(x + 1) * 0.93 / 2`. All values are then scaled by 65536 and clipped
+ * to 0..65535.
+ *
+ * @param in the source, `frames * channels`.
+ * @param raw the raw samples, `frames * channels`, interleaved.
+ * @param frames the number of frames.
+ * @param channels the number of channels.
+ * @param interleaved whether `in` is interleaved.
+ * @param expanderMask bit n set if the audio expander is enabled on channel n.
+ * @param smoothing the smoothing of the outputs, or NULL.
+ */
+void analogOutputsToInt(const float* in, uint16_t* raw, unsigned int frames, unsigned int channels,
+		bool interleaved, uint32_t expanderMask, AnalogOutSmoothing* smoothing = NULL);
+
+#endif /* __AnalogConversion_H_INCLUDED__ */
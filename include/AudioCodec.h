@@ -7,6 +7,12 @@ public:
 	virtual ~AudioCodec() {};
 	virtual int initCodec() = 0;
 	virtual int startAudio(int parameter) = 0;
+	// startAudio() in two steps, so that the caller can do something useful
+	// (e.g.: load the PRU code) while the codec settles: startAudioBegin()
+	// powers up the codec and sets settleUs to the number of microseconds to
+	// wait before calling startAudioEnd(), which unmutes the outputs.
+	virtual int startAudioBegin(int parameter, unsigned int* settleUs) { *settleUs = 0; return startAudio(parameter); }
+	virtual int startAudioEnd() { return 0; }
 	virtual int stopAudio() = 0;
 	virtual int setPga(float newGain, unsigned short int channel) = 0;
 	virtual int setDACVolume(int halfDbSteps) = 0;
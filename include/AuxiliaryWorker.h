@@ -0,0 +1,75 @@
+/***** AuxiliaryWorker.h *****/
+#ifndef __AuxiliaryWorker_H_INCLUDED__
+#define __AuxiliaryWorker_H_INCLUDED__
+
+#include <Bela.h>
+
+/**
+ * An auxiliary task working for an object, which can be stopped before the
+ * object goes away.
+ *
+ * Auxiliary tasks cannot be deleted, and a task that has been scheduled
+ * may start running at any later time, so a task must not hold a pointer to
+ * an object that can be destroyed. An AuxiliaryWorker gives its task a
+ * control block that is never freed: the task reads the object pointer from
+ * there, and stop() clears it and waits for the call in progress, if any,
+ * to return. From then on, the task returns straight away when it runs.
+ *
+ * The control blocks of stopped workers, with their tasks, are kept in a
+ * pool, and start() reuses one with the same priority before creating a new
+ * task, so that calling setup() repeatedly on an object, or creating and
+ * destroying objects, does not create new tasks every time.
+ *
+ * start() and stop() can block and must not be called from the audio thread.
+ * schedule() can be called from the audio thread.
+ */
+class AuxiliaryWorker {
+public:
+	AuxiliaryWorker();
+	~AuxiliaryWorker();
+
+	/**
+	 * Stop the worker if it is running, then get a task which calls
+	 * `callback(arg)` every time it is scheduled.
+	 *
+	 * @param callback the function called by the task.
+	 * @param arg the argument passed to the function, typically the object.
+	 * It must stay valid until stop() returns.
+	 * @param priority the priority of the task.
+	 * @param name the prefix of the name of the task, if a new one is
+	 * created. A number is appended to it, so that the name is unique.
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	int start(void (*callback)(void*), void* arg, int priority, const char* name);
+
+	/**
+	 * Wake up the task. Does nothing if the worker is not running.
+	 */
+	void schedule();
+
+	/**
+	 * Detach the task from the object, and wait for it to return if it is
+	 * running. The callback is not called again after this returns, and the
+	 * task goes back to the pool.
+	 *
+	 * The callback has to return in a timely fashion: the object typically
+	 * sets a flag checked by the callback before calling this.
+	 */
+	void stop();
+
+	/**
+	 * Whether start() has been called successfully since the last stop().
+	 */
+	bool isRunning() { return NULL != control; }
+
+private:
+	struct Control;
+	static void run(void* arg);
+	static Control* pool; // the control blocks of the stopped workers
+	AuxiliaryWorker(const AuxiliaryWorker&);
+	AuxiliaryWorker& operator=(const AuxiliaryWorker&);
+	Control* control;
+};
+
+#endif /* __AuxiliaryWorker_H_INCLUDED__ */
@@ -0,0 +1,274 @@
+/***** BiquadCascade.h *****/
+#ifndef __BiquadCascade_H_INCLUDED__
+#define __BiquadCascade_H_INCLUDED__
+
+#include <vector>
+#include <string.h>
+
+/**
+ * The group of `BiquadCascade::kLanes` samples processed at once, as a
+ * vector type, which the compiler maps to SIMD registers.
+ */
+template <typename sample_t> struct BiquadLanes;
+template <> struct BiquadLanes<float> { typedef float type __attribute__((vector_size(32))); };
+template <> struct BiquadLanes<double> { typedef double type __attribute__((vector_size(32))); };
+
+/**
+ * A multi-channel cascade of biquad filters.
+ *
+ * All channels share the same coefficients, and each stage is computed in
+ * transposed direct form II. Channels are processed in groups of
+ * `kLanes` (8 floats or 4 doubles), each held in a vector type, so that
+ * the compiler maps each group to SIMD registers (NEON on the
+ * BeagleBone, SSE/AVX on x86). Each stage of a group runs over the whole
+ * block with its state in registers.
+ *
+ * Coefficients use the same format as IirFilterStage: `b0, b1, b2, a1, a2`
+ * (`a0` is assumed to be 1). They can be changed with a linear ramp
+ * over a given number of frames, in which case they are interpolated every frame.
+ *
+ * All memory is allocated in setup(), so that the other methods can be
+ * called from the audio thread.
+ */
+template <typename sample_t>
+class BiquadCascade {
+public:
+	static const unsigned int kLanes = 32 / sizeof(sample_t);
+	static const unsigned int kCoefficients = 5;
+
+	BiquadCascade() :
+		numStages(0),
+		numChannels(0),
+		paddedChannels(0),
+		maxFrames(0)
+	{}
+
+	/**
+	 * Allocate the memory for the filter.
+	 *
+	 * @param newNumStages the number of second-order stages.
+	 * @param newNumChannels the number of channels.
+	 * @param newMaxFrames the maximum number of frames that will be
+	 * passed to the process methods in one call.
+	 */
+	void setup(unsigned int newNumStages, unsigned int newNumChannels, unsigned int newMaxFrames){
+		numStages = newNumStages;
+		numChannels = newNumChannels;
+		paddedChannels = (numChannels + kLanes - 1) / kLanes * kLanes;
+		maxFrames = newMaxFrames;
+		coefficients.assign(numStages, Coefficients());
+		targets.assign(numStages, Coefficients());
+		increments.assign(numStages, Coefficients());
+		rampFrames.assign(numStages, 0);
+		s1.assign(numStages * paddedChannels, 0);
+		s2.assign(numStages * paddedChannels, 0);
+		scratch.assign(maxFrames * paddedChannels, 0);
+	}
+
+	/**
+	 * Set the coefficients of all the stages at once.
+	 *
+	 * @param newCoefficients an array of `getNumStages() * 5` values.
+	 */
+	void setCoefficients(const sample_t* newCoefficients){
+		for(unsigned int s = 0; s < numStages; ++s)
+			setCoefficients(s, newCoefficients + s * kCoefficients);
+	}
+
+	/**
+	 * Set the coefficients of one stage.
+	 *
+	 * @param stage the stage to set
+	 * @param newCoefficients the 5 coefficients of the stage
+	 * @param ramp the number of frames over which the coefficients move
+	 * linearly from their current value to the new one. If 0, the new value
+	 * is applied immediately.
+	 */
+	void setCoefficients(unsigned int stage, const sample_t* newCoefficients, unsigned int ramp = 0){
+		Coefficients& target = targets[stage];
+		Coefficients& current = coefficients[stage];
+		Coefficients& increment = increments[stage];
+		memcpy(target.c, newCoefficients, sizeof(target.c));
+		rampFrames[stage] = ramp;
+		for(unsigned int n = 0; n < kCoefficients; ++n)
+		{
+			if(ramp)
+			{
+				increment.c[n] = (target.c[n] - current.c[n]) / ramp;
+			} else {
+				current.c[n] = target.c[n];
+				increment.c[n] = 0;
+			}
+		}
+	}
+
+	/**
+	 * Clear the state of all stages for all channels.
+	 */
+	void reset(){
+		memset(s1.data(), 0, sizeof(s1[0]) * s1.size());
+		memset(s2.data(), 0, sizeof(s2[0]) * s2.size());
+	}
+
+	/**
+	 * Process interleaved buffers in place.
+	 *
+	 * @param inout the buffer, containing `frames * getNumChannels()` samples.
+	 * @param frames the number of frames. Values larger than the
+	 * `maxFrames` passed to setup() are truncated.
+	 */
+	void processInterleaved(sample_t* inout, unsigned int frames){
+		if(frames > maxFrames)
+			frames = maxFrames;
+		for(unsigned int n = 0; n < frames; ++n)
+			memcpy(&scratch[n * paddedChannels], inout + n * numChannels, sizeof(sample_t) * numChannels);
+		run(frames);
+		for(unsigned int n = 0; n < frames; ++n)
+			memcpy(inout + n * numChannels, &scratch[n * paddedChannels], sizeof(sample_t) * numChannels);
+	}
+
+	/**
+	 * Process non-interleaved buffers in place.
+	 *
+	 * @param inout the buffer. Channel `c` starts at `inout + c * frames`.
+	 * @param frames the number of frames. Values larger than the
+	 * `maxFrames` passed to setup() are truncated.
+	 */
+	void process(sample_t* inout, unsigned int frames){
+		if(frames > maxFrames)
+			frames = maxFrames;
+		for(unsigned int c = 0; c < numChannels; ++c)
+			for(unsigned int n = 0; n < frames; ++n)
+				scratch[n * paddedChannels + c] = inout[c * frames + n];
+		run(frames);
+		for(unsigned int c = 0; c < numChannels; ++c)
+			for(unsigned int n = 0; n < frames; ++n)
+				inout[c * frames + n] = scratch[n * paddedChannels + c];
+	}
+
+	unsigned int getNumStages() { return numStages; }
+	unsigned int getNumChannels() { return numChannels; }
+
+private:
+	struct Coefficients {
+		Coefficients() { memset(c, 0, sizeof(c)); }
+		sample_t c[kCoefficients]; // b0, b1, b2, a1, a2
+	};
+
+	// Process `frames` frames of the frame-major scratch buffer,
+	// splitting the block where a coefficient ramp ends.
+	void run(unsigned int frames){
+		unsigned int done = 0;
+		while(done < frames)
+		{
+			unsigned int chunk = frames - done;
+			bool ramping = false;
+			for(unsigned int s = 0; s < numStages; ++s)
+			{
+				if(rampFrames[s])
+				{
+					ramping = true;
+					if(rampFrames[s] < chunk)
+						chunk = rampFrames[s];
+				}
+			}
+			if(ramping)
+				processFrames<true>(&scratch[done * paddedChannels], chunk);
+			else
+				processFrames<false>(&scratch[done * paddedChannels], chunk);
+			if(ramping)
+			{
+				for(unsigned int s = 0; s < numStages; ++s)
+				{
+					if(!rampFrames[s])
+						continue;
+					rampFrames[s] -= chunk;
+					if(!rampFrames[s])
+					{
+						// snap to the target to remove accumulated rounding errors
+						coefficients[s] = targets[s];
+						increments[s] = Coefficients();
+					}
+				}
+			}
+			done += chunk;
+		}
+	}
+
+	template <bool ramping>
+	void processFrames(sample_t* buf, unsigned int frames){
+		if(!ramping)
+		{
+			// each stage of each group runs over the whole block
+			for(unsigned int g = 0; g < paddedChannels; g += kLanes)
+			{
+				for(unsigned int s = 0; s < numStages; ++s)
+					processStage(buf + g, frames, coefficients[s].c,
+							&s1[s * paddedChannels + g], &s2[s * paddedChannels + g]);
+			}
+			return;
+		}
+		for(unsigned int n = 0; n < frames; ++n)
+		{
+			sample_t* frame = buf + n * paddedChannels;
+			for(unsigned int g = 0; g < paddedChannels; g += kLanes)
+			{
+				for(unsigned int s = 0; s < numStages; ++s)
+					processStage(frame + g, 1, coefficients[s].c,
+							&s1[s * paddedChannels + g], &s2[s * paddedChannels + g]);
+			}
+			for(unsigned int s = 0; s < numStages; ++s)
+				for(unsigned int c = 0; c < kCoefficients; ++c)
+					coefficients[s].c[c] += increments[s].c[c];
+		}
+	}
+
+	typedef typename BiquadLanes<sample_t>::type Lanes;
+
+	static void splat(Lanes& lanes, sample_t value){
+		for(unsigned int l = 0; l < kLanes; ++l)
+			lanes[l] = value;
+	}
+
+	// Process one stage for the kLanes channels of a group, starting at `x`,
+	// with the coefficients and the state in registers over the whole block
+	void processStage(sample_t* x, unsigned int frames, const sample_t* k,
+			sample_t* state1, sample_t* state2){
+		Lanes b0, b1, b2, a1, a2;
+		splat(b0, k[0]);
+		splat(b1, k[1]);
+		splat(b2, k[2]);
+		splat(a1, k[3]);
+		splat(a2, k[4]);
+		const unsigned int stride = paddedChannels;
+		Lanes z1;
+		Lanes z2;
+		memcpy(&z1, state1, sizeof(z1));
+		memcpy(&z2, state2, sizeof(z2));
+		for(unsigned int n = 0; n < frames; ++n)
+		{
+			Lanes in;
+			memcpy(&in, x + n * stride, sizeof(in));
+			Lanes out = b0 * in + z1;
+			z1 = b1 * in - a1 * out + z2;
+			z2 = b2 * in - a2 * out;
+			memcpy(x + n * stride, &out, sizeof(out));
+		}
+		memcpy(state1, &z1, sizeof(z1));
+		memcpy(state2, &z2, sizeof(z2));
+	}
+
+	std::vector<Coefficients> coefficients;
+	std::vector<Coefficients> targets;
+	std::vector<Coefficients> increments;
+	std::vector<unsigned int> rampFrames;
+	std::vector<sample_t> s1; // first state of each stage, [stage][channel]
+	std::vector<sample_t> s2; // second state of each stage, [stage][channel]
+	std::vector<sample_t> scratch; // frame-major working buffer, [frame][channel]
+	unsigned int numStages;
+	unsigned int numChannels;
+	unsigned int paddedChannels;
+	unsigned int maxFrames;
+};
+
+#endif /* __BiquadCascade_H_INCLUDED__ */
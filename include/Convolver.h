@@ -0,0 +1,174 @@
+/***** Convolver.h *****/
+#ifndef __Convolver_H_INCLUDED__
+#define __Convolver_H_INCLUDED__
+
+#include <Bela.h>
+#include <AuxiliaryWorker.h>
+#include <ne10/NE10.h>
+#include <atomic>
+
+/**
+ * An impulse response split into partitions for Convolver.
+ *
+ * The impulse response is split into three parts:
+ * - the head, the first `partitionSize` taps, applied in the time domain
+ *   one sample at a time;
+ * - the body, up to tap 2 * `tailPartitionSize`, applied in the frequency
+ *   domain in partitions of `partitionSize` taps, on the audio thread;
+ * - the tail, the rest of the taps, applied in the frequency domain in
+ *   partitions of `tailPartitionSize` taps, normally on a worker thread.
+ *
+ * A ConvolverIr only holds the spectra of the partitions and is not changed
+ * by Convolver, so one ConvolverIr can be shared by several Convolver objects,
+ * e.g.: one per channel.
+ */
+class ConvolverIr {
+public:
+	ConvolverIr();
+	~ConvolverIr();
+
+	/**
+	 * Split an impulse response into partitions and compute their spectra.
+	 *
+	 * @param ir the impulse response.
+	 * @param length the number of taps.
+	 * @param partitionSize the size of the head and of the body partitions,
+	 * a power of 2. Larger values make the body cheaper, but make the time domain
+	 * head and the FFTs on the audio thread more expensive.
+	 * @param tailPartitionSize the size of the tail partitions, a power of 2
+	 * and a multiple of `partitionSize`. The worker thread has
+	 * `tailPartitionSize` samples to process each tail partition.
+	 *
+	 * @return 0 on success, or a negative value on error.
+	 */
+	int setup(const float* ir, unsigned int length, unsigned int partitionSize = 64, unsigned int tailPartitionSize = 1024);
+
+	/**
+	 * Free the spectra. Do not call this while a Convolver is using it.
+	 */
+	void cleanup();
+
+	unsigned int getLength() const { return length; }
+	unsigned int getPartitionSize() const { return partitionSize; }
+	unsigned int getTailPartitionSize() const { return tailPartitionSize; }
+
+private:
+	friend class Convolver;
+	unsigned int length;
+	unsigned int partitionSize;
+	unsigned int tailPartitionSize;
+	float* head; // the first partitionSize taps
+	ne10_fft_cpx_float32_t* bodySpectra; // bodyPartitions * (partitionSize + 1) bins
+	unsigned int bodyPartitions;
+	ne10_fft_cpx_float32_t* tailSpectra; // tailPartitions * (tailPartitionSize + 1) bins
+	unsigned int tailPartitions;
+};
+
+/**
+ * Zero-latency convolution with a long impulse response.
+ *
+ * The cost of each output sample is roughly that of a partitionSize-tap FIR,
+ * plus FFTs of size 2 * partitionSize and 2 * tailPartitionSize
+ * amortised over partitionSize and tailPartitionSize samples, plus one complex
+ * multiply-add per bin and partition (see ConvolverIr).
+ *
+ * The tail is computed by an auxiliary task. If it is not ready in time,
+ * that block of the tail is left out of the output and counted by
+ * getLateBlocks(); if the worker falls further behind, it starts again
+ * from the most recent input, which is counted by getResyncs().
+ */
+class Convolver {
+public:
+	Convolver();
+	~Convolver();
+
+	/**
+	 * Prepare to convolve with an impulse response.
+	 *
+	 * @param ir the impulse response. It must not be changed or freed while
+	 * this object uses it.
+	 * @param useWorker whether to compute the tail on a worker thread. If
+	 * false, the tail is computed in process(), which gives occasional
+	 * expensive blocks but never loses any of the tail.
+	 * @param priority the priority of the worker thread.
+	 *
+	 * @return 0 on success, or a negative value on error.
+	 */
+	int setup(const ConvolverIr* ir, bool useWorker = true, int priority = 80);
+
+	/**
+	 * Convolve a block of samples. Call this from render().
+	 *
+	 * @param input the input samples.
+	 * @param output where the output samples are written. This can be the same as `input`.
+	 * @param frames the number of samples.
+	 */
+	void process(const float* input, float* output, unsigned int frames);
+
+	/**
+	 * Clear the input history and the pending output. This waits for the
+	 * worker thread to return, if it is running.
+	 * Do not call this while process() may be running.
+	 */
+	void reset();
+
+	/**
+	 * Get the number of blocks of the tail that were not ready in time.
+	 */
+	unsigned int getLateBlocks() { return lateBlocks; }
+
+	/**
+	 * Get the number of times the worker thread had to start again
+	 * because it fell too far behind.
+	 */
+	unsigned int getResyncs() { return resyncs.load(); }
+
+	/**
+	 * Stop the worker thread and free the buffers.
+	 */
+	void cleanup();
+
+private:
+	// one size of uniformly partitioned convolution, with a frequency-domain delay line
+	struct Segment {
+		unsigned int size; // partition size
+		unsigned int partitions;
+		const ne10_fft_cpx_float32_t* spectra;
+		ne10_fft_r2c_cfg_float32_t cfg;
+		ne10_fft_cpx_float32_t* delayLine; // the spectra of the last `partitions` input blocks
+		unsigned int delayLinePosition;
+		ne10_fft_cpx_float32_t* accumulator;
+		float* time; // 2 * size samples
+	};
+	int setupSegment(Segment& s, unsigned int size, unsigned int partitions, const ne10_fft_cpx_float32_t* spectra);
+	void cleanupSegment(Segment& s);
+	void resetSegment(Segment& s);
+	const float* processSegment(Segment& s, uint64_t end);
+	void processTail();
+	static void workerLoop(void* arg);
+	void boundary();
+
+	const ConvolverIr* ir;
+	float* headHistory; // 2 * partitionSize samples, each written twice
+	unsigned int headPosition;
+	float* input; // ring buffer of input samples
+	unsigned int inputMask;
+	float* output; // ring buffer of pending output samples
+	unsigned int outputMask;
+	uint64_t count; // samples processed so far
+	Segment body;
+	Segment tail;
+	float* tailOutput; // the last few blocks of the tail
+	uint64_t* tailOutputBlock; // which input block each of them is for
+	std::atomic<uint64_t> tailInputBlocks; // complete blocks of input available to the tail
+	std::atomic<uint64_t> tailDoneBlocks; // blocks of the tail computed so far
+	uint64_t tailNextBlock; // used by the worker only
+	AuxiliaryWorker worker;
+	int priority;
+	bool useWorker;
+	unsigned int lateBlocks;
+	std::atomic<unsigned int> resyncs;
+	std::atomic<bool> stopping;
+};
+
+#endif /* __Convolver_H_INCLUDED__ */
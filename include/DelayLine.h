@@ -0,0 +1,406 @@
+/***** DelayLine.h *****/
+#ifndef __DelayLine_H_INCLUDED__
+#define __DelayLine_H_INCLUDED__
+
+#include <vector>
+#include <string.h>
+
+/**
+ * How DelayLine reads samples at fractional delays.
+ */
+typedef enum {
+	kDelayInterpolationNone, ///< round the delay down to a whole number of samples
+	kDelayInterpolationLinear, ///< linear interpolation between two samples
+	kDelayInterpolationLagrange, ///< third-order Lagrange interpolation on four samples. Delays must be at least 1
+	kDelayInterpolationAllpass, ///< first-order allpass, only for DelayLine::readModulated(). Delays must be at least 1
+} DelayInterpolation;
+
+/**
+ * A read position in a DelayLine whose delay can be changed without clicks.
+ *
+ * When the delay is changed with setDelay(), the tap crossfades from the
+ * old delay to the new one over the given number of frames, instead of jumping.
+ */
+struct DelayLineTap {
+	DelayLineTap(float initialDelay = 0) :
+		delay(initialDelay),
+		nextDelay(initialDelay),
+		pendingDelay(initialDelay),
+		fadeFrames(0),
+		pendingFadeFrames(0),
+		fadePosition(0),
+		pending(false)
+	{}
+
+	/**
+	 * Change the delay.
+	 *
+	 * @param newDelay the new delay, in samples.
+	 * @param crossfadeFrames the length of the crossfade from the current
+	 * delay. If 0, the delay changes immediately. If a crossfade is already
+	 * in progress, the new one starts when it ends.
+	 */
+	void setDelay(float newDelay, unsigned int crossfadeFrames){
+		if(fadeFrames)
+		{
+			pendingDelay = newDelay;
+			pendingFadeFrames = crossfadeFrames;
+			pending = true;
+			return;
+		}
+		if(!crossfadeFrames)
+		{
+			delay = nextDelay = newDelay;
+			return;
+		}
+		nextDelay = newDelay;
+		fadeFrames = crossfadeFrames;
+		fadePosition = 0;
+	}
+
+	float getDelay() { return fadeFrames ? nextDelay : delay; }
+
+	float delay; // the delay being read
+	float nextDelay; // the delay being faded in
+	float pendingDelay; // the delay to fade in after the current fade
+	unsigned int fadeFrames;
+	unsigned int pendingFadeFrames;
+	unsigned int fadePosition;
+	bool pending;
+};
+
+/**
+ * A multi-channel delay line for block processing.
+ *
+ * Each channel is a circular buffer whose size is a power of two, so that
+ * positions wrap with a mask. The first samples of each buffer are also
+ * copied after its end, so that any span of up to `maxFrames` frames (plus
+ * the interpolation taps) is contiguous in memory: reads at a constant
+ * delay become a loop over frames with fixed offsets, which the compiler
+ * vectorises, and only writes are split around the wrap.
+ *
+ * In each block, call write() and the read methods for each channel, then
+ * advance() once. For frame `n` of the block, a delay of `d` returns the
+ * sample written at frame `n - d`. Reading before writing, e.g.: to feed
+ * the output back into the input, only works for delays of at least the
+ * block size (plus one for Lagrange interpolation).
+ *
+ * All memory is allocated in setup(), so that the other methods can be
+ * called from the audio thread.
+ */
+template <typename sample_t>
+class DelayLine {
+public:
+	DelayLine() :
+		numChannels(0),
+		maxFrames(0),
+		size(0),
+		mask(0),
+		stride(0),
+		position(0)
+	{}
+
+	/**
+	 * Allocate the memory for the delay line.
+	 *
+	 * @param maxDelay the longest delay that will be read, in samples.
+	 * @param newNumChannels the number of channels.
+	 * @param newMaxFrames the maximum number of frames that will be
+	 * passed to the read and write methods in one call.
+	 */
+	void setup(unsigned int maxDelay, unsigned int newNumChannels, unsigned int newMaxFrames){
+		numChannels = newNumChannels;
+		maxFrames = newMaxFrames;
+		// room for the longest delay plus the interpolation taps,
+		// while a block is being written
+		size = 1;
+		while(size < maxDelay + maxFrames + 4)
+			size <<= 1;
+		mask = size - 1;
+		stride = size + kGuard();
+		buffer.assign(numChannels * stride, 0);
+		allpassState.assign(numChannels, 0);
+		indices.assign(maxFrames, 0);
+		fractions.assign(maxFrames, 0);
+		fadeOut.assign(maxFrames, 0);
+		fadeIn.assign(maxFrames, 0);
+		position = 0;
+	}
+
+	/**
+	 * Clear all the channels.
+	 */
+	void reset(){
+		memset(buffer.data(), 0, sizeof(buffer[0]) * buffer.size());
+		memset(allpassState.data(), 0, sizeof(allpassState[0]) * allpassState.size());
+	}
+
+	/**
+	 * Write a block of samples into a channel, at the current position.
+	 */
+	void write(unsigned int channel, const sample_t* in, unsigned int frames){
+		sample_t* buf = &buffer[channel * stride];
+		unsigned int start = position & mask;
+		unsigned int first = size - start;
+		if(first > frames)
+			first = frames;
+		memcpy(buf + start, in, sizeof(in[0]) * first);
+		memcpy(buf, in + first, sizeof(in[0]) * (frames - first));
+		// keep the copy of the start of the buffer after its end
+		if(start < kGuard())
+		{
+			unsigned int count = kGuard() - start < first ? kGuard() - start : first;
+			memcpy(buf + size + start, in, sizeof(in[0]) * count);
+		}
+		if(frames > first)
+			memcpy(buf + size, in + first, sizeof(in[0]) * (frames - first));
+	}
+
+	/**
+	 * Move the current position forward. Call this once per block, after
+	 * all channels have been read and written.
+	 */
+	void advance(unsigned int frames){
+		position += frames;
+	}
+
+	/**
+	 * Read a block at a constant delay.
+	 *
+	 * @param channel the channel to read.
+	 * @param out where to store the samples.
+	 * @param frames the number of frames.
+	 * @param delay the delay, in samples. It can be fractional unless
+	 * `interpolation` is kDelayInterpolationNone.
+	 * @param interpolation how to interpolate between samples.
+	 * kDelayInterpolationAllpass is not supported here and falls back to linear.
+	 * @param gain the samples are multiplied by this.
+	 * @param accumulate if true, the samples are added to `out` instead of
+	 * replacing its content, e.g.: to sum several taps.
+	 */
+	void read(unsigned int channel, sample_t* out, unsigned int frames, float delay,
+			DelayInterpolation interpolation = kDelayInterpolationLinear,
+			sample_t gain = 1, bool accumulate = false){
+		readAt(channel, 0, out, frames, delay, interpolation, gain, accumulate);
+	}
+
+	/**
+	 * Read a block through a tap, crossfading if its delay is changing.
+	 *
+	 * The parameters are the same as for read(). The crossfade of the tap
+	 * moves forward by `frames`.
+	 */
+	void read(unsigned int channel, sample_t* out, unsigned int frames, DelayLineTap& tap,
+			DelayInterpolation interpolation = kDelayInterpolationLinear,
+			sample_t gain = 1, bool accumulate = false){
+		unsigned int done = 0;
+		while(done < frames)
+		{
+			if(!tap.fadeFrames)
+			{
+				readAt(channel, done, out + done, frames - done, tap.delay, interpolation, gain, accumulate);
+				return;
+			}
+			unsigned int chunk = frames - done;
+			if(chunk > tap.fadeFrames - tap.fadePosition)
+				chunk = tap.fadeFrames - tap.fadePosition;
+			// read both delays, then mix them with a linear ramp
+			sample_t* __restrict__ from = fadeOut.data();
+			sample_t* __restrict__ to = fadeIn.data();
+			readAt(channel, done, from, chunk, tap.delay, interpolation, 1, false);
+			readAt(channel, done, to, chunk, tap.nextDelay, interpolation, 1, false);
+			sample_t* __restrict__ o = out + done;
+			sample_t step = gain / tap.fadeFrames;
+			sample_t g = step * tap.fadePosition;
+			for(unsigned int n = 0; n < chunk; ++n)
+			{
+				sample_t in = g + step * n;
+				o[n] = (accumulate ? o[n] : 0) + from[n] * (gain - in) + to[n] * in;
+			}
+			done += chunk;
+			tap.fadePosition += chunk;
+			if(tap.fadePosition == tap.fadeFrames)
+			{
+				tap.delay = tap.nextDelay;
+				tap.fadeFrames = 0;
+				tap.fadePosition = 0;
+				if(tap.pending)
+				{
+					tap.pending = false;
+					tap.setDelay(tap.pendingDelay, tap.pendingFadeFrames);
+				}
+			}
+		}
+	}
+
+	/**
+	 * Read a block from several taps of the same channel and sum them.
+	 *
+	 * @param channel the channel to read.
+	 * @param out where to store the sum.
+	 * @param frames the number of frames.
+	 * @param taps the taps.
+	 * @param gains the gain of each tap.
+	 * @param numTaps the number of taps.
+	 * @param interpolation how to interpolate between samples.
+	 */
+	void readTaps(unsigned int channel, sample_t* out, unsigned int frames,
+			DelayLineTap* taps, const sample_t* gains, unsigned int numTaps,
+			DelayInterpolation interpolation = kDelayInterpolationLinear){
+		if(!numTaps)
+		{
+			memset(out, 0, sizeof(out[0]) * frames);
+			return;
+		}
+		for(unsigned int t = 0; t < numTaps; ++t)
+			read(channel, out, frames, taps[t], interpolation, gains[t], t > 0);
+	}
+
+	/**
+	 * Read a block with a different delay for each frame, e.g.: for a
+	 * chorus, flanger or vibrato.
+	 *
+	 * @param channel the channel to read.
+	 * @param out where to store the samples.
+	 * @param frames the number of frames.
+	 * @param delays the delay for each frame, in samples.
+	 * @param interpolation how to interpolate between samples. With
+	 * kDelayInterpolationAllpass the interpolator keeps one state per
+	 * channel, so only one modulated read per channel and per block should use it.
+	 */
+	void readModulated(unsigned int channel, sample_t* out, unsigned int frames, const float* delays,
+			DelayInterpolation interpolation = kDelayInterpolationLinear){
+		const sample_t* buf = &buffer[channel * stride];
+		// split the delays into whole and fractional parts in a
+		// separate loop, so that it is vectorised
+		unsigned int* __restrict__ idx = indices.data();
+		sample_t* __restrict__ frac = fractions.data();
+		unsigned int pos = position;
+		for(unsigned int n = 0; n < frames; ++n)
+		{
+			int d = (int)delays[n];
+			frac[n] = delays[n] - d;
+			idx[n] = pos + n - d;
+		}
+		switch(interpolation)
+		{
+		case kDelayInterpolationNone:
+			for(unsigned int n = 0; n < frames; ++n)
+				out[n] = buf[idx[n] & mask];
+			break;
+		case kDelayInterpolationLinear:
+			for(unsigned int n = 0; n < frames; ++n)
+			{
+				const sample_t* x = buf + ((idx[n] - 1) & mask);
+				out[n] = x[0] * frac[n] + x[1] * (1 - frac[n]);
+			}
+			break;
+		case kDelayInterpolationLagrange:
+			for(unsigned int n = 0; n < frames; ++n)
+			{
+				const sample_t* x = buf + ((idx[n] - 2) & mask);
+				sample_t h[4];
+				lagrange(frac[n], h);
+				out[n] = h[0] * x[0] + h[1] * x[1] + h[2] * x[2] + h[3] * x[3];
+			}
+			break;
+		case kDelayInterpolationAllpass:
+		{
+			sample_t y = allpassState[channel];
+			for(unsigned int n = 0; n < frames; ++n)
+			{
+				// keep the fractional part in [0.5, 1.5), where the
+				// allpass is well behaved
+				unsigned int i = idx[n];
+				sample_t f = frac[n];
+				if(f < sample_t(0.5))
+				{
+					f += 1;
+					++i;
+				}
+				sample_t eta = (1 - f) / (1 + f);
+				const sample_t* x = buf + ((i - 1) & mask);
+				y = eta * (x[1] - y) + x[0];
+				out[n] = y;
+			}
+			allpassState[channel] = y;
+			break;
+		}
+		}
+	}
+
+	unsigned int getNumChannels() { return numChannels; }
+	/**
+	 * Get the longest delay that can be read, in samples.
+	 */
+	unsigned int getMaxDelay() { return size - maxFrames - 4; }
+
+private:
+	unsigned int kGuard() { return maxFrames + 4; }
+
+	// read a block starting `offset` frames after the current position
+	void readAt(unsigned int channel, unsigned int offset, sample_t* out, unsigned int frames, float delay,
+			DelayInterpolation interpolation, sample_t gain, bool accumulate){
+		const sample_t* buf = &buffer[channel * stride];
+		unsigned int pos = position + offset;
+		unsigned int d = (unsigned int)delay;
+		sample_t f = delay - d;
+		sample_t* __restrict__ o = out;
+		if(kDelayInterpolationNone == interpolation || 0 == f)
+		{
+			const sample_t* __restrict__ x = buf + ((pos - d) & mask);
+			for(unsigned int n = 0; n < frames; ++n)
+				o[n] = (accumulate ? o[n] : 0) + gain * x[n];
+		}
+		else if(kDelayInterpolationLagrange == interpolation)
+		{
+			// taps at delays d + 2, d + 1, d, d - 1
+			sample_t h[4];
+			lagrange(f, h);
+			const sample_t* __restrict__ x = buf + ((pos - d - 2) & mask);
+			sample_t h0 = gain * h[0];
+			sample_t h1 = gain * h[1];
+			sample_t h2 = gain * h[2];
+			sample_t h3 = gain * h[3];
+			for(unsigned int n = 0; n < frames; ++n)
+				o[n] = (accumulate ? o[n] : 0) + h0 * x[n] + h1 * x[n + 1] + h2 * x[n + 2] + h3 * x[n + 3];
+		}
+		else
+		{
+			// taps at delays d + 1 and d
+			const sample_t* __restrict__ x = buf + ((pos - d - 1) & mask);
+			sample_t h0 = gain * f;
+			sample_t h1 = gain * (1 - f);
+			for(unsigned int n = 0; n < frames; ++n)
+				o[n] = (accumulate ? o[n] : 0) + h0 * x[n] + h1 * x[n + 1];
+		}
+	}
+
+	// coefficients of the third-order Lagrange interpolator for a delay of
+	// 1 + f from the newest of the four samples, oldest sample first
+	static void lagrange(sample_t f, sample_t* h){
+		sample_t d = 1 + f;
+		sample_t dm1 = d - 1;
+		sample_t dm2 = d - 2;
+		sample_t dm3 = d - 3;
+		h[3] = -dm1 * dm2 * dm3 / 6;
+		h[2] = d * dm2 * dm3 / 2;
+		h[1] = -d * dm1 * dm3 / 2;
+		h[0] = d * dm1 * dm2 / 6;
+	}
+
+	std::vector<sample_t> buffer; // [channel][size + guard]
+	std::vector<sample_t> allpassState;
+	std::vector<unsigned int> indices;
+	std::vector<sample_t> fractions;
+	std::vector<sample_t> fadeOut;
+	std::vector<sample_t> fadeIn;
+	unsigned int numChannels;
+	unsigned int maxFrames;
+	unsigned int size;
+	unsigned int mask;
+	unsigned int stride;
+	unsigned int position;
+};
+
+#endif /* __DelayLine_H_INCLUDED__ */
@@ -0,0 +1,109 @@
+/***** DigitalCapture.h *****/
+#ifndef __DigitalCapture_H_INCLUDED__
+#define __DigitalCapture_H_INCLUDED__
+
+#include <Bela.h>
+
+/// The maximum number of quadrature encoders handled by a DigitalCapture object
+#define kMaxDigitalCaptureEncoders 8
+
+/**
+ * The state of a digital channel, as measured by DigitalCapture.
+ *
+ * Times are expressed in digital frames since the audio started.
+ * Durations are 0 until they have been measured at least once.
+ */
+struct DigitalCaptureChannel {
+	uint64_t risingEdges; ///< number of rising edges detected so far
+	uint64_t fallingEdges; ///< number of falling edges detected so far
+	uint64_t lastRisingEdge; ///< time of the most recent rising edge
+	uint64_t lastFallingEdge; ///< time of the most recent falling edge
+	uint32_t highWidth; ///< duration of the most recent complete high pulse
+	uint32_t lowWidth; ///< duration of the most recent complete low pulse
+	uint32_t period; ///< time between the two most recent rising edges
+	bool value; ///< current value of the channel
+};
+
+/**
+ * The state of a quadrature encoder, as decoded by DigitalCapture.
+ */
+struct DigitalCaptureEncoder {
+	int64_t position; ///< accumulated position, in quadrature steps (4 per cycle)
+	int32_t delta; ///< change of position during the most recent block
+	uint32_t errors; ///< number of invalid transitions (both channels changed at once)
+	uint8_t channelA; ///< the channel connected to output A of the encoder
+	uint8_t channelB; ///< the channel connected to output B of the encoder
+};
+
+/**
+ * Capture edges, pulse widths, periods and quadrature encoders on the digital channels.
+ *
+ * All the enabled channels are analysed in a single pass over the digital
+ * frames of each block: adjacent frames are compared four at a time, and only the frames
+ * where one of the enabled channels changed are looked at in detail. The timing
+ * of each edge is frame-accurate.
+ *
+ * This replaces multiple PulseIn objects (one per pin) with a single object.
+ */
+class DigitalCapture {
+public:
+	DigitalCapture();
+
+	/**
+	 * Set the channels to capture and set them as inputs.
+	 *
+	 * @param context the BelaContext
+	 * @param channels a bit mask of the channels to capture (bit n for channel n).
+	 */
+	void setup(BelaContext* context, uint16_t channels);
+
+	/**
+	 * Decode a quadrature encoder connected to two of the captured channels.
+	 *
+	 * @param channelA the channel connected to output A.
+	 * @param channelB the channel connected to output B.
+	 *
+	 * @return the index of the encoder, to be passed to getEncoder(), or -1
+	 * if no more encoders can be added or the channels are not captured.
+	 */
+	int addEncoder(unsigned int channelA, unsigned int channelB);
+
+	/**
+	 * Analyse the digital frames of the current block.
+	 *
+	 * Call this once per block, from render().
+	 */
+	void process(BelaContext* context);
+
+	/**
+	 * Get the state of a channel, updated at the end of the most recent block.
+	 */
+	const DigitalCaptureChannel& getChannel(unsigned int channel){
+		return channels[channel];
+	}
+
+	/**
+	 * Get the state of an encoder, updated at the end of the most recent block.
+	 */
+	const DigitalCaptureEncoder& getEncoder(unsigned int encoder){
+		return encoders[encoder];
+	}
+
+	/**
+	 * Get the number of encoders.
+	 */
+	unsigned int getNumEncoders(){
+		return numEncoders;
+	}
+private:
+	void processFrame(uint16_t changed, uint16_t values, uint64_t time);
+	DigitalCaptureChannel channels[16];
+	DigitalCaptureEncoder encoders[kMaxDigitalCaptureEncoders];
+	unsigned int numEncoders;
+	uint16_t captureMask;
+	uint16_t encoderMask;
+	uint16_t lastValues;
+	bool firstBlock;
+};
+
+#endif /* __DigitalCapture_H_INCLUDED__ */
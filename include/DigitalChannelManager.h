@@ -31,6 +31,18 @@
  *
  */
 
+/**
+ * A state change of a digital input managed at message rate.
+ */
+struct DigitalChannelEvent {
+	uint16_t frame; ///< the frame at which the channel changed state
+	uint8_t channel; ///< the channel
+	uint8_t value; ///< the new value of the channel
+};
+
+/// The maximum number of events stored for each call to DigitalChannelManager::processInput()
+#define kMaxDigitalChannelEvents 1024
+
 class DigitalChannelManager {
 public:
 	DigitalChannelManager();
@@ -72,45 +84,79 @@ public:
 	/** Process the input signals.
 	 *
 	 * Parses the input array and looks for state changes in the bits
-	 * managed as message-rate inputs and invokes the
-	 * appropriate callbacks.
+	 * managed as message-rate inputs. The changes are stored
+	 * as events, in order of frame and channel, which can be
+	 * retrieved with getEvents() until the next call to processInput().
+	 * If a callback is set, it is then invoked for each event.
+	 *
+	 * Frames are compared in groups of 4 words, and only the frames
+	 * where something changed are scanned for the bits that changed.
 	 *
 	 * @param array the array of input values
 	 * @param length the length of the array
 	 *
 	 */
-	void processInput(uint32_t* array, unsigned int length){
-		if(callbackEnabled == false){
-			return;
-		}
-		// DIGITAL_FORMAT_ASSUMPTION
-		static uint16_t lastDigitalInputValues = 0;
-		for (unsigned int frame = 0; frame < length; ++frame) {
-			uint32_t inWord = array[frame];
-			uint16_t direction = inWord & 0Xffff;
-			uint16_t inputValues = (inWord >> 16);
-			// note: even though INPUT == 0 and OUTPUT == 0, this is actually reversed in the binary word,
-			// so it actually is 1 for input and 0 for output
-
-			// mask out outputValues from the half-word by setting them to zero
-			// if a bit of direction is 1, then it is an input.
-			// ANDing this with the inputValues gets rid of the output values
-			inputValues &= direction;
-			uint16_t changed = inputValues ^ lastDigitalInputValues;
-			//mask out channels that are not set at message rate
-			changed &= messageRate;
-			if(changed){
-//				rt_printf("changed: 0x%x, messageRate: 0x%x, ANDed: 0x%x\n", changed, messageRate, changed&messageRate);
-				for(int n = 0; n < 16; ++n){
-					if(changed & (1 << n)){ //if state for this channel has changed, invoke the callback
-						stateChangedCallback(inputValues & (1 << n), frame, callbackArguments[n]);
-					}
-				}
-			}
-			lastDigitalInputValues = inputValues;
-		}
+	void processInput(uint32_t* array, unsigned int length);
+
+	/**
+	 * Get the number of events detected by the most recent call to processInput().
+	 */
+	unsigned int getNumEvents(){
+		return numEvents;
 	}
 
+	/**
+	 * Get the events detected by the most recent call to processInput().
+	 *
+	 * @return an array of getNumEvents() events.
+	 */
+	const DigitalChannelEvent* getEvents(){
+		return events;
+	}
+
+	/**
+	 * Get the number of events that have been discarded since the
+	 * object was created because more than #kMaxDigitalChannelEvents
+	 * were detected in a single call to processInput().
+	 */
+	unsigned int getNumDroppedEvents(){
+		return numDroppedEvents;
+	}
+
+	/**
+	 * Unpack the signal-rate inputs into float buffers.
+	 *
+	 * For each frame and each channel managed as a signal-rate input,
+	 * the value of the bit is written as 0 or 1 into the
+	 * corresponding float buffer. Channels not managed as signal-rate
+	 * inputs are left untouched.
+	 *
+	 * @param array the array of digital frames
+	 * @param length the number of frames to process
+	 * @param out the buffer for channel 0. The buffer for channel \c k
+	 * starts at `out + k * stride`.
+	 * @param stride the distance between the buffers of two consecutive channels.
+	 * @param maxChannels only channels below this are processed.
+	 */
+	void processSignalRateInput(const uint32_t* array, unsigned int length, float* out, unsigned int stride, unsigned int maxChannels = 16);
+
+	/**
+	 * Pack the float buffers into the signal-rate outputs.
+	 *
+	 * For each frame and each channel managed as a signal-rate output,
+	 * the corresponding bit is set if the value in the float
+	 * buffer is larger than 0.5, cleared otherwise.
+	 * Bits of channels not managed as signal-rate outputs are left untouched.
+	 *
+	 * @param array the array of digital frames
+	 * @param length the number of frames to process
+	 * @param in the buffer for channel 0. The buffer for channel \c k
+	 * starts at `in + k * stride`.
+	 * @param stride the distance between the buffers of two consecutive channels.
+	 * @param maxChannels only channels below this are processed.
+	 */
+	void processSignalRateOutput(uint32_t* array, unsigned int length, const float* in, unsigned int stride, unsigned int maxChannels = 16);
+
 	/** Process the output signals.
 	 *
 	 * Processes the output array and appropriately sets the
@@ -202,6 +248,7 @@ public:
 		modeOutput = clearBit(modeOutput, channel);
 		clearDataOut = clearBit(clearDataOut, channel);
 		setDataOut = clearBit(setDataOut, channel);
+		updateSignalRateChannels();
 	}
 
 	/**
@@ -226,6 +273,7 @@ public:
 			modeInput = setBit(modeInput, channel);
 			modeOutput = clearBit(modeOutput, channel);
 		}
+		updateSignalRateChannels();
 		if(verbose)
 			rt_printf("Bela digital: channel %d is set as %s at %s rate\n", channel,
 				isInput(channel) ? "input" : "output", isSignalRate(channel) ? "signal" : "message");
@@ -234,6 +282,19 @@ public:
 	void setVerbose(bool isVerbose);
 	virtual ~DigitalChannelManager();
 private:
+	void updateSignalRateChannels();
+	void addEvents(uint16_t changed, uint16_t values, unsigned int frame);
+	DigitalChannelEvent events[kMaxDigitalChannelEvents];
+	unsigned int numEvents;
+	unsigned int numDroppedEvents;
+	uint16_t lastDigitalInputValues;
+	// the lists of signal-rate channels, recomputed every time
+	// a channel changes, so that the signal-rate kernels do not have to
+	// test every bit of every frame
+	uint8_t signalRateInputChannels[16];
+	uint8_t signalRateOutputChannels[16];
+	unsigned int numSignalRateInputChannels;
+	unsigned int numSignalRateOutputChannels;
 	bool callbackEnabled;
 	void* callbackArguments[16];
 	void (*stateChangedCallback)(bool value, unsigned int delay, void* arg);
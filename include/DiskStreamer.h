@@ -0,0 +1,252 @@
+/***** DiskStreamer.h *****/
+#ifndef __DiskStreamer_H_INCLUDED__
+#define __DiskStreamer_H_INCLUDED__
+
+#include <Bela.h>
+#include <AuxiliaryWorker.h>
+#include <SampleRateConverter.h>
+#include <vector>
+#include <atomic>
+#include <sndfile.h>
+
+/// The maximum number of I/O threads used by a DiskStreamer
+#define kMaxDiskStreamerThreads 4
+/// The largest ratio between the sample rate of a file (times the playback
+/// rate of the voice) and that of the DiskStreamer
+#define kDiskStreamerMaxRatio 4
+
+/**
+ * Stream many sound files from disk at the same time.
+ *
+ * Files are added in setup() with addFile(): they are kept open for the whole
+ * lifetime of the object and the first frames of each (the "attack") are loaded in
+ * memory, so that a voice can start playing immediately while the rest
+ * of the file is being read from disk.
+ *
+ * Each voice has its own ring buffer, which is refilled by one or more I/O
+ * threads (auxiliary tasks). Every time a thread looks for work it picks the voice
+ * that is closest to running out of data, so that the voices that are about to
+ * underrun are served first.
+ *
+ * Uncompressed WAV files (16-bit, 24-bit or float) are memory-mapped and
+ * converted directly from the mapping, with the kernel being told to read
+ * ahead of the position of each voice. Other formats are read through libsndfile,
+ * using one open handle per file per I/O thread, again with a hint to the kernel to
+ * read ahead.
+ *
+ * Files whose sample rate differs from that of the DiskStreamer are
+ * resampled while they play, by a SampleRateConverter in each voice, which
+ * also allows to change the playback rate of a voice with setRate(). Voices
+ * that play a file at its own sample rate and at the original rate are
+ * copied straight from the buffers.
+ *
+ * The audio-thread methods (play(), stop(), setGain(), setRate(), process(),
+ * processVoice()) do not allocate memory or perform any I/O.
+ */
+class DiskStreamer {
+public:
+	DiskStreamer();
+	~DiskStreamer();
+
+	/**
+	 * Allocate the voices and start the I/O threads.
+	 *
+	 * @param maxVoices the number of voices that can play at the same time.
+	 * @param maxChannels the maximum number of channels of the files.
+	 * @param bufferFrames the size of the ring buffer of each voice, in frames.
+	 * @param sampleRate the sample rate of the output, used to convert fade
+	 * times and to resample the files that have a different sample rate.
+	 * @param numThreads the number of I/O threads.
+	 * @param priority the priority of the I/O threads.
+	 * @param quality the quality of the resampling.
+	 *
+	 * @return 0 on success, or a negative value on error.
+	 */
+	int setup(unsigned int maxVoices, unsigned int maxChannels, unsigned int bufferFrames,
+			float sampleRate, unsigned int numThreads = 1, int priority = 90,
+			SampleRateConverterQuality quality = kSrcMedium);
+
+	/**
+	 * Open a file and load its first frames in memory.
+	 *
+	 * Call this from setup(), after setup().
+	 *
+	 * @param path the path of the file.
+	 * @param preloadFrames the number of frames to load in memory. This
+	 * should cover the time it takes the I/O threads to fill the ring buffer of
+	 * a voice.
+	 *
+	 * @return the index of the file, to be passed to play(), or a negative
+	 * value on error.
+	 */
+	int addFile(const char* path, unsigned int preloadFrames);
+
+	/**
+	 * Start playing a file on a free voice.
+	 *
+	 * @param file the index of the file, as returned by addFile().
+	 * @param gain the gain of the voice.
+	 * @param fadeIn the duration of the fade in, in seconds.
+	 * @param loop whether to start again from the beginning when the end of the file is reached.
+	 *
+	 * @return the index of the voice, or -1 if all the voices are busy.
+	 */
+	int play(unsigned int file, float gain = 1, float fadeIn = 0, bool loop = false);
+
+	/**
+	 * Stop a voice.
+	 *
+	 * @param voice the voice to stop.
+	 * @param fadeOut the duration of the fade out, in seconds.
+	 */
+	void stop(unsigned int voice, float fadeOut = 0);
+
+	/**
+	 * Set the gain of a voice.
+	 */
+	void setGain(unsigned int voice, float gain);
+
+	/**
+	 * Set the playback rate of a voice, e.g.: for varispeed or scrubbing.
+	 *
+	 * @param voice the voice.
+	 * @param rate the playback rate: 1 is the original speed and pitch, 2
+	 * is an octave up, 0 stops the playback. The sample rate of the file
+	 * times the rate can be at most kDiskStreamerMaxRatio times the sample rate
+	 * of the DiskStreamer.
+	 * @param rampTime the time it takes to reach the new rate, in seconds.
+	 */
+	void setRate(unsigned int voice, float rate, float rampTime = 0);
+
+	/**
+	 * Get the next frames of a voice.
+	 *
+	 * @param voice the voice.
+	 * @param out the destination buffer, where the interleaved frames of the
+	 * file are added to the existing content.
+	 * @param frames the number of frames to generate.
+	 *
+	 * @return the number of frames that were generated, which is less than
+	 * `frames` if the voice stopped or ran out of data.
+	 */
+	unsigned int processVoice(unsigned int voice, float* out, unsigned int frames);
+
+	/**
+	 * Mix all the active voices into the audio outputs and schedule the
+	 * I/O threads when needed.
+	 *
+	 * Call this once per block, from render(). Output channel `c` receives
+	 * channel `c % channels` of each file, so that mono files go to all the outputs.
+	 */
+	void process(BelaContext* context);
+
+	/**
+	 * Schedule the I/O threads if any of the voices need more data.
+	 * This is called by process(). Call it at the end of render() if you use processVoice() directly.
+	 */
+	void scheduleIo();
+
+	/**
+	 * Whether a voice is playing.
+	 */
+	bool isPlaying(unsigned int voice);
+
+	/**
+	 * Get the number of times a voice ran out of data.
+	 */
+	unsigned int getUnderruns(unsigned int voice);
+
+	/**
+	 * Get the number of frames available in the ring buffer of a voice.
+	 */
+	unsigned int getBufferedFrames(unsigned int voice);
+
+	/**
+	 * Get the number of channels of a file.
+	 */
+	unsigned int getNumChannels(unsigned int file);
+
+	/**
+	 * Get the number of frames of a file.
+	 */
+	uint64_t getNumFrames(unsigned int file);
+
+	/**
+	 * Get the sample rate of a file.
+	 */
+	float getSampleRate(unsigned int file);
+
+	unsigned int getNumVoices() { return numVoices; }
+	unsigned int getNumFiles() { return files.size(); }
+
+	/**
+	 * Stop the I/O threads and close all the files.
+	 */
+	void cleanup();
+
+private:
+	struct File {
+		SNDFILE* sndfiles[kMaxDiskStreamerThreads]; // one per I/O thread, unused when mapped
+		int fd;
+		const char* mapping; // the whole file, if it is mapped
+		size_t fileSize;
+		size_t dataOffset; // the position of the first frame in the file
+		unsigned int bytesPerSample; // 2, 3 or 4 (float) for mapped files
+		unsigned int channels;
+		uint64_t frames;
+		float sampleRate;
+		unsigned int preloadFrames;
+		std::vector<float> preload; // interleaved
+	};
+	struct Voice {
+		std::atomic<bool> active; // set by the audio thread
+		std::atomic<bool> claimed; // set by the I/O thread that is filling the buffer
+		std::atomic<uint64_t> written; // frames written to the ring buffer since play()
+		std::atomic<uint64_t> consumed; // frames read from the ring buffer since play()
+		uint64_t position; // frames played since play()
+		unsigned int file;
+		bool loop;
+		float gain;
+		float fade;
+		float fadeIncrement;
+		unsigned int underruns;
+		float* buffer; // interleaved ring buffer
+		bool resampling; // whether the frames go through the converter
+		unsigned int padding; // frames of silence fed to the converter after the end of the file
+		SampleRateConverter converter;
+	};
+	struct IoThread {
+		DiskStreamer* that;
+		unsigned int index;
+		AuxiliaryWorker worker;
+	};
+	static void ioLoop(void* arg);
+	void serviceVoices(unsigned int thread);
+	bool fillVoice(Voice& v, unsigned int thread);
+	void readFrames(File& f, unsigned int thread, uint64_t start, float* dest, unsigned int frames);
+	void hint(File& f, uint64_t start, unsigned int frames);
+	unsigned int framesToRead(Voice& v);
+	uint64_t getFrames(Voice& v, const float** src, bool* fromRing);
+	void consume(Voice& v, unsigned int frames, bool fromRing);
+	unsigned int mix(Voice& v, const float* src, float* dest, unsigned int frames, unsigned int channels);
+	unsigned int processResampled(Voice& v, float* out, unsigned int frames);
+	uint64_t fileFrame(File& f, uint64_t position, bool loop);
+	void closeFile(File& f);
+
+	Voice* voices;
+	unsigned int numVoices;
+	std::vector<File> files;
+	IoThread threads[kMaxDiskStreamerThreads];
+	unsigned int numThreads;
+	unsigned int maxChannels;
+	unsigned int bufferFrames;
+	unsigned int chunkFrames; // the number of frames read at once by an I/O thread
+	float sampleRate;
+	float* buffers;
+	std::vector<float> mixBuffer;
+	std::vector<float> resampleInput;
+	std::vector<float> resampleOutput;
+	std::atomic<bool> stopping;
+};
+
+#endif /* __DiskStreamer_H_INCLUDED__ */
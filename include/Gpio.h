@@ -19,6 +19,7 @@
 */
 
 static const uint32_t GPIO_SIZE =  0x198;
+static const uint32_t GPIO_OE = (0x134 / 4);
 static const uint32_t GPIO_DATAIN = (0x138 / 4);
 static const uint32_t GPIO_CLEARDATAOUT = (0x190 / 4);
 static const uint32_t GPIO_SETDATAOUT = (0x194 / 4);
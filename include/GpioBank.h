@@ -0,0 +1,167 @@
+/***** GpioBank.h *****/
+#ifndef __GpioBank_H_INCLUDED__
+#define __GpioBank_H_INCLUDED__
+
+#include <Gpio.h>
+
+#define GPIO_BANK_MAX_PINS 32
+
+/**
+ * A set of GPIO pins, resolved to their bank and mask once, so that
+ * they can be written together with one register access per bank.
+ */
+struct GpioPins {
+	unsigned int numPins;
+	uint8_t bank[GPIO_BANK_MAX_PINS]; // bank of each pin
+	uint32_t mask[GPIO_BANK_MAX_PINS]; // mask of each pin within its bank
+	uint32_t bankMasks[4]; // masks of all the pins in each bank
+};
+
+/**
+ * Memory-mapped access to all four GPIO banks of the AM335x.
+ *
+ * Unlike Gpio, which maps one bank for each pin object, GpioBank maps all
+ * the banks once and gives access to whole banks through bit masks. All the
+ * pins set in a mask are set or cleared with a single write to the
+ * SETDATAOUT or CLEARDATAOUT register of the bank, so that they change at
+ * the same time.
+ *
+ * Pins are not exported or muxed by this class: use Gpio or gpio_export()
+ * for that, if needed.
+ */
+class GpioBank {
+public:
+	static const unsigned int kNumBanks = 4;
+	static const unsigned int kStandInBankSize = 4096;
+
+	GpioBank();
+	~GpioBank();
+
+	/**
+	 * Map the GPIO banks.
+	 *
+	 * @param memFile if `NULL`, the banks are mapped from `/dev/mem` at
+	 * their physical addresses. Otherwise, the name of a regular file to be used
+	 * as a stand-in for testing: bank `n` is mapped at offset `n * kStandInBankSize`,
+	 * and the file must be at least `kNumBanks * kStandInBankSize` bytes long.
+	 *
+	 * @return 0 on success, a negative value otherwise.
+	 */
+	int open(const char* memFile = NULL);
+
+	/**
+	 * Unmap the GPIO banks.
+	 */
+	void close();
+
+	/**
+	 * Check whether the banks are mapped.
+	 */
+	bool enabled(){
+		return fd != -1;
+	}
+
+	/**
+	 * Set the pins in `mask` of the given bank to 1.
+	 */
+	void setMask(unsigned int bank, uint32_t mask){
+		banks[bank][GPIO_SETDATAOUT] = mask;
+	}
+
+	/**
+	 * Clear the pins in `mask` of the given bank to 0.
+	 */
+	void clearMask(unsigned int bank, uint32_t mask){
+		banks[bank][GPIO_CLEARDATAOUT] = mask;
+	}
+
+	/**
+	 * Read the pins in `mask` of the given bank.
+	 *
+	 * @return the input values of the bank, ANDed with `mask`.
+	 */
+	uint32_t readMask(unsigned int bank, uint32_t mask = 0xffffffff){
+		return banks[bank][GPIO_DATAIN] & mask;
+	}
+
+	/**
+	 * Set the direction of the pins in `mask` of the given bank.
+	 *
+	 * @param bank the bank
+	 * @param mask the pins to change
+	 * @param direction one of INPUT or OUTPUT
+	 */
+	void setDirectionMask(unsigned int bank, uint32_t mask, unsigned int direction);
+
+	/**
+	 * Resolve a list of GPIO numbers into a GpioPins object.
+	 *
+	 * @param pins the GPIO numbers (0 <= pin < 128)
+	 * @param numPins the number of pins, at most #GPIO_BANK_MAX_PINS
+	 * @param out the object to initialise
+	 *
+	 * @return 0 on success, a negative value otherwise.
+	 */
+	static int resolvePins(const unsigned int* pins, unsigned int numPins, GpioPins& out);
+
+	/**
+	 * Set all the pins in `pins` to 1.
+	 */
+	void set(const GpioPins& pins){
+		for(unsigned int b = 0; b < kNumBanks; ++b)
+			if(pins.bankMasks[b])
+				setMask(b, pins.bankMasks[b]);
+	}
+
+	/**
+	 * Clear all the pins in `pins` to 0.
+	 */
+	void clear(const GpioPins& pins){
+		for(unsigned int b = 0; b < kNumBanks; ++b)
+			if(pins.bankMasks[b])
+				clearMask(b, pins.bankMasks[b]);
+	}
+
+	/**
+	 * Write all the pins in `pins` at once.
+	 *
+	 * @param pins the pins to write
+	 * @param values bit `n` is the value for the `n`-th pin in `pins`
+	 */
+	void write(const GpioPins& pins, uint32_t values){
+		uint32_t set[kNumBanks] = {0};
+		for(unsigned int n = 0; n < pins.numPins; ++n)
+			set[pins.bank[n]] |= ((values >> n) & 1) ? pins.mask[n] : 0;
+		for(unsigned int b = 0; b < kNumBanks; ++b)
+		{
+			if(!pins.bankMasks[b])
+				continue;
+			uint32_t clear = pins.bankMasks[b] & ~set[b];
+			if(set[b])
+				setMask(b, set[b]);
+			if(clear)
+				clearMask(b, clear);
+		}
+	}
+
+	/**
+	 * Read all the pins in `pins` at once.
+	 *
+	 * @return bit `n` is the value of the `n`-th pin in `pins`
+	 */
+	uint32_t read(const GpioPins& pins){
+		uint32_t in[kNumBanks];
+		for(unsigned int b = 0; b < kNumBanks; ++b)
+			in[b] = pins.bankMasks[b] ? readMask(b) : 0;
+		uint32_t values = 0;
+		for(unsigned int n = 0; n < pins.numPins; ++n)
+			values |= (uint32_t)((in[pins.bank[n]] & pins.mask[n]) != 0) << n;
+		return values;
+	}
+private:
+	int fd;
+	volatile uint32_t* banks[kNumBanks];
+	unsigned int mapSize;
+};
+
+#endif /* __GpioBank_H_INCLUDED__ */
@@ -0,0 +1,232 @@
+/***** I2cScheduler.h *****/
+#ifndef __I2cScheduler_H_INCLUDED__
+#define __I2cScheduler_H_INCLUDED__
+
+#include <I2c.h>
+#include <Bela.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+/// The maximum number of messages sent in one combined transfer (I2C_RDWR_IOCTL_MAX_MSGS)
+#define kI2cSchedulerMaxMessages 42
+
+/**
+ * An I2C bus, as seen by I2cScheduler.
+ *
+ * Override transfer() to run the scheduler against something other than a
+ * real bus, e.g.: I2cFakeAdapter for testing.
+ */
+class I2cAdapter {
+public:
+	/**
+	 * Perform a combined transfer: all the messages are sent in
+	 * order, separated by repeated starts, as with the I2C_RDWR ioctl.
+	 *
+	 * @return 0 on success, a negative value if any of the messages failed.
+	 */
+	virtual int transfer(struct i2c_msg* messages, unsigned int count) = 0;
+	virtual ~I2cAdapter() {}
+};
+
+/**
+ * A Linux I2C bus (`/dev/i2c-N`).
+ */
+class I2cDevAdapter : public I2cAdapter {
+public:
+	I2cDevAdapter();
+	~I2cDevAdapter();
+	int open(int bus);
+	void close();
+	int transfer(struct i2c_msg* messages, unsigned int count);
+private:
+	int fd;
+};
+
+/**
+ * A simulated I2C bus with register-based devices, for testing code that uses
+ * I2cScheduler without any hardware.
+ *
+ * Each device has 256 byte-wide registers and a register pointer: the
+ * first byte written to a device sets the pointer, the following bytes are written
+ * to consecutive registers. Reads return consecutive registers starting from
+ * the pointer. Messages to an address without a device fail, as a real device would
+ * not acknowledge them.
+ */
+class I2cFakeAdapter : public I2cAdapter {
+public:
+	I2cFakeAdapter();
+	/**
+	 * Add a device, or change the content of its registers.
+	 */
+	void setRegisters(uint16_t address, unsigned int reg, const uint8_t* data, unsigned int length);
+	/**
+	 * Get the 256 registers of a device, or NULL if there is no such device.
+	 */
+	const uint8_t* getRegisters(uint16_t address);
+	/**
+	 * Make all the messages to a device fail.
+	 */
+	void setFailing(uint16_t address, bool failing);
+	unsigned int getNumTransfers() { return numTransfers; }
+	unsigned int getNumMessages() { return numMessages; }
+	int transfer(struct i2c_msg* messages, unsigned int count);
+private:
+	struct Device {
+		uint16_t address;
+		bool failing;
+		uint8_t pointer;
+		uint8_t registers[256];
+	};
+	Device* findDevice(uint16_t address);
+	std::vector<Device> devices;
+	unsigned int numTransfers;
+	unsigned int numMessages;
+};
+
+/**
+ * Poll I2C devices periodically from a background thread, and make the
+ * results available to the audio thread without locks.
+ *
+ * The I2C thread is a regular Linux thread, not a Xenomai one, as it spends
+ * its time in blocking system calls: with a priority above 0 it runs with
+ * the SCHED_FIFO policy.
+ *
+ * Each device registers one or more transactions: an optional write
+ * (e.g.: a register address) followed by an optional read, repeated at a given
+ * rate. All the transactions on the bus are run by a single thread: the ones that
+ * are due at the same time are sent in one combined transfer (I2C_RDWR).
+ * If a combined transfer fails, its transactions are retried one by one, so that a
+ * missing device does not affect the others.
+ *
+ * The data read by each transaction goes into a triple buffer: render() always
+ * gets the most recent complete result, together with the time at which it was read,
+ * and the I2C thread never waits for the audio thread.
+ *
+ * Create one I2cScheduler per bus.
+ */
+class I2cScheduler {
+public:
+	I2cScheduler();
+	~I2cScheduler();
+
+	/**
+	 * Use a Linux I2C bus.
+	 *
+	 * @param bus the number of the bus (`/dev/i2c-N`)
+	 * @param priority the real-time priority of the I2C thread, or 0 for
+	 * a normal thread
+	 *
+	 * @return 0 on success, or a negative value on error.
+	 */
+	int setup(int bus, int priority = 0);
+
+	/**
+	 * Use a custom adapter, e.g.: an I2cFakeAdapter. The adapter
+	 * must outlive the scheduler.
+	 */
+	int setup(I2cAdapter* adapter, int priority = 0);
+
+	/**
+	 * Add a periodic transaction. Call this before start().
+	 *
+	 * @param address the address of the device
+	 * @param writeData the bytes to write before reading, or NULL
+	 * @param writeLength the number of bytes to write
+	 * @param readLength the number of bytes to read
+	 * @param rate how many times per second the transaction should run
+	 *
+	 * @return the index of the transaction, or a negative value on error.
+	 */
+	int addTransaction(uint16_t address, const uint8_t* writeData, unsigned int writeLength,
+			unsigned int readLength, float rate);
+
+	/**
+	 * Start the I2C thread.
+	 *
+	 * @return 0 on success, or a negative value on error.
+	 */
+	int start();
+
+	/**
+	 * Stop the I2C thread. This wakes it up and waits for it to finish
+	 * the transactions it is running and to return.
+	 */
+	void stop();
+
+	/**
+	 * Get the most recent result of a transaction. Safe to call from the audio thread.
+	 *
+	 * @param transaction the index of the transaction
+	 * @param data set to the bytes read by the transaction. The pointer
+	 * remains valid until the next call to read() for the same transaction.
+	 * @param timestamp if not NULL, set to the time at which the data was
+	 * read, as returned by getTime()
+	 *
+	 * @return 1 if the data is new since the previous call, 0 if it is
+	 * the same as in the previous call, -1 if no data has been read yet.
+	 */
+	int read(unsigned int transaction, const uint8_t** data, uint64_t* timestamp = NULL);
+
+	/**
+	 * Get the number of times a transaction failed.
+	 */
+	unsigned int getErrors(unsigned int transaction);
+
+	/**
+	 * Run all the transactions that are due at the given time.
+	 *
+	 * This is what the I2C thread does every time it wakes up. Call it
+	 * directly (without calling start()) to drive the scheduler with a simulated clock.
+	 *
+	 * @param now the current time, in microseconds
+	 *
+	 * @return the time at which the next transaction is due.
+	 */
+	uint64_t poll(uint64_t now);
+
+	/**
+	 * Get the time from the monotonic clock, in microseconds.
+	 */
+	static uint64_t getTime();
+
+	unsigned int getNumTransactions() { return transactions.size(); }
+
+private:
+	struct Transaction {
+		uint16_t address;
+		std::vector<uint8_t> writeData;
+		unsigned int readLength;
+		uint64_t period;
+		uint64_t nextTime;
+		std::atomic<unsigned int> errors;
+		// triple buffer: the I2C thread fills `back`, the audio thread reads
+		// `front`, and they swap their buffer with `middle` when done
+		std::vector<uint8_t> buffers;
+		uint64_t timestamps[3];
+		unsigned int back;
+		std::atomic<unsigned int> middle;
+		unsigned int front;
+		bool received;
+	};
+	static void loop(void* arg);
+	unsigned int addMessages(Transaction* t, struct i2c_msg* messages);
+	void runBatch(unsigned int numDue, unsigned int numMessages, uint64_t now);
+	void publish(Transaction* t, uint64_t now);
+
+	I2cAdapter* adapter;
+	I2cDevAdapter devAdapter;
+	std::vector<Transaction*> transactions;
+	std::vector<Transaction*> due;
+	struct i2c_msg messages[kI2cSchedulerMaxMessages];
+	int priority;
+	std::atomic<bool> running;
+	std::thread thread;
+	std::mutex mutex; // protects the changes of `running` that the I2C thread waits for
+	std::condition_variable wakeup;
+};
+
+#endif /* __I2cScheduler_H_INCLUDED__ */
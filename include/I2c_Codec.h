@@ -19,6 +19,8 @@
 #include "AudioCodec.h"
 #include "I2c.h"
 
+// The maximum number of register writes queued between beginBatch() and endBatch()
+#define kI2cCodecMaxBatch 64
 
 class I2c_Codec : public I2c, public AudioCodec
 {
@@ -31,6 +33,8 @@ public:
 
 	int initCodec();
 	int startAudio(int dual_rate);
+	int startAudioBegin(int dual_rate, unsigned int* settleUs);
+	int startAudioEnd();
 	int stopAudio();
 
 	int setPllJ(short unsigned int j);
@@ -63,11 +67,22 @@ public:
 
 private:
 	int configureDCRemovalIIR(); //called by startAudio()
+	int writeStartRegisters(int dual_rate);
+	int writeUnmuteRegisters();
+	// while batching, writeRegister() queues the writes and endBatch()
+	// sends them all in a single I2C_RDWR transfer
+	void beginBatch();
+	int endBatch();
 	int dacVolumeHalfDbs;
 	int adcVolumeHalfDbs;
 	int hpVolumeHalfDbs;
 	bool running;
 	bool verbose;
+	bool batching;
+	bool batchFailed;
+	unsigned int batchLength;
+	unsigned char batchRegisters[kI2cCodecMaxBatch];
+	unsigned char batchValues[kI2cCodecMaxBatch];
 };
 
 
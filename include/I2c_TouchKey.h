@@ -42,10 +42,14 @@ private:
 	float sliderPosition[5];
 	float sliderPositionH;
 
+	void parseData();
 
 public:
 	int initTouchKey(int sensorTypeToUse = kSensorTypeTouchKey);
 	int readI2C();
+	// parse data read elsewhere (e.g.: by an I2cScheduler transaction of getNumBytesToRead() bytes)
+	void processData(const uint8_t* data);
+	int getNumBytesToRead() { return numBytesToRead; }
 	int getTouchCount();
 	float * getSlidersize();
 	float * getSliderPosition();
@@ -76,7 +76,7 @@ public:
 		return in;
 	};
 	void process(double* inout, int length){
-		for(int n = 0; n < numberOfStages && n < 8/* TODO: this "8" compensates for a memory corruption somewhere on the BBB*/; n++){
+		for(int n = 0; n < numberOfStages; n++){
 			stages[n]->process(inout, length);
 		}
 	}
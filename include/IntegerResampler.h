@@ -0,0 +1,105 @@
+/***** IntegerResampler.h *****/
+#ifndef __IntegerResampler_H_INCLUDED__
+#define __IntegerResampler_H_INCLUDED__
+
+#include <vector>
+
+/**
+ * Quality of the interpolation/decimation performed by IntegerResampler.
+ */
+typedef enum {
+	kResamplerHold, ///< duplicate samples when upsampling, drop them when downsampling
+	kResamplerLinear, ///< linear interpolation when upsampling, boxcar average when downsampling
+	kResamplerPolyphase, ///< windowed-sinc polyphase FIR
+} ResamplerQuality;
+
+/**
+ * A multi-channel resampler for a fixed integer ratio.
+ *
+ * It is meant to bridge signals running at different (integer-related)
+ * sampling rates, e.g.: the analog channels (22.05kHz) and the audio
+ * channels (44.1kHz) of Bela. All the memory is allocated in setup(),
+ * so that process() can be called from the audio thread.
+ *
+ * Each channel is processed independently on non-interleaved buffers.
+ */
+class IntegerResampler {
+public:
+	IntegerResampler();
+
+	/**
+	 * Allocate the memory for the resampler.
+	 *
+	 * @param numChannels the number of channels.
+	 * @param factor the integer resampling factor.
+	 * @param upsample if `true`, each input sample generates `factor`
+	 * output samples, otherwise `factor` input samples generate one output sample.
+	 * @param maxInputFrames the maximum number of input frames that will
+	 * be passed to process() in a single call.
+	 * @param quality the initial quality.
+	 * @param tapsPerPhase the number of taps of each of the polyphase
+	 * filters, used only by kResamplerPolyphase.
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	int setup(unsigned int numChannels, unsigned int factor, bool upsample,
+			unsigned int maxInputFrames, ResamplerQuality quality = kResamplerLinear,
+			unsigned int tapsPerPhase = 8);
+
+	/**
+	 * Change the quality of the resampler.
+	 *
+	 * This does not allocate memory and it can be called from the audio thread.
+	 * The state of all channels is reset.
+	 */
+	void setQuality(ResamplerQuality newQuality);
+
+	ResamplerQuality getQuality() { return quality; }
+
+	/**
+	 * Get the number of output frames generated for a given number of input frames.
+	 */
+	unsigned int getOutputFrames(unsigned int inputFrames){
+		return upsample ? inputFrames * factor : inputFrames / factor;
+	}
+
+	/**
+	 * Get the delay introduced by the resampler at the current quality,
+	 * expressed in output frames.
+	 */
+	float getLatency();
+
+	/**
+	 * Reset the internal state of all channels.
+	 */
+	void reset();
+
+	/**
+	 * Resample one block of one channel.
+	 *
+	 * @param channel the channel the block belongs to.
+	 * @param in the input buffer.
+	 * @param inputFrames the number of frames in `in`. When downsampling,
+	 * this should be a multiple of the resampling factor. It must not be larger
+	 * than the `maxInputFrames` passed to setup().
+	 * @param out the output buffer, which has to be large enough to
+	 * store getOutputFrames(inputFrames) frames.
+	 */
+	void process(unsigned int channel, const float* in, unsigned int inputFrames, float* out);
+private:
+	void processUp(unsigned int channel, const float* in, unsigned int inputFrames, float* out);
+	void processDown(unsigned int channel, const float* in, unsigned int inputFrames, float* out);
+	unsigned int getHistoryLength();
+	std::vector<float> filter; // polyphase prototype, stored phase by phase
+	std::vector<float> history; // per-channel contiguous input history
+	std::vector<float> lastSample;
+	unsigned int numChannels;
+	unsigned int factor;
+	unsigned int maxInputFrames;
+	unsigned int tapsPerPhase;
+	unsigned int historyStride;
+	ResamplerQuality quality;
+	bool upsample;
+};
+
+#endif /* __IntegerResampler_H_INCLUDED__ */
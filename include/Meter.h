@@ -0,0 +1,154 @@
+/***** Meter.h *****/
+#ifndef __Meter_H_INCLUDED__
+#define __Meter_H_INCLUDED__
+
+#include <Bela.h>
+#include <BiquadCascade.h>
+#include <atomic>
+#include <vector>
+
+/// The maximum number of channels a Meter can have
+#define kMaxMeterChannels 32
+/// The loudness reported for silence, in LUFS
+#define kMeterMinLoudness -120.f
+
+/**
+ * The levels of one channel, over the last update interval of a Meter.
+ */
+struct MeterReading {
+	float peak; ///< the largest absolute sample value, linear
+	float rms; ///< the RMS value over the RMS window, linear
+	float truePeak; ///< the largest absolute value of the signal oversampled 4 times, linear
+	float loudness; ///< the short-term (3 seconds) loudness, in LUFS
+};
+
+/**
+ * The levels of all channels, as published by a Meter.
+ */
+struct MeterSnapshot {
+	uint64_t frame; ///< the number of frames metered when the snapshot was taken
+	unsigned int numChannels; ///< the number of valid entries in `channels`
+	MeterReading channels[kMaxMeterChannels];
+};
+
+/**
+ * Multi-channel level meter: sample peak, RMS, true peak and short-term
+ * loudness (ITU-R BS.1770 K-weighting, ungated, per channel).
+ *
+ * process() is called from render() with each block of audio. It keeps a
+ * few per-channel accumulators and every update interval (0.1s by default)
+ * it publishes a MeterSnapshot, which any thread can read with
+ * getSnapshot() without locking: the snapshot is protected by a sequence
+ * counter, so that the audio thread never waits for a reader.
+ *
+ * Each block is first copied into an interleaved buffer, padded to a
+ * multiple of `kLanes` channels, after the last samples of the previous
+ * block. The peak, sum of squares and true-peak interpolation then update
+ * `kLanes` channels at a time, reading one frame of the buffer per step,
+ * which the compiler turns into vector instructions. The K-weighting filter
+ * runs on a copy of the same buffer.
+ *
+ * All the memory is allocated in setup().
+ */
+class Meter {
+public:
+	static const unsigned int kLanes = 8;
+	static const unsigned int kTruePeakTaps = 12; // per phase of the 4x interpolator
+
+	Meter();
+
+	/**
+	 * Allocate the memory for the meter.
+	 *
+	 * @param numChannels the number of channels, at most kMaxMeterChannels.
+	 * @param sampleRate the sample rate.
+	 * @param maxFrames the maximum number of frames passed to process() at a time.
+	 * @param interval the interval between snapshots, in seconds.
+	 * @param enableTruePeak whether to compute the true peak. This is the most
+	 * expensive part of the meter: if it is false, `truePeak` is the sample peak.
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	int setup(unsigned int numChannels, float sampleRate, unsigned int maxFrames,
+			float interval = 0.1, bool enableTruePeak = true);
+
+	/**
+	 * Meter a block of samples. Call this from render().
+	 *
+	 * @param buffer the samples: sample `n` of channel `c` is at
+	 * `buffer[c * channelStride + n * frameStride]`.
+	 * @param frames the number of frames.
+	 * @param channelStride the distance between channels.
+	 * @param frameStride the distance between frames.
+	 */
+	void process(const float* buffer, unsigned int frames, unsigned int channelStride, unsigned int frameStride);
+
+	/**
+	 * Meter the first getNumChannels() audio inputs of the context.
+	 */
+	void processAudioIn(BelaContext* context);
+
+	/**
+	 * Meter the first getNumChannels() audio outputs of the context.
+	 * Call this at the end of render().
+	 */
+	void processAudioOut(BelaContext* context);
+
+	/**
+	 * Get the latest snapshot. This can be called from any thread.
+	 *
+	 * @param snapshot where to copy the snapshot.
+	 *
+	 * @return the number of snapshots published so far, 0 if there is none yet.
+	 */
+	unsigned int getSnapshot(MeterSnapshot& snapshot);
+
+	/**
+	 * Get the number of snapshots published so far.
+	 */
+	unsigned int getNumSnapshots() { return sequence.load(std::memory_order_acquire) / 2; }
+
+	/**
+	 * Clear all the accumulated levels.
+	 */
+	void reset();
+
+	unsigned int getNumChannels() { return numChannels; }
+
+	/**
+	 * Convert a linear level to dBFS, with a floor at kMeterMinLoudness.
+	 */
+	static float toDb(float linear);
+
+private:
+	void processChunk(const float* buffer, unsigned int frames, unsigned int channelStride, unsigned int frameStride);
+	void publish();
+
+	unsigned int numChannels;
+	unsigned int paddedChannels;
+	unsigned int maxFrames;
+	bool truePeakEnabled;
+	std::vector<float> input; // [kTruePeakTaps - 1 + maxFrames][paddedChannels], the first frames are history
+	std::vector<float> weighted; // [maxFrames][paddedChannels]
+	BiquadCascade<float> kWeighting;
+	float truePeakCoefficients[3][kTruePeakTaps];
+	// accumulated over the current update interval
+	std::vector<float> peak;
+	std::vector<float> truePeak;
+	std::vector<float> sum;
+	std::vector<float> weightedSum;
+	// one entry per update interval, [slot][channel]
+	std::vector<double> sumSlots;
+	std::vector<double> weightedSumSlots;
+	unsigned int numSlots; // for the short-term loudness
+	unsigned int rmsSlots;
+	unsigned int slot;
+	unsigned int filledSlots;
+	unsigned int slotFrames;
+	unsigned int slotCount;
+	uint64_t frameCount;
+	std::atomic<unsigned int> sequence;
+	MeterSnapshot snapshot;
+};
+
+#endif /* __Meter_H_INCLUDED__ */
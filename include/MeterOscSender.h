@@ -0,0 +1,56 @@
+/***** MeterOscSender.h *****/
+#ifndef __MeterOscSender_H_INCLUDED__
+#define __MeterOscSender_H_INCLUDED__
+
+#include <Meter.h>
+#include <OSCClient.h>
+#include <AuxTaskNonRT.h>
+#include <string>
+
+/**
+ * Send the snapshots of a Meter over OSC.
+ *
+ * Each snapshot is sent as four messages, `<path>/peak`, `<path>/rms`,
+ * `<path>/truepeak` (in dBFS) and `<path>/loudness` (in LUFS), with one float
+ * argument per channel.
+ *
+ * The messages are built and sent by a non-real-time thread, which
+ * reads the snapshots from the Meter: the audio thread only wakes it up.
+ */
+class MeterOscSender {
+public:
+	MeterOscSender();
+
+	/**
+	 * @param meter the meter to read from.
+	 * @param port the port to send to.
+	 * @param address the IP address to send to.
+	 * @param path the prefix of the OSC addresses.
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	int setup(Meter* meter, int port, const char* address = "127.0.0.1", const char* path = "/bela/meter");
+
+	/**
+	 * Call this from render() after Meter::process(): if the meter
+	 * published a new snapshot, it gets sent.
+	 */
+	void update();
+
+private:
+	static void sendLoop(void* arg);
+	void send();
+
+	Meter* meter;
+	OSCClient client;
+	AuxTaskNonRT task;
+	std::string taskName;
+	std::string peakPath;
+	std::string rmsPath;
+	std::string truePeakPath;
+	std::string loudnessPath;
+	unsigned int lastSnapshot;
+	MeterSnapshot snapshot;
+};
+
+#endif /* __MeterOscSender_H_INCLUDED__ */
@@ -0,0 +1,160 @@
+/***** MultiplexerCapture.h *****/
+#ifndef __MultiplexerCapture_H_INCLUDED__
+#define __MultiplexerCapture_H_INCLUDED__
+
+#include <Bela.h>
+#include <atomic>
+
+/**
+ * How MultiplexerCapture relates the samples of a cycle to time.
+ */
+enum MultiplexerCaptureMode {
+	/// Each sample as it was read: the sample of multiplexer channel `m`
+	/// was read `m` frames after the time of its cycle (see getSampleTime()).
+	kMultiplexerCaptureRaw,
+	/// All the samples of a cycle are held until the end of the cycle:
+	/// the values are those of the raw mode, and they are all valid at
+	/// `time + multiplexerChannels - 1`.
+	kMultiplexerCaptureSampleAndHold,
+	/// All the samples of a cycle are linearly interpolated (from the
+	/// previous cycle) to the time of the cycle, so that all the inputs are
+	/// aligned on a uniform grid.
+	kMultiplexerCaptureInterpolated,
+};
+
+/**
+ * Capture every sample of the multiplexer capelet, with its time.
+ *
+ * context->multiplexerAnalogIn only holds the most recent value of each
+ * input. MultiplexerCapture goes through all the analog frames of each block
+ * instead, and stores every complete multiplexer cycle in a ring buffer. A cycle starts
+ * on the frame where multiplexer channel 0 is read and holds one value for each of
+ * the `multiplexerChannels * analogInChannels` inputs, in the same layout as
+ * context->multiplexerAnalogIn (input `m * analogInChannels + c` is channel `c` of
+ * multiplexer channel `m`), together with the time of its first frame.
+ * Times are expressed in analog frames since the audio started.
+ *
+ * The reader gets pointers into the ring buffer, so no data is copied
+ * after demultiplexing. The stream of a single input is found at a fixed offset
+ * in each cycle, with a stride of getCycleSize() floats.
+ * The ring buffer can be read from another thread (e.g.: one writing to disk),
+ * as long as there is only one reader. If the reader falls behind, the
+ * new cycles are dropped and counted by getOverruns().
+ *
+ * Cycles that are interrupted by a dropped block are discarded, so the cycles
+ * in the buffer are always complete, but there may be gaps in their times.
+ *
+ * The analog inputs must not be resampled to the audio rate
+ * (uniformSampleRate), as the multiplexer channel changes every analog frame.
+ */
+class MultiplexerCapture {
+public:
+	MultiplexerCapture();
+	~MultiplexerCapture();
+
+	/**
+	 * Allocate the ring buffer.
+	 *
+	 * @param context the BelaContext
+	 * @param length the number of cycles in the ring buffer.
+	 * @param mode how the samples relate to the time of the cycle.
+	 *
+	 * @return 0 on success, or a negative value if the multiplexer capelet is
+	 * not enabled or the allocation failed.
+	 */
+	int setup(BelaContext* context, unsigned int length, MultiplexerCaptureMode mode = kMultiplexerCaptureRaw);
+
+	/**
+	 * Demultiplex the analog frames of the current block.
+	 *
+	 * Call this once per block, from render().
+	 */
+	void process(BelaContext* context);
+
+	/**
+	 * Get the number of complete cycles that have not been consumed yet.
+	 */
+	unsigned int getAvailable();
+
+	/**
+	 * Get the values of a cycle that has not been consumed yet.
+	 *
+	 * @param n the index of the cycle, from 0 (the oldest) to getAvailable() - 1
+	 * @param time if not NULL, set to the time of the cycle.
+	 *
+	 * @return a pointer to getCycleSize() values, which remains valid until
+	 * the cycle is consumed.
+	 */
+	const float* getCycle(unsigned int n, uint64_t* time = NULL);
+
+	/**
+	 * Get the oldest cycles as at most two contiguous regions of the ring
+	 * buffer, in order to process several cycles at once without copying.
+	 *
+	 * @param first set to the first region.
+	 * @param firstCycles set to the number of cycles in the first region.
+	 * @param second set to the second region, which starts at the beginning of the buffer.
+	 * @param secondCycles set to the number of cycles in the second region (0 if there is none).
+	 */
+	void getRegions(const float** first, unsigned int* firstCycles, const float** second, unsigned int* secondCycles);
+
+	/**
+	 * Release the oldest cycles, so that the space can be reused.
+	 */
+	void consume(unsigned int cycles);
+
+	/**
+	 * Get the time at which an input was sampled, given the time of its cycle.
+	 */
+	uint64_t getSampleTime(uint64_t cycleTime, unsigned int input) {
+		if(mode == kMultiplexerCaptureRaw)
+			return cycleTime + input / analogInChannels;
+		if(mode == kMultiplexerCaptureSampleAndHold)
+			return cycleTime + multiplexerChannels - 1;
+		return cycleTime;
+	}
+
+	/**
+	 * Get the number of values in each cycle (multiplexerChannels * analogInChannels).
+	 */
+	unsigned int getCycleSize() { return cycleSize; }
+
+	/**
+	 * Get the number of cycles that were dropped because the ring buffer was full.
+	 */
+	unsigned int getOverruns() { return overruns; }
+
+	/**
+	 * Get the number of cycles that were discarded because they were incomplete.
+	 */
+	unsigned int getDiscontinuities() { return discontinuities; }
+
+	/**
+	 * Free the ring buffer.
+	 */
+	void cleanup();
+
+private:
+	void startCycle(uint64_t time);
+	void endCycle();
+	float* buffer; // length cycles of cycleSize values
+	uint64_t* times;
+	float* raw[2]; // the current and previous raw cycles, for interpolation
+	float* weights; // interpolation weight of each input
+	unsigned int length;
+	unsigned int cycleSize;
+	unsigned int analogInChannels;
+	unsigned int multiplexerChannels;
+	MultiplexerCaptureMode mode;
+	std::atomic<uint64_t> written;
+	std::atomic<uint64_t> read;
+	float* current; // where the cycle being demultiplexed goes, or NULL
+	uint64_t currentTime;
+	unsigned int nextChannel; // the next multiplexer channel expected
+	uint64_t nextFrame; // the frame at which it is expected
+	bool hasPrevious; // whether raw[1] holds the previous cycle
+	unsigned int overruns;
+	unsigned int discontinuities;
+};
+
+#endif /* __MultiplexerCapture_H_INCLUDED__ */
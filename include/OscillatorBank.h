@@ -20,11 +20,13 @@ http://www.eecs.qmul.ac.uk/~andrewm
 The Bela software is distributed under the GNU Lesser General Public License
 (LGPL 3.0), available here: https://www.gnu.org/licenses/lgpl-3.0.txt
 */
+#ifndef OSCILLATORBANK_H_
+#define OSCILLATORBANK_H_
 #include <string.h> 
 #include <stdio.h>
 #include <stdlib.h>
-#include <ne10/NE10.h>
 
+#ifdef __ARM_NEON__
 extern "C" {
 	// Function prototype for ARM assembly implementation of oscillator bank
 	void oscillator_bank_neon(int numAudioFrames, float *audioOut,
@@ -33,30 +35,76 @@ extern "C" {
 							  float *freqDerivatives, float *ampDerivatives,
 							  float *lookupTable);
 }
+#endif /* __ARM_NEON__ */
+
+/**
+ * Portable implementation of oscillator_bank_neon(), with the same
+ * arguments and the same alignment requirements. It uses SSE2 where
+ * available and plain C++ otherwise.
+ *
+ * `activePartialNum` must be a multiple of 4 and `lookupTableSize` a power of 2.
+ */
+void oscillator_bank_portable(int numAudioFrames, float *audioOut,
+		int activePartialNum, int lookupTableSize,
+		float *phases, float *frequencies, float *amplitudes,
+		float *freqDerivatives, float *ampDerivatives,
+		float *lookupTable);
+
+/**
+ * Interpolation used when reading from the wavetable.
+ */
+typedef enum {
+	kOscillatorBankLinear, ///< linear interpolation between adjacent samples
+	kOscillatorBankCubic, ///< 4-point, 3rd-order Hermite interpolation
+} OscillatorBankInterpolation;
 
 /**
  * A class for computing a table-lookup oscillator bank.
- * The internal routine is highly optimized, written in NEON assembly.
+ * The internal routine is highly optimized, written in NEON assembly
+ * on ARM, with a portable fallback on other architectures.
+ *
+ * Before each block, the oscillators which are silent (zero amplitude
+ * and zero amplitude derivative) are left out of the inner loop: the active ones
+ * are compacted into dense arrays, and only the phase and frequency of the
+ * silent ones is advanced.
+ *
+ * Optionally, band-limited copies of the wavetable (one per octave) can be
+ * generated with generateMipmaps(), so that each oscillator reads from a
+ * table that does not alias at its frequency. The mipmaps are read by a
+ * vectorised C++ routine rather than the NEON assembly: it gathers the
+ * samples of the 4 oscillators of each group from 4 different tables, which
+ * makes it slower than the single-table routine, more so when most of the
+ * oscillators are active and with cubic interpolation. The "oscillators"
+ * benchmark of the dsp-benchmarks project measures both.
  */
 class OscillatorBank{
 public:
 	OscillatorBank():
 	sampleRate(1),
+	numOscillators(0),
+	paddedOscillators(0),
+	numActive(0),
+	compacted(false),
 	wavetable(NULL),
 	phases(NULL),
 	frequencies(NULL),
 	amplitudes(NULL),
 	dFrequencies(NULL),
-	dAmplitudes(NULL)
+	dAmplitudes(NULL),
+	activeIndices(NULL),
+	activePhases(NULL),
+	activeFrequencies(NULL),
+	activeAmplitudes(NULL),
+	activeDFrequencies(NULL),
+	activeDAmplitudes(NULL),
+	mipmaps(NULL),
+	tableOffsets(NULL),
+	numMipmaps(0),
+	interpolation(kOscillatorBankLinear)
 	{}
 
 	~OscillatorBank(){
-		free(wavetable);
-		free(phases);
-		free(frequencies);
-		free(amplitudes);
-		free(dFrequencies);
-		free(dAmplitudes);
+		dealloc();
 	}
 
 	/**
@@ -64,7 +112,7 @@ public:
 	 * with the appropriate alignment required by the NEON code.
 	 * 
 	 * @param newWavetableLength the length of the wavetable. The internal wavetable 
-	 * will have length *(newWavetableLength + 1)*.
+	 * will have length *(newWavetableLength + 1)*. It must be a power of 2.
 	 * @param newNumOscillators the number of oscillators to use. The class will internally
 	 * increment and store the frequency, amplitude and phase of each oscillator.
 	 * @param newSampleRate the sampling rate of the output samples. This affects the
@@ -72,40 +120,7 @@ public:
 	 * 
 	 * @return 0 upon success, a negative value otherwise.
 	 */
-	int init(int newWavetableLength, int newNumOscillators, float newSampleRate){
-		wavetableLength = newWavetableLength;
-		numOscillators = newNumOscillators;
-		sampleRate = newSampleRate;
-		// Initialise the sine wavetable
-		if(posix_memalign((void **)&wavetable, 8, (wavetableLength + 1) * sizeof(float))) {
-			fprintf(stderr, "Error allocating wavetable\n");
-			return -1;
-		}
-
-		// Allocate the other buffers
-		if(posix_memalign((void **)&phases, 16, numOscillators * sizeof(float))) {
-			fprintf(stderr, "Error allocating phase buffer\n");
-			return -1;
-		}
-		if(posix_memalign((void **)&frequencies, 16, numOscillators * sizeof(float))) {
-			fprintf(stderr, "Error allocating frequency buffer\n");
-			return -1;
-		}
-		if(posix_memalign((void **)&amplitudes, 16, numOscillators * sizeof(float))) {
-			fprintf(stderr, "Error allocating amplitude buffer\n");
-			return -1;
-		}
-		if(posix_memalign((void **)&dFrequencies, 16, numOscillators * sizeof(float))) {
-			fprintf(stderr, "Error allocating frequency derivative buffer\n");
-			return -1;
-		}
-		if(posix_memalign((void **)&dAmplitudes, 16, numOscillators * sizeof(float))) {
-			fprintf(stderr, "Error allocating amplitude derivative buffer\n");
-			return -1;
-		}
-		clearArrays();
-			return 0;
-	}
+	int init(int newWavetableLength, int newNumOscillators, float newSampleRate);
 
 	/**
 	 * Get the wavetable. It is the responsibilty of the user to 
@@ -119,6 +134,41 @@ public:
 		return wavetable;	
 	}
 	
+	/**
+	 * Generate band-limited versions of the wavetable.
+	 *
+	 * Call this after filling the wavetable (and every time it is changed).
+	 * Mipmap `k` contains only the harmonics that do not alias for
+	 * oscillators up to `2^k` wavetable samples per output sample, and each
+	 * oscillator reads from the lowest mipmap suitable for its frequency at
+	 * the beginning of each block.
+	 * This allocates memory and is computationally expensive: it should
+	 * not be called from the audio thread.
+	 *
+	 * @param maxMipmaps the maximum number of mipmaps to generate. If 0,
+	 * mipmaps are generated down to a table containing only the fundamental.
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	int generateMipmaps(int maxMipmaps = 0);
+
+	/**
+	 * Stop using the band-limited tables and use the wavetable for all
+	 * oscillators.
+	 */
+	void disableMipmaps();
+
+	/**
+	 * Set the interpolation used when reading from the wavetable.
+	 *
+	 * Cubic interpolation reads from the mipmaps, so it is only used after
+	 * generateMipmaps() has been called (use `generateMipmaps(1)` to get cubic
+	 * interpolation on the full-band wavetable only).
+	 */
+	void setInterpolation(OscillatorBankInterpolation newInterpolation){
+		interpolation = newInterpolation;
+	}
+
 	/**
 	 * Get the length of the wavetable. The internally allocated array 
 	 * is actually of size `getWavetableLength() + 1`.
@@ -184,9 +234,9 @@ public:
 	 * oscillator bank.
 	 */
 	void clearArrays(){
-		memset(phases, 0, sizeof(float)*numOscillators);
-		memset(dFrequencies, 0, sizeof(float)*numOscillators);
-		memset(dAmplitudes, 0, sizeof(float)*numOscillators);
+		memset(phases, 0, sizeof(float)*paddedOscillators);
+		memset(dFrequencies, 0, sizeof(float)*paddedOscillators);
+		memset(dAmplitudes, 0, sizeof(float)*paddedOscillators);
 	}
 
 	/**
@@ -199,16 +249,57 @@ public:
 	void process(int frames, float* output){
 		// Initialise buffer to 0
 		memset(output, 0, frames * sizeof(float));
-		oscillator_bank_neon(frames, output,
-				numOscillators, wavetableLength,
-				phases, frequencies, amplitudes,
-				dFrequencies, dAmplitudes,
-				wavetable);
+		int active = prepare(frames);
+		processChunk(frames, output, 0, active);
+		finish();
 	}
-	
+
+	/**
+	 * \name Chunked processing
+	 *
+	 * process() is equivalent to calling prepare(), then processChunk()
+	 * on the whole active set, then finish(). Large banks can instead be
+	 * split into several chunks, which can be processed concurrently
+	 * from different threads, each into its own output buffer, as long as
+	 * all of them complete before finish() is called.
+	 *
+	 * @{
+	 */
+
+	/**
+	 * Compact the active oscillators and advance the silent ones.
+	 *
+	 * @param frames the number of frames that will be processed.
+	 * @return the number of active oscillators to pass to processChunk(),
+	 * rounded up to a multiple of 4.
+	 */
+	int prepare(int frames);
+
+	/**
+	 * Process a range of the active oscillators, accumulating into `output`.
+	 *
+	 * @param frames the number of frames to process.
+	 * @param output the buffer where the output is added.
+	 * @param begin the first active oscillator to process. Must be a multiple of 4.
+	 * @param end one past the last active oscillator to process. Must be a multiple of 4.
+	 */
+	void processChunk(int frames, float* output, int begin, int end);
+
+	/**
+	 * Store back the state of the active oscillators.
+	 */
+	void finish();
+
+	/** @} */
+
 private:
+	void dealloc();
+	void computeTableOffsets(const float* freqs, int count);
 	float sampleRate;
 	int numOscillators;
+	int paddedOscillators;	// numOscillators rounded up to a multiple of 4
+	int numActive;
+	bool compacted;		// whether the current block uses the active* arrays
 	int wavetableLength;
 	float *wavetable;		// Buffer holding the precalculated sine lookup table
 	float *phases;			// Buffer holding the phase of each oscillator
@@ -216,4 +307,16 @@ private:
 	float *amplitudes;		// Buffer holding the amplitudes of each oscillator
 	float *dFrequencies;	// Buffer holding the derivatives of frequency
 	float *dAmplitudes;	// Buffer holding the derivatives of amplitude
+	int *activeIndices;		// Index of each of the compacted oscillators
+	float *activePhases;	// Compacted copies of the above, for the active oscillators
+	float *activeFrequencies;
+	float *activeAmplitudes;
+	float *activeDFrequencies;
+	float *activeDAmplitudes;
+	float *mipmaps;		// numMipmaps tables of (wavetableLength + 3) samples, with guard points for the interpolation
+	int *tableOffsets;		// Offset in mipmaps of the table used by each oscillator in the current block
+	int numMipmaps;
+	OscillatorBankInterpolation interpolation;
 };
+
+#endif /* OSCILLATORBANK_H_ */
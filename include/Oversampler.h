@@ -0,0 +1,152 @@
+/***** Oversampler.h *****/
+#ifndef __Oversampler_H_INCLUDED__
+#define __Oversampler_H_INCLUDED__
+
+#include <vector>
+
+/**
+ * The half-band filters used by Oversampler.
+ */
+typedef enum {
+	kOversamplerFir, ///< linear-phase FIRs: the output is a delayed copy of the input
+	kOversamplerIir, ///< polyphase allpass IIRs: cheaper and with a lower latency, but not linear-phase
+} OversamplerFilter;
+
+/**
+ * An oversampling stage for non-linear processing (saturation, wave folding...),
+ * which would otherwise alias.
+ *
+ * Each block of each channel is upsampled by 2, 4 or 8, processed at the
+ * higher rate, and downsampled back. The resampling is done by a cascade of
+ * 2x stages, each made of a half-band low-pass filter split into its two
+ * polyphase components, so that each stage only computes the samples it
+ * keeps. The first stage, next to the original rate, has the sharpest filter;
+ * the stages at the higher rates only have to reject the images of the
+ * original band, and use much shorter filters.
+ *
+ * With kOversamplerFir, every other coefficient of a half-band FIR is 0, except
+ * for the central one, so that only one of the polyphase components is a real
+ * filter. It is computed one tap at a time over the whole block, a loop over
+ * contiguous memory that the compiler vectorises. With kOversamplerIir, each
+ * polyphase component is a chain of first-order allpass filters: these are
+ * recursive, so each sample depends on the previous one, and the two chains
+ * are computed side by side in the lanes of a NEON (or SSE) register.
+ *
+ * Each channel has its own state, but the buffers of the intermediate
+ * stages are shared by all the channels: an Oversampler must only be used
+ * by one thread at a time. Use one Oversampler per thread to process
+ * channels in parallel. All the memory is allocated in setup(): process(),
+ * upsample() and downsample() can be called from the audio thread.
+ */
+class Oversampler {
+public:
+	/// the largest number of 2x stages, for a factor of 8
+	static const unsigned int kMaxStages = 3;
+
+	Oversampler();
+
+	/**
+	 * Allocate the memory for the oversampler.
+	 *
+	 * @param numChannels the number of channels.
+	 * @param factor the oversampling factor: 1, 2, 4 or 8.
+	 * @param maxFrames the largest number of frames that will be processed
+	 * at a time, at the original rate.
+	 * @param filter the type of the half-band filters.
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	int setup(unsigned int numChannels, unsigned int factor, unsigned int maxFrames,
+			OversamplerFilter filter = kOversamplerFir);
+
+	/**
+	 * Upsample, process and downsample a block of one channel.
+	 *
+	 * @param channel the channel.
+	 * @param in the input, at the original rate.
+	 * @param out the output, at the original rate. This can be the same as `in`.
+	 * @param frames the number of frames of `in` and `out`, at most the
+	 * `maxFrames` passed to setup().
+	 * @param function what to do at the higher rate: it is called as
+	 * `function(samples, frames * getFactor())` and it processes `samples` in
+	 * place, e.g.: a lambda.
+	 */
+	template <typename Function>
+	void process(unsigned int channel, const float* in, float* out, unsigned int frames, Function function)
+	{
+		float* samples = upsample(channel, in, frames);
+		if(!samples)
+			return;
+		function(samples, frames * factor);
+		downsample(channel, samples, out, frames);
+	}
+
+	/**
+	 * Upsample a block of one channel.
+	 *
+	 * @param channel the channel.
+	 * @param in the input, at the original rate.
+	 * @param frames the number of frames of `in`, at most the `maxFrames`
+	 * passed to setup().
+	 *
+	 * @return a buffer of `frames * getFactor()` samples, which belongs to
+	 * the channel and can be processed in place and passed to downsample(),
+	 * or NULL on error.
+	 */
+	float* upsample(unsigned int channel, const float* in, unsigned int frames);
+
+	/**
+	 * Downsample a block of one channel.
+	 *
+	 * @param channel the channel.
+	 * @param in the input, `frames * getFactor()` samples at the higher rate.
+	 * @param out the output, at the original rate.
+	 * @param frames the number of frames of `out`, at most the `maxFrames`
+	 * passed to setup().
+	 */
+	void downsample(unsigned int channel, const float* in, float* out, unsigned int frames);
+
+	/**
+	 * Get the delay introduced by upsampling and then downsampling, in
+	 * frames at the original rate. For kOversamplerIir this is the delay
+	 * at low frequencies, as the delay varies with frequency.
+	 */
+	float getLatency() { return latency; }
+
+	unsigned int getFactor() { return factor; }
+	unsigned int getNumChannels() { return numChannels; }
+	OversamplerFilter getFilter() { return filter; }
+
+	/**
+	 * Clear the state of all channels.
+	 */
+	void reset();
+
+private:
+	struct Stage {
+		unsigned int halfTaps; // kOversamplerFir: half the number of coefficients of the filtering polyphase component
+		std::vector<float> coefficients; // kOversamplerFir: that component, kOversamplerIir: the allpass coefficients
+		unsigned int upState; // the offset of the state of the upsampler in the state of a channel
+		unsigned int downState; // the same for the downsampler
+	};
+	void upsampleFir(Stage& stage, float* state, const float* in, unsigned int frames, float* out);
+	void downsampleFir(Stage& stage, float* state, const float* in, unsigned int frames, float* out);
+	void upsampleIir(Stage& stage, float* state, const float* in, unsigned int frames, float* out);
+	void downsampleIir(Stage& stage, float* state, const float* in, unsigned int frames, float* out);
+
+	Stage stages[kMaxStages];
+	unsigned int numStages;
+	unsigned int numChannels;
+	unsigned int factor;
+	unsigned int maxFrames;
+	OversamplerFilter filter;
+	float latency;
+	unsigned int stateSize; // per channel
+	std::vector<float> state; // [channel][stateSize]
+	std::vector<float> oversampled; // [channel][maxFrames * factor]
+	std::vector<float> stageBuffer; // [2][maxFrames * factor], the outputs of the intermediate stages
+	std::vector<float> work; // input and history of a stage
+	std::vector<float> scratch; // the accumulator of the FIR stages
+};
+
+#endif /* __Oversampler_H_INCLUDED__ */
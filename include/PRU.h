@@ -12,6 +12,7 @@
 #include "Bela.h"
 #include "Gpio.h"
 #include "AudioCodec.h"
+#include "AnalogConversion.h"
 
 /**
  * Internal version of the BelaContext struct which does not have const
@@ -179,6 +180,9 @@ public:
 	// Exit the whole PRU subsystem
 	void exitPRUSS();
 
+	// The smoothing applied to the analog outputs
+	AnalogOutSmoothing* getAnalogOutSmoothing() { return &analog_out_smoothing; }
+
 private:
 	void initialisePruCommon();
 	int testPruError();
@@ -204,6 +208,7 @@ private:
 	float *audio_expander_input_history;
 	float *audio_expander_output_history;
 	float audio_expander_filter_coeff;
+	AnalogOutSmoothing analog_out_smoothing;
 	bool pruUsesMcaspIrq;
 	BelaHw belaHw;
 
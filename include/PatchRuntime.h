@@ -0,0 +1,350 @@
+/***** PatchRuntime.h *****/
+#ifndef __PatchRuntime_H_INCLUDED__
+#define __PatchRuntime_H_INCLUDED__
+
+#include <Bela.h>
+#include <Midi.h>
+#include <Scope.h>
+#include <DigitalChannelManager.h>
+#include <IntegerResampler.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+/// The maximum number of MIDI messages queued in each block
+#define kMaxPatchMidiEvents 256
+/// The number of scope channels when the engine can have as many channels as needed
+#define kPatchDefaultScopeChannels 4
+
+/**
+ * A MIDI message received by PatchRuntime.
+ */
+struct PatchMidiEvent {
+	uint64_t frame; ///< the audio frame at which the engine should handle the message (see PatchRuntime::processMidiInput())
+	unsigned int port; ///< the port it was received on
+	MidiChannelMessage message; ///< the message
+};
+
+/**
+ * The parts of the wrappers around embedded patch engines (libpd, Heavy,
+ * Csound) that do not depend on the engine.
+ *
+ * The engine sees the Bela I/O as a single set of channels, in this order:
+ * - the audio channels, starting from 0;
+ * - the analog channels, starting from getFirstAnalogChannel();
+ * - the digital channels, starting from getFirstDigitalChannel() (at least
+ *   10, for backwards compatibility), at signal rate;
+ * - the scope channels (outputs only), starting from getFirstScopeChannel().
+ *
+ * processInputs() and processOutputs() move a block of all these channels
+ * between the BelaContext and the engine's non-interleaved buffers, resampling the
+ * analog channels to the audio rate if needed and unpacking/packing the
+ * digital bits in the same call. They also take care of the digital channels
+ * managed at message rate, and of the scope. processInputs() reads the
+ * inputs in a single pass over the frames: the audio and analog samples of
+ * each group of frames are copied, and the digital words of the group are
+ * unpacked and checked for changes, before moving to the next group.
+ *
+ * The runtime also owns the MIDI ports: the messages received on all
+ * ports are stamped with the time they arrive at, and collected by
+ * processMidiInput() into a queue, sorted by the frame at which they should
+ * be handled, which the engine then dispatches as it wants.
+ *
+ * The context must not be interleaved (see Bela_userSettings()).
+ */
+class PatchRuntime {
+public:
+	/**
+	 * A function called when a digital input managed at message rate changes.
+	 *
+	 * @param receiverName the name of the receiver for the channel, e.g.: "bela_digitalIn11"
+	 * @param value the new value of the input
+	 * @param arg the argument passed to setDigitalCallback()
+	 */
+	typedef void (*DigitalInputCallback)(const char* receiverName, float value, void* arg);
+
+	PatchRuntime();
+	~PatchRuntime();
+
+	/**
+	 * Compute the channel layout and allocate the buffers.
+	 *
+	 * @param context the context passed to setup().
+	 * @param blockSize the number of frames the engine processes at a time.
+	 * It must divide context->audioFrames.
+	 * @param numInputs the number of input channels of the engine, or -1 if
+	 * the engine can have as many as getNumInputs() returns.
+	 * @param numOutputs the number of output channels of the engine, or -1 if
+	 * the engine can have as many as getNumOutputs() returns. Any outputs
+	 * after getFirstScopeChannel() go to the scope.
+	 * @param analogBlocks whether processInputs() and processOutputs() move
+	 * the analog channels. An engine that only uses
+	 * processInterleavedInputs() and processInterleavedOutputs() passes
+	 * false: the analog channels are then not resampled, and any ratio
+	 * between the analog and the audio sample rates is supported.
+	 *
+	 * @return 0 on success, or a negative value on error.
+	 */
+	int setup(BelaContext* context, unsigned int blockSize, int numInputs = -1, int numOutputs = -1, bool analogBlocks = true);
+
+	unsigned int getBlockSize() { return blockSize; }
+	unsigned int getNumInputs() { return numInputs; }
+	unsigned int getNumOutputs() { return numOutputs; }
+	unsigned int getFirstAnalogChannel() { return firstAnalogChannel; }
+	unsigned int getFirstDigitalChannel() { return firstDigitalChannel; }
+	unsigned int getFirstScopeChannel() { return firstScopeChannel; }
+	unsigned int getNumScopeChannels() { return numScopeChannels; }
+	/**
+	 * Get the number the patch uses for digital channel 0, e.g.: in
+	 * "bela_digitalIn11" and in the messages to "bela_setDigital".
+	 */
+	unsigned int getDigitalChannelOffset() { return digitalChannelOffset; }
+	/**
+	 * Get the number of digital channels the engine sees at signal rate.
+	 */
+	unsigned int getNumSignalRateDigitalInputs() { return numDigitalSignalInputs; }
+	unsigned int getNumSignalRateDigitalOutputs() { return numDigitalSignalOutputs; }
+	const std::vector<std::string>& getDigitalInputNames() { return digitalInputNames; }
+	const std::vector<std::string>& getDigitalOutputNames() { return digitalOutputNames; }
+
+	/**
+	 * Move the inputs of one engine block from the context to the engine.
+	 *
+	 * @param context the context passed to render().
+	 * @param tick the index of the engine block within the Bela block.
+	 * @param in the engine's input buffers: channel `c` starts at `in + c * getBlockSize()`.
+	 */
+	void processInputs(BelaContext* context, unsigned int tick, float* in);
+
+	/**
+	 * Move the outputs of one engine block from the engine to the context
+	 * and the scope.
+	 *
+	 * @param context the context passed to render().
+	 * @param tick the index of the engine block within the Bela block.
+	 * @param out the engine's output buffers: channel `c` starts at `out + c * getBlockSize()`.
+	 */
+	void processOutputs(BelaContext* context, unsigned int tick, const float* out);
+
+	/**
+	 * Move the audio and analog inputs of some frames to an interleaved
+	 * engine buffer (e.g.: Csound's spin), scaling them on the way. The analog
+	 * inputs are sampled and held at the audio rate.
+	 *
+	 * @param context the context passed to render().
+	 * @param frame the first frame in the Bela block.
+	 * @param frames the number of frames.
+	 * @param in where to write the first frame.
+	 * @param channels the number of channels of the engine buffer.
+	 * @param scale the value of a full scale sample.
+	 */
+	template <typename T>
+	void processInterleavedInputs(BelaContext* context, unsigned int frame, unsigned int frames,
+			T* in, unsigned int channels, T scale);
+
+	/**
+	 * Move the audio and analog outputs of some frames from an interleaved
+	 * engine buffer (e.g.: Csound's spout), scaling them on the way. When the
+	 * analog outputs run slower than the audio, the last value for each analog
+	 * frame is kept.
+	 */
+	template <typename T>
+	void processInterleavedOutputs(BelaContext* context, unsigned int frame, unsigned int frames,
+			const T* out, unsigned int channels, T scale);
+
+	/**
+	 * Set the function called when a digital input managed at message rate changes.
+	 */
+	void setDigitalCallback(DigitalInputCallback callback, void* arg);
+
+	/**
+	 * Handle a "bela_setDigital" message.
+	 *
+	 * @param direction "in", "out" or "disable"
+	 * @param channel the channel, as numbered by the patch
+	 * @param rate "~" or "sig..." for signal rate, anything else (or NULL) for message rate
+	 */
+	void setDigital(const char* direction, int channel, const char* rate);
+
+	/**
+	 * Handle a float sent to a "bela_digitalOutXX" receiver.
+	 *
+	 * @return true if `receiverName` is one of them.
+	 */
+	bool setDigitalOutput(const char* receiverName, float value);
+
+	/**
+	 * Open a MIDI port, for input and output.
+	 *
+	 * @param name the name of the port, e.g.: "hw:1,0,0"
+	 * @param verbose whether to print success and errors.
+	 *
+	 * @return 0 on success, or a negative value on error.
+	 */
+	int openMidiPort(const std::string& name, bool verbose = false);
+
+	/**
+	 * Handle a "bela_setMidi" message: open the port `symbol:num0,num1,num2`
+	 * and print the list of ports.
+	 */
+	void addMidiPort(const char* symbol, int num0, int num1, int num2);
+
+	/**
+	 * Print the list of MIDI ports.
+	 */
+	void dumpMidi();
+
+	/**
+	 * Collect the MIDI messages received on all ports. Call this at the
+	 * start of render(), then read them with getMidiEvents().
+	 *
+	 * The messages received since the previous call are spread over the
+	 * current block, keeping their distances in time: each of them is late
+	 * by about one block, always by the same amount, instead of being
+	 * handled at the start of the block whenever it arrived. The
+	 * PatchMidiEvent::frame of the events is between
+	 * context->audioFramesElapsed and context->audioFramesElapsed +
+	 * context->audioFrames - 1, in ascending order.
+	 */
+	void processMidiInput(BelaContext* context);
+	unsigned int getNumMidiEvents() { return numMidiEvents; }
+	const PatchMidiEvent* getMidiEvents() { return midiEvents; }
+
+	/**
+	 * Get the port for a MIDI output channel numbered across all ports (16
+	 * channels per port), and turn the channel into the channel within that port.
+	 *
+	 * @return the port, or NULL if no port is open.
+	 */
+	Midi* getMidiOutputPort(int* channel);
+
+	/**
+	 * Get a MIDI port by number, or the first one if out of range.
+	 *
+	 * @return the port, or NULL if no port is open.
+	 */
+	Midi* getMidiPort(int port);
+
+	/**
+	 * Whether the patch should receive the multiplexer capelet inputs.
+	 */
+	bool isMultiplexerActive() { return multiplexerActive; }
+	unsigned int getMultiplexerArraySize() { return multiplexerArraySize; }
+	/**
+	 * Call this once per engine block: it returns true when the engine
+	 * should copy context->multiplexerAnalogIn into its array.
+	 */
+	bool isMultiplexerUpdateDue();
+
+	void setResamplingQuality(ResamplerQuality quality);
+
+	void cleanup();
+
+private:
+	// The messages received on a port, with the time at which they were
+	// received, in ns. Written by the MIDI input thread, read by
+	// processMidiInput().
+	struct MidiInputQueue {
+		uint64_t times[kMaxPatchMidiEvents];
+		MidiChannelMessage messages[kMaxPatchMidiEvents];
+		std::atomic<uint64_t> written;
+		std::atomic<uint64_t> read;
+	};
+	static void midiMessageReceived(MidiChannelMessage message, void* arg);
+	void reportDigitalChanges(uint16_t changed, uint16_t values);
+
+	unsigned int blockSize;
+	unsigned int numInputs;
+	unsigned int numOutputs;
+	unsigned int firstAnalogChannel;
+	unsigned int firstDigitalChannel;
+	unsigned int firstScopeChannel;
+	unsigned int numScopeChannels;
+	unsigned int digitalChannelOffset;
+	unsigned int numDigitalChannels;
+	unsigned int numDigitalSignalInputs;
+	unsigned int numDigitalSignalOutputs;
+	bool digitalEnabled;
+	std::vector<std::string> digitalInputNames;
+	std::vector<std::string> digitalOutputNames;
+	DigitalChannelManager dcm;
+	DigitalInputCallback digitalInputCallback;
+	void* digitalInputCallbackArg;
+	uint16_t lastDigitalInputs; // the input values of the last digital frame
+
+	unsigned int analogFramesPerBlock; // 0 if the analog channels are not moved by processInputs() and processOutputs()
+	bool analogResampling;
+	IntegerResampler analogInResampler;
+	IntegerResampler analogOutResampler;
+
+	Scope* scope;
+	std::vector<float> scopeFrame;
+
+	std::vector<Midi*> midi;
+	std::vector<std::string> midiPortNames;
+	std::vector<MidiInputQueue*> midiQueues;
+	uint64_t lastMidiInputTime; // when processMidiInput() last ran, in ns
+	PatchMidiEvent midiEvents[kMaxPatchMidiEvents];
+	unsigned int numMidiEvents;
+
+	bool multiplexerActive;
+	unsigned int multiplexerArraySize;
+	unsigned int multiplexerCounter;
+};
+
+template <typename T>
+void PatchRuntime::processInterleavedInputs(BelaContext* context, unsigned int frame, unsigned int frames,
+		T* in, unsigned int channels, T scale)
+{
+	unsigned int audioChannels = context->audioInChannels < channels ? context->audioInChannels : channels;
+	unsigned int analogChannels = 0;
+	if(channels > firstAnalogChannel && context->analogFrames)
+		analogChannels = channels - firstAnalogChannel < context->analogInChannels ? channels - firstAnalogChannel : context->analogInChannels;
+	for(unsigned int ch = 0; ch < audioChannels; ++ch)
+	{
+		const float* src = context->audioIn + ch * context->audioFrames + frame;
+		for(unsigned int n = 0; n < frames; ++n)
+			in[n * channels + ch] = src[n] * scale;
+	}
+	for(unsigned int ch = 0; ch < analogChannels; ++ch)
+	{
+		const float* src = context->analogIn + ch * context->analogFrames;
+		T* dst = in + firstAnalogChannel + ch;
+		for(unsigned int n = 0; n < frames; ++n)
+			dst[n * channels] = src[(frame + n) * context->analogFrames / context->audioFrames] * scale;
+	}
+}
+
+template <typename T>
+void PatchRuntime::processInterleavedOutputs(BelaContext* context, unsigned int frame, unsigned int frames,
+		const T* out, unsigned int channels, T scale)
+{
+	unsigned int audioChannels = context->audioOutChannels < channels ? context->audioOutChannels : channels;
+	unsigned int analogChannels = 0;
+	if(channels > firstAnalogChannel && context->analogFrames)
+		analogChannels = channels - firstAnalogChannel < context->analogOutChannels ? channels - firstAnalogChannel : context->analogOutChannels;
+	T inverseScale = 1 / scale;
+	for(unsigned int ch = 0; ch < audioChannels; ++ch)
+	{
+		float* dst = context->audioOut + ch * context->audioFrames + frame;
+		for(unsigned int n = 0; n < frames; ++n)
+			dst[n] = out[n * channels + ch] * inverseScale;
+	}
+	for(unsigned int ch = 0; ch < analogChannels; ++ch)
+	{
+		float* dst = context->analogOut + ch * context->analogFrames;
+		const T* src = out + firstAnalogChannel + ch;
+		for(unsigned int n = 0; n < frames; ++n)
+		{
+			// the analog frames that fall within this audio frame
+			unsigned int first = (frame + n) * context->analogFrames / context->audioFrames;
+			unsigned int last = (frame + n + 1) * context->analogFrames / context->audioFrames;
+			float value = src[n * channels] * inverseScale;
+			do
+				dst[first] = value;
+			while(++first < last);
+		}
+	}
+}
+
+#endif /* __PatchRuntime_H_INCLUDED__ */
@@ -0,0 +1,104 @@
+/***** Reblocker.h *****/
+#ifndef __Reblocker_H_INCLUDED__
+#define __Reblocker_H_INCLUDED__
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * Run an engine with a fixed block size under a Bela period of a different
+ * size, e.g.: Pd with 64-frame blocks under 2-frame periods.
+ *
+ * Each period, the input frames are appended to the engine's input block,
+ * and the engine is run every time the block is complete: that is, once
+ * every few periods when the period is shorter than the block, or one or
+ * more times per period otherwise. Its output goes into a FIFO, from which
+ * one period is read at the end of each period.
+ *
+ * For the FIFO never to run out, the output is delayed by getLatency() frames:
+ * `blockSize - gcd(blockSize, periodSize)`, the smallest delay that works
+ * for all periods. This is 0 when the period is a multiple of the block size.
+ *
+ * All the memory is allocated in setup() and process() only copies memory,
+ * so it can be called from the audio thread.
+ */
+class Reblocker {
+public:
+	/**
+	 * The function that processes one block.
+	 *
+	 * @param in the engine's input: channel `c` starts at `in + c * blockSize`.
+	 * @param out the engine's output: channel `c` starts at `out + c * blockSize`.
+	 * @param arg the argument passed to setup().
+	 */
+	typedef void (*ProcessCallback)(float* in, float* out, void* arg);
+
+	Reblocker();
+
+	/**
+	 * Allocate the memory.
+	 *
+	 * @param blockSize the number of frames the engine processes at a time.
+	 * @param periodSize the number of frames passed to process() each time.
+	 * @param numInputs the number of input channels of the engine.
+	 * @param numOutputs the number of output channels of the engine.
+	 * @param callback the function that processes one block.
+	 * @param arg an argument passed to the callback.
+	 * @param engineIn a buffer of `numInputs * blockSize` samples that the
+	 * engine reads its input from, or NULL to have it allocated here.
+	 * @param engineOut a buffer of `numOutputs * blockSize` samples that the
+	 * engine writes its output to, or NULL to have it allocated here.
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	int setup(unsigned int blockSize, unsigned int periodSize,
+			unsigned int numInputs, unsigned int numOutputs,
+			ProcessCallback callback, void* arg,
+			float* engineIn = NULL, float* engineOut = NULL);
+
+	/**
+	 * Process one period.
+	 *
+	 * @param in the input: channel `c` starts at `in + c * periodSize`.
+	 * @param out the output, delayed by getLatency() frames: channel `c`
+	 * starts at `out + c * periodSize`.
+	 */
+	void process(const float* in, float* out);
+
+	/**
+	 * Get the number of frames the output is delayed by, on top of
+	 * the latency of the engine itself.
+	 */
+	unsigned int getLatency() { return latency; }
+
+	/**
+	 * Get the latency added by running an engine with the given block
+	 * size under the given period size.
+	 */
+	static unsigned int computeLatency(unsigned int blockSize, unsigned int periodSize);
+
+	/**
+	 * Clear the partial input block and the pending output.
+	 */
+	void reset();
+
+private:
+	unsigned int blockSize;
+	unsigned int periodSize;
+	unsigned int numInputs;
+	unsigned int numOutputs;
+	ProcessCallback callback;
+	void* callbackArg;
+	std::vector<float> ownEngineIn;
+	std::vector<float> ownEngineOut;
+	float* engineIn;
+	float* engineOut;
+	unsigned int inputCount; // frames in the current input block
+	std::vector<float> fifo; // numOutputs rings of fifoMask + 1 samples
+	unsigned int fifoMask;
+	unsigned int fifoRead;
+	unsigned int fifoWrite;
+	unsigned int latency;
+};
+
+#endif /* __Reblocker_H_INCLUDED__ */
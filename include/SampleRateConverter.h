@@ -0,0 +1,199 @@
+/***** SampleRateConverter.h *****/
+#ifndef __SampleRateConverter_H_INCLUDED__
+#define __SampleRateConverter_H_INCLUDED__
+
+#include <vector>
+#include <stddef.h>
+
+/**
+ * Quality of the interpolation performed by SampleRateConverter. Higher
+ * qualities use longer filters, which cost more CPU and add more latency.
+ */
+typedef enum {
+	kSrcLinear, ///< linear interpolation: cheapest, with no anti-aliasing
+	kSrcFast, ///< 8-tap windowed sinc
+	kSrcMedium, ///< 16-tap windowed sinc
+	kSrcBest, ///< 32-tap windowed sinc
+} SampleRateConverterQuality;
+
+/**
+ * A streaming multi-channel sample rate converter, for an arbitrary and
+ * time-varying ratio, e.g.: to play a 48kHz file on a 44.1kHz device, or to
+ * change the playback speed of a sample.
+ *
+ * The ratio is the number of input frames consumed for each output frame:
+ * the rate of the input divided by that of the output, times the playback speed.
+ *
+ * Each output frame is a dot product between the input around its
+ * position and a windowed sinc, shifted by the fractional part of the position:
+ * - when the ratio is at most 1, the coefficients come from a polyphase
+ * filter bank with 128 phases, interpolating linearly between two phases.
+ * The coefficients of a phase are contiguous, so that this is vectorised.
+ * - when the ratio is larger than 1, the sinc is stretched by the ratio, so
+ * that its cutoff follows the output rate and the input is not aliased.
+ * The filter has `ratio` times more taps, whose coefficients are looked up
+ * in a finely sampled table of the sinc.
+ *
+ * The coefficients are computed once per output frame and shared by all the
+ * channels. The input history is stored one channel after the other, so that
+ * the dot products run on contiguous memory.
+ *
+ * Output frame `n` is always taken at input frame `n * ratio` (or at the
+ * sum of the ratios of the previous output frames, if the ratio changes),
+ * so that the output is aligned with the input. An output frame can only
+ * be generated once getLatency() input frames after it are available, which
+ * gives two ways of using the converter:
+ * - pull: to generate a given number of output frames, e.g.: in render(),
+ * call getInputFramesNeeded() and pass that many input frames to process().
+ * The latency is absorbed by reading ahead in the input.
+ * - push: pass blocks of input frames to process(), which generates as many
+ * output frames as it can. The last input frames are held back until more
+ * input arrives.
+ *
+ * All the memory is allocated in setup(), so that the other methods can be
+ * called from the audio thread.
+ */
+class SampleRateConverter {
+public:
+	SampleRateConverter();
+
+	/**
+	 * Allocate the memory for the converter.
+	 *
+	 * @param numChannels the number of channels.
+	 * @param maxInputFrames the number of input frames that the converter
+	 * can store. process() can be passed any number of frames, but it will
+	 * process them in chunks of at most this size.
+	 * @param ratio the initial ratio.
+	 * @param quality the quality.
+	 * @param maxRatio the largest ratio that will be used. The ratio can
+	 * then vary between 0 and maxRatio. If 0, `ratio` is used.
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	int setup(unsigned int numChannels, unsigned int maxInputFrames, double ratio,
+			SampleRateConverterQuality quality = kSrcMedium, double maxRatio = 0);
+
+	/**
+	 * Change the ratio.
+	 *
+	 * @param ratio the new ratio, which is clamped between 0 and the
+	 * `maxRatio` passed to setup().
+	 * @param rampFrames the number of output frames over which the ratio
+	 * moves linearly to the new value, e.g.: to avoid zipper noise when
+	 * scrubbing. If 0, it changes immediately.
+	 */
+	void setRatio(double ratio, unsigned int rampFrames = 0);
+
+	/**
+	 * Get the current ratio, which may be moving towards the one passed to setRatio().
+	 */
+	double getRatio() { return ratio; }
+
+	SampleRateConverterQuality getQuality() { return quality; }
+
+	unsigned int getNumChannels() { return numChannels; }
+
+	/**
+	 * Change the number of channels, e.g.: to play a different file.
+	 * This does not allocate memory and it can be called from the audio thread.
+	 * The converter is reset.
+	 *
+	 * @param numChannels the number of channels, at most the number passed to setup().
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	int setNumChannels(unsigned int numChannels);
+
+	/**
+	 * Get the number of input frames that have to be passed to process()
+	 * for it to generate `outputFrames` frames.
+	 */
+	unsigned int getInputFramesNeeded(unsigned int outputFrames);
+
+	/**
+	 * Get the largest value that getInputFramesNeeded() can return for
+	 * `outputFrames` at any ratio, e.g.: to allocate an input buffer.
+	 */
+	unsigned int getMaxInputFramesNeeded(unsigned int outputFrames);
+
+	/**
+	 * Get the largest number of output frames that process() can generate
+	 * from `inputFrames` frames at the current ratio.
+	 */
+	unsigned int getMaxOutputFrames(unsigned int inputFrames);
+
+	/**
+	 * Get the number of input frames that the converter waits for before
+	 * it generates an output frame, at the current ratio.
+	 */
+	unsigned int getLatency();
+
+	/**
+	 * Convert a block.
+	 *
+	 * @param in the interleaved input frames.
+	 * @param inputFrames the number of input frames.
+	 * @param out where to store the interleaved output frames.
+	 * @param outputFrames the maximum number of output frames to generate.
+	 * @param inputUsed if not NULL, this is set to the number of input frames
+	 * that were used. All of them are used, unless `outputFrames` were
+	 * generated before the converter could store them.
+	 *
+	 * @return the number of output frames generated.
+	 */
+	unsigned int process(const float* in, unsigned int inputFrames, float* out,
+			unsigned int outputFrames, unsigned int* inputUsed = NULL);
+
+	/**
+	 * Clear the input history and go back to the initial position. The
+	 * ratio stays the same.
+	 */
+	void reset();
+
+	/**
+	 * Convert a whole buffer at once, e.g.: after loading a file whose sample
+	 * rate differs from that of the audio device. This allocates memory and
+	 * should not be called from the audio thread.
+	 *
+	 * @param in the interleaved input frames.
+	 * @param inputFrames the number of input frames.
+	 * @param numChannels the number of channels.
+	 * @param ratio the input sample rate divided by the output sample rate.
+	 * @param out the interleaved output frames, resized to fit the
+	 * whole input, aligned with it.
+	 * @param quality the quality.
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	static int convert(const float* in, unsigned int inputFrames, unsigned int numChannels,
+			double ratio, std::vector<float>& out, SampleRateConverterQuality quality = kSrcBest);
+
+private:
+	unsigned int getHalfWidth();
+	unsigned int produce(float* out, unsigned int outputFrames, unsigned int halfWidth);
+	void advance();
+	void computeCoefficients(unsigned int halfWidth);
+
+	std::vector<float> bank; // [phase][tap], for ratios up to 1
+	std::vector<float> table; // one side of the sinc, for stretched filters
+	std::vector<float> history; // [channel][capacity]
+	std::vector<float> coefficients; // of the current output frame
+	std::vector<float> positions; // scratch for computeCoefficients()
+	unsigned int numChannels;
+	unsigned int maxChannels;
+	unsigned int halfTaps;
+	unsigned int maxHalfWidth;
+	unsigned int capacity; // of the history of each channel
+	unsigned int fill; // the number of frames in the history
+	unsigned int position; // the integer part of the input position, in the history
+	double fraction; // the fractional part of the input position
+	double ratio;
+	double targetRatio;
+	double ratioIncrement;
+	unsigned int rampFrames;
+	double maxRatio;
+	SampleRateConverterQuality quality;
+};
+
+#endif /* __SampleRateConverter_H_INCLUDED__ */
@@ -0,0 +1,174 @@
+/***** Stft.h *****/
+#ifndef __Stft_H_INCLUDED__
+#define __Stft_H_INCLUDED__
+
+#include <Bela.h>
+#include <AuxiliaryWorker.h>
+#include <ne10/NE10.h>
+#include <atomic>
+
+/// The maximum number of worker threads used by an Stft
+#define kMaxStftWorkers 4
+
+/**
+ * Window shapes for Stft::makeWindow().
+ */
+enum StftWindowType {
+	kStftWindowRectangular,
+	kStftWindowHann, ///< periodic Hann
+	kStftWindowSqrtHann, ///< square root of the periodic Hann: a Hann window overall when used for both analysis and synthesis
+};
+
+/**
+ * A short-time Fourier transform with overlap-add resynthesis, computed
+ * by background threads.
+ *
+ * Every hopSize samples, the audio thread windows the most recent fftSize
+ * input samples into a free frame and hands it to a worker thread (an
+ * auxiliary task). The worker computes the real FFT, calls the user's
+ * processing function on the spectrum, computes the inverse FFT and applies the
+ * synthesis window. The audio thread then adds the result to the output
+ * (overlap-add), so that the workers never touch the output buffer.
+ *
+ * The output is delayed by fftSize + workerLatency samples: each frame must
+ * be back from the worker within workerLatency samples of being handed over. Frames
+ * that come back too late are discarded and counted by getLateFrames(), rather than
+ * being added to output that has already been played. The handoff uses a
+ * fixed pool of frames with atomic states: the audio thread never waits
+ * for the workers.
+ *
+ * The windows are normalised so that, for a window pair that overlap-adds to a
+ * constant at the chosen hop size (e.g.: sqrt-Hann with a hop of fftSize / 2 or
+ * fftSize / 4, the default), an unmodified spectrum gives back the input.
+ *
+ * Each Stft processes one channel: use one object per channel.
+ */
+class Stft {
+public:
+	/**
+	 * A function that processes a spectrum in place.
+	 *
+	 * @param spectrum the bins from 0 (DC) to fftSize / 2 (Nyquist)
+	 * @param bins the number of bins (fftSize / 2 + 1)
+	 * @param arg the argument passed to setup()
+	 */
+	typedef void (*ProcessCallback)(ne10_fft_cpx_float32_t* spectrum, unsigned int bins, void* arg);
+
+	Stft();
+	~Stft();
+
+	/**
+	 * Allocate the buffers and start the worker threads. The threads are
+	 * taken from those left by stopped objects when possible: see
+	 * AuxiliaryWorker.
+	 *
+	 * @param fftSize the size of the FFT, a power of 2.
+	 * @param hopSize the number of samples between successive frames.
+	 * @param workerLatency how many samples the workers have to process each
+	 * frame. This must be at least the block size, as the workers only run once
+	 * render() returns, plus the time it takes to process a frame.
+	 * @param processCallback the function that processes each spectrum, called from the worker threads.
+	 * @param arg an argument passed to `processCallback`.
+	 * @param numWorkers the number of worker threads.
+	 * @param priority the priority of the worker threads.
+	 *
+	 * @return 0 on success, or a negative value on error.
+	 */
+	int setup(unsigned int fftSize, unsigned int hopSize, unsigned int workerLatency,
+			ProcessCallback processCallback, void* arg, unsigned int numWorkers = 1, int priority = 90);
+
+	/**
+	 * Set the analysis and synthesis windows, each fftSize samples long.
+	 * Call this from setup(), after Stft::setup().
+	 */
+	void setWindows(const float* analysis, const float* synthesis);
+
+	/**
+	 * Process a block of samples. Call this from render().
+	 *
+	 * @param input the input samples.
+	 * @param output where the output samples are written. This can be the same as `input`.
+	 * @param frames the number of samples.
+	 */
+	void process(const float* input, float* output, unsigned int frames);
+
+	/**
+	 * Get the delay between input and output, in samples.
+	 */
+	unsigned int getLatency() { return fftSize + workerLatency; }
+
+	/**
+	 * Get the number of frames that did not come back from the workers in time.
+	 */
+	unsigned int getLateFrames() { return lateFrames; }
+
+	/**
+	 * Get the number of frames that were skipped because all the frames were in use.
+	 */
+	unsigned int getDroppedFrames() { return droppedFrames; }
+
+	unsigned int getFftSize() { return fftSize; }
+	unsigned int getHopSize() { return hopSize; }
+
+	/**
+	 * Fill a window.
+	 */
+	static void makeWindow(StftWindowType type, float* window, unsigned int length);
+
+	/**
+	 * Stop the workers and free the buffers.
+	 */
+	void cleanup();
+
+private:
+	enum {
+		kFrameFree,
+		kFrameQueued, // waiting for a worker
+		kFrameProcessing,
+		kFrameDone, // waiting for the audio thread to add it to the output
+	};
+	struct Frame {
+		std::atomic<int> state;
+		// where the first sample of the frame goes in the output. The workers
+		// read it to pick a frame, while the audio thread may be reusing it
+		std::atomic<uint64_t> outputStart;
+		bool late; // the audio thread has given up on it
+		float* samples; // the windowed input, then the output
+	};
+	struct Worker {
+		Stft* that;
+		AuxiliaryWorker worker;
+		ne10_fft_r2c_cfg_float32_t cfg; // each worker needs its own, as NE10 uses it as scratch space
+		ne10_fft_cpx_float32_t* spectrum;
+	};
+	static void workerLoop(void* arg);
+	void processFrames(Worker& w);
+	void collectFrames();
+	void queueFrame();
+
+	unsigned int fftSize;
+	unsigned int hopSize;
+	unsigned int workerLatency;
+	ProcessCallback callback;
+	void* callbackArg;
+	float fftScale; // compensates for the scaling of the inverse FFT
+	float* analysisWindow;
+	float* synthesisWindow; // includes the overlap-add and FFT normalisation
+	float* inputBuffer; // ring buffer
+	unsigned int inputMask;
+	float* outputBuffer; // ring buffer
+	unsigned int outputMask;
+	uint64_t inputCount; // samples received so far
+	uint64_t outputCount; // samples sent so far
+	unsigned int hopCount;
+	Frame* frames;
+	unsigned int numFrames;
+	Worker workers[kMaxStftWorkers];
+	unsigned int numWorkers;
+	unsigned int nextWorker;
+	unsigned int lateFrames;
+	unsigned int droppedFrames;
+	std::atomic<bool> stopping;
+};
+
+#endif /* __Stft_H_INCLUDED__ */
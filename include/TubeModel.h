@@ -0,0 +1,172 @@
+/***** TubeModel.h *****/
+#ifndef __TubeModel_H_INCLUDED__
+#define __TubeModel_H_INCLUDED__
+
+#include <vector>
+
+/**
+ * A Kelly-Lochbaum waveguide model of a tube made of cylindrical segments,
+ * with an optional side branch, for several voices. It is the vocal tract
+ * (and nasal cavity) of the Pink Trombone example, extracted so that several
+ * tracts can run on one board.
+ *
+ * Each segment holds a wave travelling right (towards the end) and one
+ * travelling left (towards the start). At each step, the waves scatter at the
+ * junctions between segments, according to reflection coefficients
+ * computed from the diameters of the segments. The start (the glottis) is
+ * driven by an excitation signal and reflects the left-going wave; the end
+ * (the lips) reflects part of the right-going wave, and the rest is the
+ * output. The side branch (the nose) starts at a three-way junction, and its
+ * end is added to the output.
+ *
+ * Voice `v` is lane `v % kLanes` of group `v / kLanes`. Each wave and each
+ * reflection coefficient of a group is stored as `[segment][lane]`, so a
+ * junction reads and writes `kLanes` adjacent floats, one per voice, and is
+ * scattered for all the voices of the group with the same instructions.
+ * The new waves of a step are written to a second buffer, so the junctions
+ * of a step do not depend on each other and the loop over them runs without
+ * a carried dependency.
+ *
+ * The shape of the tube is set at block rate with setDiameters(): the
+ * reflection coefficients move linearly from the current ones to the new ones
+ * over the next call to process(), so that changes of the shape do not click.
+ *
+ * All the memory is allocated in setup().
+ */
+class TubeModel {
+public:
+	static const unsigned int kLanes = 4;
+
+	TubeModel();
+
+	/**
+	 * Allocate the memory for the model.
+	 *
+	 * @param numVoices the number of voices.
+	 * @param numSegments the number of segments of the tube, at least 3.
+	 * @param maxFrames the largest number of frames passed to process().
+	 * @param stepsPerFrame the number of steps of the waveguide for each
+	 * frame: the Pink Trombone runs its tract at twice the sample rate.
+	 * @param sideLength the number of segments of the side branch, 0 for none.
+	 * @param sideJunction the junction where the side branch starts,
+	 * between segments `sideJunction - 1` and `sideJunction`. It has to be
+	 * between 1 and `numSegments - 1`.
+	 *
+	 * @return 0 upon success, a negative value otherwise.
+	 */
+	int setup(unsigned int numVoices, unsigned int numSegments, unsigned int maxFrames,
+			unsigned int stepsPerFrame = 2, unsigned int sideLength = 0, unsigned int sideJunction = 0);
+
+	/**
+	 * Set the shape of the tube of a voice, which is reached at the end of
+	 * the next call to process().
+	 *
+	 * @param voice the voice.
+	 * @param diameters the diameter of each segment.
+	 */
+	void setDiameters(unsigned int voice, const float* diameters);
+
+	/**
+	 * Set the shape of the side branch of a voice, which is reached at the
+	 * end of the next call to process(). The first segment is the opening
+	 * of the branch, e.g.: the velum.
+	 *
+	 * @param voice the voice.
+	 * @param diameters the diameter of each segment of the side branch.
+	 */
+	void setSideDiameters(unsigned int voice, const float* diameters);
+
+	/**
+	 * Set the reflection coefficients at the ends of the tube.
+	 *
+	 * @param start the reflection at the start of the tube (the glottis).
+	 * @param end the reflection at the end of the tube and of the side
+	 * branch (the lips and the nostrils).
+	 */
+	void setEndReflections(float start, float end);
+
+	/**
+	 * Set the damping of the waves at each step.
+	 *
+	 * @param tube the gain applied to the waves in the tube.
+	 * @param side the gain applied to the waves in the side branch.
+	 */
+	void setDamping(float tube, float side);
+
+	/**
+	 * Set where the `noise` passed to process() is injected into the tube of
+	 * a voice, e.g.: the turbulence at a constriction.
+	 *
+	 * @param voice the voice.
+	 * @param position the position, in segments: the noise is split between
+	 * segments `floor(position) + 1` and `floor(position) + 2`, in both
+	 * directions. It is clipped to the tube.
+	 */
+	void setNoisePosition(unsigned int voice, float position);
+
+	/**
+	 * Run the waveguide for a block.
+	 *
+	 * @param excitation the signal at the start of the tube, with sample `n`
+	 * of voice `v` at `excitation[v * frames + n]`.
+	 * @param noise the signal injected at the position set by
+	 * setNoisePosition(), with the same layout, or NULL.
+	 * @param output where to store the output, with the same layout: the sum of the
+	 * waves leaving the end of the tube and of the side branch over the
+	 * steps of each frame.
+	 * @param frames the number of frames, at most the `maxFrames` passed to setup().
+	 */
+	void process(const float* excitation, const float* noise, float* output, unsigned int frames);
+
+	/**
+	 * Clear the waves in the tubes of all voices, and move them to the shapes
+	 * set by setDiameters() and setSideDiameters() immediately.
+	 */
+	void reset();
+
+	unsigned int getNumVoices() { return numVoices; }
+	unsigned int getNumSegments() { return numSegments; }
+	unsigned int getSideLength() { return sideLength; }
+
+private:
+	static float computeReflection(float previousArea, float area);
+	void computeJunctionReflections(unsigned int voice);
+	void processGroup(unsigned int group, unsigned int frames, bool hasNoise, bool moving);
+
+	unsigned int numVoices;
+	unsigned int numGroups;
+	unsigned int numSegments;
+	unsigned int sideLength;
+	unsigned int sideJunction;
+	unsigned int maxFrames;
+	unsigned int stepsPerFrame;
+	unsigned int groupSize; // the number of floats of each wave of a group
+	unsigned int reflectionsSize; // the number of floats of the reflections of a group
+	unsigned int current; // which of the two buffers of each wave holds the current waves
+	float startReflection;
+	float endReflection;
+	float tubeDamping;
+	float sideDamping;
+	// [2][group][segment][lane], the current and the next waves
+	std::vector<float> right;
+	std::vector<float> left;
+	std::vector<float> sideRight;
+	std::vector<float> sideLeft;
+	// [group][reflection][lane], with, for each group, the reflections at the
+	// junctions of the tube (junction `i` is between segments `i - 1` and `i`),
+	// then at those of the side branch, then the left, right and side
+	// reflections at the junction with the side branch
+	std::vector<float> reflection; // at the start of the block
+	std::vector<float> reflectionDelta; // from the start to the end of the block
+	std::vector<float> targetReflection; // at the end of the block
+	std::vector<float> area; // [voice][segment]
+	std::vector<float> sideArea; // [voice][segment]
+	std::vector<unsigned int> noiseSegment; // [group][lane]
+	std::vector<float> noiseFraction; // [group][lane]
+	// the inputs and output of a group, [frame][lane]
+	std::vector<float> excitationLanes;
+	std::vector<float> noiseLanes;
+	std::vector<float> outputLanes;
+};
+
+#endif /* __TubeModel_H_INCLUDED__ */
@@ -182,6 +182,37 @@ static inline void analogWriteOnce(BelaContext *context, int frame, int channel,
  */
 static inline void analogWriteOnceNI(BelaContext *context, int frame, int channel, float value);
 
+/**
+ * \brief Make an analog output go to a value in a linear ramp.
+ *
+ * The ramp is generated for each frame by the core while converting the
+ * outputs for the DAC, so that a value updated once per block does not produce
+ * steps. From the first call, the channel ignores the values written with analogWrite()
+ * and analogWriteOnce(), until analogSetSmoothing() is called for the channel.
+ *
+ * \param context The I/O data structure which is passed by Bela to render().
+ * \param channel Which analog output to write.
+ * \param value The target value, range 0 to 1.
+ * \param rampFrames How many analog frames the ramp lasts, starting from the
+ * first frame of the current block. 0 jumps to the value straight away.
+ */
+void analogWriteTarget(BelaContext *context, int channel, float value, unsigned int rampFrames);
+
+/**
+ * \brief Smooth the values written to an analog output.
+ *
+ * The values written with analogWrite() and analogWriteOnce() go through a
+ * one-pole lowpass and then a slew rate limiter, applied by the core while converting
+ * the outputs for the DAC.
+ *
+ * \param context The I/O data structure which is passed by Bela to render().
+ * \param channel Which analog output to smooth.
+ * \param maxStep The maximum change of the output from one analog frame to the next,
+ * or 0 for no limit.
+ * \param timeConstant The time constant of the lowpass, in analog frames, or 0 for no lowpass.
+ */
+void analogSetSmoothing(BelaContext *context, int channel, float maxStep, float timeConstant);
+
 /**
  * \brief Read a digital input, specifying the frame number (when to read) and the pin.
  *
@@ -0,0 +1,315 @@
+/***** VoicePool.h *****/
+#ifndef __VoicePool_H_INCLUDED__
+#define __VoicePool_H_INCLUDED__
+
+#include <Bela.h>
+#include <Midi.h>
+#include <AuxiliaryWorker.h>
+#include <atomic>
+#include <vector>
+
+/// The maximum number of worker threads used by a VoicePool
+#define kMaxVoicePoolWorkers 4
+/// How long the audio thread waits for the groups rendered by the workers, in ns
+#define kVoicePoolWorkerTimeout 2000000
+/// The number of MIDI channels
+#define kVoicePoolMidiChannels 16
+
+/**
+ * What a VoicePool does with a note on when all its voices are in use.
+ *
+ * Except for kVoiceStealNone, a voice that has been released and is
+ * fading out is always stolen first (the quietest of them): the policy
+ * chooses among the voices whose note is still held.
+ */
+typedef enum {
+	kVoiceStealNone, ///< ignore the note
+	kVoiceStealOldest, ///< the voice whose note started first
+	kVoiceStealQuietest, ///< the voice with the lowest level
+	kVoiceStealLowest, ///< the voice playing the lowest note
+	kVoiceStealHighest, ///< the voice playing the highest note
+} VoiceStealing;
+
+/**
+ * The state of the voices of a VoicePool, as structure-of-arrays: element
+ * `v` of each array belongs to voice `v`. The arrays are padded to a whole
+ * number of groups.
+ */
+struct VoicePoolVoices {
+	float* frequency; ///< in Hz, from the note and the pitch bend of its channel
+	float* velocity; ///< between 0 and 1
+	float* gate; ///< 1 while the key is down or sustained, 0 once it is released
+	float* level; ///< the current level, written by the RenderCallback
+	unsigned char* triggered; ///< 1 in the first block after a note on (including a stolen or retriggered voice)
+	unsigned char* state; ///< a VoicePool::VoiceState
+	int* note; ///< the MIDI note number
+	int* channel; ///< the MIDI channel
+	unsigned int* age; ///< incremented on every note on: a larger value is a more recent note
+};
+
+/**
+ * A pool of synthesizer voices, driven by MIDI note and controller
+ * messages, which only renders the voices that are sounding.
+ *
+ * The voices are rendered in groups of `groupSize` adjacent voices by a
+ * user-provided RenderCallback, which reads the state of the voices from
+ * getVoices(). The state is stored as structure-of-arrays, so that the
+ * callback can process the voices of a group side by side, with the inner
+ * loop over the voices mapped to SIMD registers (a group of 4 fills a NEON
+ * register). A group is rendered only if at least one of its voices is
+ * sounding, and free voices are allocated from the groups that are already
+ * sounding first, so that a few notes keep few groups busy.
+ *
+ * A voice is allocated on note on and it is released (its gate goes to 0)
+ * on note off, or when the sustain pedal is lifted. The callback writes the
+ * level of each voice to `level`: after each block, the released voices
+ * whose level is below the silence threshold are freed. When all voices are
+ * in use, a voice is stolen according to a VoiceStealing policy.
+ *
+ * Optionally, the groups can be shared with worker threads (auxiliary tasks),
+ * which is worthwhile on a multi-core board with many voices. In each block, the
+ * audio thread and the workers claim the groups one at a time, each adding
+ * its groups to its own mix buffer, and the audio thread waits for the groups
+ * claimed by the workers before mixing the buffers. As the audio thread
+ * renders any group that no worker has claimed, it never waits for a worker
+ * that has not started. There is at most one worker per core besides the
+ * one of the audio thread, so on a single-core board all the groups are
+ * rendered by the audio thread.
+ *
+ * If a worker is preempted while it renders a group, the audio thread
+ * stops waiting after kVoicePoolWorkerTimeout: the output of the workers is
+ * dropped from that block, and the groups they had claimed are neither
+ * rendered nor freed until all the workers have returned. Meanwhile, the
+ * audio thread renders the other groups on its own, and the MIDI messages
+ * may change the state of the voices that a late worker is rendering.
+ *
+ * All the memory is allocated in setup(). The MIDI messages are processed
+ * at the start of the next block: the methods that process them and render()
+ * must be called from the same thread, normally the audio thread.
+ */
+class VoicePool {
+public:
+	typedef enum {
+		kVoiceFree,
+		kVoiceHeld, ///< the key is down
+		kVoiceSustained, ///< the key is up, but the sustain pedal is down
+		kVoiceReleased, ///< fading out
+	} VoiceState;
+
+	/**
+	 * A function that renders a group of voices.
+	 *
+	 * @param pool the pool, whose getVoices() contains the state of the voices.
+	 * @param firstVoice the first voice of the group. The group contains the
+	 * voices from `firstVoice` to `firstVoice + pool.getGroupSize() - 1`, some
+	 * of which may be free: their `gate` and `velocity` are 0.
+	 * @param out the output of the group has to be added to this buffer,
+	 * with sample `n` of channel `c` at `out[c * frames + n]`.
+	 * @param frames the number of frames.
+	 * @param arg the argument passed to setup().
+	 */
+	typedef void (*RenderCallback)(VoicePool& pool, unsigned int firstVoice, float* out, unsigned int frames, void* arg);
+
+	VoicePool();
+	~VoicePool();
+
+	/**
+	 * Allocate the memory and create the worker threads.
+	 *
+	 * @param numVoices the number of voices.
+	 * @param numChannels the number of output channels.
+	 * @param maxFrames the largest number of frames rendered at a time:
+	 * render() splits longer blocks.
+	 * @param renderCallback the function that renders a group of voices. If
+	 * there are worker threads, it is called concurrently for different groups.
+	 * @param arg an argument passed to `renderCallback`.
+	 * @param stealing the stealing policy.
+	 * @param groupSize the number of voices in a group.
+	 * @param numWorkers the number of worker threads, at most kMaxVoicePoolWorkers.
+	 * It is reduced to the number of cores minus one.
+	 * @param priority the priority of the worker threads.
+	 *
+	 * @return 0 on success, or a negative value on error.
+	 */
+	int setup(unsigned int numVoices, unsigned int numChannels, unsigned int maxFrames,
+			RenderCallback renderCallback, void* arg, VoiceStealing stealing = kVoiceStealOldest,
+			unsigned int groupSize = 4, unsigned int numWorkers = 0, int priority = 94);
+
+	void setStealing(VoiceStealing newStealing) { stealing = newStealing; }
+
+	/**
+	 * Set the level below which a released voice is freed. The default is
+	 * 0.0001 (-80dB).
+	 */
+	void setSilenceThreshold(float threshold) { silenceThreshold = threshold; }
+
+	/**
+	 * Set the range of the pitch bend, in semitones. The default is 2.
+	 */
+	void setPitchBendRange(float semitones);
+
+	/**
+	 * Start a note.
+	 *
+	 * If the note is already sounding on the same channel, its voice is retriggered.
+	 *
+	 * @param channel the MIDI channel.
+	 * @param note the MIDI note number.
+	 * @param velocity the MIDI velocity. If 0, this is a note off.
+	 *
+	 * @return the voice playing the note, or -1 if there is none.
+	 */
+	int noteOn(unsigned int channel, unsigned int note, unsigned int velocity);
+
+	/**
+	 * Release a note.
+	 */
+	void noteOff(unsigned int channel, unsigned int note);
+
+	/**
+	 * Press or lift the sustain pedal of a channel.
+	 */
+	void setSustain(unsigned int channel, bool sustain);
+
+	/**
+	 * Set the pitch bend of a channel.
+	 *
+	 * @param channel the MIDI channel.
+	 * @param bend the pitch bend, between -1 and 1.
+	 */
+	void setPitchBend(unsigned int channel, float bend);
+
+	/**
+	 * Release all the notes, and lift the sustain pedals.
+	 */
+	void allNotesOff();
+
+	/**
+	 * Free all the voices immediately, without letting them fade out.
+	 */
+	void reset();
+
+	/**
+	 * Process a MIDI message: note on and off, pitch bend and the sustain,
+	 * all sound off (which frees the voices of the channel) and all notes off
+	 * controllers. Other messages are ignored.
+	 */
+	void processMessage(MidiChannelMessage& message);
+
+	/**
+	 * Process all the messages available from a MidiParser. Call this
+	 * from render(), before render(BelaContext*).
+	 */
+	void processMidi(MidiParser* parser);
+
+	/**
+	 * Render the sounding voices.
+	 *
+	 * @param out where to store the output, with sample `n` of channel `c`
+	 * at `out[c * frames + n]`.
+	 * @param frames the number of frames.
+	 */
+	void render(float* out, unsigned int frames);
+
+	/**
+	 * Render the sounding voices, adding them to the audio outputs of the
+	 * context. If the pool has a single channel, it is added to all outputs.
+	 */
+	void render(BelaContext* context);
+
+	/**
+	 * Get the state of the voices.
+	 */
+	VoicePoolVoices& getVoices() { return voices; }
+
+	unsigned int getNumVoices() { return numVoices; }
+	unsigned int getNumChannels() { return numChannels; }
+	unsigned int getGroupSize() { return groupSize; }
+
+	/**
+	 * Get the number of voices that are not free.
+	 */
+	unsigned int getNumActiveVoices() { return numActiveVoices; }
+
+	/**
+	 * Get the number of groups rendered in the last block.
+	 */
+	unsigned int getNumRenderedGroups() { return numRenderedGroups; }
+
+	/**
+	 * Get the number of voices that have been stolen so far.
+	 */
+	unsigned int getNumStolenVoices() { return numStolenVoices; }
+
+	/**
+	 * Get the number of blocks in which the audio thread stopped waiting
+	 * for the workers.
+	 */
+	unsigned int getNumWorkerTimeouts() { return numWorkerTimeouts; }
+
+	/**
+	 * Stop the workers.
+	 */
+	void cleanup();
+
+private:
+	struct Worker {
+		VoicePool* that;
+		AuxiliaryWorker worker;
+		unsigned int index; // of its mix buffer
+		std::atomic<bool> busy; // while it claims or renders groups
+	};
+	static void workerLoop(void* arg);
+	int claimGroup();
+	void renderGroups(unsigned int mixIndex);
+	void renderChunk(unsigned int frames); // leaves the output at the start of `mix`
+	void freeFadedVoices(unsigned int group);
+	int findVoice();
+	void startVoice(unsigned int voice, unsigned int channel, unsigned int note, unsigned int velocity);
+	void releaseVoice(unsigned int voice);
+	void freeVoice(unsigned int voice);
+	void updateFrequency(unsigned int voice);
+
+	VoicePoolVoices voices;
+	std::vector<float> frequency;
+	std::vector<float> velocity;
+	std::vector<float> gate;
+	std::vector<float> level;
+	std::vector<unsigned char> triggered;
+	std::vector<unsigned char> state;
+	std::vector<int> note;
+	std::vector<int> channel;
+	std::vector<unsigned int> age;
+	std::vector<unsigned int> groupVoices; // the number of voices that are not free in each group
+	std::vector<unsigned int> activeGroups; // the groups to render in the current block
+	std::vector<unsigned char> ownGroups; // which of activeGroups the audio thread has rendered
+	std::vector<unsigned char> lateGroups; // the groups claimed by a worker that timed out
+	std::vector<int> noteVoices; // [channel][note], the voice playing each note, or -1
+	std::vector<float> mix; // [numWorkers + 1][numChannels][maxFrames]
+	bool sustain[kVoicePoolMidiChannels];
+	float pitchBend[kVoicePoolMidiChannels]; // in semitones
+	float pitchBendRange;
+	RenderCallback callback;
+	void* callbackArg;
+	VoiceStealing stealing;
+	float silenceThreshold;
+	unsigned int numVoices;
+	unsigned int paddedVoices;
+	unsigned int numChannels;
+	unsigned int maxFrames;
+	unsigned int groupSize;
+	unsigned int numActiveVoices;
+	unsigned int numRenderedGroups;
+	unsigned int numStolenVoices;
+	unsigned int numWorkerTimeouts;
+	unsigned int nextAge;
+	unsigned int chunkFrames; // of the block being rendered by the workers
+	Worker workers[kMaxVoicePoolWorkers];
+	unsigned int numWorkers;
+	bool workersLate; // a worker has not returned since the last timeout
+	std::atomic<unsigned int> unclaimedGroups;
+	std::atomic<unsigned int> renderedGroups;
+	std::atomic<bool> stopping;
+};
+
+#endif /* __VoicePool_H_INCLUDED__ */
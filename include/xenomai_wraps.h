@@ -24,6 +24,7 @@ extern "C" {
 // Forward declare __wrap_ versions of POSIX calls.
 // At link time, Xenomai will provide implementations for these
 int __wrap_nanosleep(const struct timespec *req, struct timespec *rem);
+int __wrap_clock_gettime(clockid_t clock_id, struct timespec *tp);
 int __wrap_pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine) (void *), void *arg);
 int __wrap_pthread_setschedparam(pthread_t thread, int policy, const struct sched_param *param);
 int __wrap_pthread_getschedparam(pthread_t thread, int *policy, struct sched_param *param);
@@ -69,6 +70,7 @@ int __wrap_sched_get_priority_max(int policy);
 
 #ifdef XENOMAI_SKIN_native
 #include <native/task.h>
+#include <native/timer.h>
 typedef RTIME time_ns_t;
 #endif
 #ifdef XENOMAI_SKIN_posix
@@ -94,6 +96,19 @@ inline int task_sleep_ns(long long int timens)
 #endif
 }
 
+// the monotonic time, in ns
+inline time_ns_t task_get_time_ns()
+{
+#ifdef XENOMAI_SKIN_native
+	return rt_timer_read();
+#endif
+#ifdef XENOMAI_SKIN_posix
+	struct timespec ts;
+	__wrap_clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
 #ifdef XENOMAI_SKIN_posix
 #include <error.h>
 //void error(int exitCode, int errno, char* message)
@@ -22,115 +22,28 @@ The Bela software is distributed under the GNU Lesser General Public License
 */
 
 #include <Bela.h>
-#include <Midi.h>
-#include <Scope.h>
+#include <PatchRuntime.h>
 #include <cmath>
 #include <Heavy_bela.h>
 #include <string.h>
 #include <stdlib.h>
 #include <string>
-#include <sstream>
-#include <DigitalChannelManager.h>
-#include <algorithm>
 #include <array>
 
-enum { minFirstDigitalChannel = 10 };
-
-static unsigned int gAudioChannelsInUse;
-static unsigned int gAnalogChannelsInUse;
-static unsigned int gDigitalChannelsInUse;
-unsigned int gScopeChannelsInUse;
-static unsigned int gChannelsInUse;
-static unsigned int gFirstAnalogChannel;
-static unsigned int gFirstDigitalChannel;
-static unsigned int gDigitalChannelOffset;
-static unsigned int gFirstScopeChannel;
-
-static unsigned int gDigitalSigInChannelsInUse;
-static unsigned int gDigitalSigOutChannelsInUse;
-
-float* gScopeOut;
-// Bela Scope
-static Scope* scope = NULL;
+static PatchRuntime gRuntime;
 static char multiplexerArray[] = {"bela_multiplexer"};
-static int multiplexerArraySize = 0;
 static bool pdMultiplexerActive = false;
-bool gDigitalEnabled = 0;
 
-// Bela Midi
-unsigned int hvMidiHashes[7]; // heavy-specific
-static std::vector<Midi*> midi;
-std::vector<std::string> gMidiPortNames;
-
-void dumpMidi()
+void Bela_userSettings(BelaInitSettings *settings)
 {
-	if(midi.size() == 0)
-	{
-		printf("No MIDI device enabled\n");
-		return;
-	}
-	printf("The following MIDI devices are enabled:\n");
-	printf("%4s%20s %3s %3s %s\n",
-			"Num",
-			"Name",
-			"In",
-			"Out",
-			"Pd channels"
-	      );
-	for(unsigned int n = 0; n < midi.size(); ++n)
-	{
-		printf("[%2d]%20s %3s %3s (%d-%d)\n",
-			n,
-			gMidiPortNames[n].c_str(),
-			midi[n]->isInputEnabled() ? "x" : "_",
-			midi[n]->isOutputEnabled() ? "x" : "_",
-			n * 16,
-			n * 16 + 15
-		);
-	}
+	// the runtime moves non-interleaved buffers. The other settings keep
+	// their defaults: the analog channels run at their native rate and are
+	// resampled in render(), unless --uniform-sample-rate is passed
+	settings->interleave = 0;
 }
 
-Midi* openMidiDevice(std::string name, bool verboseSuccess = false, bool verboseError = false)
-{
-	Midi* newMidi;
-	newMidi = new Midi();
-	newMidi->readFrom(name.c_str());
-	newMidi->writeTo(name.c_str());
-	newMidi->enableParser(true);
-	if(newMidi->isOutputEnabled())
-	{
-		if(verboseSuccess)
-			printf("Opened MIDI device %s as output\n", name.c_str());
-	}
-	if(newMidi->isInputEnabled())
-	{
-		if(verboseSuccess)
-			printf("Opened MIDI device %s as input\n", name.c_str());
-	}
-	if(!newMidi->isInputEnabled() && !newMidi->isOutputEnabled())
-	{
-		if(verboseError)
-			fprintf(stderr, "Failed to open  MIDI device %s\n", name.c_str());
-		return nullptr;
-	} else {
-		return newMidi;
-	}
-}
-
-static unsigned int getPortChannel(int* channel){
-	unsigned int port = 0;
-	while(*channel > 16){
-		*channel -= 16;
-		port += 1;
-	}
-	if(port >= midi.size()){
-		// if the port number exceeds the number of ports available, send out
-		// of the first port
-		rt_fprintf(stderr, "Port out of range, using port 0 instead\n");
-		port = 0;
-	}
-	return port;
-}
+// Bela Midi
+unsigned int hvMidiHashes[7]; // heavy-specific
 
 /*
  *	HEAVY CONTEXT & BUFFERS
@@ -155,22 +68,9 @@ void printHook(HeavyContextInterface *context, const char *printLabel, const cha
 
 
 // digitals
-static DigitalChannelManager dcm;
-
-void sendDigitalMessage(bool state, unsigned int delay, void* receiverName){
-	hv_sendFloatToReceiver(gHeavyContext, hv_stringToHash((char*)receiverName), (float)state);
-//	rt_printf("%s: %d\n", (char*)receiverName, state);
-}
-
-
-std::vector<std::string> gHvDigitalInHashes;
-void generateDigitalNames(unsigned int numDigitals, unsigned int digitalOffset, std::vector<std::string>& receiverInputNames)
-{
-	std::string inBaseString = "bela_digitalIn";
-	for(unsigned int i = 0; i<numDigitals; i++)
-	{
-		receiverInputNames.push_back(inBaseString + std::to_string(i+digitalOffset));
-	}
+void sendDigitalMessage(const char* receiverName, float value, void*){
+	hv_sendFloatToReceiver(gHeavyContext, hv_stringToHash(receiverName), value);
+//	rt_printf("%s: %f\n", receiverName, value);
 }
 
 // For a message to be received here, you need to use the following syntax in Pd:
@@ -183,25 +83,9 @@ static void sendHook(
 
 	// Bela digital run-time messages
 
-	// TODO: this first block is almost an exact copy of libpd's code, should we add this to the class?
-	// let's make this as optimized as possible for built-in digital Out parsing
-	// the built-in digital receivers are of the form "bela_digitalOutXX" where XX is between 11 and 26
-	static const int prefixLength = 15; // strlen("bela_digitalOut")
-	if(strncmp(receiverName, "bela_digitalOut", prefixLength)==0){
-		if(receiverName[prefixLength] != 0){ //the two ifs are used instead of if(strlen(source) >= prefixLength+2)
-			if(receiverName[prefixLength + 1] != 0){
-				// quickly convert the suffix to integer, assuming they are numbers, avoiding to call atoi
-				int receiver = ((receiverName[prefixLength] - '0') * 10);
-				receiver += (receiverName[prefixLength+1] - '0');
-				unsigned int channel = receiver - gDigitalChannelOffset; // go back to the actual Bela digital channel number
-				bool value = (hv_msg_getFloat(m, 0) != 0.0f);
-				if(channel < gDigitalChannelsInUse){ //gDigitalChannelsInUse is the number of digital channels
-					dcm.setValue(channel, value);
-				}
-			}
-		}
+	// the built-in digital receivers are of the form "bela_digitalOutXX"
+	if(gRuntime.setDigitalOutput(receiverName, hv_msg_getFloat(m, 0)))
 		return;
-	}
 
 	// More MIDI and digital messages. To obtain the hashes below, use hv_stringToHash("yourString")
 	switch (sendHash) {
@@ -216,53 +100,18 @@ static void sendHook(
 			{
 				num[n] = hv_msg_getFloat(m, n + 1);
 			}
-			std::ostringstream deviceName;
-			deviceName << symbol << ":" << num[0] << "," << num[1] << "," << num[2];
-			printf("Adding Midi device: %s\n", deviceName.str().c_str());
-			Midi* newMidi = openMidiDevice(deviceName.str(), true, true);
-			if(newMidi)
-			{
-				midi.push_back(newMidi);
-				gMidiPortNames.push_back(deviceName.str());
-			}
-			dumpMidi();
+			gRuntime.addMidiPort(symbol, num[0], num[1], num[2]);
 			break;
 		}
 		case 0x70418732: { // bela_setDigital
-			if(gDigitalEnabled)
-			{
-				// Third argument (optional) can be ~ or sig for signal-rate, message-rate otherwise.
-				// [in 14 ~(
-				// |
-				// [s bela_setDigital]
-				// is signal("sig" or "~") or message("message", default) rate
-				bool isMessageRate = true; // defaults to message rate
-				bool direction = 0; // initialize it just to avoid the compiler's warning
-				bool disable = false;
-				if (!(hv_msg_isSymbol(m, 0) && hv_msg_isFloat(m, 1))) return;
-				const char *symbol = hv_msg_getSymbol(m, 0);
-				if(strcmp(symbol, "in") == 0){
-					direction = INPUT;
-				} else if(strcmp(symbol, "out") == 0){
-					direction = OUTPUT;
-				} else if(strcmp(symbol, "disable") == 0){
-					disable = true;
-				} else {
-					return;
-				}
-				int channel = hv_msg_getFloat(m, 1) - gDigitalChannelOffset;
-				if(disable == true){
-					dcm.unmanage(channel);
-					return;
-				}
-				if(hv_msg_isSymbol(m, 2)){
-					const char *s = hv_msg_getSymbol(m, 2);
-					if(strcmp(s, "~") == 0  || strncmp(s, "sig", 3) == 0){
-						isMessageRate = false;
-					}
-				}
-				dcm.manage(channel, direction, isMessageRate);
-			}
+			// Third argument (optional) can be ~ or sig for signal-rate, message-rate otherwise.
+			// [in 14 ~(
+			// |
+			// [s bela_setDigital]
+			// is signal("sig" or "~") or message("message", default) rate
+			if (!(hv_msg_isSymbol(m, 0) && hv_msg_isFloat(m, 1))) return;
+			const char *rate = hv_msg_isSymbol(m, 2) ? hv_msg_getSymbol(m, 2) : NULL;
+			gRuntime.setDigital(hv_msg_getSymbol(m, 0), hv_msg_getFloat(m, 1), rate);
 			break;
 		}
 		case 0xd1d4ac2: { // __hv_noteout
@@ -270,9 +119,10 @@ static void sendHook(
 			midi_byte_t pitch = (midi_byte_t) hv_msg_getFloat(m, 0);
 			midi_byte_t velocity = (midi_byte_t) hv_msg_getFloat(m, 1);
 			int channel = (midi_byte_t) hv_msg_getFloat(m, 2);
-			int port = getPortChannel(&channel);
-			//rt_printf("noteout[%d]: %d %d %d\n", port, channel, pitch, velocity);
-			midi[port]->writeNoteOn(channel, pitch, velocity);
+			Midi* port = gRuntime.getMidiOutputPort(&channel);
+			//rt_printf("noteout: %d %d %d\n", channel, pitch, velocity);
+			if(port)
+				port->writeNoteOn(channel, pitch, velocity);
 			break;
 		}
 		case 0xe5e2a040: { // __hv_ctlout
@@ -280,35 +130,39 @@ static void sendHook(
 			midi_byte_t value = (midi_byte_t) hv_msg_getFloat(m, 0);
 			midi_byte_t controller = (midi_byte_t) hv_msg_getFloat(m, 1);
 			int channel = (midi_byte_t) hv_msg_getFloat(m, 2);
-			int port = getPortChannel(&channel);
-			//rt_printf("controlout[%d]: %d %d %d\n", port, channel, controller, value);
-			midi[port]->writeControlChange(channel, controller, value);
+			Midi* port = gRuntime.getMidiOutputPort(&channel);
+			//rt_printf("controlout: %d %d %d\n", channel, controller, value);
+			if(port)
+				port->writeControlChange(channel, controller, value);
 			break;
 		}
 		case 0x8753e39e: { // __hv_pgmout
 			midi_byte_t program = (midi_byte_t) hv_msg_getFloat(m, 0);
 			int channel = (midi_byte_t) hv_msg_getFloat(m, 1);
-			int port = getPortChannel(&channel);
-			//rt_printf("pgmout[%d]: %d %d\n", port, channel, program);
-			midi[port]->writeProgramChange(channel, program);
+			Midi* port = gRuntime.getMidiOutputPort(&channel);
+			//rt_printf("pgmout: %d %d\n", channel, program);
+			if(port)
+				port->writeProgramChange(channel, program);
 			break;
 		}
 		case 0xe8458013: { // __hv_bendout
 			if (!hv_msg_hasFormat(m, "ff")) return;
 			unsigned int value = ((midi_byte_t) hv_msg_getFloat(m, 0)) + 8192;
 			int channel = (midi_byte_t) hv_msg_getFloat(m, 1);
-			int port = getPortChannel(&channel);
-			//rt_printf("bendout[%d]: %d %d\n", port, channel, value);
-			midi[port]->writePitchBend(channel, value);
+			Midi* port = gRuntime.getMidiOutputPort(&channel);
+			//rt_printf("bendout: %d %d\n", channel, value);
+			if(port)
+				port->writePitchBend(channel, value);
 			break;
 		}
 		case 0x476d4387: { // __hv_touchout
 			if (!hv_msg_hasFormat(m, "ff")) return;
 			midi_byte_t pressure = (midi_byte_t) hv_msg_getFloat(m, 0);
 			int channel = (midi_byte_t) hv_msg_getFloat(m, 1);
-			int port = getPortChannel(&channel);
-			//rt_printf("touchout[%d]: %d %d\n", port, channel, pressure);
-			midi[port]->writeChannelPressure(channel, pressure);
+			Midi* port = gRuntime.getMidiOutputPort(&channel);
+			//rt_printf("touchout: %d %d\n", channel, pressure);
+			if(port)
+				port->writeChannelPressure(channel, pressure);
 			break;
 		}
 		case 0xd5aca9d1: { // __hv_polytouchout, not currently supported by Heavy. You have to [send __hv_polytouchout]
@@ -316,17 +170,19 @@ static void sendHook(
 			midi_byte_t pitch = (midi_byte_t) hv_msg_getFloat(m, 0);
 			midi_byte_t pressure = (midi_byte_t) hv_msg_getFloat(m, 1);
 			int channel = (midi_byte_t) hv_msg_getFloat(m, 2);
-			int port = getPortChannel(&channel);
-			//rt_printf("polytouchout [%d]: %d %d %d\n", port, channel, pitch, pressure);
-			midi[port]->writePolyphonicKeyPressure(channel, pitch, pressure);
+			Midi* port = gRuntime.getMidiOutputPort(&channel);
+			//rt_printf("polytouchout: %d %d %d\n", channel, pitch, pressure);
+			if(port)
+				port->writePolyphonicKeyPressure(channel, pitch, pressure);
 			break;
 		}
 		case 0x6511de55: { // __hv_midiout, not currently supported by Heavy. You have to [send __hv_midiout]
 			if (!hv_msg_hasFormat(m, "ff")) return;
 			midi_byte_t byte = (midi_byte_t) hv_msg_getFloat(m, 0);
-			int port = (int) hv_msg_getFloat(m, 1);
-			//rt_printf("midiout port: %d, byte: %d\n", port, byte);
-			midi[port]->writeOutput(byte);
+			Midi* port = gRuntime.getMidiPort((int) hv_msg_getFloat(m, 1));
+			//rt_printf("midiout byte: %d\n", byte);
+			if(port)
+				port->writeOutput(byte);
 			break;
 		}
 		default: {
@@ -343,27 +199,6 @@ static void sendHook(
 
 bool setup(BelaContext *context, void *userData)	{
 
-	// Check if digitals are enabled
-	if(context->digitalFrames > 0 && context->digitalChannels > 0)
-		gDigitalEnabled = 1;
-
-	gAudioChannelsInUse = std::max(context->audioInChannels, context->audioOutChannels);
-	gAnalogChannelsInUse = std::max(context->analogInChannels, context->analogOutChannels);
-	gDigitalChannelsInUse = context->digitalChannels;
-
-	// Channel distribution
-	gFirstAnalogChannel = std::max(context->audioInChannels, context->audioOutChannels);
-	gFirstDigitalChannel = gFirstAnalogChannel + std::max(context->analogInChannels, context->analogOutChannels);
-	if(gFirstDigitalChannel < minFirstDigitalChannel)
-		gFirstDigitalChannel = minFirstDigitalChannel; //for backwards compatibility
-	gDigitalChannelOffset = gFirstDigitalChannel + 1;
-	gFirstScopeChannel = gFirstDigitalChannel + gDigitalChannelsInUse;
-
-	gChannelsInUse = gFirstScopeChannel + gScopeChannelsInUse;
-	
-	// Create hashes for digital channels
-	generateDigitalNames(gDigitalChannelsInUse, gDigitalChannelOffset, gHvDigitalInHashes);
-
 	/* HEAVY */
 	std::array<std::string, 8> outs = {{
 		"__hv_noteout",
@@ -401,26 +236,23 @@ bool setup(BelaContext *context, void *userData)	{
 	gHvInputChannels = hv_getNumInputChannels(gHeavyContext);
 	gHvOutputChannels = hv_getNumOutputChannels(gHeavyContext);
 
-	gScopeChannelsInUse = gHvOutputChannels > gFirstScopeChannel ?
-			gHvOutputChannels - gFirstScopeChannel : 0;
-	if(gDigitalEnabled)
-	{
-		gDigitalSigInChannelsInUse = gHvInputChannels > gFirstDigitalChannel ?
-			gHvInputChannels - gFirstDigitalChannel : 0;
-		gDigitalSigOutChannelsInUse = gHvOutputChannels > gFirstDigitalChannel ?
-			gHvOutputChannels - gFirstDigitalChannel - gScopeChannelsInUse: 0;
-	}
-	else
-	{
-		gDigitalSigInChannelsInUse = 0;
-		gDigitalSigOutChannelsInUse = 0;
-	}
+	// Channel distribution, analog resampling, digitals and scope.
+	// We requested in Bela_userSettings() to have non-interleaved buffers:
+	// this fails if that did not happen.
+	if(gRuntime.setup(context, context->audioFrames, gHvInputChannels, gHvOutputChannels))
+		return false;
+	// When the analog channels run at half the audio rate, each analog input
+	// is held for two audio frames and the analog outputs take the second
+	// of each pair of audio frames, as Heavy has always done: this adds no
+	// latency. Pass kResamplerLinear or kResamplerPolyphase instead to filter
+	// the analog channels, at the cost of some latency.
+	gRuntime.setResamplingQuality(kResamplerHold);
 
 	printf("Starting Heavy context with %d input channels and %d output channels\n",
 			gHvInputChannels, gHvOutputChannels);
 	printf("Channels in use:\n");
-	printf("Digital in : %u, Digital out: %u\n", gDigitalSigInChannelsInUse, gDigitalSigOutChannelsInUse);
-	printf("Scope out: %u\n", gScopeChannelsInUse);
+	printf("Digital in : %u, Digital out: %u\n", gRuntime.getNumSignalRateDigitalInputs(), gRuntime.getNumSignalRateDigitalOutputs());
+	printf("Scope out: %u\n", gRuntime.getNumScopeChannels());
 
 	if(gHvInputChannels != 0) {
 		gHvInputBuffers = (float *)calloc(gHvInputChannels * context->audioFrames,sizeof(float));
@@ -437,50 +269,26 @@ bool setup(BelaContext *context, void *userData)	{
 	hv_setSendHook(gHeavyContext, sendHook);
 
 	// add here other devices you need
-	gMidiPortNames.push_back("hw:1,0,0");
-	//gMidiPortNames.push_back("hw:0,0,0");
-	//gMidiPortNames.push_back("hw:1,0,1");
-	unsigned int n = 0;
-	while(n < gMidiPortNames.size())
-	{
-		Midi* newMidi = openMidiDevice(gMidiPortNames[n], true, true);
-		if(newMidi)
-		{
-			midi.push_back(newMidi);
-			++n;
-		} else {
-			gMidiPortNames.erase(gMidiPortNames.begin() + n);
-		}
-	}
-	dumpMidi();
+	gRuntime.openMidiPort("hw:1,0,0", true);
+	//gRuntime.openMidiPort("hw:0,0,0", true);
+	//gRuntime.openMidiPort("hw:1,0,1", true);
+	gRuntime.dumpMidi();
 
-	if(gScopeChannelsInUse > 0){
+	if(gRuntime.getNumScopeChannels() > 0){
 #if __clang_major__ == 3 && __clang_minor__ == 8
 		fprintf(stderr, "Scope currently not supported when compiling heavy with clang3.8, see #265 https://github.com/BelaPlatform/Bela/issues/265. You should specify `COMPILER gcc;` in your Makefile options\n");
 		exit(1);
 #endif
-		scope = new Scope();
-		scope->setup(gScopeChannelsInUse, context->audioSampleRate);
-		gScopeOut = new float[gScopeChannelsInUse];
 	}
 	// Bela digital
-	if(gDigitalEnabled)
-	{
-		dcm.setCallback(sendDigitalMessage);
-		if(gDigitalChannelsInUse> 0){
-			for(unsigned int ch = 0; ch < gDigitalChannelsInUse; ++ch){
-				dcm.setCallbackArgument(ch, (void *) gHvDigitalInHashes[ch].c_str());
-			}
-		}
-	}
+	gRuntime.setDigitalCallback(sendDigitalMessage, NULL);
 	// unlike libpd, no need here to bind the bela_digitalOut.. receivers
 	// but make sure you do something like [send receiverName @hv_param]
 	// when you want to send a message from Heavy to the wrapper.
 	multiplexerTableHash = hv_stringToHash(multiplexerArray);
-	if(context->multiplexerChannels > 0){
+	if(gRuntime.isMultiplexerActive()){
 		pdMultiplexerActive = true;
-		multiplexerArraySize = context->multiplexerChannels * context->analogInChannels;
-		hv_table_setLength(gHeavyContext, multiplexerTableHash, multiplexerArraySize);
+		hv_table_setLength(gHeavyContext, multiplexerTableHash, gRuntime.getMultiplexerArraySize());
 		hv_sendFloatToReceiver(gHeavyContext, hv_stringToHash("bela_multiplexerChannels"), context->multiplexerChannels);
 	}
 
@@ -490,153 +298,91 @@ bool setup(BelaContext *context, void *userData)	{
 
 void render(BelaContext *context, void *userData)
 {
-	int num;
-	for(unsigned int port = 0; port < midi.size(); ++port){
-		while((num = midi[port]->getParser()->numAvailableMessages()) > 0){
-			static MidiChannelMessage message;
-			unsigned int channelOffset = port * 16 + 1; // remove + 1 if you want your first channel to be 0 (libpd-style)
-			message = midi[port]->getParser()->getNextChannelMessage();
-			switch(message.getType()){
-			case kmmNoteOn: {
-				//message.prettyPrint();
-				int noteNumber = message.getDataByte(0);
-				int velocity = message.getDataByte(1);
-				int channel = message.getChannel();
-				// rt_printf("message: noteNumber: %f, velocity: %f, channel: %f\n", noteNumber, velocity, channel);
-				hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmNoteOn], 0, "fff",
-						(float)noteNumber, (float)velocity, (float)channel + channelOffset);
-				break;
-			}
-			case kmmNoteOff: {
-				/* PureData does not seem to handle noteoff messages as per the MIDI specs,
-				 * so that the noteoff velocity is ignored. Here we convert them to noteon
-				 * with a velocity of 0.
-				 */
-				int noteNumber = message.getDataByte(0);
-				// int velocity = message.getDataByte(1); // would be ignored by Pd
-				int channel = message.getChannel();
-				// note we are sending the below to hvHashes[kmmNoteOn] !!
-				hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmNoteOn], 0, "fff",
-						(float)noteNumber, (float)0, (float)channel + channelOffset);
-				break;
-			}
-			case kmmControlChange: {
-				int channel = message.getChannel();
-				int controller = message.getDataByte(0);
-				int value = message.getDataByte(1);
-				hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmControlChange], 0, "fff",
-						(float)value, (float)controller, (float)channel + channelOffset);
-				break;
-			}
-			case kmmProgramChange: {
-				int channel = message.getChannel();
-				int program = message.getDataByte(0);
-				hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmProgramChange], 0, "ff",
-						(float)program, (float)channel + channelOffset);
-				break;
-			}
-			case kmmPolyphonicKeyPressure: {
-				//TODO: untested, I do not have anything with polyTouch... who does, anyhow?
-				int channel = message.getChannel();
-				int pitch = message.getDataByte(0);
-				int value = message.getDataByte(1);
-				hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmPolyphonicKeyPressure], 0, "fff",
-						(float)channel + channelOffset, (float)pitch, (float)value);
-				break;
-			}
-			case kmmChannelPressure:
-			{
-				int channel = message.getChannel();
-				int value = message.getDataByte(0);
-				hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmChannelPressure], 0, "ff",
-						(float)value, (float)channel + channelOffset);
-				break;
-			}
-			case kmmPitchBend:
-			{
-				int channel = message.getChannel();
-				int value = ((message.getDataByte(1) << 7) | message.getDataByte(0));
-				hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmPitchBend], 0, "ff",
-						(float)value, (float)channel + channelOffset);
-				break;
-			}
-			case kmmSystem:
-			case kmmNone:
-			case kmmAny:
-				break;
-			}
+	gRuntime.processMidiInput(context);
+	const PatchMidiEvent* events = gRuntime.getMidiEvents();
+	for(unsigned int n = 0; n < gRuntime.getNumMidiEvents(); ++n){
+		MidiChannelMessage message = events[n].message;
+		unsigned int channelOffset = events[n].port * 16 + 1; // remove + 1 if you want your first channel to be 0 (libpd-style)
+		// Heavy handles the message at its frame within this block
+		double delayMs = (events[n].frame - context->audioFramesElapsed) * 1000.0 / context->audioSampleRate;
+		switch(message.getType()){
+		case kmmNoteOn: {
+			//message.prettyPrint();
+			int noteNumber = message.getDataByte(0);
+			int velocity = message.getDataByte(1);
+			int channel = message.getChannel();
+			// rt_printf("message: noteNumber: %f, velocity: %f, channel: %f\n", noteNumber, velocity, channel);
+			hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmNoteOn], delayMs, "fff",
+					(float)noteNumber, (float)velocity, (float)channel + channelOffset);
+			break;
 		}
-	}
-
-	// De-interleave the data
-	if(gHvInputBuffers != NULL) {
-		for(unsigned int n = 0; n < context->audioFrames; n++) {
-			for(unsigned int ch = 0; ch < gHvInputChannels; ch++) {
-				if(ch >= gAudioChannelsInUse + gAnalogChannelsInUse) {
-					// THESE ARE PARAMETER INPUT 'CHANNELS' USED FOR ROUTING
-					// 'sensor' outputs from routing channels of dac~ are passed through here
-					// these could be also digital channels (handled by the dcm)
-					// or parameter channels used for routing (currently unhandled)
-					break;
-				} else {
-					// If more than 2 ADC inputs are used in the pd patch, route the analog inputs
-					// i.e. ADC3->analogIn0 etc. (first two are always audio inputs)
-					if(ch >= gAudioChannelsInUse)
-					{
-						unsigned int analogCh = ch - gAudioChannelsInUse;
-						if(analogCh < context->analogInChannels)
-						{
-							int m = n/2;
-							float mIn = analogRead(context, m, analogCh);
-							gHvInputBuffers[ch * context->audioFrames + n] = mIn;
-						}
-					} else {
-						if(ch < context->audioInChannels)
-							gHvInputBuffers[ch * context->audioFrames + n] = audioRead(context, n, ch);
-					}
-				}
-			}
+		case kmmNoteOff: {
+			/* PureData does not seem to handle noteoff messages as per the MIDI specs,
+			 * so that the noteoff velocity is ignored. Here we convert them to noteon
+			 * with a velocity of 0.
+			 */
+			int noteNumber = message.getDataByte(0);
+			// int velocity = message.getDataByte(1); // would be ignored by Pd
+			int channel = message.getChannel();
+			// note we are sending the below to hvHashes[kmmNoteOn] !!
+			hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmNoteOn], delayMs, "fff",
+					(float)noteNumber, (float)0, (float)channel + channelOffset);
+			break;
 		}
-	}
-
-	if(pdMultiplexerActive){
-		static int lastMuxerUpdate = 0;
-		if(++lastMuxerUpdate == multiplexerArraySize){
-			lastMuxerUpdate = 0;
-			memcpy(hv_table_getBuffer(gHeavyContext, multiplexerTableHash), (float *const)context->multiplexerAnalogIn, multiplexerArraySize * sizeof(float));
+		case kmmControlChange: {
+			int channel = message.getChannel();
+			int controller = message.getDataByte(0);
+			int value = message.getDataByte(1);
+			hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmControlChange], delayMs, "fff",
+					(float)value, (float)controller, (float)channel + channelOffset);
+			break;
 		}
-	}
-
-
-	// Bela digital in
-	if(gDigitalEnabled)
-	{
-		// note: in multiple places below we assume that the number of digital frames is same as number of audio
-		// Bela digital in at message-rate
-		dcm.processInput(context->digital, context->digitalFrames);
-	
-		// Bela digital in at signal-rate
-		if(gDigitalSigInChannelsInUse > 0)
+		case kmmProgramChange: {
+			int channel = message.getChannel();
+			int program = message.getDataByte(0);
+			hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmProgramChange], delayMs, "ff",
+					(float)program, (float)channel + channelOffset);
+			break;
+		}
+		case kmmPolyphonicKeyPressure: {
+			//TODO: untested, I do not have anything with polyTouch... who does, anyhow?
+			int channel = message.getChannel();
+			int pitch = message.getDataByte(0);
+			int value = message.getDataByte(1);
+			hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmPolyphonicKeyPressure], delayMs, "fff",
+					(float)channel + channelOffset, (float)pitch, (float)value);
+			break;
+		}
+		case kmmChannelPressure:
 		{
-			unsigned int j, k;
-			float *p0, *p1;
-			const unsigned int gLibpdBlockSize = context->audioFrames;
-			const unsigned int  audioFrameBase = 0;
-			float* gInBuf = gHvInputBuffers;
-			// block below copy/pasted from libpd, except
-			// 16 has been replaced with gDigitalSigInChannelsInUse
-			for (j = 0, p0 = gInBuf; j < gLibpdBlockSize; j++, p0++) {
-				unsigned int digitalFrame = audioFrameBase + j;
-				for (k = 0, p1 = p0 + gLibpdBlockSize * gFirstDigitalChannel;
-						k < gDigitalSigInChannelsInUse; ++k, p1 += gLibpdBlockSize) {
-					if(dcm.isSignalRate(k) && dcm.isInput(k)){ // only process input channels that are handled at signal rate
-						*p1 = digitalRead(context, digitalFrame, k);
-					}
-				}
-			}
+			int channel = message.getChannel();
+			int value = message.getDataByte(0);
+			hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmChannelPressure], delayMs, "ff",
+					(float)value, (float)channel + channelOffset);
+			break;
+		}
+		case kmmPitchBend:
+		{
+			int channel = message.getChannel();
+			int value = ((message.getDataByte(1) << 7) | message.getDataByte(0));
+			hv_sendMessageToReceiverV(gHeavyContext, hvMidiHashes[kmmPitchBend], delayMs, "ff",
+					(float)value, (float)channel + channelOffset);
+			break;
+		}
+		case kmmSystem:
+		case kmmNone:
+		case kmmAny:
+			break;
 		}
 	}
 
+	// audio, analog and digital inputs. This also runs the message-rate
+	// digitals, so it is called even if the patch has no inputs
+	gRuntime.processInputs(context, 0, gHvInputBuffers);
+
+	if(pdMultiplexerActive && gRuntime.isMultiplexerUpdateDue())
+		memcpy(hv_table_getBuffer(gHeavyContext, multiplexerTableHash), (float *const)context->multiplexerAnalogIn, gRuntime.getMultiplexerArraySize() * sizeof(float));
+
 	// replacement for bang~ object
 	//hv_sendMessageToReceiverV(gHeavyContext, "bela_bang", 0.0f, "b");
 	
@@ -651,72 +397,8 @@ void render(BelaContext *context, void *userData)
 	}
 	*/
 
-	// Bela digital out
-	if(gDigitalEnabled)
-	{
-		// Bela digital out at signal-rate
-		if(gDigitalSigOutChannelsInUse > 0)
-		{
-				unsigned int j, k;
-				float *p0, *p1;
-				const unsigned int gLibpdBlockSize = context->audioFrames;
-				const unsigned int  audioFrameBase = 0;
-				float* gOutBuf = gHvOutputBuffers;
-				// block below copy/pasted from libpd, except
-				// context->digitalChannels has been replaced with gDigitalSigOutChannelsInUse
-				for (j = 0, p0 = gOutBuf; j < gLibpdBlockSize; ++j, ++p0) {
-					unsigned int digitalFrame = (audioFrameBase + j);
-					for (k = 0, p1 = p0  + gLibpdBlockSize * gFirstDigitalChannel;
-							k < gDigitalSigOutChannelsInUse; k++, p1 += gLibpdBlockSize) {
-						if(dcm.isSignalRate(k) && dcm.isOutput(k)){ // only process output channels that are handled at signal rate
-							digitalWriteOnce(context, digitalFrame, k, *p1 > 0.5);
-						}
-					}
-				}
-		}
-		// Bela digital out at message-rate
-		dcm.processOutput(context->digital, context->digitalFrames);
-	}
-	
-	// Bela scope
-	if(gScopeChannelsInUse > 0)
-	{
-		unsigned int j, k;
-		float *p0, *p1;
-		const unsigned int gLibpdBlockSize = context->audioFrames;
-		float* gOutBuf = gHvOutputBuffers;
-
-		// block below copy/pasted from libpd
-		for (j = 0, p0 = gOutBuf; j < gLibpdBlockSize; ++j, ++p0) {
-			for (k = 0, p1 = p0  + gLibpdBlockSize * gFirstScopeChannel; k < gScopeChannelsInUse; k++, p1 += gLibpdBlockSize) {
-				gScopeOut[k] = *p1;
-			}
-			scope->log(gScopeOut);
-		}
-	}
-
-	// Interleave the output data
-	if(gHvOutputBuffers != NULL) {
-		for(unsigned int n = 0; n < context->audioFrames; n++) {
-			for(unsigned int ch = 0; ch < gHvOutputChannels; ch++) {
-				if(ch >= gAudioChannelsInUse + gAnalogChannelsInUse) {
-					// THESE ARE SENSOR OUTPUT 'CHANNELS' USED FOR ROUTING
-					// they are the content of the 'sensor output' dac~ channels
-				} else {
-					if(ch >= gAudioChannelsInUse)	{
-						int m = n/2;
-						unsigned int analogCh = ch - gAudioChannelsInUse;
-						if(analogCh < context->analogOutChannels)
-							analogWriteOnce(context, m, analogCh, gHvOutputBuffers[ch*context->audioFrames + n]);
-					} else {
-						if(ch < context->audioOutChannels)
-							audioWrite(context, n, ch, gHvOutputBuffers[ch * context->audioFrames + n]);
-					}
-				}
-			}
-		}
-	}
-
+	// digital, scope, audio and analog outputs
+	gRuntime.processOutputs(context, 0, gHvOutputBuffers);
 }
 
 
@@ -725,6 +407,5 @@ void cleanup(BelaContext *context, void *userData)
 	hv_delete(gHeavyContext);
 	free(gHvInputBuffers);
 	free(gHvOutputBuffers);
-	delete[] gScopeOut;
-	delete scope;
+	gRuntime.cleanup();
 }